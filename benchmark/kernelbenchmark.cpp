@@ -0,0 +1,245 @@
+#include <cfloat>
+#include <cstring>
+#include <limits>
+
+#include "simdmatrix.h"
+#include "smfmesh.h"
+#include "soamesh.h"
+
+#include "kernelbenchmark.h"
+
+// the results of the kernels are summed in here, so that the compiler keeps them
+static volatile float sink;
+
+namespace {
+
+// the layout of the vertices before SoaMesh
+struct Vertex
+{
+    QVector3D position;
+    QVector3D normal;
+};
+
+}
+
+KernelBenchmark::KernelBenchmark(int repetitions)
+    : _repetitions(qMax(1, repetitions))
+{
+}
+
+template <class Kernel>
+double KernelBenchmark::fastest(Kernel kernel) const
+{
+    qint64 best = std::numeric_limits<qint64>::max();
+    QElapsedTimer timer;
+    for (int i = 0; i < _repetitions; i++) {
+        timer.start();
+        kernel();
+        best = qMin(best, timer.nsecsElapsed());
+    }
+    return best / 1e6;
+}
+
+QJsonObject KernelBenchmark::comparison(const char * baselineKey, double baselineMs, const char * key, double ms)
+{
+    QJsonObject result;
+    result[baselineKey] = baselineMs;
+    result[key] = ms;
+    result["speedup"] = ms > 0 ? baselineMs / ms : 0.0;
+    return result;
+}
+
+QJsonObject KernelBenchmark::meshLayouts()
+{
+    SmfMesh mesh = SmfMesh::load(OPENGL_TUTORIALS_DATA_PATH"/dragon-10000.smf");
+    QVector<Vertex> aos(mesh.positions.size());
+    for (int i = 0; i < aos.size(); i++) {
+        aos[i].position = mesh.positions[i];
+        aos[i].normal = mesh.normals[i];
+    }
+    if (aos.isEmpty()) {
+        qWarning("Cannot read the dragon mesh, the mesh layouts are not measured");
+        return QJsonObject();
+    }
+    SoaMesh soa;
+    soa.assign(mesh.positions, mesh.normals);
+
+    QMatrix4x4 matrix;
+    matrix.translate(0.5f, -0.25f, 2);
+    matrix.rotate(30, 1, 1, 0);
+    matrix.scale(1.5f, 1, 0.75f);
+    QMatrix4x4 normalMatrix(matrix.normalMatrix());
+
+    QJsonObject result;
+    result["vertices"] = aos.size();
+
+    double aosMs = fastest([&] {
+        QVector3D minCorner(FLT_MAX, FLT_MAX, FLT_MAX), maxCorner(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (const Vertex & v : aos) {
+            for (int k = 0; k < 3; k++) {
+                minCorner[k] = qMin(minCorner[k], v.position[k]);
+                maxCorner[k] = qMax(maxCorner[k], v.position[k]);
+            }
+        }
+        sink = sink + minCorner.x() + maxCorner.x();
+    });
+    double soaMs = fastest([&] {
+        QVector3D minCorner, maxCorner;
+        soa.bounds(&minCorner, &maxCorner);
+        sink = sink + minCorner.x() + maxCorner.x();
+    });
+    result["bounds"] = comparison("aosMs", aosMs, "soaMs", soaMs);
+
+    QVector<Vertex> aosOut(aos.size());
+    SoaMesh soaOut;
+    aosMs = fastest([&] {
+        for (int i = 0; i < aos.size(); i++) {
+            aosOut[i].position = matrix.map(aos[i].position);
+            aosOut[i].normal = normalMatrix.mapVector(aos[i].normal).normalized();
+        }
+        sink = sink + aosOut.last().position.x();
+    });
+    soaMs = fastest([&] {
+        soa.transform(matrix, &soaOut);
+        sink = sink + soaOut.x()[0];
+    });
+    result["transform"] = comparison("aosMs", aosMs, "soaMs", soaMs);
+
+    // the normals are scaled back and forth so that every run normalizes something
+    aosMs = fastest([&] {
+        for (Vertex & v : aosOut) {
+            v.normal = (v.normal * 2).normalized();
+        }
+        sink = sink + aosOut.last().normal.x();
+    });
+    soaMs = fastest([&] {
+        float * nx = soaOut.nx();
+        for (int i = 0; i < soaOut.paddedSize(); i++) {
+            nx[i] *= 2;
+        }
+        soaOut.normalizeNormals();
+        sink = sink + soaOut.nx()[0];
+    });
+    result["normalize"] = comparison("aosMs", aosMs, "soaMs", soaMs);
+
+    // an array of structs is uploaded as it is, copying it is the cost to beat
+    aosMs = fastest([&] {
+        QVector<float> vertices(aos.size() * 6);
+        memcpy(vertices.data(), aos.constData(), aos.size() * sizeof(Vertex));
+        sink = sink + vertices.last();
+    });
+    soaMs = fastest([&] {
+        QVector<float> vertices = soa.interleave();
+        sink = sink + vertices.last();
+    });
+    result["interleave"] = comparison("aosMs", aosMs, "soaMs", soaMs);
+    return result;
+}
+
+QJsonObject KernelBenchmark::matrices()
+{
+    // the placements of a crowd, the corners of their boxes, and a camera looking at them
+    const int count = 10000;
+    QVector<QMatrix4x4> placements(count);
+    QVector<SimdMatrix4> simdPlacements(count);
+    QVector<QVector3D> points(count), boundsMin(count), boundsMax(count);
+    for (int i = 0; i < count; i++) {
+        placements[i].translate(i % 100 - 50.0f, 0, i / 100 - 50.0f);
+        placements[i].rotate(i * 37.0f, 0, 1, 0);
+        placements[i].scale(0.5f);
+        simdPlacements[i] = SimdMatrix4(placements[i]);
+        points[i] = QVector3D(i % 17 - 8.0f, i % 5 - 2.0f, i % 11 - 5.0f);
+        boundsMin[i] = QVector3D(i % 100 - 50.5f, -0.5f, i / 100 - 50.5f);
+        boundsMax[i] = boundsMin[i] + QVector3D(1, 1, 1);
+    }
+    QMatrix4x4 scene;
+    scene.rotate(20, 1, 0, 0);
+    scene.scale(1.25f);
+    QMatrix4x4 viewProjection;
+    viewProjection.perspective(30, 16.0f / 9, 0.1f, 100);
+    viewProjection.lookAt(QVector3D(0, 10, -60), QVector3D(0, 0, 0), QVector3D(0, 1, 0));
+
+    QJsonObject result;
+    result["count"] = count;
+
+    QVector<QMatrix4x4> products(count);
+    QVector<SimdMatrix4> simdProducts(count);
+    double qtMs = fastest([&] {
+        for (int i = 0; i < count; i++) {
+            products[i] = scene * placements[i];
+        }
+        sink = sink + products.last()(0, 0);
+    });
+    double simdMs = fastest([&] {
+        SimdMatrix4::multiply(SimdMatrix4(scene), simdPlacements.constData(), simdProducts.data(), count);
+        sink = sink + simdProducts.last().columns[0].x();
+    });
+    result["multiply"] = comparison("qtMs", qtMs, "simdMs", simdMs);
+
+    QVector<QVector4D> mapped(count);
+    qtMs = fastest([&] {
+        for (int i = 0; i < count; i++) {
+            mapped[i] = viewProjection * QVector4D(points[i], 1);
+        }
+        sink = sink + mapped.last().w();
+    });
+    simdMs = fastest([&] {
+        SimdMatrix4::mapPoints(SimdMatrix4(viewProjection), points.constData(), mapped.data(), count);
+        sink = sink + mapped.last().w();
+    });
+    result["mapPoints"] = comparison("qtMs", qtMs, "simdMs", simdMs);
+
+    // the planes, then a test of every box against them
+    qtMs = fastest([&] {
+        QVector4D planes[6];
+        for (int i = 0; i < 3; i++) {
+            planes[2 * i] = viewProjection.row(3) + viewProjection.row(i);
+            planes[2 * i + 1] = viewProjection.row(3) - viewProjection.row(i);
+        }
+        for (QVector4D & plane : planes) {
+            plane /= plane.toVector3D().length();
+        }
+        int inside = 0;
+        for (int i = 0; i < count; i++) {
+            bool intersects = true;
+            for (const QVector4D & plane : planes) {
+                QVector3D corner(plane.x() >= 0 ? boundsMax[i].x() : boundsMin[i].x(),
+                    plane.y() >= 0 ? boundsMax[i].y() : boundsMin[i].y(),
+                    plane.z() >= 0 ? boundsMax[i].z() : boundsMin[i].z());
+                intersects = intersects && QVector4D::dotProduct(plane, QVector4D(corner, 1)) >= 0;
+            }
+            inside += intersects;
+        }
+        sink = sink + inside;
+    });
+    simdMs = fastest([&] {
+        SimdFrustum frustum{ SimdMatrix4(viewProjection) };
+        int inside = 0;
+        for (int i = 0; i < count; i++) {
+            inside += frustum.intersectsBox(boundsMin[i], boundsMax[i]);
+        }
+        sink = sink + inside;
+    });
+    result["frustumCulling"] = comparison("qtMs", qtMs, "simdMs", simdMs);
+
+    // the rotations of a mouse drag composed frame after frame
+    qtMs = fastest([&] {
+        QMatrix4x4 m = scene;
+        for (int i = 0; i < count; i++) {
+            QMatrix4x4 rotation;
+            rotation.rotate(0.5f, 0, 1, 0);
+            rotation.rotate(0.25f, 1, 0, 0);
+            m = rotation * m;
+        }
+        sink = sink + m(0, 0);
+    });
+    simdMs = fastest([&] {
+        SimdMatrix4 m(scene);
+        for (int i = 0; i < count; i++) {
+            m = SimdMatrix4::rotation(0.5f, QVector3D(0, 1, 0)) * SimdMatrix4::rotation(0.25f, QVector3D(1, 0, 0)) * m;
+        }
+        sink = sink + m.columns[0].x();
+    });
+    result["rotate"] = comparison("qtMs", qtMs, "simdMs", simdMs);
+    return result;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QtGui>
+
+// measures the CPU kernels of the demo outside of any scene, each against the code it replaces
+// every kernel runs 'repetitions' times and the fastest run is reported, in milliseconds
+class KernelBenchmark
+{
+public:
+    explicit KernelBenchmark(int repetitions);
+
+    // the dragon mesh as an array of structs (QVector3D position and normal) and as an SoaMesh:
+    //   { "vertices", "bounds", "transform", "normalize", "interleave" }
+    // where each kernel is { "aosMs", "soaMs", "speedup" }
+    QJsonObject meshLayouts();
+    // batches of 10000 matrices and points with QMatrix4x4 and with SimdMatrix4:
+    //   { "count", "multiply", "mapPoints", "frustumCulling", "rotate" }
+    // where each kernel is { "qtMs", "simdMs", "speedup" }
+    QJsonObject matrices();
+
+private:
+    // the fastest of the runs of 'kernel'
+    template <class Kernel>
+    double fastest(Kernel kernel) const;
+    static QJsonObject comparison(const char * baselineKey, double baselineMs, const char * key, double ms);
+
+private:
+    int _repetitions;
+};
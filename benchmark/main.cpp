@@ -0,0 +1,128 @@
+#include <QtCore>
+#include <QtWidgets>
+#include <QtOpenGL>
+
+#include "kernelbenchmark.h"
+#include "offscreenrenderer.h"
+#include "profiler.h"
+#include "scenebenchmark.h"
+#include "scenes.h"
+#include "textureloader.h"
+
+// runs the demo scenes offscreen along a scripted camera path and reports their frame times as JSON
+//
+//     Benchmark --scene all --size 1280x720 --warmup 30 --frames 300 --output results.json
+//
+// compare the "scenes" of two result files to compare builds; --kernels 20 adds the "kernels", the CPU kernels
+// of the demo timed against the code they replace
+int main(int argc, char *argv[])
+{
+    QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Frame time benchmark of the OpenGL tutorial demos");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "scene", "Scenes to run: all, or a comma separated list of " + sceneNames().join(", ") + ".", 
+            "names", "all" },
+        { "size", "Resolution of the frames.", "WIDTHxHEIGHT", "1280x720" },
+        { "samples", "Number of samples per pixel (0 disables multisampling).", "n", "0" },
+        { "warmup", "Number of frames run before measuring.", "n", "30" },
+        { "frames", "Number of measured frames.", "n", "300" },
+        { "output", "JSON file of the results, printed to the standard output if not set.", "file" },
+        { "trace", "Write the timing zones of the run as a Chrome trace.", "file" },
+        { "kernels", "Also time the CPU kernels of the demo against the code they replace, "
+            "reporting the fastest of n runs of each.", "n" }
+    });
+    parser.process(a);
+
+    QStringList names = parser.value("scene") == "all" ? 
+        sceneNames() : parser.value("scene").split(',', QString::SkipEmptyParts);
+    for (const QString & name : names) {
+        if (!sceneNames().contains(name)) {
+            qWarning("Unknown scene \"%s\", expected one of: all, %s", 
+                qPrintable(name), qPrintable(sceneNames().join(", ")));
+            return 1;
+        }
+    }
+    QStringList size = parser.value("size").split('x');
+    int width = size.value(0).toInt(), height = size.value(1).toInt();
+    if (size.size() != 2 || width <= 0 || height <= 0) {
+        qWarning("Invalid size \"%s\", expected WIDTHxHEIGHT", qPrintable(parser.value("size")));
+        return 1;
+    }
+    int warmupFrames = qMax(0, parser.value("warmup").toInt());
+    int measuredFrames = qMax(1, parser.value("frames").toInt());
+
+    // the zones only cost time when a trace is requested
+    Profiler::setEnabled(parser.isSet("trace"));
+
+    OffscreenRenderer renderer(QSize(width, height), parser.value("samples").toInt());
+    if (!renderer.create()) {
+        return 1;
+    }
+    // the measured frames draw the textures, whatever the speed of the decode
+    TextureLoader::setSynchronous(true);
+
+    QJsonArray scenes;
+    {
+        SceneBenchmark benchmark(renderer, warmupFrames, measuredFrames);
+        for (const QString & name : names) {
+            QJsonObject result = benchmark.run(name);
+            qDebug("%-8s cpu p50 %7.3f ms  p95 %7.3f ms  p99 %7.3f ms  |  %6.0f draws  %9.0f triangles", 
+                qPrintable(name), 
+                result["cpuMs"].toObject()["p50"].toDouble(), 
+                result["cpuMs"].toObject()["p95"].toDouble(),
+                result["cpuMs"].toObject()["p99"].toDouble(),
+                result["drawCallsPerFrame"].toDouble(),
+                result["trianglesPerFrame"].toDouble());
+            scenes.append(result);
+        }
+    }
+
+    QJsonObject kernels;
+    if (parser.isSet("kernels")) {
+        KernelBenchmark benchmark(parser.value("kernels").toInt());
+        kernels["meshLayouts"] = benchmark.meshLayouts();
+        for (const QString & kernel : { "bounds", "transform", "normalize", "interleave" }) {
+            QJsonObject result = kernels["meshLayouts"].toObject()[kernel].toObject();
+            qDebug("mesh %-14s AoS %7.3f ms  SoA  %7.3f ms  x%.2f", qPrintable(kernel),
+                result["aosMs"].toDouble(), result["soaMs"].toDouble(), result["speedup"].toDouble());
+        }
+        kernels["matrices"] = benchmark.matrices();
+        for (const QString & kernel : { "multiply", "mapPoints", "frustumCulling", "rotate" }) {
+            QJsonObject result = kernels["matrices"].toObject()[kernel].toObject();
+            qDebug("matrix %-12s Qt  %7.3f ms  SIMD %7.3f ms  x%.2f", qPrintable(kernel),
+                result["qtMs"].toDouble(), result["simdMs"].toDouble(), result["speedup"].toDouble());
+        }
+    }
+
+    if (parser.isSet("trace") && !Profiler::writeChromeTrace(parser.value("trace"))) {
+        return 1;
+    }
+
+    QJsonObject report;
+    report["renderer"] = renderer.rendererName();
+    report["qtVersion"] = QString(qVersion());
+    report["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["size"] = QJsonArray({ width, height });
+    report["samples"] = parser.value("samples").toInt();
+    report["warmupFrames"] = warmupFrames;
+    report["measuredFrames"] = measuredFrames;
+    report["scenes"] = scenes;
+    if (!kernels.isEmpty()) {
+        report["kernels"] = kernels;
+    }
+    QByteArray json = QJsonDocument(report).toJson();
+
+    if (!parser.isSet("output")) {
+        QTextStream(stdout) << json;
+        return 0;
+    }
+    QSaveFile file(parser.value("output"));
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size() || !file.commit()) {
+        qWarning("Cannot write %s", qPrintable(parser.value("output")));
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include <numeric>
+
+#include "blockcompressor.h"
+#include "drawstats.h"
+#include "memorytracker.h"
+#include "occlusionculler.h"
+#include "streambuffer.h"
+#include "profiler.h"
+#include "scenes.h"
+#include "textureloader.h"
+#include "tilecache.h"
+
+#include "scenebenchmark.h"
+
+// the camera path: frames per turn, radius of the mouse circle in pixels, wheel amplitude
+static const int cameraPeriod = 120;
+static const double dragRadius = 40.0;
+static const double wheelAmplitude = 10.0;
+
+SceneBenchmark::SceneBenchmark(OffscreenRenderer & renderer, int warmupFrames, int measuredFrames)
+    : _renderer(renderer)
+{
+    _warmupFrames = warmupFrames;
+    _measuredFrames = measuredFrames;
+
+    // GPU times need GL 3.3 or ARB_timer_query, 
+    // and cannot be measured while the profiler records GPU zones (GL_TIME_ELAPSED queries do not nest)
+    _renderer.makeCurrent();
+    _timerQuery = nullptr;
+    if (Profiler::isEnabled()) {
+        qWarning("The profiler is enabled, GPU times are only recorded in the trace");
+        return;
+    }
+    _timerQuery = new QOpenGLTimerQuery;
+    if (!_timerQuery->create()) {
+        qWarning("Timer queries are not supported, GPU times are not reported");
+        delete _timerQuery;
+        _timerQuery = nullptr;
+    }
+}
+
+SceneBenchmark::~SceneBenchmark()
+{
+    if (_timerQuery) {
+        _renderer.makeCurrent();
+        delete _timerQuery;
+    }
+}
+
+QJsonObject SceneBenchmark::run(const QString & scene)
+{
+    // the textures of the scene are compressed (unless cached) and uploaded before its first frame
+    qint64 encodedTexelsBefore = BlockCompressor::totalTexels();
+    qint64 encodeBefore = BlockCompressor::totalNanoseconds();
+    qint64 savedBefore = TextureLoader::savedBytes();
+    qint64 tilesBefore = TileCache::totalLoadedTiles();
+    qint64 tileLatencyBefore = TileCache::totalLatencyNanoseconds();
+
+    QGLWidget * widget = createScene(scene);
+    Q_ASSERT(widget);
+    _renderer.setScene(widget);
+
+    QOpenGLFunctions * f = _renderer.context()->functions();
+    QVector<double> cpuTimes, frameTimes, gpuTimes;
+    qint64 drawCalls = 0, triangles = 0;
+    qint64 occlusionTested = 0, occlusionCulled = 0, occlusionNanoseconds = 0;
+    qint64 streamedBytes = 0, streamStallNanoseconds = 0;
+    QElapsedTimer timer;
+
+    // start dragging at the first point of the circle
+    QPointF center(widget->width() / 2.0, widget->height() / 2.0);
+    QMouseEvent press(QEvent::MouseButtonPress, center + QPointF(dragRadius, 0), 
+        Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
+    QCoreApplication::sendEvent(widget, &press);
+
+    for (int i = 0; i < _warmupFrames + _measuredFrames; i++) {
+        moveCamera(widget, i);
+
+        bool measured = i >= _warmupFrames;
+        qint64 drawCallsBefore = DrawStats::drawCalls();
+        qint64 trianglesBefore = DrawStats::triangles();
+        qint64 testedBefore = OcclusionCuller::totalTested();
+        qint64 culledBefore = OcclusionCuller::totalCulled();
+        qint64 cullingBefore = OcclusionCuller::totalNanoseconds();
+        qint64 streamedBefore = StreamBuffer::totalBytes();
+        qint64 stallBefore = StreamBuffer::totalStallNanoseconds();
+        if (measured && _timerQuery) {
+            _timerQuery->begin();
+        }
+
+        // the cpu time is spent in paintGL, the frame time also waits for the GPU to finish
+        timer.start();
+        _renderer.renderFrame();
+        qint64 cpuTime = timer.nsecsElapsed();
+        if (measured && _timerQuery) {
+            _timerQuery->end();
+        }
+        f->glFinish();
+        qint64 frameTime = timer.nsecsElapsed();
+
+        if (!measured) {
+            continue;
+        }
+        cpuTimes << cpuTime / 1e6;
+        frameTimes << frameTime / 1e6;
+        if (_timerQuery) {
+            gpuTimes << _timerQuery->waitForResult() / 1e6;
+        }
+        drawCalls += DrawStats::drawCalls() - drawCallsBefore;
+        triangles += DrawStats::triangles() - trianglesBefore;
+        occlusionTested += OcclusionCuller::totalTested() - testedBefore;
+        occlusionCulled += OcclusionCuller::totalCulled() - culledBefore;
+        occlusionNanoseconds += OcclusionCuller::totalNanoseconds() - cullingBefore;
+        streamedBytes += StreamBuffer::totalBytes() - streamedBefore;
+        streamStallNanoseconds += StreamBuffer::totalStallNanoseconds() - stallBefore;
+    }
+
+    QMouseEvent release(QEvent::MouseButtonRelease, center + QPointF(dragRadius, 0), 
+        Qt::LeftButton, Qt::NoButton, Qt::NoModifier);
+    QCoreApplication::sendEvent(widget, &release);
+    // the tile caches of the scene are deleted with it
+    qint64 tileCpuBytes = TileCache::totalCpuBytes(), tileGpuBytes = TileCache::totalGpuBytes();
+    // and the memory reported to MemoryTracker, the scenes being benchmarked one after the other
+    qint64 cpuBytes = MemoryTracker::currentBytes(MemoryTracker::Cpu);
+    qint64 gpuBytes = MemoryTracker::currentBytes(MemoryTracker::Gpu);
+    _renderer.releaseScene();
+
+    QJsonObject result;
+    result["scene"] = scene;
+    result["frames"] = _measuredFrames;
+    result["cpuMs"] = statistics(cpuTimes);
+    result["frameMs"] = statistics(frameTimes);
+    result["gpuMs"] = gpuTimes.isEmpty() ? QJsonValue() : QJsonValue(statistics(gpuTimes));
+    result["drawCallsPerFrame"] = double(drawCalls) / qMax(_measuredFrames, 1);
+    result["trianglesPerFrame"] = double(triangles) / qMax(_measuredFrames, 1);
+    result["cpuBytes"] = double(cpuBytes);
+    result["gpuBytes"] = double(gpuBytes);
+    // only the scenes with an OcclusionCuller test boxes
+    if (occlusionTested > 0) {
+        result["occlusionCulledPercent"] = 100.0 * occlusionCulled / occlusionTested;
+        result["occlusionCullingMs"] = occlusionNanoseconds / 1e6 / qMax(_measuredFrames, 1);
+    }
+    // and only the scenes with a StreamBuffer upload per frame
+    if (streamedBytes > 0) {
+        result["streamedBytesPerFrame"] = double(streamedBytes) / qMax(_measuredFrames, 1);
+        result["streamStallMs"] = streamStallNanoseconds / 1e6 / qMax(_measuredFrames, 1);
+    }
+    // and only the scenes with block compressed textures, encoded by this run or read from the cache
+    qint64 encodedTexels = BlockCompressor::totalTexels() - encodedTexelsBefore;
+    if (encodedTexels > 0) {
+        qint64 encodeNanoseconds = BlockCompressor::totalNanoseconds() - encodeBefore;
+        result["textureEncodeMTexelsPerSecond"] = encodedTexels * 1e3 / qMax(encodeNanoseconds, qint64(1));
+    }
+    qint64 savedBytes = TextureLoader::savedBytes() - savedBefore;
+    if (savedBytes > 0) {
+        result["textureBytesSaved"] = double(savedBytes);
+    }
+    // and only the scenes streaming tiles
+    qint64 tiles = TileCache::totalLoadedTiles() - tilesBefore;
+    if (tiles > 0) {
+        result["tilesLoaded"] = double(tiles);
+        result["tileLatencyMs"] = (TileCache::totalLatencyNanoseconds() - tileLatencyBefore) / 1e6 / tiles;
+        result["tileCpuBytes"] = double(tileCpuBytes);
+        result["tileGpuBytes"] = double(tileGpuBytes);
+    }
+    return result;
+}
+
+void SceneBenchmark::moveCamera(QGLWidget * scene, int frame)
+{
+    // orbit by dragging the mouse along a circle around the center of the widget
+    double angle = 2.0 * M_PI * (frame + 1) / cameraPeriod;
+    QPointF center(scene->width() / 2.0, scene->height() / 2.0);
+    QPointF position = center + dragRadius * QPointF(cos(angle), sin(angle));
+    QMouseEvent move(QEvent::MouseMove, position, Qt::NoButton, Qt::LeftButton, Qt::NoModifier);
+    QCoreApplication::sendEvent(scene, &move);
+
+    // zoom in then out, the deltas of a turn sum up to zero
+    int delta = qRound(wheelAmplitude * sin(angle));
+    if (delta != 0) {
+        QWheelEvent wheel(position, delta, Qt::LeftButton, Qt::NoModifier);
+        QCoreApplication::sendEvent(scene, &wheel);
+    }
+}
+
+QJsonObject SceneBenchmark::statistics(QVector<double> values)
+{
+    QJsonObject result;
+    if (values.isEmpty()) {
+        return result;
+    }
+    std::sort(values.begin(), values.end());
+    // nearest-rank percentile
+    auto percentile = [&values](double p) {
+        int rank = qCeil(p / 100.0 * values.size());
+        return values[qBound(0, rank - 1, values.size() - 1)];
+    };
+    result["mean"] = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+    result["min"] = values.first();
+    result["p50"] = percentile(50);
+    result["p95"] = percentile(95);
+    result["p99"] = percentile(99);
+    result["max"] = values.last();
+    return result;
+}
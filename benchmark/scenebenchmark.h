@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QtOpenGL>
+
+#include "offscreenrenderer.h"
+
+// measures the frame times of the demo scenes in an OffscreenRenderer
+// each scene runs warm-up frames then measured frames, while a scripted camera path
+// (a circular mouse drag and an oscillating wheel, sent as input events) moves its view
+class SceneBenchmark
+{
+public:
+    SceneBenchmark(OffscreenRenderer & renderer, int warmupFrames, int measuredFrames);
+    ~SceneBenchmark();
+
+    // run one scene and return its results:
+    //   { "scene", "frames", "cpuMs", "frameMs", "gpuMs", "drawCallsPerFrame", "trianglesPerFrame" }
+    // where the times are { "mean", "min", "p50", "p95", "p99", "max" } and "gpuMs" is null
+    // if the context has no timer queries, plus "occlusionCulledPercent" and "occlusionCullingMs" (per frame)
+    // for the scenes with occlusion culling, and "streamedBytesPerFrame" and "streamStallMs" (per frame)
+    // for the scenes streaming per-frame data through StreamBuffers
+    QJsonObject run(const QString & scene);
+
+private:
+    // send the input events of a frame of the camera path to the scene
+    void moveCamera(QGLWidget * scene, int frame);
+    static QJsonObject statistics(QVector<double> values);
+
+private:
+    OffscreenRenderer & _renderer;
+    int _warmupFrames, _measuredFrames;
+    QOpenGLTimerQuery * _timerQuery; // nullptr if not supported
+};
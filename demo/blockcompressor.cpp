@@ -0,0 +1,386 @@
+#include "simd.h"
+
+#include "blockcompressor.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RED_RGTC1
+#define GL_COMPRESSED_RED_RGTC1 0x8DBB
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+
+static QAtomicInteger<qint64> encodedTexels;
+static QAtomicInteger<qint64> encodeNanoseconds;
+
+namespace {
+
+// the 16 texels of a block, channel by channel, as values in [0, 255]
+struct Block
+{
+    alignas(32) float channels[4][16];
+};
+
+// the rgb colors of a BC1 palette, in [0, 255]
+struct Palette
+{
+    float r[4], g[4], b[4];
+};
+
+}
+
+static void writeLittleEndian(uchar * p, quint64 value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        p[i] = uchar(value >> (8 * i));
+    }
+}
+
+// the block at (bx, by) of an RGBA8888 image, the texels past the edges repeat the last row and column
+static void loadBlock(const QImage & image, int bx, int by, Block * block)
+{
+    const int w = image.width(), h = image.height();
+    for (int j = 0; j < 4; j++) {
+        const uchar * row = image.constScanLine(qMin(by * 4 + j, h - 1));
+        for (int i = 0; i < 4; i++) {
+            const uchar * texel = row + 4 * qMin(bx * 4 + i, w - 1);
+            for (int c = 0; c < 4; c++) {
+                block->channels[c][j * 4 + i] = texel[c];
+            }
+        }
+    }
+}
+
+static float horizontalMin(SimdFloat v)
+{
+    float m = v[0];
+    for (int i = 1; i < SimdFloat::Width; i++) {
+        m = qMin(m, v[i]);
+    }
+    return m;
+}
+
+static float horizontalMax(SimdFloat v)
+{
+    float m = v[0];
+    for (int i = 1; i < SimdFloat::Width; i++) {
+        m = qMax(m, v[i]);
+    }
+    return m;
+}
+
+static float horizontalSum(SimdFloat v)
+{
+    float s = 0;
+    for (int i = 0; i < SimdFloat::Width; i++) {
+        s += v[i];
+    }
+    return s;
+}
+
+// the 565 color nearest to an rgb color in [0, 255], and the color it decodes to
+static quint16 quantize565(const float color[3], float decoded[3])
+{
+    int r = qBound(0, int(color[0] * 31 / 255 + 0.5f), 31);
+    int g = qBound(0, int(color[1] * 63 / 255 + 0.5f), 63);
+    int b = qBound(0, int(color[2] * 31 / 255 + 0.5f), 31);
+    decoded[0] = (r << 3) | (r >> 2);
+    decoded[1] = (g << 2) | (g >> 4);
+    decoded[2] = (b << 3) | (b >> 2);
+    return quint16((r << 11) | (g << 5) | b);
+}
+
+// the nearest entry of the palette for each texel (stored as floats), returns the summed squared error
+static float selectColorIndices(const Block & block, const Palette & palette, float indices[16])
+{
+    SimdFloat error = 0.0f;
+    for (int i = 0; i < 16; i += SimdFloat::Width) {
+        SimdFloat r = SimdFloat::load(block.channels[0] + i);
+        SimdFloat g = SimdFloat::load(block.channels[1] + i);
+        SimdFloat b = SimdFloat::load(block.channels[2] + i);
+        SimdFloat best = 0.0f, bestDistance = 0.0f;
+        for (int k = 0; k < 4; k++) {
+            SimdFloat dr = r - palette.r[k], dg = g - palette.g[k], db = b - palette.b[k];
+            SimdFloat distance = multiplyAdd(dr, dr, multiplyAdd(dg, dg, db * db));
+            if (k == 0) {
+                bestDistance = distance;
+                continue;
+            }
+            SimdMask closer = distance < bestDistance;
+            bestDistance = select(closer, distance, bestDistance);
+            best = select(closer, SimdFloat(float(k)), best);
+        }
+        best.store(indices + i);
+        error = error + bestDistance;
+    }
+    return horizontalSum(error);
+}
+
+// the 4 color palette of two 565 endpoints, c0 > c1
+static Palette colorPalette(const float e0[3], const float e1[3])
+{
+    Palette palette;
+    float * channels[3] = { palette.r, palette.g, palette.b };
+    for (int c = 0; c < 3; c++) {
+        channels[c][0] = e0[c];
+        channels[c][1] = e1[c];
+        channels[c][2] = (2 * e0[c] + e1[c]) / 3;
+        channels[c][3] = (e0[c] + 2 * e1[c]) / 3;
+    }
+    return palette;
+}
+
+// the endpoints and indices of the block for two endpoint colors, returns the squared error
+static float encodeColorEndpoints(const Block & block, const float end0[3], const float end1[3], uchar * out)
+{
+    float e0[3], e1[3];
+    quint16 c0 = quantize565(end0, e0);
+    quint16 c1 = quantize565(end1, e1);
+    // the 4 color mode needs c0 > c1 (equal endpoints decode to the same color in either mode)
+    if (c0 < c1) {
+        qSwap(c0, c1);
+        for (int c = 0; c < 3; c++) {
+            qSwap(e0[c], e1[c]);
+        }
+    }
+    float indices[16];
+    float error = selectColorIndices(block, colorPalette(e0, e1), indices);
+    quint32 bits = 0;
+    if (c0 != c1) {
+        for (int i = 0; i < 16; i++) {
+            bits |= quint32(indices[i]) << (2 * i);
+        }
+    }
+    writeLittleEndian(out, c0, 2);
+    writeLittleEndian(out + 2, c1, 2);
+    writeLittleEndian(out + 4, bits, 4);
+    return error;
+}
+
+static void encodeBC1(const Block & block, uchar * out)
+{
+    // the mean and covariance of the colors
+    float mean[3] = { 0, 0, 0 };
+    for (int c = 0; c < 3; c++) {
+        SimdFloat sum = 0.0f;
+        for (int i = 0; i < 16; i += SimdFloat::Width) {
+            sum = sum + SimdFloat::load(block.channels[c] + i);
+        }
+        mean[c] = horizontalSum(sum) / 16;
+    }
+    float covariance[3][3];
+    for (int a = 0; a < 3; a++) {
+        for (int b = a; b < 3; b++) {
+            SimdFloat sum = 0.0f;
+            for (int i = 0; i < 16; i += SimdFloat::Width) {
+                sum = multiplyAdd(SimdFloat::load(block.channels[a] + i) - mean[a],
+                    SimdFloat::load(block.channels[b] + i) - mean[b], sum);
+            }
+            covariance[a][b] = covariance[b][a] = horizontalSum(sum);
+        }
+    }
+
+    // the principal axis by power iteration, from the diagonal of the color box
+    float axis[3];
+    for (int c = 0; c < 3; c++) {
+        SimdFloat low = SimdFloat::load(block.channels[c]), high = low;
+        for (int i = SimdFloat::Width; i < 16; i += SimdFloat::Width) {
+            low = minimum(low, SimdFloat::load(block.channels[c] + i));
+            high = maximum(high, SimdFloat::load(block.channels[c] + i));
+        }
+        axis[c] = horizontalMax(high) - horizontalMin(low);
+    }
+    for (int iteration = 0; iteration < 4; iteration++) {
+        float next[3];
+        for (int c = 0; c < 3; c++) {
+            next[c] = covariance[c][0] * axis[0] + covariance[c][1] * axis[1] + covariance[c][2] * axis[2];
+        }
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < 3; c++) {
+            axis[c] = next[c] / length;
+        }
+    }
+    float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (length < 1e-6f) {
+        // a single color
+        encodeColorEndpoints(block, mean, mean, out);
+        return;
+    }
+    for (int c = 0; c < 3; c++) {
+        axis[c] /= length;
+    }
+
+    // the extent of the colors along the axis
+    SimdFloat low = 0.0f, high = 0.0f;
+    for (int i = 0; i < 16; i += SimdFloat::Width) {
+        SimdFloat t = (SimdFloat::load(block.channels[0] + i) - mean[0]) * axis[0];
+        t = multiplyAdd(SimdFloat::load(block.channels[1] + i) - mean[1], axis[1], t);
+        t = multiplyAdd(SimdFloat::load(block.channels[2] + i) - mean[2], axis[2], t);
+        low = i == 0 ? t : minimum(low, t);
+        high = i == 0 ? t : maximum(high, t);
+    }
+    float tLow = horizontalMin(low), tHigh = horizontalMax(high);
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++) {
+        end0[c] = qBound(0.0f, mean[c] + axis[c] * tHigh, 255.0f);
+        end1[c] = qBound(0.0f, mean[c] + axis[c] * tLow, 255.0f);
+    }
+    uchar first[8];
+    float firstError = encodeColorEndpoints(block, end0, end1, first);
+
+    // refine the endpoints by least squares for the chosen indices: each texel is w * e0 + (1 - w) * e1
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3, 1.0f / 3 };
+    quint32 bits = first[4] | (first[5] << 8) | (first[6] << 16) | (quint32(first[7]) << 24);
+    float aa = 0, ab = 0, bb = 0, ap[3] = { 0, 0, 0 }, bp[3] = { 0, 0, 0 };
+    // the indices refer to the quantized endpoints, which may be end0 and end1 swapped
+    float decoded0[3], decoded1[3];
+    quint16 c0 = quantize565(end0, decoded0), c1 = quantize565(end1, decoded1);
+    for (int i = 0; i < 16; i++) {
+        float a = weights[(bits >> (2 * i)) & 3];
+        if (c0 < c1) {
+            a = 1 - a;
+        }
+        float b = 1 - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; c++) {
+            ap[c] += a * block.channels[c][i];
+            bp[c] += b * block.channels[c][i];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) > 1e-3f) {
+        float refined0[3], refined1[3];
+        for (int c = 0; c < 3; c++) {
+            refined0[c] = qBound(0.0f, (bb * ap[c] - ab * bp[c]) / determinant, 255.0f);
+            refined1[c] = qBound(0.0f, (aa * bp[c] - ab * ap[c]) / determinant, 255.0f);
+        }
+        uchar second[8];
+        if (encodeColorEndpoints(block, refined0, refined1, second) < firstError) {
+            memcpy(out, second, 8);
+            return;
+        }
+    }
+    memcpy(out, first, 8);
+}
+
+// one channel: the extremes are the endpoints, in the mode of 6 interpolated values
+static void encodeBC4(const float * values, uchar * out)
+{
+    SimdFloat low = SimdFloat::load(values), high = low;
+    for (int i = SimdFloat::Width; i < 16; i += SimdFloat::Width) {
+        low = minimum(low, SimdFloat::load(values + i));
+        high = maximum(high, SimdFloat::load(values + i));
+    }
+    const float e0 = horizontalMax(high), e1 = horizontalMin(low);
+    out[0] = uchar(e0);
+    out[1] = uchar(e1);
+    quint64 bits = 0;
+    if (e0 > e1) {
+        // the step k from e0 towards e1 (0 is e0, 7 is e1) is code 0 for k = 0, 1 for k = 7 and k + 1 otherwise
+        const float scale = 7 / (e0 - e1);
+        float codes[16];
+        for (int i = 0; i < 16; i += SimdFloat::Width) {
+            // k rounded to the nearest step, counted over the midpoints between the steps
+            SimdFloat t = (SimdFloat(e0) - SimdFloat::load(values + i)) * scale;
+            SimdFloat k = 0.0f;
+            for (int step = 1; step < 8; step++) {
+                k = select(t >= step - 0.5f, SimdFloat(float(step)), k);
+            }
+            SimdFloat code = select(k == 0.0f, SimdFloat(0.0f), select(k == 7.0f, SimdFloat(1.0f), k + 1.0f));
+            code.store(codes + i);
+        }
+        for (int i = 0; i < 16; i++) {
+            bits |= quint64(codes[i]) << (3 * i);
+        }
+    }
+    writeLittleEndian(out + 2, bits, 6);
+}
+
+static void encodeBlock(const Block & block, BlockCompressor::Format format, int firstChannel, uchar * out)
+{
+    switch (format) {
+    case BlockCompressor::BC1:
+        encodeBC1(block, out);
+        break;
+    case BlockCompressor::BC4:
+        encodeBC4(block.channels[firstChannel], out);
+        break;
+    case BlockCompressor::BC5:
+        encodeBC4(block.channels[firstChannel], out);
+        encodeBC4(block.channels[firstChannel + 1], out + 8);
+        break;
+    }
+}
+
+BlockCompressor::BlockCompressor(WorkStealingPool & pool)
+    : _pool(pool)
+{
+}
+
+BlockCompressor::~BlockCompressor()
+{
+}
+
+GLenum BlockCompressor::glFormat(Format format)
+{
+    switch (format) {
+    case BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BC4:
+        return GL_COMPRESSED_RED_RGTC1;
+    case BC5:
+        return GL_COMPRESSED_RG_RGTC2;
+    }
+    return 0;
+}
+
+int BlockCompressor::blockBytes(Format format)
+{
+    return format == BC5 ? 16 : 8;
+}
+
+int BlockCompressor::compressedSize(Format format, const QSize & size)
+{
+    return (size.width() + 3) / 4 * ((size.height() + 3) / 4) * blockBytes(format);
+}
+
+QByteArray BlockCompressor::compress(const QImage & image, Format format, int firstChannel)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+    const int blocksWide = (rgba.width() + 3) / 4, blocksHigh = (rgba.height() + 3) / 4;
+    const int bytes = blockBytes(format);
+    QByteArray out(compressedSize(format, rgba.size()), Qt::Uninitialized);
+    uchar * data = reinterpret_cast<uchar *>(out.data());
+    _pool.parallelFor(blocksHigh, [&](int by, int) {
+        Block block;
+        uchar * row = data + by * blocksWide * bytes;
+        for (int bx = 0; bx < blocksWide; bx++) {
+            loadBlock(rgba, bx, by, &block);
+            encodeBlock(block, format, firstChannel, row + bx * bytes);
+        }
+    });
+
+    encodedTexels.fetchAndAddRelaxed(qint64(rgba.width()) * rgba.height());
+    encodeNanoseconds.fetchAndAddRelaxed(timer.nsecsElapsed());
+    return out;
+}
+
+qint64 BlockCompressor::totalTexels()
+{
+    return encodedTexels.load();
+}
+
+qint64 BlockCompressor::totalNanoseconds()
+{
+    return encodeNanoseconds.load();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QtGui>
+
+#include "workstealingpool.h"
+
+// encodes RGBA8888 images into the block compressed formats of OpenGL, 4x4 texels per block:
+//   BC1 (GL_COMPRESSED_RGB_S3TC_DXT1_EXT), 8 bytes: two 565 colors and 2 bit indices, for color maps
+//   BC4 (GL_COMPRESSED_RED_RGTC1), 8 bytes: two 8 bit values and 3 bit indices, for one channel (heights)
+//   BC5 (GL_COMPRESSED_RG_RGTC2), 16 bytes: two BC4 blocks, for two channels (normals)
+//
+// the endpoints of a BC1 block lie on the principal axis of its colors and are refined by a least squares fit
+// to the indices; the distances of the 16 texels to the palette are computed SimdFloat::Width texels at a time,
+// and the rows of blocks are spread over a WorkStealingPool (WorkStealingPool::shared() by default, so that
+// compressors made on several threads share its threads)
+class BlockCompressor
+{
+public:
+    enum Format { BC1, BC4, BC5 };
+
+    explicit BlockCompressor(WorkStealingPool & pool = WorkStealingPool::shared());
+    ~BlockCompressor();
+
+    // the blocks of the image, row by row; BC1 encodes the rgb channels, BC4 the channel 'firstChannel'
+    // and BC5 the channels 'firstChannel' and 'firstChannel' + 1 (0 is red, 3 is alpha)
+    QByteArray compress(const QImage & image, Format format, int firstChannel = 0);
+
+    // the OpenGL internal format and the size of the blocks of a format
+    static GLenum glFormat(Format format);
+    static int blockBytes(Format format);
+    // the size of the compressed data of an image
+    static int compressedSize(Format format, const QSize & size);
+
+    // totals of all the compressors
+    static qint64 totalTexels();
+    static qint64 totalNanoseconds();
+
+private:
+    WorkStealingPool & _pool;
+};
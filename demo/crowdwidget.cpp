@@ -0,0 +1,339 @@
+#include "drawstats.h"
+#include "glresourceregistry.h"
+#include "memorytracker.h"
+#include "profiler.h"
+#include "smfmesh.h"
+
+#include "crowdwidget.h"
+
+#include "glcapturecalls.h"
+
+// the dragons stand on a grid of Rows x Columns, 'spacing' apart
+static const int rows = 16;
+static const int columns = 16;
+static const float spacing = 1.2f;
+
+// room of the geometry arena, a few dragon meshes
+static const int arenaVertices = 1 << 16;
+static const int arenaIndices = 1 << 18;
+
+// interleaved vertex of the buffers, the same layout as the float vertices of Dragon2Widget
+struct CrowdVertex
+{
+    QVector3D position;
+    QVector3D normal;
+};
+
+// a unit cube centered on the origin, with the normals of its faces
+static void makeBox(QVector<QVector3D> & positions, QVector<QVector3D> & normals, QVector<quint32> & indices)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        for (int side = -1; side <= 1; side += 2) {
+            QVector3D normal;
+            normal[axis] = side;
+            QVector3D u, v;
+            u[(axis + 1) % 3] = 0.5f;
+            v[(axis + 2) % 3] = 0.5f;
+            quint32 first = positions.size();
+            positions << normal * 0.5f - u - v << normal * 0.5f + u - v << normal * 0.5f + u + v << normal * 0.5f - u + v;
+            normals << normal << normal << normal << normal;
+            indices << first << first + 1 << first + 2 << first << first + 2 << first + 3;
+        }
+    }
+}
+
+CrowdWidget::CrowdWidget(QWidget *parent, const QGLWidget * shareWidget)
+    : QGLWidget(parent, shareWidget), QGLFunctions(), _frameScheduler(this)
+{
+    setWindowTitle(tr("7. Crowd"));
+    setObjectName("crowd");
+    setMinimumSize(200, 200);
+    setMouseTracking(true);
+    setFocusPolicy(Qt::ClickFocus);
+
+    // the dragon mesh, sharing its float vertex buffer with Dragon2Widget
+    QString dragonFile = tr(OPENGL_TUTORIALS_DATA_PATH"/dragon-10000.smf");
+    SmfMesh dragon = SmfMesh::load(dragonFile);
+    _dragon.asset = dragonFile;
+    _dragon.positions = dragon.positions;
+    _dragon.normals = dragon.normals;
+    _dragon.indices = dragon.indices;
+    dragon.bounds(&_dragon.boundsMin, &_dragon.boundsMax);
+
+    _box.asset = "crowd:box";
+    makeBox(_box.positions, _box.normals, _box.indices);
+    _box.boundsMin = QVector3D(-0.5f, -0.5f, -0.5f);
+    _box.boundsMax = QVector3D(0.5f, 0.5f, 0.5f);
+
+    // every dragon is scaled to a unit size and turned a bit differently
+    QVector3D extent = _dragon.boundsMax - _dragon.boundsMin;
+    float size = qMax(extent.x(), qMax(extent.y(), extent.z()));
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            QMatrix4x4 m;
+            m.translate((c - (columns - 1) / 2.0f) * spacing, 0, (r - (rows - 1) / 2.0f) * spacing);
+            m.rotate((r * columns + c) * 37.0f, 0, 1, 0);
+            m.scale(size > 0 ? 1 / size : 1);
+            m.translate(-(_dragon.boundsMin + _dragon.boundsMax) / 2);
+            _dragonMatrices << SimdMatrix4(m);
+        }
+    }
+    // three walls between the camera and the field, with gaps between them
+    for (int i = -1; i <= 1; i++) {
+        QMatrix4x4 m;
+        m.translate(i * 5.0f, 0.75f, -(rows / 2.0f) * spacing - 1.5f);
+        m.scale(4.5f, 2.5f, 0.3f);
+        _wallMatrices << m;
+    }
+
+    _sceneMatrix.setToIdentity();
+
+    MemoryTracker::set(MemoryTracker::Cpu, objectName(), "dragon mesh",
+        memoryBytes(_dragon.positions) + memoryBytes(_dragon.normals) + memoryBytes(_dragon.indices));
+    MemoryTracker::set(MemoryTracker::Cpu, objectName(), "box mesh",
+        memoryBytes(_box.positions) + memoryBytes(_box.normals) + memoryBytes(_box.indices));
+    MemoryTracker::set(MemoryTracker::Cpu, objectName(), "matrices",
+        memoryBytes(_dragonMatrices) + memoryBytes(_wallMatrices));
+
+    // the camera looks at the field over the walls
+    QMatrix4x4 viewMatrix;
+    viewMatrix.lookAt(QVector3D(0, 3, -16), QVector3D(0, 0, 0), QVector3D(0, 1, 0));
+    _frameUniforms.setViewMatrix(viewMatrix);
+
+    _meshShader = qSharedPointerCast<MeshShader>(GLResourceRegistry::instance().shaderVariants(
+        "MeshShader", [] { return new MeshShader; }));
+
+    _occlusionCulling = true;
+    _arenaDragon = _arenaBox = -1;
+    _multiDraw = true;
+}
+
+CrowdWidget::~CrowdWidget()
+{
+    // take the context back from the render thread, if any
+    _frameScheduler.stopRendering();
+
+    if (_dragon.vertexBuffer != 0) {
+        makeCurrent();
+        releaseBuffers(_dragon);
+        releaseBuffers(_box);
+        _arena.release();
+        _meshShader.clear();
+    }
+    MemoryTracker::clear(MemoryTracker::Cpu, objectName());
+}
+
+void CrowdWidget::initializeGL()
+{
+    PROFILE_SCOPE("CrowdWidget::initializeGL");
+    makeCurrent();
+    initializeGLFunctions(context());
+    _glState.initialize(context());
+
+    acquireBuffers(_dragon);
+    acquireBuffers(_box);
+
+    if (_arena.initialize(context(), _glState, arenaVertices, arenaIndices)) {
+        _arenaDragon = _arena.addMesh(_dragon.positions, _dragon.normals, _dragon.indices);
+        _arenaBox = _arena.addMesh(_box.positions, _box.normals, _box.indices);
+    }
+}
+
+void CrowdWidget::acquireBuffers(Mesh & mesh)
+{
+    GLResourceRegistry & resources = GLResourceRegistry::instance();
+    mesh.vertexBuffer = resources.acquireOrCreate(GLResourceRegistry::Buffer, mesh.asset + ":vertices",
+        [&](qint64 * bytes) {
+            QVector<CrowdVertex> vertices(mesh.positions.size());
+            for (int i = 0; i < vertices.size(); i++) {
+                vertices[i].position = mesh.positions[i];
+                vertices[i].normal = mesh.normals[i];
+            }
+            GLuint buffer = 0;
+            glGenBuffers(1, &buffer);
+            _glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+            *bytes = sizeof(CrowdVertex) * vertices.size();
+            glBufferData(GL_ARRAY_BUFFER, *bytes, vertices.constData(), GL_STATIC_DRAW);
+            return buffer;
+        });
+    mesh.indexBuffer = resources.acquireOrCreate(GLResourceRegistry::Buffer, mesh.asset + ":indices",
+        [&](qint64 * bytes) {
+            GLuint buffer = 0;
+            glGenBuffers(1, &buffer);
+            _glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+            *bytes = sizeof(quint32) * mesh.indices.size();
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, *bytes, mesh.indices.constData(), GL_STATIC_DRAW);
+            return buffer;
+        });
+}
+
+void CrowdWidget::releaseBuffers(Mesh & mesh)
+{
+    GLResourceRegistry & resources = GLResourceRegistry::instance();
+    resources.release(GLResourceRegistry::Buffer, mesh.asset + ":vertices");
+    resources.release(GLResourceRegistry::Buffer, mesh.asset + ":indices");
+    mesh.vertexBuffer = mesh.indexBuffer = 0;
+}
+
+void CrowdWidget::bindBuffers(const Mesh & mesh)
+{
+    _glState.bindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    _glState.enableVertexAttribArray(0);
+    _glState.enableVertexAttribArray(1);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CrowdVertex), 0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(CrowdVertex), (void*)offsetof(CrowdVertex, normal));
+    _glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+}
+
+void CrowdWidget::drawMesh(const Mesh & mesh, const QMatrix4x4 & modelMatrix)
+{
+    _frameUniforms.setModelMatrix(modelMatrix);
+    _frameUniforms.bind();
+    glDrawElements(GL_TRIANGLES, mesh.indices.size(), GL_UNSIGNED_INT, 0);
+    DrawStats::count(GL_TRIANGLES, mesh.indices.size());
+}
+
+void CrowdWidget::paintGL()
+{
+    PROFILE_GL_SCOPE("CrowdWidget::paintGL");
+
+    // apply the input accumulated since the last frame
+    QPointF t = _frameScheduler.takeDrag();
+    if (!t.isNull()) {
+        QMatrix4x4 rotMat;
+        rotMat.rotate(t.x() / 10.0 * M_PI, 0, 1, 0);
+        rotMat.rotate(t.y() / 10.0 * M_PI, 1, 0, 0);
+        _sceneMatrix = rotMat * _sceneMatrix;
+    }
+    int wheel = _frameScheduler.takeWheel();
+    if (wheel != 0) {
+        _sceneMatrix.scale(exp(wheel / 1000.0));
+    }
+    if (_frameScheduler.takeKeyPresses(Qt::Key_O) % 2) {
+        _occlusionCulling = !_occlusionCulling;
+    }
+    if (_frameScheduler.takeKeyPresses(Qt::Key_M) % 2) {
+        _multiDraw = !_multiDraw;
+    }
+
+    _glState.clearColor(Qt::white);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    _glState.enable(GL_DEPTH_TEST);
+    _glState.disable(GL_BLEND);
+
+    // the multi-draw variant may not compile, the scene is then drawn object by object
+    // (as while capturing: GLCapture does not record the indirect draws and the matrix texture of the arena)
+    bool multiDraw = _multiDraw && !GLCapture::isCapturing() && _arenaDragon >= 0 && _arenaBox >= 0;
+    ShaderProgram * program = nullptr;
+    if (multiDraw) {
+        program = _meshShader->variant(MeshShader::LambertLighting | MeshShader::MultiDraw);
+        multiDraw = program != nullptr;
+    }
+    if (!multiDraw) {
+        program = _meshShader->variant(MeshShader::LambertLighting);
+    }
+    if (!program) {
+        return;
+    }
+    _glState.useProgram(program->programId());
+
+    // the model matrices of the dragons, in one batch
+    int dragonCount = _dragonMatrices.size();
+    _dragonModelMatrices.resize(dragonCount);
+    SimdMatrix4::multiply(SimdMatrix4(_sceneMatrix), _dragonMatrices.constData(), _dragonModelMatrices.data(),
+        dragonCount);
+    // the dragons out of the view are not drawn, nor tested by the culler
+    QMatrix4x4 viewProjection = _frameUniforms.projectionMatrix() * _frameUniforms.viewMatrix();
+    SimdMatrix4 simdViewProjection(viewProjection);
+    SimdFrustum frustum(simdViewProjection);
+    auto isVisible = [&](const SimdMatrix4 & modelMatrix) {
+        QVector3D boundsMin, boundsMax;
+        modelMatrix.mapBox(_dragon.boundsMin, _dragon.boundsMax, &boundsMin, &boundsMax);
+        if (!frustum.intersectsBox(boundsMin, boundsMax)) {
+            return false;
+        }
+        return !_occlusionCulling || _culler.isVisible(_dragon.boundsMin, _dragon.boundsMax, modelMatrix);
+    };
+
+    // the walls hide the dragons behind them from the culler before any dragon is drawn
+    if (_occlusionCulling) {
+        _culler.beginFrame(viewProjection, _viewportSize);
+        for (const QMatrix4x4 & wall : _wallMatrices) {
+            _culler.addOccluder(_box.positions, _box.indices, _sceneMatrix * wall);
+        }
+        _culler.endOccluders();
+    }
+
+    if (multiDraw) {
+        // the view and projection matrices still come from FrameBlock
+        _frameUniforms.bind();
+        _arena.clearDraws();
+        for (const QMatrix4x4 & wall : _wallMatrices) {
+            _arena.addDraw(_arenaBox, _sceneMatrix * wall);
+        }
+        for (const SimdMatrix4 & modelMatrix : _dragonModelMatrices) {
+            if (isVisible(modelMatrix)) {
+                _arena.addDraw(_arenaDragon, modelMatrix);
+            }
+        }
+        _arena.submit(program);
+        return;
+    }
+
+    bindBuffers(_box);
+    for (const QMatrix4x4 & wall : _wallMatrices) {
+        drawMesh(_box, _sceneMatrix * wall);
+    }
+
+    bindBuffers(_dragon);
+    for (const SimdMatrix4 & modelMatrix : _dragonModelMatrices) {
+        if (isVisible(modelMatrix)) {
+            drawMesh(_dragon, modelMatrix.toQMatrix4x4());
+        }
+    }
+}
+
+void CrowdWidget::resizeGL(int w, int h)
+{
+    glViewport(0, 0, w, h);
+    _viewportSize = QSize(w, h);
+
+    QMatrix4x4 projectionMatrix;
+    projectionMatrix.perspective(30, (float)w / h, 0.1f, 100.0f);
+    _frameUniforms.setProjectionMatrix(projectionMatrix);
+}
+
+void CrowdWidget::mousePressEvent(QMouseEvent * e)
+{
+    _lastMousePos = e->pos();
+    setCursor(Qt::OpenHandCursor);
+}
+
+void CrowdWidget::mouseMoveEvent(QMouseEvent * e)
+{
+    if (e->buttons() != Qt::NoButton) {
+        setCursor(Qt::ClosedHandCursor);
+        _frameScheduler.addDrag(e->pos() - _lastMousePos);
+        _lastMousePos = e->pos();
+    }
+}
+
+void CrowdWidget::mouseReleaseEvent(QMouseEvent * e)
+{
+    setCursor(Qt::ArrowCursor);
+}
+
+void CrowdWidget::wheelEvent(QWheelEvent * e)
+{
+    _frameScheduler.addWheel(e->delta());
+}
+
+void CrowdWidget::keyPressEvent(QKeyEvent * e)
+{
+    if (e->key() == Qt::Key_O || e->key() == Qt::Key_M) {
+        _frameScheduler.addKey(e->key());
+    } else {
+        QGLWidget::keyPressEvent(e);
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QtOpenGL>
+
+#include "frameuniforms.h"
+#include "framescheduler.h"
+#include "geometryarena.h"
+#include "glstatecache.h"
+#include "meshshader.h"
+#include "occlusionculler.h"
+#include "simdmatrix.h"
+
+// a field of dragons behind a row of walls, many meshes sharing one view
+// the walls are the occluders of an OcclusionCuller, which skips the dragons they hide (toggled by the O key)
+// the meshes are also stored in a GeometryArena, which draws the whole scene with one multi-draw
+// instead of one glDrawElements per object (toggled by the M key)
+class CrowdWidget : public QGLWidget, public QGLFunctions
+{
+public:
+    CrowdWidget(QWidget *parent = nullptr, const QGLWidget * shareWidget = nullptr);
+    ~CrowdWidget();
+
+    // the occlusion culling stage, for its statistics
+    const OcclusionCuller & occlusionCuller() const { return _culler; }
+
+protected:
+    // opengl methods
+    virtual void initializeGL() override;
+    virtual void paintGL() override;
+    virtual void resizeGL(int w, int h) override;
+
+    // mouse event handlers
+    virtual void mousePressEvent(QMouseEvent * e) override;
+    virtual void mouseMoveEvent(QMouseEvent * e) override;
+    virtual void mouseReleaseEvent(QMouseEvent * e) override;
+    virtual void wheelEvent(QWheelEvent * e) override;
+
+    // key event handler (toggles the occlusion culling and the multi-draw)
+    virtual void keyPressEvent(QKeyEvent * e) override;
+
+private:
+    // a mesh stored in a shared vertex buffer ({position, normal} floats) and index buffer
+    struct Mesh
+    {
+        QString asset; // name of the buffers in GLResourceRegistry
+        QVector<QVector3D> positions, normals;
+        QVector<quint32> indices;
+        QVector3D boundsMin, boundsMax;
+        GLuint vertexBuffer = 0, indexBuffer = 0;
+    };
+    // upload the buffers of the mesh, unless another widget of the share group already did
+    void acquireBuffers(Mesh & mesh);
+    void releaseBuffers(Mesh & mesh);
+    // bind the buffers of the mesh to the attributes "position" and "normal"
+    void bindBuffers(const Mesh & mesh);
+    // set the model matrix and draw the mesh
+    void drawMesh(const Mesh & mesh, const QMatrix4x4 & modelMatrix);
+
+private:
+    // rotation and zoom of the whole scene
+    QMatrix4x4 _sceneMatrix;
+    QSize _viewportSize;
+
+    Mesh _dragon, _box;
+    // the placement of each dragon and wall in the scene
+    QVector<SimdMatrix4> _dragonMatrices;
+    QVector<QMatrix4x4> _wallMatrices;
+    // the model matrices of the dragons in this frame
+    QVector<SimdMatrix4> _dragonModelMatrices;
+
+    QSharedPointer<MeshShader> _meshShader;
+    FrameUniforms _frameUniforms;
+
+    OcclusionCuller _culler;
+    bool _occlusionCulling;
+
+    // the dragon and the box in one pair of buffers, -1 if the context has no arena
+    GeometryArena _arena;
+    int _arenaDragon, _arenaBox;
+    bool _multiDraw;
+
+    // the shadowed OpenGL state of this widget's context
+    GLStateCache _glState;
+
+    // accumulates the mouse input between frames and paces the repaints
+    FrameScheduler _frameScheduler;
+
+private:
+    QPointF _lastMousePos;
+};
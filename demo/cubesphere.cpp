@@ -0,0 +1,177 @@
+#include "cubesphere.h"
+
+// the deepest level of the quadtrees, far below a pixel at any zoom of the widgets
+static const int maxLevel = 20;
+
+// whether a part of the patch may be seen
+static bool isVisible(const SpherePatch & patch, const QMatrix4x4 & modelMatrix, const QSize & viewport)
+{
+    // the patch is within a cone around its center, the farthest points being its corners
+    // (its edges are arcs of great circles)
+    QVector3D center = patch.spherePoint(0.5f, 0.5f);
+    float minCos = 1;
+    for (int i = 0; i < 4; i++) {
+        minCos = qMin(minCos, QVector3D::dotProduct(center, patch.spherePoint(i & 1, i >> 1)));
+    }
+    float sinHalfAngle = std::sqrt(qMax(0.0f, 1 - minCos * minCos));
+
+    // facing away: every direction of the cone is more than 90 degrees from the viewer (+z);
+    // the projection is orthographic, so the horizon is the silhouette and the patches behind it face away
+    if (modelMatrix.mapVector(center).normalized().z() < -sinHalfAngle) {
+        return false;
+    }
+
+    // out of the viewport: the bounds of 3 x 3 points in pixels, with some slack as the patch bulges between them
+    float left = FLT_MAX, right = -FLT_MAX, bottom = FLT_MAX, top = -FLT_MAX;
+    for (int i = 0; i <= 2; i++) {
+        for (int j = 0; j <= 2; j++) {
+            QVector3D eye = modelMatrix.map(patch.spherePoint(i / 2.0f, j / 2.0f));
+            left = qMin(left, eye.x());
+            right = qMax(right, eye.x());
+            bottom = qMin(bottom, eye.y());
+            top = qMax(top, eye.y());
+        }
+    }
+    float margin = qMax(right - left, top - bottom) * 0.25f;
+    return left - margin < viewport.width() / 2.0f && right + margin > -viewport.width() / 2.0f &&
+        bottom - margin < viewport.height() / 2.0f && top + margin > -viewport.height() / 2.0f;
+}
+
+QVector3D SpherePatch::cubePoint(float u, float v) const
+{
+    QVector3D center, xAxis, yAxis;
+    CubeSphere::faceAxes(face, &center, &xAxis, &yAxis);
+    return center + (x + u * size) * xAxis + (y + v * size) * yAxis;
+}
+
+QVector<SpherePatch> CubeSphere::select(const QMatrix4x4 & modelMatrix, const QSize & viewport, float maxPixelError,
+    int maxPatches)
+{
+    // the radius of the sphere in pixels
+    float radius = QVector3D(modelMatrix.column(0)).length();
+
+    // breadth first, so that the patches are refined evenly when they reach maxPatches
+    QVector<SpherePatch> patches;
+    QQueue<SpherePatch> queue;
+    for (int face = 0; face < 6; face++) {
+        queue.enqueue(SpherePatch(face, 0, -1, -1, 2));
+    }
+    while (!queue.isEmpty()) {
+        SpherePatch patch = queue.dequeue();
+        if (!isVisible(patch, modelMatrix, viewport)) {
+            continue;
+        }
+        // the grid points are at most size / GridSize radians apart (the faces are 1 from the center),
+        // the chords between them sag by r (1 - cos(a / 2)), about r a^2 / 8
+        float step = patch.size / GridSize;
+        float error = radius * step * step / 8;
+        if (error > maxPixelError && patch.level < maxLevel && patches.size() + queue.size() + 4 <= maxPatches) {
+            for (int i = 0; i < 4; i++) {
+                queue.enqueue(patch.child(i));
+            }
+        } else {
+            patches << patch;
+        }
+    }
+    return patches;
+}
+
+void CubeSphere::faceAxes(int face, QVector3D * center, QVector3D * xAxis, QVector3D * yAxis)
+{
+    // +x, -x, +y (the north pole), -y, +z, -z
+    static const float axes[6][3][3] = {
+        { { 1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } },
+        { { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+        { { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },
+        { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+        { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },
+        { { 0, 0, -1 }, { -1, 0, 0 }, { 0, 1, 0 } }
+    };
+    *center = QVector3D(axes[face][0][0], axes[face][0][1], axes[face][0][2]);
+    *xAxis = QVector3D(axes[face][1][0], axes[face][1][1], axes[face][1][2]);
+    *yAxis = QVector3D(axes[face][2][0], axes[face][2][1], axes[face][2][2]);
+}
+
+void CubeSphere::grid(QVector<QVector3D> * vertices, QVector<GLuint> * indices)
+{
+    const int n = GridSize + 1;
+    vertices->clear();
+    indices->clear();
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            *vertices << QVector3D(float(j) / GridSize, float(i) / GridSize, 0);
+        }
+    }
+    for (int i = 1; i < n; i++) {
+        for (int j = 1; j < n; j++) {
+            GLuint a = (i - 1) * n + j - 1, b = a + 1, c = i * n + j, d = c - 1;
+            *indices << a << b << c << a << c << d;
+        }
+    }
+
+    // each edge, and the copy of its vertices hanging below it
+    for (int edge = 0; edge < 4; edge++) {
+        GLuint skirt = vertices->size();
+        QVector<GLuint> points;
+        for (int k = 0; k < n; k++) {
+            int i = edge == 0 ? 0 : edge == 1 ? n - 1 : k;
+            int j = edge == 2 ? 0 : edge == 3 ? n - 1 : k;
+            points << i * n + j;
+            *vertices << QVector3D(float(j) / GridSize, float(i) / GridSize, 1);
+        }
+        for (int k = 1; k < n; k++) {
+            *indices << points[k - 1] << points[k] << skirt + k << points[k - 1] << skirt + k << skirt + k - 1;
+        }
+    }
+}
+
+float CubeSphere::skirtDepth(const SpherePatch & patch)
+{
+    // deep enough for a neighbour 4 times coarser, whose chords sag 16 times more
+    float step = patch.size / GridSize;
+    return qMin(2 * step * step, 0.1f);
+}
+
+QPointF CubeSphere::mapPoint(const QVector3D & spherePoint)
+{
+    double s = -std::atan2(spherePoint.z(), spherePoint.x()) / (2 * M_PI);
+    double t = 0.5 - std::asin(qBound(-1.0f, spherePoint.y(), 1.0f)) / M_PI;
+    return QPointF(s - std::floor(s), t);
+}
+
+QVector3D CubeSphere::spherePoint(const QPointF & mapPoint)
+{
+    double xangle = M_PI * 2 * (1 - mapPoint.x());
+    double yangle = M_PI_2 - M_PI * mapPoint.y();
+    return QVector3D(cos(xangle) * cos(yangle), sin(yangle), sin(xangle) * cos(yangle));
+}
+
+QRectF CubeSphere::mapBounds(const SpherePatch & patch)
+{
+    // the longitudes are taken around the one of the center, so the patches across the date line
+    // extend past 0 or 1 rather than covering the whole map
+    QPointF center = mapPoint(patch.spherePoint(0.5f, 0.5f));
+    double left = 0, right = 0, top = center.y(), bottom = center.y();
+    for (int i = 0; i <= 4; i++) {
+        for (int j = 0; j <= 4; j++) {
+            QPointF point = mapPoint(patch.spherePoint(i / 4.0f, j / 4.0f));
+            double ds = point.x() - center.x();
+            ds -= std::floor(ds + 0.5);
+            left = qMin(left, ds);
+            right = qMax(right, ds);
+            top = qMin(top, point.y());
+            bottom = qMax(bottom, point.y());
+        }
+    }
+
+    // a patch around a pole has all the longitudes
+    bool pole = (patch.face == 2 || patch.face == 3) && patch.x <= 0 && patch.x + patch.size >= 0 &&
+        patch.y <= 0 && patch.y + patch.size >= 0;
+    if (pole) {
+        return patch.face == 2 ? QRectF(0, 0, 1, bottom) : QRectF(0, top, 1, 1 - top);
+    }
+    // the patch bulges between the points
+    double sMargin = (right - left) * 0.1 + 1e-4, tMargin = (bottom - top) * 0.1 + 1e-4;
+    return QRectF(center.x() + left - sMargin, top - tMargin, right - left + 2 * sMargin,
+        bottom - top + 2 * tMargin);
+}
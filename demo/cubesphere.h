@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QtGui>
+
+// a square of a face of the cube-sphere: [x, x + size] x [y, y + size] in the coordinates of the face,
+// which span [-1, 1] (see CubeSphere::faceAxes())
+struct SpherePatch
+{
+    int face = 0, level = 0;
+    float x = -1, y = -1, size = 2;
+
+    SpherePatch() {}
+    SpherePatch(int f, int l, float px, float py, float s) : face(f), level(l), x(px), y(py), size(s) {}
+
+    // the children 0 to 3, row by row
+    SpherePatch child(int i) const
+    {
+        return SpherePatch(face, level + 1, x + (i & 1) * size / 2, y + (i >> 1) * size / 2, size / 2);
+    }
+
+    // the point of the cube at (u, v) in [0, 1] in the patch, and its point of the unit sphere
+    QVector3D cubePoint(float u, float v) const;
+    QVector3D spherePoint(float u, float v) const { return cubePoint(u, v).normalized(); }
+};
+
+// the unit sphere as the 6 faces of a cube pushed onto it, each a quadtree of patches
+// all the patches are drawn with the same grid of GridSize x GridSize quads, placed by the uniforms of the patch:
+// so the patches are refined where the grid would deviate from the sphere by more than a pixel on screen,
+// and the vertex count follows the view (the poles are no denser than the equator, unlike a UV sphere)
+class CubeSphere
+{
+public:
+    enum { GridSize = 16 };
+
+    // the patches to draw for the unit sphere mapped to pixels by 'modelMatrix', in an orthographic projection
+    // with the origin at the center of the viewport: refined until the grid is at most 'maxPixelError' pixels
+    // off the sphere (or there are 'maxPatches'), without the ones facing away or out of the viewport
+    static QVector<SpherePatch> select(const QMatrix4x4 & modelMatrix, const QSize & viewport, float maxPixelError,
+        int maxPatches);
+
+    // the center of a face and its axes, the face coordinates are along the axes
+    static void faceAxes(int face, QVector3D * center, QVector3D * xAxis, QVector3D * yAxis);
+
+    // the vertices of the shared grid: (u, v) in the patch and 1 for the skirt hanging below its edges,
+    // which hides the cracks along neighbours of other levels; and its triangles
+    static void grid(QVector<QVector3D> * vertices, QVector<GLuint> * indices);
+    // how deep the skirt of a patch hangs below the sphere, in radii
+    static float skirtDepth(const SpherePatch & patch);
+
+    // the point of the earth map (equirectangular, in [0, 1] from its top left corner) of a point of the unit sphere,
+    // and back
+    static QPointF mapPoint(const QVector3D & spherePoint);
+    static QVector3D spherePoint(const QPointF & mapPoint);
+    // the bounds of a patch in the earth map; across the date line they extend past 0 or 1
+    static QRectF mapBounds(const SpherePatch & patch);
+};
@@ -1,9 +1,15 @@
+#include "drawstats.h"
+#include "profiler.h"
+
 #include "cubewidget.h"
 
-CubeWidget::CubeWidget(QWidget *parent)
-    : QGLWidget(parent)
+#include "glcapturecalls.h"
+
+CubeWidget::CubeWidget(QWidget *parent, const QGLWidget * shareWidget)
+    : QGLWidget(parent, shareWidget), _frameScheduler(this)
 {
     setWindowTitle(tr("2. Cube"));
+    setObjectName("cube");
     setMinimumSize(200, 200);
     setMouseTracking(true);
     setFocusPolicy(Qt::ClickFocus);
@@ -19,18 +25,36 @@ CubeWidget::~CubeWidget()
 
 void CubeWidget::initializeGL()
 {
+    PROFILE_SCOPE("CubeWidget::initializeGL");
     makeCurrent();
+    _glState.initialize(context());
 }
 
 void CubeWidget::paintGL()
 {
-    qglClearColor(Qt::white);
+    PROFILE_GL_SCOPE("CubeWidget::paintGL");
+
+    // apply the input accumulated since the last frame
+    QPointF t = _frameScheduler.takeDrag();
+    if (!t.isNull()) {
+        QMatrix4x4 rotMat;
+        rotMat.rotate(t.x() / 10.0 * M_PI, 0, 1, 0);
+        rotMat.rotate(t.y() / 10.0 * M_PI, 1, 0, 0);
+        _modelMatrix = rotMat * _modelMatrix;
+    }
+    int wheel = _frameScheduler.takeWheel();
+    if (wheel != 0) {
+        _modelMatrix.scale(exp(wheel / 1000.0));
+    }
+
+    _glState.clearColor(Qt::white);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_ALPHA_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // set states (only the changed ones reach OpenGL)
+    _glState.enable(GL_DEPTH_TEST);
+    _glState.enable(GL_ALPHA_TEST);
+    _glState.enable(GL_BLEND);
+    _glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // setup model matrix (ignore the "view matrix" since it is identity here)
     glMatrixMode(GL_MODELVIEW);
@@ -40,7 +64,8 @@ void CubeWidget::paintGL()
     glMatrixMode(GL_PROJECTION);
     QMatrix4x4 projectionMatrix;
     projectionMatrix.setToIdentity();
-    projectionMatrix.ortho(-width()/2.0, width()/2.0, -height()/2.0, height()/2.0, -1e3, 1e3);
+    projectionMatrix.ortho(-_viewportSize.width()/2.0, _viewportSize.width()/2.0, 
+        -_viewportSize.height()/2.0, _viewportSize.height()/2.0, -1e3, 1e3);
     glLoadMatrixf(projectionMatrix.data());
 
     // draw a cube
@@ -100,6 +125,7 @@ void CubeWidget::paintGL()
         glVertex4dv(verts[quadFaces[i][3]]);
     }
     glEnd(); 
+    DrawStats::count(GL_TRIANGLES, 6 * 6);
 
     //glLineWidth(1.0f);
     //glBegin(GL_LINES);
@@ -116,6 +142,7 @@ void CubeWidget::paintGL()
 void CubeWidget::resizeGL( int w, int h )
 {
     glViewport(0, 0, w, h);
+    _viewportSize = QSize(w, h);
 }
 
 void CubeWidget::mousePressEvent( QMouseEvent * e )
@@ -129,13 +156,9 @@ void CubeWidget::mouseMoveEvent( QMouseEvent * e )
     if(e->buttons() != Qt::NoButton)
     {
         setCursor(Qt::ClosedHandCursor);
-        auto t = (e->pos() - _lastMousePos);
-        QMatrix4x4 rotMat;
-        rotMat.rotate(t.x() / 10.0 * M_PI, 0, 1, 0);
-        rotMat.rotate(t.y() / 10.0 * M_PI, 1, 0, 0);
-        _modelMatrix = rotMat * _modelMatrix;
+        // the rotation is applied by the next frame, together with the other moves until then
+        _frameScheduler.addDrag(e->pos() - _lastMousePos);
         _lastMousePos = e->pos();
-        update();
     }
 }
 
@@ -146,6 +169,5 @@ void CubeWidget::mouseReleaseEvent( QMouseEvent * e )
 
 void CubeWidget::wheelEvent( QWheelEvent * e )
 {
-    _modelMatrix.scale(exp(e->delta() / 1000.0));
-    update();
+    _frameScheduler.addWheel(e->delta());
 }
\ No newline at end of file
@@ -2,10 +2,13 @@
 
 #include <QtOpenGL>
 
+#include "framescheduler.h"
+#include "glstatecache.h"
+
 class CubeWidget : public QGLWidget
 {
 public:
-    CubeWidget(QWidget *parent = nullptr);
+    CubeWidget(QWidget *parent = nullptr, const QGLWidget * shareWidget = nullptr);
     ~CubeWidget();
 
 protected:
@@ -23,6 +26,15 @@ protected:
 private:
     QMatrix4x4 _modelMatrix;
 
+    // the size given to the last resizeGL, paintGL may run on a render thread and cannot read the widget's size
+    QSize _viewportSize;
+
+    // the shadowed OpenGL state of this widget's context
+    GLStateCache _glState;
+
+    // accumulates the mouse input between frames and paces the repaints
+    FrameScheduler _frameScheduler;
+
 private:
     QPointF _lastMousePos;
 };
@@ -1,9 +1,18 @@
+#include "drawstats.h"
+#include "glresourceregistry.h"
+#include "memorytracker.h"
+#include "profiler.h"
+#include "smfmesh.h"
+
 #include "dragon2widget.h"
 
-Dragon2Widget::Dragon2Widget(QWidget *parent)
-    : QGLWidget(parent), QGLFunctions()
+#include "glcapturecalls.h"
+
+Dragon2Widget::Dragon2Widget(QWidget *parent, const QGLWidget * shareWidget)
+    : QGLWidget(parent, shareWidget), QGLFunctions(), _frameScheduler(this)
 {
     setWindowTitle(tr("5. Dragon 2"));
+    setObjectName("dragon2");
     setMinimumSize(200, 200);
     setMouseTracking(true);
     setFocusPolicy(Qt::ClickFocus);
@@ -16,237 +25,227 @@ Dragon2Widget::Dragon2Widget(QWidget *parent)
     _modelMatrix.scale(1.5);
     _modelMatrix.rotate(45, 1, 1, 1);
 
+    // initialize view matrix data
+    QMatrix4x4 viewMatrix;
+    viewMatrix.lookAt(QVector3D(0, 0, -1000), QVector3D(0, 0, 0), QVector3D(0, -1, 0));
+    _frameUniforms.setViewMatrix(viewMatrix);
+
     // initialize buffer ids to 0
     _vertBuffer = 0;
     _triangleIndicesBuffer = 0;
 
+    // the shader variants are shared by the widgets of the share group
+    _meshShader = qSharedPointerCast<MeshShader>(GLResourceRegistry::instance().shaderVariants(
+        "MeshShader", [] { return new MeshShader; }));
+    // the minimal shader variant for this widget: quantized vertices colored by cutting spheres
+    _shaderFeatures = MeshShader::QuantizedAttributes | MeshShader::CuttingSpheres;
+
     // initialize program id to -1
     _program = -1;
 
     // initialize uniform variable locations to -1
-    _modelMatrixLocation = -1;
-    _viewMatrixLocation = -1;
-    _projectionMatrixLocation = -1;
+    _positionScaleLocation = -1;
+    _positionOffsetLocation = -1;
+
+    _rayTracing = false;
 }
 
 Dragon2Widget::~Dragon2Widget()
-{}
-
-// the source code of vertex shader
-static const char * vshaderSource = 
-    "#version 120\n"                    // the version of this shader
-    "attribute lowp vec3 position;\n"   // the position of each vertex
-    "attribute lowp vec3 normal;\n"     // the normal of each vertex
-    "uniform lowp mat4 viewMatrix;\n"       // the viewMatrix of this shader program
-    "uniform lowp mat4 modelMatrix;\n"      // the modelMatrix of this shader program
-    "uniform lowp mat4 projectionMatrix;\n" // the projectionMatrix of this shader program
-    "varying lowp vec4 pixelColor;\n"    // the output color on this vertex (will be interpolated in fragment shader)
-    "varying lowp vec3 pixelPosition;\n" // the output position on this vertex (will be interpolated in fragment shader) 
-    "void main(void)\n" // the main function
-    "{\n"
-    
-    // gl_Position is the final coordinate of this vertex on screen
-    "    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(position, 1.0);\n" 
-    
-    //  here we directly use the normal vector as color values on this vertex
-    "    pixelColor = vec4(normal, 1.0);\n" 
-    
-    // we directly pass the original vertex position to pixelPosition, to retrieve the spatial position of each pixel in fragment shader
-    "    pixelPosition = position;\n" 
-
-    "}\n";
-
-// the source code of fragment shader
-static const char * fshaderSource = 
-    "#version 120\n" // the version of this shader
-    "varying lowp vec4 pixelColor;\n" // the interpolated color on this pixel
-    "varying lowp vec3 pixelPosition;\n" // the interpolated position on this pixel
-    "void main(void)\n" // the main function
-    "{\n"
-
-    // the center of cutting spheres
-    "    lowp vec3 center = vec3(1.0, 0.0, 0.0);\n"
-
-    // compute the distance between the center and this pixel
-    "    lowp float distance = length(center - pixelPosition);\n"
-    
-    // use sin(distance) to conditionally visualize pixels 
-    "    gl_FragColor = pixelColor * sin(distance);\n"
-    
-    "}\n";
-
+{
+    // take the context back from the render thread, if any
+    _frameScheduler.stopRendering();
+
+    // drop the references to the shared buffers
+    if (_vertBuffer != 0) {
+        makeCurrent();
+        GLResourceRegistry & resources = GLResourceRegistry::instance();
+        resources.release(GLResourceRegistry::Buffer, vertexBufferAsset());
+        resources.release(GLResourceRegistry::Buffer, _meshFile + ":indices");
+        // the last widget using the variants deletes their programs, while its context is current
+        _meshShader.clear();
+    }
+    MemoryTracker::clear(MemoryTracker::Cpu, objectName());
+}
 
 void Dragon2Widget::initializeGL()
 {
+    PROFILE_SCOPE("Dragon2Widget::initializeGL");
     makeCurrent();
     initializeGLFunctions(context());
+    _glState.initialize(context());
 
-    // create OpenGL shader program
-    _program = glCreateProgram();
-
-    // create a vertex shader
-    int vshader = glCreateShader(GL_VERTEX_SHADER);
-
-    // load shader source and compile
-    glShaderSource(vshader, 1, &vshaderSource, 0);
-    glCompileShader(vshader);       
-    { // check status
-        GLint logLength;
-        glGetShaderiv(vshader, GL_INFO_LOG_LENGTH, &logLength);
-        if (logLength > 0) {
-            GLchar *log = (GLchar *)malloc(logLength);
-            glGetShaderInfoLog(vshader, logLength, &logLength, log);
-            qDebug("Shader compile log:\n%s", log);
-            free(log);
-        }
-        GLint status;
-        glGetShaderiv(vshader, GL_COMPILE_STATUS, &status);
-        if (status == 0) {
-            glDeleteShader(vshader);
-            return;
-        }
-    }
-
-    // create a fragment shader
-    int fshader = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // load shader source and compile
-    glShaderSource(fshader, 1, &fshaderSource, 0);
-    glCompileShader(fshader);
-    { // check status
-        GLint logLength;
-        glGetShaderiv(fshader, GL_INFO_LOG_LENGTH, &logLength);
-        if (logLength > 0) {
-            GLchar *log = (GLchar *)malloc(logLength);
-            glGetShaderInfoLog(fshader, logLength, &logLength, log);
-            qDebug("Shader compile log:\n%s", log);
-            free(log);
-        }
-        GLint status;
-        glGetShaderiv(fshader, GL_COMPILE_STATUS, &status);
-        if (status == 0) {
-            glDeleteShader(fshader);
-            return;
-        }
+    // the range of the quantized positions is needed even if the buffer is already uploaded
+    if (_shaderFeatures & MeshShader::QuantizedAttributes) {
+        computePositionRange();
     }
 
-    // attach shaders to the program
-    glAttachShader(_program, vshader);
-    glAttachShader(_program, fshader);
-
-    // link the program
-    glLinkProgram(_program);
-    { // check status
-        GLint logLength, status;
-        glValidateProgram(_program);
-        glGetProgramiv(_program, GL_INFO_LOG_LENGTH, &logLength);
-        if (logLength > 0) {
-            GLchar *log = (GLchar *)malloc(logLength);
-            glGetProgramInfoLog(_program, logLength, &logLength, log);
-            qDebug("Program validate log:\n%s", log);
-            free(log);
-        }
-
-        glGetProgramiv(_program, GL_VALIDATE_STATUS, &status);
-        if (status == 0) {
-            return;
+    // reuse the buffers if another widget of the share group already uploaded the mesh
+    GLResourceRegistry & resources = GLResourceRegistry::instance();
+    _vertBuffer = resources.acquireOrCreate(GLResourceRegistry::Buffer, vertexBufferAsset(), [&](qint64 * bytes) {
+        // generate buffer
+        GLuint buffer = 0;
+        glGenBuffers(1, &buffer);
+
+        // use the buffer as the ArrayBuffer and fill it with vertices array 
+        _glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (_shaderFeatures & MeshShader::QuantizedAttributes) {
+            QVector<QuantizedVertex> quantizedVertices = quantizeVertices();
+            *bytes = sizeof(quantizedVertices.first()) * quantizedVertices.size();
+            glBufferData(GL_ARRAY_BUFFER, *bytes, quantizedVertices.data(), GL_STATIC_DRAW);
+        } else {
+            QVector<float> vertices = _vertices.interleave();
+            *bytes = sizeof(vertices.first()) * vertices.size();
+            glBufferData(GL_ARRAY_BUFFER, *bytes, vertices.data(), GL_STATIC_DRAW);
         }
-    }
-
-    // get locations of uniform variable from the linked program
-    _modelMatrixLocation = glGetUniformLocation(_program, "modelMatrix");
-    _viewMatrixLocation = glGetUniformLocation(_program, "viewMatrix");
-    _projectionMatrixLocation = glGetUniformLocation(_program, "projectionMatrix");
-
-    Q_ASSERT(_modelMatrixLocation != -1 && _viewMatrixLocation != -1 && _projectionMatrixLocation != -1);
-
-    // bind 0 to the "position" attribute of each vertex in shader program
-    glBindAttribLocation(_program, 0, "position");
-    // bind 1 to the "normal" attribute of each vertex in shader program
-    glBindAttribLocation(_program, 1, "normal");
-
-
-    // generate buffers
-    glGenBuffers(1, &_vertBuffer);
-    glGenBuffers(1, &_triangleIndicesBuffer);
-
-    // use _vertBuffer as the ArrayBuffer and fill it with vertices array 
-    glBindBuffer(GL_ARRAY_BUFFER, _vertBuffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(_vertices.first()) * _vertices.size(), 
-        _vertices.data(), GL_STATIC_DRAW);
-
-    // use _triangleIndicesBuffer as the ElementArrayBuffer and fill it with triangle indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _triangleIndicesBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(_triangleIndices.first()) * _triangleIndices.size(),
-        _triangleIndices.data(), GL_STATIC_DRAW);   
-
-    // unbind buffers
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
+        return buffer;
+    });
+
+    _triangleIndicesBuffer = resources.acquireOrCreate(GLResourceRegistry::Buffer, _meshFile + ":indices",
+        [&](qint64 * bytes) {
+            // generate buffer
+            GLuint buffer = 0;
+            glGenBuffers(1, &buffer);
+
+            // use the buffer as the ElementArrayBuffer and fill it with triangle indices
+            _glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+            *bytes = sizeof(_triangleIndices.first()) * _triangleIndices.size();
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, *bytes, _triangleIndices.data(), GL_STATIC_DRAW);
+            return buffer;
+        });
 }
 
 void Dragon2Widget::paintGL()
 {
-    qglClearColor(Qt::white);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    PROFILE_GL_SCOPE("Dragon2Widget::paintGL");
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_ALPHA_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // apply the input accumulated since the last frame
+    QPointF t = _frameScheduler.takeDrag();
+    if (!t.isNull()) {
+        QMatrix4x4 rotMat;
+        rotMat.rotate(-t.x() / 10.0 * M_PI, 0, 1, 0);
+        rotMat.rotate(t.y() / 10.0 * M_PI, 1, 0, 0);
+        _modelMatrix = rotMat * _modelMatrix;
+    }
+    int wheel = _frameScheduler.takeWheel();
+    if (wheel != 0) {
+        _modelMatrix.scale(exp(wheel / 1000.0));
+    }
+    // an odd number of presses toggles a feature
+    if (_frameScheduler.takeKeyPresses(Qt::Key_L) % 2) {
+        _shaderFeatures ^= MeshShader::LambertLighting;
+    }
+    if (_frameScheduler.takeKeyPresses(Qt::Key_N) % 2) {
+        _shaderFeatures ^= MeshShader::DebugNormals;
+    }
+    if (_frameScheduler.takeKeyPresses(Qt::Key_R) % 2) {
+        _rayTracing = !_rayTracing;
+    }
+    if (_rayTracing) {
+        paintRayTraced();
+        return;
+    }
 
-    // use the OpenGL shader program for painting
-    glUseProgram(_program);
+    _glState.clearColor(Qt::white);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // set model matrix
-    glUniformMatrix4fv(_modelMatrixLocation, 1, GL_FALSE, _modelMatrix.data());
+    // set states (only the changed ones reach OpenGL)
+    _glState.enable(GL_DEPTH_TEST);
+    _glState.enable(GL_ALPHA_TEST);
+    _glState.enable(GL_BLEND);
+    _glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    // set view matrix
-    QMatrix4x4 viewMatrix;
-    viewMatrix.setToIdentity();
-    viewMatrix.lookAt(QVector3D(0, 0, -1000), QVector3D(0, 0, 0), QVector3D(0, -1, 0));
-    glUniformMatrix4fv(_viewMatrixLocation, 1, GL_FALSE, viewMatrix.data());
+    // the shader variant of the current features, compiled on its first use
+    ShaderProgram * program = _meshShader->variant(_shaderFeatures);
+    if (!program) {
+        return;
+    }
+    if (program->programId() != _program) {
+        // get locations of uniform variable from the linked program
+        _program = program->programId();
+        _positionScaleLocation = program->uniformLocation("positionScale");
+        _positionOffsetLocation = program->uniformLocation("positionOffset");
+    }
 
-    // set projection matrix
-    QMatrix4x4 projectionMatrix;
-    projectionMatrix.setToIdentity();
-    projectionMatrix.perspective(30, (float)width()/height(), 0.01f, 1e5f);
-    glUniformMatrix4fv(_projectionMatrixLocation, 1, GL_FALSE, projectionMatrix.data());
+    // use the OpenGL shader program for painting
+    _glState.useProgram(_program);
+
+    // uniform values are kept by the program (which may be shared with other widgets),
+    // so they are only set when another widget set its own values in between
+    if (program->claimUniforms(this)) {
+        // set the range of the normalized positions
+        glUniform3f(_positionScaleLocation, _positionScale.x(), _positionScale.y(), _positionScale.z());
+        glUniform3f(_positionOffsetLocation, _positionOffset.x(), _positionOffset.y(), _positionOffset.z());
+    }
+
+    // set model matrix, the camera block is only uploaded if a matrix changed since the last frame
+    _frameUniforms.setModelMatrix(_modelMatrix);
+    _frameUniforms.bind();
 
     // bind ArrayBuffer to _vertBuffer
-    glBindBuffer(GL_ARRAY_BUFFER, _vertBuffer);
+    _glState.bindBuffer(GL_ARRAY_BUFFER, _vertBuffer);
     // enable vertex attribute "position" (bound to 0 already)
-    glEnableVertexAttribArray(0); 
-    // set the data of vertex attribute "position" using current ArrayBuffer
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(_vertices.first()), 0);
+    _glState.enableVertexAttribArray(0); 
     // enable vertex attribute "normal" (bound to 1 already)
-    glEnableVertexAttribArray(1);
-    // set the data of vertex attribute "normal" using current ArrayBuffer
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(_vertices.first()), (void*)(3 * sizeof(float)));
+    _glState.enableVertexAttribArray(1);
+    if (_shaderFeatures & MeshShader::QuantizedAttributes) {
+        // set the data of vertex attributes "position" and "normal" as normalized integers
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), 0);
+        glVertexAttribPointer(1, 3, GL_BYTE, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, normal));
+    } else {
+        // set the data of vertex attributes "position" and "normal" using current ArrayBuffer
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), 0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    }
 
     // bind ElementArrayBuffer to _triangleIndicesBuffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _triangleIndicesBuffer);
+    _glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _triangleIndicesBuffer);
     // draw mesh using the indices stored in ElementArrayBuffer
     glDrawElements(GL_TRIANGLES, _triangleIndices.size(), GL_UNSIGNED_INT, 0);
+    DrawStats::count(GL_TRIANGLES, _triangleIndices.size());
 
-    // disable vertex attributes
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
+    // states and bindings are left as they are, _glState skips setting them again in the next frame
+}
 
-    // unbind buffers
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+void Dragon2Widget::paintRayTraced()
+{
+    PROFILE_SCOPE("Dragon2Widget::paintRayTraced");
+    // the image stops improving visibly after that many samples per pixel
+    static const int maxSamples = 256;
 
-    // restore states
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_ALPHA_TEST);
-    glDisable(GL_BLEND);
+    if (!_rayTracer) {
+        _rayTracer.reset(new SoftwareRayTracer);
+    }
+    _rayTracer->setViewportSize(_viewportSize);
+    SoftwareMesh mesh = softwareMesh(_viewportSize);
+    if (!_rayTracer->accumulates(mesh) || _rayTracer->sampleCount() < maxSamples) {
+        _rayTracer->render(mesh);
+    }
+
+    // the image is drawn as a texture over the whole viewport by the fixed pipeline
+    _glState.useProgram(0);
+    _glState.disable(GL_DEPTH_TEST);
+    GLuint texture = bindTexture(_rayTracer->image(), GL_TEXTURE_2D, GL_RGBA,
+        QGLContext::LinearFilteringBindOption | QGLContext::InvertedYBindOption);
+    drawTexture(QRectF(-1, -1, 2, 2), texture);
+    deleteTexture(texture);
+    // bindTexture and drawTexture changed the bindings and states behind the cache
+    _glState.invalidate();
+
+    // keep refining while the camera holds still, any input restarts the accumulation
+    if (_rayTracer->sampleCount() < maxSamples) {
+        QMetaObject::invokeMethod(&_frameScheduler, "requestFrame", Qt::QueuedConnection);
+    }
 }
 
 void Dragon2Widget::resizeGL( int w, int h )
 {
     glViewport(0, 0, w, h);
+    _viewportSize = QSize(w, h);
+
+    // set projection matrix (it only relies on the size of the window)
+    QMatrix4x4 projectionMatrix;
+    projectionMatrix.perspective(30, (float)w / h, 0.01f, 1e5f);
+    _frameUniforms.setProjectionMatrix(projectionMatrix);
 }
 
 void Dragon2Widget::mousePressEvent( QMouseEvent * e )
@@ -260,13 +259,9 @@ void Dragon2Widget::mouseMoveEvent( QMouseEvent * e )
     if(e->buttons() != Qt::NoButton)
     {
         setCursor(Qt::ClosedHandCursor);
-        auto t = (e->pos() - _lastMousePos);
-        QMatrix4x4 rotMat;
-        rotMat.rotate(-t.x() / 10.0 * M_PI, 0, 1, 0);
-        rotMat.rotate(t.y() / 10.0 * M_PI, 1, 0, 0);
-        _modelMatrix = rotMat * _modelMatrix;
+        // the rotation is applied by the next frame, together with the other moves until then
+        _frameScheduler.addDrag(e->pos() - _lastMousePos);
         _lastMousePos = e->pos();
-        update();
     }
 }
 
@@ -277,48 +272,85 @@ void Dragon2Widget::mouseReleaseEvent( QMouseEvent * e )
 
 void Dragon2Widget::wheelEvent( QWheelEvent * e )
 {
-    _modelMatrix.scale(exp(e->delta() / 1000.0));
-    update();
+    _frameScheduler.addWheel(e->delta());
+}
+
+void Dragon2Widget::keyPressEvent( QKeyEvent * e )
+{
+    // the shader features (and the ray tracer) are toggled by the next frame, which compiles the new variant on its first use
+    if (e->key() == Qt::Key_L || e->key() == Qt::Key_N || e->key() == Qt::Key_R) {
+        _frameScheduler.addKey(e->key());
+    } else {
+        QGLWidget::keyPressEvent(e);
+    }
+}
+
+SoftwareMesh Dragon2Widget::softwareMesh(const QSize & viewportSize) const
+{
+    SoftwareMesh mesh;
+    mesh.positions.reserve(_vertices.size());
+    mesh.normals.reserve(_vertices.size());
+    mesh.colors.reserve(_vertices.size());
+    for (int i = 0; i < _vertices.size(); i++) {
+        QVector3D position = _vertices.position(i), normal = _vertices.normal(i);
+        mesh.positions << position;
+        mesh.normals << normal;
+        mesh.colors << MeshShader::shade(_shaderFeatures, normal, position, 1.0f, _modelMatrix);
+    }
+    mesh.indices = _triangleIndices;
+
+    mesh.modelMatrix = _modelMatrix;
+    mesh.viewMatrix = _frameUniforms.viewMatrix();
+    // as set by resizeGL
+    mesh.projectionMatrix.perspective(30, (float)viewportSize.width() / viewportSize.height(), 0.01f, 1e5f);
+    mesh.clearColor = Qt::white;
+    return mesh;
 }
 
 void Dragon2Widget::loadMesh( const QString & f )
 {
-    _vertices.clear();
-    _triangleIndices.clear();
-    QFile file(f);
-    if(file.open(QFile::ReadOnly))
-    {
-        QTextStream ts(&file);
-        ts.readLine();
-        QString token;
-        while(true)
-        {
-            ts >> token;
-            if(token == "v")
-            {
-                double x, y, z;
-                ts >> x >> y >> z;
-                Vertex v = {QVector3D(x, y, z), QVector3D(0, 0, 0)};
-                _vertices << v;
-            }else if (token == "f")
-            {
-                int a, b, c;
-                ts >> a >> b >> c;
-                _triangleIndices << (a-1) << (b-1) << (c-1);
-                QVector3D normal = QVector3D::crossProduct(
-                    _vertices[a-1].position - _vertices[b-1].position, 
-                    _vertices[c-1].position - _vertices[b-1].position).normalized();
-                _vertices[a-1].normal += normal;
-                _vertices[b-1].normal += normal;
-                _vertices[c-1].normal += normal;
-            }else
-            {
-                break;
-            }
+    PROFILE_SCOPE("Dragon2Widget::loadMesh");
+    _meshFile = f;
+    SmfMesh mesh = SmfMesh::load(f);
+    _vertices.assign(mesh.positions, mesh.normals);
+    _triangleIndices = mesh.indices;
+    MemoryTracker::set(MemoryTracker::Cpu, objectName(), "vertices", _vertices.bytes());
+    MemoryTracker::set(MemoryTracker::Cpu, objectName(), "indices", memoryBytes(_triangleIndices));
+}
+
+QString Dragon2Widget::vertexBufferAsset() const
+{
+    return _meshFile + ((_shaderFeatures & MeshShader::QuantizedAttributes) ? 
+        ":quantized vertices" : ":vertices");
+}
+
+void Dragon2Widget::computePositionRange()
+{
+    // compute the bounds of the mesh
+    QVector3D minCorner, maxCorner;
+    _vertices.bounds(&minCorner, &maxCorner);
+    _positionOffset = (minCorner + maxCorner) / 2;
+    _positionScale = (maxCorner - minCorner) / 2;
+    for (int k = 0; k < 3; k++) {
+        if (_positionScale[k] <= 0) {
+            _positionScale[k] = 1;
         }
-        for(auto & v : _vertices)
-        {
-            v.normal = -v.normal.normalized();
+    }
+}
+
+QVector<Dragon2Widget::QuantizedVertex> Dragon2Widget::quantizeVertices()
+{
+    // map positions to [-32767, 32767] and normals to [-127, 127]
+    QVector<QuantizedVertex> quantizedVertices(_vertices.size());
+    for (int i = 0; i < _vertices.size(); i++) {
+        QVector3D p = (_vertices.position(i) - _positionOffset) / _positionScale;
+        QVector3D n = _vertices.normal(i);
+        for (int k = 0; k < 3; k++) {
+            quantizedVertices[i].position[k] = GLshort(qRound(qBound(-1.0f, p[k], 1.0f) * 32767));
+            quantizedVertices[i].normal[k] = GLbyte(qRound(qBound(-1.0f, n[k], 1.0f) * 127));
         }
+        quantizedVertices[i].position[3] = 0;
+        quantizedVertices[i].normal[3] = 0;
     }
+    return quantizedVertices;
 }
@@ -2,12 +2,23 @@
 
 #include <QtOpenGL>
 
-class Dragon2Widget : public QGLWidget, public QGLFunctions
+#include "frameuniforms.h"
+#include "framescheduler.h"
+#include "glstatecache.h"
+#include "meshshader.h"
+#include "soamesh.h"
+#include "softwarescene.h"
+#include "softwareraytracer.h"
+
+class Dragon2Widget : public QGLWidget, public QGLFunctions, public SoftwareScene
 {
 public:
-    Dragon2Widget(QWidget *parent = nullptr);
+    Dragon2Widget(QWidget *parent = nullptr, const QGLWidget * shareWidget = nullptr);
     ~Dragon2Widget();
 
+    // the loaded mesh, shaded like the current shader variant
+    virtual SoftwareMesh softwareMesh(const QSize & viewportSize) const override;
+
 protected:
     // opengl methods
     virtual void initializeGL() override;
@@ -21,20 +32,37 @@ protected:
     virtual void mouseReleaseEvent(QMouseEvent * e) override;
     virtual void wheelEvent(QWheelEvent * e) override;
 
+    // key event handler (toggles shader features)
+    virtual void keyPressEvent(QKeyEvent * e) override;
+
     // load mesh
     void loadMesh(const QString & file);
 
+    // paint the mesh with the ray tracer instead of the shader, one more sample per frame
+    void paintRayTraced();
+
 private:
     QMatrix4x4 _modelMatrix;
 
-    // mesh data
-    struct Vertex // data of each vertex
+    // mesh data, as arrays of each component (interleaved by interleave() when uploaded)
+    SoaMesh _vertices; // positions and normals of all vertices
+    QVector<quint32> _triangleIndices; // indices of vertices for drawing triangles
+
+    // compact vertex data used with MeshShader::QuantizedAttributes
+    struct QuantizedVertex
     {
-        QVector3D position;
-        QVector3D normal;
+        GLshort position[4]; // normalized position within the mesh bounds (padded to 8 bytes)
+        GLbyte normal[4];    // normalized normal (padded to 4 bytes)
     };
-    QVector<Vertex> _vertices; // data of all vertices
-    QVector<quint32> _triangleIndices; // indices of vertices for drawing triangles
+    // compute _positionScale and _positionOffset from the bounds of _vertices
+    void computePositionRange();
+    // quantize _vertices into the range of _positionScale and _positionOffset
+    QVector<QuantizedVertex> quantizeVertices();
+    QVector3D _positionScale, _positionOffset;
+
+    // the loaded mesh file, and the name of the vertex buffer in GLResourceRegistry
+    QString _meshFile;
+    QString vertexBufferAsset() const;
 
 
     // buffer for storing the _vertices data on GPU
@@ -42,10 +70,25 @@ private:
     // buffer for storing the _triangleIndices data on GPU
     GLuint _triangleIndicesBuffer;
 
-    // id of the OpenGL shader program
+    // the variants of the shader, the features in use and the id of the current program
+    QSharedPointer<MeshShader> _meshShader;
+    quint32 _shaderFeatures;
     GLuint _program;
+    // the matrices shared with the shader program through FrameBlock
+    FrameUniforms _frameUniforms;
     // location of uniform variables in the OpenGL shader program 
-    GLuint _modelMatrixLocation, _viewMatrixLocation, _projectionMatrixLocation;
+    GLuint _positionScaleLocation, _positionOffsetLocation;
+
+    // the shadowed OpenGL state of this widget's context
+    GLStateCache _glState;
+
+    // accumulates the mouse input between frames and paces the repaints
+    FrameScheduler _frameScheduler;
+
+    // the CPU ray tracer toggled by the R key, created on its first use
+    QScopedPointer<SoftwareRayTracer> _rayTracer;
+    bool _rayTracing;
+    QSize _viewportSize;
 
 private:
     QPointF _lastMousePos;
@@ -1,9 +1,16 @@
+#include "drawstats.h"
+#include "memorytracker.h"
+#include "profiler.h"
+
 #include "dragonwidget.h"
 
-DragonWidget::DragonWidget(QWidget *parent)
-    : QGLWidget(parent)
+#include "glcapturecalls.h"
+
+DragonWidget::DragonWidget(QWidget *parent, const QGLWidget * shareWidget)
+    : QGLWidget(parent, shareWidget), _frameScheduler(this)
 {
     setWindowTitle(tr("3. Dragon"));
+    setObjectName("dragon");
     setMinimumSize(200, 200);
     setMouseTracking(true);
     setFocusPolicy(Qt::ClickFocus);
@@ -18,26 +25,46 @@ DragonWidget::DragonWidget(QWidget *parent)
 }
 
 DragonWidget::~DragonWidget()
-{}
+{
+    MemoryTracker::clear(MemoryTracker::Cpu, objectName());
+}
 
 
 void DragonWidget::initializeGL()
 {
+    PROFILE_SCOPE("DragonWidget::initializeGL");
     makeCurrent();
+    _glState.initialize(context());
 }
 
 void DragonWidget::paintGL()
 {
+    PROFILE_GL_SCOPE("DragonWidget::paintGL");
+
+    // apply the input accumulated since the last frame
+    QPointF t = _frameScheduler.takeDrag();
+    if (!t.isNull()) {
+        QMatrix4x4 rotMat;
+        rotMat.rotate(-t.x() / 10.0 * M_PI, 0, 1, 0);
+        rotMat.rotate(t.y() / 10.0 * M_PI, 1, 0, 0);
+        _modelMatrix = rotMat * _modelMatrix;
+    }
+    int wheel = _frameScheduler.takeWheel();
+    if (wheel != 0) {
+        _modelMatrix.scale(exp(wheel / 1000.0));
+    }
+
     makeCurrent();
 
-    qglClearColor(Qt::white);
+    _glState.clearColor(Qt::white);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_ALPHA_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glShadeModel(GL_SMOOTH);
+    // set states (only the changed ones reach OpenGL)
+    _glState.enable(GL_DEPTH_TEST);
+    _glState.enable(GL_ALPHA_TEST);
+    _glState.enable(GL_BLEND);
+    _glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    _glState.shadeModel(GL_SMOOTH);
     
     // set model-view matrix
     glMatrixMode(GL_MODELVIEW);
@@ -53,7 +80,7 @@ void DragonWidget::paintGL()
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
     QMatrix4x4 projectionMatrix;
-    projectionMatrix.perspective(30.0f, (float)width() / height(), 0.01f, 1e5f);
+    projectionMatrix.perspective(30.0f, (float)_viewportSize.width() / _viewportSize.height(), 0.01f, 1e5f);
     glMultMatrixf(projectionMatrix.data());
 
     // draw mesh
@@ -64,16 +91,13 @@ void DragonWidget::paintGL()
         glVertex3fv(&(_vertices[vid].position[0]));
     }
     glEnd();    
-
-
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_ALPHA_TEST);
-    glDisable(GL_BLEND);
+    DrawStats::count(GL_TRIANGLES, _triangleIndices.size());
 } 
 
 void DragonWidget::resizeGL( int w, int h )
 {
     glViewport(0, 0, w, h);
+    _viewportSize = QSize(w, h);
 }
 
 void DragonWidget::mousePressEvent( QMouseEvent * e )
@@ -87,13 +111,9 @@ void DragonWidget::mouseMoveEvent( QMouseEvent * e )
     if(e->buttons() != Qt::NoButton)
     {
         setCursor(Qt::ClosedHandCursor);
-        auto t = (e->pos() - _lastMousePos);
-        QMatrix4x4 rotMat;
-        rotMat.rotate(-t.x() / 10.0 * M_PI, 0, 1, 0);
-        rotMat.rotate(t.y() / 10.0 * M_PI, 1, 0, 0);
-        _modelMatrix = rotMat * _modelMatrix;
+        // the rotation is applied by the next frame, together with the other moves until then
+        _frameScheduler.addDrag(e->pos() - _lastMousePos);
         _lastMousePos = e->pos();
-        update();
     }
 }
 
@@ -104,12 +124,12 @@ void DragonWidget::mouseReleaseEvent( QMouseEvent * e )
 
 void DragonWidget::wheelEvent( QWheelEvent * e )
 {
-    _modelMatrix.scale(exp(e->delta() / 1000.0));
-    update();
+    _frameScheduler.addWheel(e->delta());
 }
 
 void DragonWidget::loadMesh( const QString & f )
 {
+    PROFILE_SCOPE("DragonWidget::loadMesh");
     _vertices.clear();
     _triangleIndices.clear();
     QFile file(f);
@@ -148,4 +168,6 @@ void DragonWidget::loadMesh( const QString & f )
             v.normal = -v.normal.normalized();
         }
     }
+    MemoryTracker::set(MemoryTracker::Cpu, objectName(), "vertices", memoryBytes(_vertices));
+    MemoryTracker::set(MemoryTracker::Cpu, objectName(), "indices", memoryBytes(_triangleIndices));
 }
@@ -2,10 +2,13 @@
 
 #include <QtOpenGL>
 
+#include "framescheduler.h"
+#include "glstatecache.h"
+
 class DragonWidget : public QGLWidget
 {
 public:
-    DragonWidget(QWidget *parent = nullptr);
+    DragonWidget(QWidget *parent = nullptr, const QGLWidget * shareWidget = nullptr);
     ~DragonWidget();
 
 protected:
@@ -26,6 +29,9 @@ protected:
 
 private:
     QMatrix4x4 _modelMatrix;
+
+    // the size of the last resizeGL, used for the projection
+    QSize _viewportSize;
     
     // mesh data
     struct Vertex // data of each vertex
@@ -36,6 +42,12 @@ private:
     QVector<Vertex> _vertices; // data of all vertices
     QVector<quint32> _triangleIndices; // indices of vertices for drawing triangles
 
+    // the shadowed OpenGL state of this widget's context
+    GLStateCache _glState;
+
+    // accumulates the mouse input between frames and paces the repaints
+    FrameScheduler _frameScheduler;
+
 private:
     QPointF _lastMousePos;
 };
@@ -0,0 +1,40 @@
+#include "drawstats.h"
+
+static QAtomicInteger<qint64> totalDrawCalls;
+static QAtomicInteger<qint64> totalTriangles;
+
+// number of triangles rasterized for the vertices of one draw call
+static qint64 triangleCount(GLenum mode, qint64 vertexCount)
+{
+    switch (mode) {
+    case GL_TRIANGLES:
+        return vertexCount / 3;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN:
+    case GL_POLYGON:
+        return qMax<qint64>(vertexCount - 2, 0);
+    case GL_QUADS:
+        return vertexCount / 4 * 2;
+    case GL_QUAD_STRIP:
+        return qMax<qint64>(vertexCount - 2, 0) / 2 * 2;
+    default:
+        // points and lines
+        return 0;
+    }
+}
+
+void DrawStats::count(GLenum mode, qint64 vertexCount)
+{
+    totalDrawCalls.fetchAndAddRelaxed(1);
+    totalTriangles.fetchAndAddRelaxed(triangleCount(mode, vertexCount));
+}
+
+qint64 DrawStats::drawCalls()
+{
+    return totalDrawCalls.load();
+}
+
+qint64 DrawStats::triangles()
+{
+    return totalTriangles.load();
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <QtOpenGL>
+
+// counters of the draw calls and triangles submitted by all the scenes
+// each glEnd / glDraw* of the widgets is followed by a call to count(), 
+// readers (status bar, benchmark) take differences of the totals between frames
+class DrawStats
+{
+public:
+    // count one draw call of 'vertexCount' vertices in the primitive 'mode'
+    static void count(GLenum mode, qint64 vertexCount);
+
+    static qint64 drawCalls();
+    static qint64 triangles();
+};
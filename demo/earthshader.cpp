@@ -0,0 +1,84 @@
+#include "earthshader.h"
+
+// the source code of vertex shader
+static const char * vshaderSource =
+    "#version 120\n"                    // the version of this shader (feature defines are injected after it)
+    "attribute vec3 gridPoint;\n"       // (u, v) in the patch, and 1 on its skirt
+    "uniform vec3 patchCorner;\n"       // the corner of the patch on the cube
+    "uniform vec3 patchAxisU;\n"        // its edges
+    "uniform vec3 patchAxisV;\n"
+    "uniform float skirtDepth;\n"       // how deep its skirt hangs, in radii
+    "varying vec3 direction;\n"         // the point of the unit sphere
+    "varying vec4 litColor;\n"          // the color of the lighting on this vertex
+    "void main(void)\n"
+    "{\n"
+    "    direction = normalize(patchCorner + gridPoint.x * patchAxisU + gridPoint.y * patchAxisV);\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(direction * (1.0 - gridPoint.z * skirtDepth), 1.0);\n"
+
+    // the normal is scaled by the inverse of the model matrix scale, which the material compensates
+    "    vec3 normal = gl_NormalMatrix * direction;\n"
+    "    vec3 light = normalize(gl_LightSource[0].position.xyz);\n"
+    "    float diffuse = max(dot(normal, light), 0.0);\n"
+    "    vec4 color = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient +\n"
+    "        gl_FrontLightProduct[0].diffuse * diffuse;\n"
+    "    if (diffuse > 0.0) {\n"
+    "        vec3 halfVector = normalize(light + vec3(0.0, 0.0, 1.0));\n"
+    "        color += gl_FrontLightProduct[0].specular *\n"
+    "            pow(max(dot(normal, halfVector), 0.0), gl_FrontMaterial.shininess);\n"
+    "    }\n"
+    "    litColor = clamp(color, 0.0, 1.0);\n"
+    "}\n";
+
+// the source code of fragment shader
+static const char * fshaderSource =
+    "#version 120\n"                    // the version of this shader (feature defines are injected after it)
+    "#ifdef TILE_ARRAY\n"
+    "#extension GL_EXT_texture_array : require\n" // for sampler2DArray
+    "uniform sampler2DArray tiles;\n"   // the layers of TileCache
+    "uniform vec3 tileRect;\n"
+    "uniform vec3 tileOrigin;\n"
+    "uniform float tileScale;\n"
+    "#else\n"
+    "uniform sampler2D earthMap;\n"
+    "#endif\n"
+    "varying vec3 direction;\n"
+    "varying vec4 litColor;\n"
+    "const float pi = 3.14159265;\n"
+    "void main(void)\n"
+    "{\n"
+    // the point of the earth map, in [0, 1] from its top left corner, computed per fragment so that
+    // the patches need not follow the date line
+    "    vec3 d = normalize(direction);\n"
+    "    vec2 mapCoord = vec2(fract(-atan(d.z, d.x) / (2.0 * pi)), 0.5 - asin(d.y) / pi);\n"
+    "#ifdef TILE_ARRAY\n"
+    // the other tiles draw the rest of the patch
+    "    vec2 inTile = (mapCoord - tileRect.xy) * vec2(tileRect.z, tileRect.z * 0.5);\n"
+    "    if (any(lessThan(inTile, vec2(0.0))) || any(greaterThan(inTile, vec2(1.0)))) {\n"
+    "        discard;\n"
+    "    }\n"
+    // the layers are flipped vertically like the other textures, the tiles are not
+    "    vec2 coord = tileOrigin.xy + inTile * tileScale;\n"
+    "    vec4 color = texture2DArray(tiles, vec3(coord.x, 1.0 - coord.y, tileOrigin.z));\n"
+    "#else\n"
+    // the longitude wraps from 1 to 0 across the date line, which would select the smallest mipmap there:
+    // it is taken in [-0.5, 0.5) instead, the map repeats
+    "    float wrapped = fract(mapCoord.x + 0.5) - 0.5;\n"
+    "    if (fwidth(wrapped) < fwidth(mapCoord.x)) {\n"
+    "        mapCoord.x = wrapped;\n"
+    "    }\n"
+    "    vec4 color = texture2D(earthMap, vec2(mapCoord.x, 1.0 - mapCoord.y));\n"
+    "#endif\n"
+    // modulated by the lighting, like GL_MODULATE
+    "    gl_FragColor = color * litColor;\n"
+    "}\n";
+
+// the macros of EarthShader::Feature, in the order of their bits
+static const QVector<QByteArray> featureDefines = {
+    "TILE_ARRAY"
+};
+
+EarthShader::EarthShader()
+    : ShaderVariants(vshaderSource, fshaderSource, featureDefines)
+{
+    bindAttributeLocation(0, "gridPoint");
+}
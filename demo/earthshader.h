@@ -0,0 +1,21 @@
+#pragma once
+
+#include "shadervariants.h"
+
+// the shader of EarthWidget: the sphere is drawn one CubeSphere patch at a time, lit like the fixed pipeline
+// (material and GL_LIGHT0, per vertex, without GL_NORMALIZE)
+// the vertices are the shared grid of CubeSphere (attribute 0, "gridPoint"), placed on the cube by "patchCorner",
+// "patchAxisU" and "patchAxisV", then pushed onto the sphere, and the skirt "skirtDepth" below it
+class EarthShader : public ShaderVariants
+{
+public:
+    enum Feature {
+        // the map is the texture array "tiles" of a TileCache, and each draw textures the part of the patch
+        // in one tile: "tileRect" (the top left corner of the tile in the map, and the columns of its zoom),
+        // "tileOrigin" (its corner in the layer, and the layer) and "tileScale" (its size in the layer);
+        // without it the map is the whole texture "earthMap"
+        TileArray = 0x01
+    };
+
+    EarthShader();
+};
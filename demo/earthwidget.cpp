@@ -1,11 +1,33 @@
+#include "drawstats.h"
+#include "glresourceregistry.h"
+#include "memorytracker.h"
+#include "profiler.h"
+
 #include "earthwidget.h"
 
-static const int M = 128, N = 256;
+#include "glcapturecalls.h"
+
+#ifndef GL_TEXTURE_2D_ARRAY
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#endif
+
+// the tiles drawn by a frame at most, well below the layers of the cache so that they all fit in it
+static const int maxDrawnTiles = 96;
+
+// how far the patches may be from the sphere on screen, and how many are drawn at most
+static const float maxPixelError = 0.5f;
+static const int maxPatches = 512;
 
-EarthWidget::EarthWidget(QWidget *parent)
-    : QGLWidget(parent)
+// the names of the earth texture and of the patch grid in GLResourceRegistry
+static const char * earthMapAsset = ":/images/earthmap.jpg";
+static const char * gridAsset = "EarthWidget:grid";
+static const char * gridIndicesAsset = "EarthWidget:gridIndices";
+
+EarthWidget::EarthWidget(QWidget *parent, const QGLWidget * shareWidget)
+    : QGLWidget(parent, shareWidget), _frameScheduler(this)
 {
     setWindowTitle(tr("4. Earth"));
+    setObjectName("earth");
     setMinimumSize(200, 200);
     setMouseTracking(true);
 
@@ -17,86 +39,290 @@ EarthWidget::EarthWidget(QWidget *parent)
     // initialize projection matrix data
     _projectionMatrix.setToIdentity();
     _projectionMatrix.ortho(-width()/2.0, width()/2.0, -height()/2.0, height()/2.0, -1e4, 1e4);
+
+    // the imagery is streamed tile by tile where texture arrays are supported (see initializeGL())
+    _tiles.setSource(TileSource::create(TileSource::defaultLocation()), &_frameScheduler);
+    _useTiles = false;
+    _earthShader = qSharedPointerCast<EarthShader>(GLResourceRegistry::instance().shaderVariants(
+        "EarthShader", [] { return new EarthShader; }));
+    _program = -1;
+    _patchCornerLocation = -1;
+    _patchAxisULocation = -1;
+    _patchAxisVLocation = -1;
+    _skirtDepthLocation = -1;
+    _mapLocation = -1;
+    _tileRectLocation = -1;
+    _tileOriginLocation = -1;
+    _tileScaleLocation = -1;
+
+    // the grid placed on every patch
+    CubeSphere::grid(&_grid, &_gridIndices);
+    MemoryTracker::set(MemoryTracker::Cpu, objectName(), "grid", memoryBytes(_grid) + memoryBytes(_gridIndices));
+    _gridBuffer = 0;
+    _gridIndicesBuffer = 0;
 }
 
 EarthWidget::~EarthWidget()
-{}
+{
+    // take the context back from the render thread, if any
+    _frameScheduler.stopRendering();
+
+    // drop the references to the shared grid and texture, delete the tiles
+    if (_gridBuffer != 0) {
+        makeCurrent();
+        GLResourceRegistry & resources = GLResourceRegistry::instance();
+        _texture.release();
+        _tiles.release();
+        resources.release(GLResourceRegistry::Buffer, gridAsset);
+        resources.release(GLResourceRegistry::Buffer, gridIndicesAsset);
+        _earthShader.clear();
+    }
+    MemoryTracker::clear(MemoryTracker::Cpu, objectName());
+}
 
 void EarthWidget::initializeGL()
 {
+    PROFILE_SCOPE("EarthWidget::initializeGL");
     makeCurrent();
-    buildModel();
+    initializeGLFunctions(context());
+    _glState.initialize(context());
+
+    // reuse the grid if another widget of the share group already uploaded it
+    GLResourceRegistry & resources = GLResourceRegistry::instance();
+    _gridBuffer = resources.acquireOrCreate(GLResourceRegistry::Buffer, gridAsset, [&](qint64 * bytes) {
+        GLuint buffer = 0;
+        glGenBuffers(1, &buffer);
+        _glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+        *bytes = sizeof(_grid.first()) * _grid.size();
+        glBufferData(GL_ARRAY_BUFFER, *bytes, _grid.data(), GL_STATIC_DRAW);
+        return buffer;
+    });
+    _gridIndicesBuffer = resources.acquireOrCreate(GLResourceRegistry::Buffer, gridIndicesAsset, [&](qint64 * bytes) {
+        GLuint buffer = 0;
+        glGenBuffers(1, &buffer);
+        _glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+        *bytes = sizeof(_gridIndices.first()) * _gridIndices.size();
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, *bytes, _gridIndices.data(), GL_STATIC_DRAW);
+        return buffer;
+    });
+
+    _useTiles = _tiles.initialize(context(), _glState);
+    if (!_useTiles) {
+        // the sphere appears when the map is uploaded (as BC1 blocks, 1/8 of the texels)
+        _texture.load(earthMapAsset, &_frameScheduler, true, TextureLoader::ColorBC1);
+    }
 }
     
 void EarthWidget::paintGL()
 {
-    qglClearColor(Qt::black);
+    PROFILE_GL_SCOPE("EarthWidget::paintGL");
+
+    // apply the input accumulated since the last frame
+    QPointF t = _frameScheduler.takeDrag();
+    if (!t.isNull()) {
+        QMatrix4x4 rotMat;
+        rotMat.rotate(t.x() / 10.0 * M_PI, 0, 1, 0);
+        rotMat.rotate(t.y() / 10.0 * M_PI, 1, 0, 0);
+        _modelMatrix = rotMat * _modelMatrix;
+    }
+    int wheel = _frameScheduler.takeWheel();
+    if (wheel != 0) {
+        _modelMatrix.scale(exp(wheel / 1000.0));
+    }
+
+    _glState.clearColor(Qt::black);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_ALPHA_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // set states (only the changed ones reach OpenGL)
+    _glState.enable(GL_DEPTH_TEST);
+    _glState.enable(GL_ALPHA_TEST);
+    _glState.enable(GL_BLEND);
+    _glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
-    // enable and bind texture
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, _textureId);
+    // the texture is read by the shader from the texture group 0
+    _glState.activeTexture(GL_TEXTURE0);
 
     static GLfloat mat_diffuse[] = {100, 100, 100, 100};
     static GLfloat mat_ambient[] = {0.f, .5f, .5f, .5f};
     static GLfloat mat_specular[] = {100, 100, 100, 100};
     static GLfloat mat_shininess = 100.0f;
 
-    // set material of the model
-    glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-    glMaterialf(GL_FRONT, GL_SHININESS, mat_shininess);
+    // set material of the model (uploaded only if it changed)
+    _glState.material(GL_FRONT, GL_AMBIENT, mat_ambient);
+    _glState.material(GL_FRONT, GL_DIFFUSE, mat_diffuse);
+    _glState.material(GL_FRONT, GL_SPECULAR, mat_specular);
+    _glState.material(GL_FRONT, GL_SHININESS, mat_shininess);
 
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
+    _glState.enable(GL_LIGHTING);
+    _glState.enable(GL_LIGHT0);
 
     // setup projection matrix
     glMatrixMode(GL_PROJECTION);
     glLoadMatrixf(_projectionMatrix.data());
 
-    // set position of the light
+    // set position of the light in eye coordinates, it is transformed by the current modelview matrix,
+    // which is always identity here, so _glState can skip it after the first frame
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
     static GLfloat lightPosition[4] = { 1, 1, 1, 0.0 };
-    glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
+    _glState.light(GL_LIGHT0, GL_POSITION, lightPosition);
 
     // setup model matrix (ignore the "view matrix" here)
-    glMatrixMode(GL_MODELVIEW);
     glLoadMatrixf(_modelMatrix.data());
 
-    // draw the sphere
-    glBegin(GL_QUADS);
-    for (int i = 1; i < M; i++) {
-        for (int j = 1; j < N; j++){
-            glNormal3fv(&(_normals[_vertIds[i][j]][0]));
-            glTexCoord2fv(&(_texCoords[_vertIds[i][j]][0]));
-            glVertex4fv(&(_vertexPositions[_vertIds[i][j]][0]));
-
-            glNormal3fv(&(_normals[_vertIds[i][j-1]][0]));
-            glTexCoord2fv(&(_texCoords[_vertIds[i][j-1]][0]));
-            glVertex4fv(&(_vertexPositions[_vertIds[i][j-1]][0]));
-
-            glNormal3fv(&(_normals[_vertIds[i-1][j-1]][0]));
-            glTexCoord2fv(&(_texCoords[_vertIds[i-1][j-1]][0]));
-            glVertex4fv(&(_vertexPositions[_vertIds[i-1][j-1]][0]));
-
-            glNormal3fv(&(_normals[_vertIds[i-1][j]][0]));
-            glTexCoord2fv(&(_texCoords[_vertIds[i-1][j]][0]));
-            glVertex4fv(&(_vertexPositions[_vertIds[i-1][j]][0]));
+    // the shader variant of the map, compiled on its first use
+    ShaderProgram * program = _earthShader->variant(_useTiles ? EarthShader::TileArray : 0);
+    if (!program && _useTiles) {
+        // the whole map is drawn from the next frames
+        _useTiles = false;
+        _tiles.release();
+        _texture.load(earthMapAsset, &_frameScheduler, true, TextureLoader::ColorBC1);
+        return;
+    }
+    if (!program) {
+        return;
+    }
+    if (program->programId() != _program) {
+        // get locations of uniform variable from the linked program
+        _program = program->programId();
+        _patchCornerLocation = program->uniformLocation("patchCorner");
+        _patchAxisULocation = program->uniformLocation("patchAxisU");
+        _patchAxisVLocation = program->uniformLocation("patchAxisV");
+        _skirtDepthLocation = program->uniformLocation("skirtDepth");
+        _mapLocation = program->uniformLocation(_useTiles ? "tiles" : "earthMap");
+        _tileRectLocation = _useTiles ? program->uniformLocation("tileRect") : -1;
+        _tileOriginLocation = _useTiles ? program->uniformLocation("tileOrigin") : -1;
+        _tileScaleLocation = _useTiles ? program->uniformLocation("tileScale") : -1;
+    }
+
+    // the patches refined for the current scale and orientation
+    QVector<SpherePatch> patches = CubeSphere::select(_modelMatrix, size(), maxPixelError, maxPatches);
+
+    // the tiles of the zoom where a texel covers about a pixel at the equator: the projection is in pixels,
+    // so the model matrix scales the unit sphere to its radius on screen
+    QVector<TileId> tiles;
+    QVector<int> layers;
+    QVector<QRectF> areas;
+    if (_useTiles) {
+        float radius = QVector3D(_modelMatrix.column(0)).length();
+        int zoom = qBound(0, int(std::ceil(std::log2(2 * M_PI * radius / TileSource::TileSize))) - 1,
+            _tiles.source()->maxZoom());
+        for (int x = 0; x < TileId::columns(0); x++) {
+            selectTiles(TileId(0, x, 0), zoom, tiles);
+        }
+
+        // the layers of the tiles, or of their ancestors until they are streamed in
+        layers.resize(tiles.size());
+        areas.resize(tiles.size());
+        _tiles.beginFrame();
+        for (int i = 0; i < tiles.size(); i++) {
+            layers[i] = _tiles.lookup(tiles[i], &areas[i]);
+        }
+        _tiles.endFrame();
+        _glState.bindTexture(GL_TEXTURE_2D_ARRAY, _tiles.textureId());
+    } else {
+        _glState.bindTexture(GL_TEXTURE_2D, _texture.update(context(), _glState));
+    }
+
+    // use the OpenGL shader program for painting
+    _glState.useProgram(_program);
+    if (program->claimUniforms(this)) {
+        glUniform1i(_mapLocation, 0);
+    }
+
+    //// set attributes data
+    _glState.bindBuffer(GL_ARRAY_BUFFER, _gridBuffer);
+    _glState.enableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(_grid.first()), 0);
+    _glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _gridIndicesBuffer);
+
+    //// draw calls
+    for (const SpherePatch & patch : patches) {
+        if (!_useTiles) {
+            drawPatch(patch);
+            continue;
+        }
+        // once per tile it overlaps, which textures its part of the patch
+        QRectF bounds = CubeSphere::mapBounds(patch);
+        for (int i = 0; i < tiles.size(); i++) {
+            QRectF rect = tiles[i].rect();
+            bool overlaps = false;
+            for (int wrap = -1; wrap <= 1; wrap++) {
+                overlaps |= rect.translated(wrap, 0).intersects(bounds);
+            }
+            if (layers[i] < 0 || !overlaps) {
+                continue;
+            }
+            glUniform3f(_tileRectLocation, rect.x(), rect.y(), TileId::columns(tiles[i].zoom));
+            glUniform3f(_tileOriginLocation, areas[i].x(), areas[i].y(), layers[i]);
+            glUniform1f(_tileScaleLocation, areas[i].width());
+            drawPatch(patch);
+        }
+    }
+
+    //// finalize
+    // states and bindings are left as they are, _glState skips setting them again in the next frame
+}
+
+void EarthWidget::drawPatch(const SpherePatch & patch)
+{
+    QVector3D corner = patch.cubePoint(0, 0);
+    QVector3D axisU = patch.cubePoint(1, 0) - corner, axisV = patch.cubePoint(0, 1) - corner;
+    glUniform3f(_patchCornerLocation, corner.x(), corner.y(), corner.z());
+    glUniform3f(_patchAxisULocation, axisU.x(), axisU.y(), axisU.z());
+    glUniform3f(_patchAxisVLocation, axisV.x(), axisV.y(), axisV.z());
+    glUniform1f(_skirtDepthLocation, CubeSphere::skirtDepth(patch));
+    glDrawElements(GL_TRIANGLES, _gridIndices.size(), GL_UNSIGNED_INT, 0);
+    DrawStats::count(GL_TRIANGLES, _gridIndices.size());
+}
+
+void EarthWidget::selectTiles(const TileId & tile, int zoom, QVector<TileId> & tiles) const
+{
+    if (!isTileVisible(tile)) {
+        return;
+    }
+    if (tile.zoom >= zoom || tiles.size() + 4 > maxDrawnTiles) {
+        tiles << tile;
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        selectTiles(tile.child(i), zoom, tiles);
+    }
+}
+
+bool EarthWidget::isTileVisible(const TileId & tile) const
+{
+    // the halves of the earth are always partly visible
+    if (tile.zoom == 0) {
+        return true;
+    }
+    // 3 x 3 points of the tile: one facing the viewer (with some slack, the tile bulges between them)
+    // and their bounds, in pixels from the center of the viewport, overlapping the viewport
+    QRectF rect = tile.rect();
+    bool facing = false;
+    float left = FLT_MAX, right = -FLT_MAX, bottom = FLT_MAX, top = -FLT_MAX;
+    for (int i = 0; i <= 2; i++) {
+        for (int j = 0; j <= 2; j++) {
+            QVector3D p = CubeSphere::spherePoint(
+                QPointF(rect.left() + rect.width() * i / 2, rect.top() + rect.height() * j / 2));
+            facing |= _modelMatrix.mapVector(p).normalized().z() > -0.3f;
+            QVector3D eye = _modelMatrix.map(p);
+            left = qMin(left, eye.x());
+            right = qMax(right, eye.x());
+            bottom = qMin(bottom, eye.y());
+            top = qMax(top, eye.y());
         }
     }
-    glEnd();    
+    float margin = qMax(right - left, top - bottom) * 0.25f;
+    return facing && left - margin < width() / 2.0f && right + margin > -width() / 2.0f &&
+        bottom - margin < height() / 2.0f && top + margin > -height() / 2.0f;
 }
 
 void EarthWidget::resizeGL( int w, int h )
 {
     glViewport(0, 0, w, h);
     _projectionMatrix.setToIdentity();
-    _projectionMatrix.ortho(-width()/2.0, width()/2.0, -height()/2.0, height()/2.0, -1e4, 1e4);
+    _projectionMatrix.ortho(-w/2.0, w/2.0, -h/2.0, h/2.0, -1e4, 1e4);
 }
 
 void EarthWidget::mousePressEvent( QMouseEvent * e )
@@ -110,13 +336,9 @@ void EarthWidget::mouseMoveEvent( QMouseEvent * e )
     if(e->buttons() != Qt::NoButton)
     {
         setCursor(Qt::ClosedHandCursor);
-        auto t = (e->pos() - _lastMousePos);
-        QMatrix4x4 rotMat;
-        rotMat.rotate(t.x() / 10.0 * M_PI, 0, 1, 0);
-        rotMat.rotate(t.y() / 10.0 * M_PI, 1, 0, 0);
-        _modelMatrix = rotMat * _modelMatrix;
+        // the rotation is applied by the next frame, together with the other moves until then
+        _frameScheduler.addDrag(e->pos() - _lastMousePos);
         _lastMousePos = e->pos();
-        update();
     }
 }
 
@@ -127,35 +349,5 @@ void EarthWidget::mouseReleaseEvent( QMouseEvent * e )
 
 void EarthWidget::wheelEvent( QWheelEvent * e )
 {
-    _modelMatrix.scale(exp(e->delta() / 1000.0));
-    update();
-}
-
-void EarthWidget::buildModel()
-{
-    // load texture
-    QImage im(":/images/earthmap.jpg");
-    Q_ASSERT(!im.isNull());
-    _textureId = bindTexture(im);
-
-    // build sphere data
-    _vertexPositions.reserve(M * N);
-    _normals.reserve(M * N);
-    _texCoords.reserve(M * N);
-    _vertIds = QVector<QVector<int>>(M, QVector<int>(N));
-    for (int i = 0; i < M; i++) {
-        for (int j = 0; j < N; j++) {
-            float xratio = 1.0f / (N - 1) * j;
-            float yratio = 1.0f / (M - 1) * i;
-            float xangle = M_PI * 2 * xratio;
-            float yangle = M_PI * yratio - M_PI_2;
-            QVector4D pos(cos(xangle)*cos(yangle), sin(yangle), sin(xangle)*cos(yangle),  1);
-            _vertexPositions << pos;
-            QVector3D normal(cos(xangle)*cos(yangle), sin(yangle), sin(xangle)*cos(yangle));
-            _normals << normal;
-            QVector2D texCoord(1.0 - xratio, yratio);
-            _texCoords << texCoord;
-            _vertIds[i][j] = _texCoords.size() - 1;
-        }
-    }
+    _frameScheduler.addWheel(e->delta());
 }
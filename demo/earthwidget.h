@@ -2,10 +2,17 @@
 
 #include <QtOpenGL>
 
-class EarthWidget : public QGLWidget
+#include "cubesphere.h"
+#include "earthshader.h"
+#include "framescheduler.h"
+#include "glstatecache.h"
+#include "textureloader.h"
+#include "tilecache.h"
+
+class EarthWidget : public QGLWidget, public QGLFunctions
 {
 public:
-    EarthWidget(QWidget *parent = nullptr);
+    EarthWidget(QWidget *parent = nullptr, const QGLWidget * shareWidget = nullptr);
     ~EarthWidget();
 
 protected:
@@ -20,16 +27,35 @@ protected:
     virtual void mouseReleaseEvent(QMouseEvent * e) override;
     virtual void wheelEvent(QWheelEvent * e) override;
 
-    // load texture and build sphere
-    void buildModel();
+    // the tiles to draw under 'tile': the visible ones, down to the zoom matching the size of the sphere
+    void selectTiles(const TileId & tile, int zoom, QVector<TileId> & tiles) const;
+    bool isTileVisible(const TileId & tile) const;
+    // set the uniforms placing the grid on a patch, and draw it
+    void drawPatch(const SpherePatch & patch);
 
 private:
     QMatrix4x4 _modelMatrix, _projectionMatrix;
-    QVector<QVector4D> _vertexPositions;
-    QVector<QVector2D> _texCoords;
-    QVector<QVector3D> _normals;
-    QVector<QVector<int>> _vertIds;
-    GLuint _textureId;
+    // the grid of the patches of the sphere and its triangles, shared by the widgets
+    QVector<QVector3D> _grid;
+    QVector<GLuint> _gridIndices;
+    GLuint _gridBuffer, _gridIndicesBuffer;
+    // the earth map, decoded in the background and drawn once uploaded (without texture arrays)
+    AsyncTexture _texture;
+
+    // the imagery streamed tile by tile, with texture arrays
+    TileCache _tiles;
+    bool _useTiles;
+
+    QSharedPointer<EarthShader> _earthShader;
+    GLuint _program;
+    GLint _patchCornerLocation, _patchAxisULocation, _patchAxisVLocation, _skirtDepthLocation;
+    GLint _mapLocation, _tileRectLocation, _tileOriginLocation, _tileScaleLocation;
+
+    // the shadowed OpenGL state of this widget's context
+    GLStateCache _glState;
+
+    // accumulates the mouse input between frames and paces the repaints
+    FrameScheduler _frameScheduler;
 
 private:
     QPointF _lastMousePos;  
@@ -0,0 +1,228 @@
+#include "profiler.h"
+#include "renderthread.h"
+
+#include "framescheduler.h"
+
+static double maxFps = 0.0;
+static bool threaded = false;
+
+static QAtomicInteger<qint64> totalInputEvents;
+static QAtomicInteger<qint64> totalCoalescedEvents;
+static QAtomicInteger<qint64> totalDroppedEvents;
+static QAtomicInteger<qint64> totalFrames;
+static QAtomicInteger<qint64> totalLatency;   // nanoseconds
+static QAtomicInteger<qint64> maximumLatency; // nanoseconds
+
+FrameScheduler::FrameScheduler(QGLWidget * widget)
+    : QObject()
+{
+    _widget = widget;
+    _renderThread = threaded ? new RenderThread(widget, this) : nullptr;
+    _presentPending = false;
+    _timer.setSingleShot(true);
+    _timer.setTimerType(Qt::PreciseTimer);
+    connect(&_timer, SIGNAL(timeout()), this, SLOT(renderFrame()));
+}
+
+FrameScheduler::~FrameScheduler()
+{
+    stopRendering();
+    delete _renderThread;
+}
+
+void FrameScheduler::addDrag(const QPointF & delta)
+{
+    totalInputEvents.fetchAndAddRelaxed(1);
+    if (delta.isNull()) {
+        totalDroppedEvents.fetchAndAddRelaxed(1);
+        return;
+    }
+    _input.drag += delta;
+    publish();
+    requestFrame();
+}
+
+void FrameScheduler::addWheel(int delta)
+{
+    totalInputEvents.fetchAndAddRelaxed(1);
+    if (delta == 0) {
+        totalDroppedEvents.fetchAndAddRelaxed(1);
+        return;
+    }
+    _input.wheel += delta;
+    publish();
+    requestFrame();
+}
+
+void FrameScheduler::addKey(int key)
+{
+    totalInputEvents.fetchAndAddRelaxed(1);
+    _input.keyPresses[key]++;
+    publish();
+    requestFrame();
+}
+
+void FrameScheduler::requestFrame()
+{
+    if (_timer.isActive()) {
+        // the change is painted by the frame already scheduled
+        totalCoalescedEvents.fetchAndAddRelaxed(1);
+        return;
+    }
+    int sinceLastFrame = _lastFrame.isValid() ? int(_lastFrame.elapsed()) : frameInterval();
+    _timer.start(qMax(0, frameInterval() - sinceLastFrame));
+}
+
+QPointF FrameScheduler::takeDrag()
+{
+    QPointF total = latestInput().drag;
+    QPointF drag = total - _applied.drag;
+    _applied.drag = total;
+    return drag;
+}
+
+int FrameScheduler::takeWheel()
+{
+    qint64 total = latestInput().wheel;
+    int wheel = int(total - _applied.wheel);
+    _applied.wheel = total;
+    return wheel;
+}
+
+int FrameScheduler::takeKeyPresses(int key)
+{
+    int total = latestInput().keyPresses.value(key);
+    int presses = total - _applied.keyPresses.value(key);
+    _applied.keyPresses[key] = total;
+    return presses;
+}
+
+void FrameScheduler::setViewportSize(const QSize & size)
+{
+    if (_input.viewportSize == size) {
+        return;
+    }
+    _input.viewportSize = size;
+    publish();
+}
+
+QSize FrameScheduler::viewportSize()
+{
+    return latestInput().viewportSize;
+}
+
+void FrameScheduler::stopRendering()
+{
+    if (_renderThread) {
+        _renderThread->stop();
+    }
+}
+
+void FrameScheduler::renderFrame()
+{
+    _lastFrame.start();
+    if (_renderThread) {
+        // the render thread paints and presents the frame, and records its latency
+        _renderThread->requestFrame();
+        return;
+    }
+    // paint synchronously, QGLWidget swaps the buffers before repaint() returns
+    _widget->repaint();
+    framePresented();
+}
+
+void FrameScheduler::publish()
+{
+    // a new batch of input starts when the painting thread took every snapshot published so far
+    if (_takenSerial.loadAcquire() == _input.serial) {
+        _input.firstInputTime = Profiler::now();
+    }
+    _input.serial++;
+    _snapshots.back() = _input;
+    _snapshots.publish();
+}
+
+const FrameScheduler::FrameInput & FrameScheduler::latestInput()
+{
+    if (_snapshots.update()) {
+        _presentPending = true;
+        _takenSerial.storeRelease(_snapshots.front().serial);
+    }
+    return _snapshots.front();
+}
+
+void FrameScheduler::framePresented()
+{
+    if (!_presentPending) {
+        return;
+    }
+    _presentPending = false;
+
+    qint64 latency = Profiler::now() - _snapshots.front().firstInputTime;
+    totalFrames.fetchAndAddRelaxed(1);
+    totalLatency.fetchAndAddRelaxed(latency);
+    qint64 maximum = maximumLatency.load();
+    while (latency > maximum && !maximumLatency.testAndSetRelaxed(maximum, latency)) {
+        maximum = maximumLatency.load();
+    }
+}
+
+int FrameScheduler::frameInterval() const
+{
+    QScreen * screen = _widget->window()->windowHandle() ? 
+        _widget->window()->windowHandle()->screen() : QGuiApplication::primaryScreen();
+    double refreshRate = screen && screen->refreshRate() > 0 ? screen->refreshRate() : 60.0;
+    double fps = maxFps > 0 ? qMin(maxFps, refreshRate) : refreshRate;
+    return qRound(1000.0 / fps);
+}
+
+void FrameScheduler::setThreadedRendering(bool enabled)
+{
+    threaded = enabled;
+}
+
+bool FrameScheduler::threadedRendering()
+{
+    return threaded;
+}
+
+void FrameScheduler::setMaxFrameRate(double fps)
+{
+    maxFps = fps;
+}
+
+double FrameScheduler::maxFrameRate()
+{
+    return maxFps;
+}
+
+qint64 FrameScheduler::inputEvents()
+{
+    return totalInputEvents.load();
+}
+
+qint64 FrameScheduler::coalescedEvents()
+{
+    return totalCoalescedEvents.load();
+}
+
+qint64 FrameScheduler::droppedEvents()
+{
+    return totalDroppedEvents.load();
+}
+
+qint64 FrameScheduler::scheduledFrames()
+{
+    return totalFrames.load();
+}
+
+double FrameScheduler::averageLatency()
+{
+    qint64 frames = totalFrames.load();
+    return frames > 0 ? totalLatency.load() / 1e6 / frames : 0.0;
+}
+
+double FrameScheduler::maxLatency()
+{
+    return maximumLatency.load() / 1e6;
+}
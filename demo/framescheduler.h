@@ -0,0 +1,112 @@
+#pragma once
+
+#include <QtOpenGL>
+
+#include "triplebuffer.h"
+
+class RenderThread;
+
+// paces the frames of a widget driven by mouse input
+// the widget adds the deltas of its input events instead of applying them right away, 
+// the scheduler repaints it at most once per display refresh (or per frame of the optional rate cap),
+// and the widget applies all the deltas accumulated since the last frame in paintGL
+// nothing is painted while no input arrives
+//
+// the input is published as a snapshot of running totals into a triple buffer, 
+// so paintGL may run on a render thread (see setThreadedRendering) and read it without locks:
+// the add* / requestFrame / setViewportSize calls belong to the GUI thread, the take* calls to the painting one
+class FrameScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FrameScheduler(QGLWidget * widget);
+    ~FrameScheduler();
+
+    // accumulate the delta of a mouse drag or wheel event, or a key press, and schedule a frame
+    void addDrag(const QPointF & delta);
+    void addWheel(int delta);
+    void addKey(int key);
+
+public slots:
+    // schedule a frame for a change that is not an input delta
+    // (a painting thread invokes it through a queued connection, e.g. to keep refining a frame)
+    void requestFrame();
+
+public:
+    // the input accumulated since the last call, called by paintGL
+    QPointF takeDrag();
+    int takeWheel();
+    // number of presses of the key
+    int takeKeyPresses(int key);
+
+    // the size of the widget as last published by the GUI thread (used by the render thread)
+    void setViewportSize(const QSize & size);
+    QSize viewportSize();
+
+    // stop the render thread of the widget, if any, and give its context back to the GUI thread
+    // widgets call it before they make their context current in their destructor
+    void stopRendering();
+
+    // paint every widget created from now on in its own thread, with its own context
+    static void setThreadedRendering(bool enabled);
+    static bool threadedRendering();
+
+    // limit the frame rate of all the widgets, 0 to only limit it to the display refresh rate
+    static void setMaxFrameRate(double fps);
+    static double maxFrameRate();
+
+    // statistics of all the schedulers
+    // input events received, events merged into an already scheduled frame, events without any change
+    static qint64 inputEvents();
+    static qint64 coalescedEvents();
+    static qint64 droppedEvents();
+    // frames painted for input, and the time from the first input event of a frame until it was presented
+    static qint64 scheduledFrames();
+    static double averageLatency(); // milliseconds
+    static double maxLatency();     // milliseconds
+
+private slots:
+    void renderFrame();
+
+private:
+    friend class RenderThread;
+
+    // running totals of the input of a widget
+    struct FrameInput
+    {
+        QPointF drag;
+        qint64 wheel = 0;
+        QHash<int, int> keyPresses;
+        QSize viewportSize;
+
+        quint64 serial = 0;          // number of snapshots published up to this one
+        qint64 firstInputTime = 0;   // Profiler::now() of the first input not painted yet
+    };
+
+    // the shortest time between two frames in milliseconds
+    int frameInterval() const;
+
+    // GUI thread: publish the current totals
+    void publish();
+    // painting thread: the latest totals
+    const FrameInput & latestInput();
+    // painting thread: record the latency of the input shown by the frame just presented
+    void framePresented();
+
+private:
+    QGLWidget * _widget;
+    RenderThread * _renderThread; // nullptr if the widget paints on the GUI thread
+    QTimer _timer;
+    QElapsedTimer _lastFrame;
+
+    // GUI thread
+    FrameInput _input;
+    // painting thread: the totals already applied by paintGL, and whether a snapshot waits to be presented
+    FrameInput _applied;
+    bool _presentPending;
+
+    TripleBuffer<FrameInput> _snapshots;
+    // the serial of the last snapshot taken by the painting thread
+    QAtomicInteger<quint64> _takenSerial;
+};
@@ -0,0 +1,114 @@
+#include "memorytracker.h"
+
+#include "frameuniforms.h"
+
+#include "glcapturecalls.h"
+
+// the std140 layout of the block, each mat4 takes 4 vec4 columns
+struct FrameBlockData
+{
+    GLfloat modelMatrix[16];
+    GLfloat viewMatrix[16];
+    GLfloat projectionMatrix[16];
+    GLfloat modelViewProjectionMatrix[16];
+};
+
+const char * FrameUniforms::blockDeclaration()
+{
+    return
+        "layout(std140) uniform FrameBlock {\n"
+        "    mat4 modelMatrix;\n"
+        "    mat4 viewMatrix;\n"
+        "    mat4 projectionMatrix;\n"
+        "    mat4 modelViewProjectionMatrix;\n"
+        "};\n";
+}
+
+FrameUniforms::FrameUniforms()
+{
+    _modelMatrix.setToIdentity();
+    _viewMatrix.setToIdentity();
+    _projectionMatrix.setToIdentity();
+    _modelViewProjectionMatrix.setToIdentity();
+    _mvpDirty = false;
+    _bufferDirty = true;
+
+    _buffer = 0;
+    _uploadCount = 0;
+}
+
+FrameUniforms::~FrameUniforms()
+{}
+
+void FrameUniforms::setModelMatrix(const QMatrix4x4 & m)
+{
+    if (m != _modelMatrix) {
+        _modelMatrix = m;
+        _mvpDirty = _bufferDirty = true;
+    }
+}
+
+void FrameUniforms::setViewMatrix(const QMatrix4x4 & m)
+{
+    if (m != _viewMatrix) {
+        _viewMatrix = m;
+        _mvpDirty = _bufferDirty = true;
+    }
+}
+
+void FrameUniforms::setProjectionMatrix(const QMatrix4x4 & m)
+{
+    if (m != _projectionMatrix) {
+        _projectionMatrix = m;
+        _mvpDirty = _bufferDirty = true;
+    }
+}
+
+const QMatrix4x4 & FrameUniforms::modelViewProjectionMatrix()
+{
+    if (_mvpDirty) {
+        _modelViewProjectionMatrix = _projectionMatrix * _viewMatrix * _modelMatrix;
+        _mvpDirty = false;
+    }
+    return _modelViewProjectionMatrix;
+}
+
+void FrameUniforms::bind()
+{
+    QOpenGLExtraFunctions * f = QOpenGLContext::currentContext()->extraFunctions();
+
+    if (_buffer == 0) {
+        f->glGenBuffers(1, &_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlockData), nullptr, GL_DYNAMIC_DRAW);
+        _bufferDirty = true;
+        _memoryOwner = MemoryTracker::contextOwner();
+        MemoryTracker::add(MemoryTracker::Gpu, _memoryOwner, "frame uniforms", sizeof(FrameBlockData));
+    }
+
+    // rewrite the block only if a matrix changed since the last frame
+    if (_bufferDirty) {
+        FrameBlockData data;
+        memcpy(data.modelMatrix, _modelMatrix.constData(), sizeof(data.modelMatrix));
+        memcpy(data.viewMatrix, _viewMatrix.constData(), sizeof(data.viewMatrix));
+        memcpy(data.projectionMatrix, _projectionMatrix.constData(), sizeof(data.projectionMatrix));
+        memcpy(data.modelViewProjectionMatrix, modelViewProjectionMatrix().constData(),
+            sizeof(data.modelViewProjectionMatrix));
+        glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(data), &data);
+        _bufferDirty = false;
+        _uploadCount++;
+    }
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, BindingPoint, _buffer);
+}
+
+void FrameUniforms::release()
+{
+    if (_buffer != 0) {
+        QOpenGLContext::currentContext()->extraFunctions()->glDeleteBuffers(1, &_buffer);
+        MemoryTracker::add(MemoryTracker::Gpu, _memoryOwner, "frame uniforms", -qint64(sizeof(FrameBlockData)));
+        _buffer = 0;
+        _bufferDirty = true;
+    }
+}
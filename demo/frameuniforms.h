@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QtOpenGL>
+
+// the camera/frame uniform block shared by every shader program:
+//
+//     layout(std140) uniform FrameBlock {
+//         mat4 modelMatrix;
+//         mat4 viewMatrix;
+//         mat4 projectionMatrix;
+//         mat4 modelViewProjectionMatrix;
+//     };
+//
+// the matrices are kept on the CPU and the uniform buffer is only rewritten when one of them changed,
+// the buffer is always bound at BindingPoint
+class FrameUniforms
+{
+public:
+    enum { BindingPoint = 0 };
+    // the declaration of the block to paste into shader sources
+    static const char * blockDeclaration();
+
+    FrameUniforms();
+    ~FrameUniforms();
+
+    void setModelMatrix(const QMatrix4x4 & m);
+    void setViewMatrix(const QMatrix4x4 & m);
+    void setProjectionMatrix(const QMatrix4x4 & m);
+
+    const QMatrix4x4 & modelMatrix() const { return _modelMatrix; }
+    const QMatrix4x4 & viewMatrix() const { return _viewMatrix; }
+    const QMatrix4x4 & projectionMatrix() const { return _projectionMatrix; }
+    // projectionMatrix * viewMatrix * modelMatrix, recomputed only when dirty
+    const QMatrix4x4 & modelViewProjectionMatrix();
+
+    // upload the block if it changed and bind it at BindingPoint, the owning context must be current
+    void bind();
+    // delete the uniform buffer, the owning context must be current
+    void release();
+
+    // number of bind() calls that had to upload the block
+    int uploadCount() const { return _uploadCount; }
+
+private:
+    QMatrix4x4 _modelMatrix, _viewMatrix, _projectionMatrix, _modelViewProjectionMatrix;
+    bool _mvpDirty;   // _modelViewProjectionMatrix is outdated
+    bool _bufferDirty; // the uniform buffer is outdated
+
+    GLuint _buffer;
+    QString _memoryOwner; // of the buffer in MemoryTracker
+    int _uploadCount;
+};
@@ -0,0 +1,355 @@
+#include "drawstats.h"
+#include "glstatecache.h"
+#include "memorytracker.h"
+#include "shaderprogram.h"
+
+#include "geometryarena.h"
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_TEXTURE_BUFFER
+#define GL_TEXTURE_BUFFER 0x8C2A
+#endif
+#ifndef GL_RGBA32F
+#define GL_RGBA32F 0x8814
+#endif
+
+// the texture unit of the matrices, after the unit 0 used by the height maps
+static const int matrixTextureUnit = 1;
+
+// the attribute locations bound by MeshShader
+static const GLuint positionAttribute = 0;
+static const GLuint normalAttribute = 1;
+static const GLuint drawIndexAttribute = 2;
+
+// a vertex of the arena, the same layout as the float vertices of the other mesh buffers
+struct ArenaVertex
+{
+    QVector3D position;
+    QVector3D normal;
+};
+
+GeometryArena::GeometryArena()
+    : _state(nullptr), _vertexCapacity(0), _indexCapacity(0), _indexTotal(0),
+      _vertexBuffer(0), _indexBuffer(0), _matrixTexture(0), _drawIndexBuffer(0),
+      _multiDrawElementsIndirect(nullptr), _texBuffer(nullptr), _vertexAttribDivisor(nullptr)
+{
+}
+
+GeometryArena::~GeometryArena()
+{
+}
+
+bool GeometryArena::initialize(const QGLContext * context, GLStateCache & state, int vertexCapacity, int indexCapacity)
+{
+    _state = &state;
+    initializeGLFunctions(context);
+
+    QOpenGLContext * glContext = context->contextHandle();
+    QPair<int, int> version = glContext->format().version();
+    // texture buffers and instanced arrays are core since OpenGL 3.1 and 3.3, indirect multi-draws since 4.3
+    // the commands carry a baseInstance since 4.2 (a reserved field that must be zero before)
+    bool textureBuffers = version >= qMakePair(3, 1) || glContext->hasExtension("GL_ARB_texture_buffer_object");
+    bool instancedArrays = version >= qMakePair(3, 3) || glContext->hasExtension("GL_ARB_instanced_arrays");
+    bool baseInstance = version >= qMakePair(4, 2) || glContext->hasExtension("GL_ARB_base_instance");
+    bool multiDraw = baseInstance &&
+        (version >= qMakePair(4, 3) || glContext->hasExtension("GL_ARB_multi_draw_indirect"));
+    if (glContext->isOpenGLES() || !textureBuffers || !instancedArrays ||
+        !glContext->hasExtension("GL_EXT_gpu_shader4")) {
+        return false;
+    }
+    _texBuffer = reinterpret_cast<TexBuffer>(glContext->getProcAddress("glTexBuffer"));
+    if (!_texBuffer) {
+        _texBuffer = reinterpret_cast<TexBuffer>(glContext->getProcAddress("glTexBufferARB"));
+    }
+    _vertexAttribDivisor = reinterpret_cast<VertexAttribDivisor>(glContext->getProcAddress("glVertexAttribDivisor"));
+    if (!_vertexAttribDivisor) {
+        _vertexAttribDivisor = reinterpret_cast<VertexAttribDivisor>(
+            glContext->getProcAddress("glVertexAttribDivisorARB"));
+    }
+    _multiDrawElementsIndirect = multiDraw ? reinterpret_cast<MultiDrawElementsIndirect>(
+        glContext->getProcAddress("glMultiDrawElementsIndirect")) : nullptr;
+    if (!_texBuffer || !_vertexAttribDivisor) {
+        return false;
+    }
+
+    _vertexCapacity = vertexCapacity;
+    _indexCapacity = indexCapacity;
+    _freeVertices.clear();
+    _freeIndices.clear();
+    _freeVertices.insert(0, vertexCapacity);
+    _freeIndices.insert(0, indexCapacity);
+    _meshes.clear();
+
+    glGenBuffers(1, &_vertexBuffer);
+    state.bindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(ArenaVertex) * vertexCapacity, nullptr, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &_indexBuffer);
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quint32) * indexCapacity, nullptr, GL_STATIC_DRAW);
+
+    if (_multiDrawElementsIndirect) {
+        _commandStream.initialize(context, state, GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand) * MaxDraws,
+            "arena draw commands");
+    }
+    _matrixStream.initialize(context, state, GL_TEXTURE_BUFFER, sizeof(GLfloat) * 16 * MaxDraws,
+        "arena matrices");
+
+    // the texture reads its texels from every region of the matrix stream
+    glGenTextures(1, &_matrixTexture);
+    state.activeTexture(GL_TEXTURE0 + matrixTextureUnit);
+    state.bindTexture(GL_TEXTURE_BUFFER, _matrixTexture);
+    _texBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _matrixStream.bufferId());
+    state.activeTexture(GL_TEXTURE0);
+
+    // so the draw indices count the matrices from the start of the stream, not of the region
+    QVector<GLfloat> drawIndices(_matrixStream.regionCount() * MaxDraws);
+    for (int i = 0; i < drawIndices.size(); i++) {
+        drawIndices[i] = i;
+    }
+    glGenBuffers(1, &_drawIndexBuffer);
+    state.bindBuffer(GL_ARRAY_BUFFER, _drawIndexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * drawIndices.size(), drawIndices.constData(), GL_STATIC_DRAW);
+
+    _memoryOwner = MemoryTracker::contextOwner();
+    MemoryTracker::add(MemoryTracker::Gpu, _memoryOwner, "arena", bufferBytes());
+    return true;
+}
+
+qint64 GeometryArena::bufferBytes() const
+{
+    return qint64(sizeof(ArenaVertex)) * _vertexCapacity + qint64(sizeof(quint32)) * _indexCapacity +
+        qint64(sizeof(GLfloat)) * _matrixStream.regionCount() * MaxDraws;
+}
+
+void GeometryArena::release()
+{
+    if (_vertexBuffer == 0) {
+        return;
+    }
+    GLuint buffers[] = { _vertexBuffer, _indexBuffer, _drawIndexBuffer };
+    glDeleteBuffers(3, buffers);
+    MemoryTracker::add(MemoryTracker::Gpu, _memoryOwner, "arena", -bufferBytes());
+    glDeleteTextures(1, &_matrixTexture);
+    _commandStream.release();
+    _matrixStream.release();
+    _vertexBuffer = _indexBuffer = _drawIndexBuffer = 0;
+    _matrixTexture = 0;
+}
+
+int GeometryArena::allocate(FreeList & freeList, int size)
+{
+    for (FreeList::iterator it = freeList.begin(); it != freeList.end(); ++it) {
+        if (it.value() >= size) {
+            int offset = it.key();
+            int left = it.value() - size;
+            freeList.erase(it);
+            if (left > 0) {
+                freeList.insert(offset + size, left);
+            }
+            return offset;
+        }
+    }
+    return -1;
+}
+
+void GeometryArena::deallocate(FreeList & freeList, int offset, int size)
+{
+    if (size <= 0) {
+        return;
+    }
+    // merge with the following range
+    FreeList::iterator next = freeList.lowerBound(offset);
+    if (next != freeList.end() && next.key() == offset + size) {
+        size += next.value();
+        next = freeList.erase(next);
+    }
+    // and with the preceding one
+    if (next != freeList.begin()) {
+        FreeList::iterator previous = next - 1;
+        if (previous.key() + previous.value() == offset) {
+            previous.value() += size;
+            return;
+        }
+    }
+    freeList.insert(offset, size);
+}
+
+int GeometryArena::freeSize(const FreeList & freeList)
+{
+    int size = 0;
+    for (int s : freeList) {
+        size += s;
+    }
+    return size;
+}
+
+int GeometryArena::addMesh(const QVector<QVector3D> & positions, const QVector<QVector3D> & normals,
+    const QVector<quint32> & indices)
+{
+    if (_vertexBuffer == 0) {
+        return -1;
+    }
+    MeshRange range;
+    range.vertexCount = positions.size();
+    range.indexCount = indices.size();
+    range.firstVertex = allocate(_freeVertices, range.vertexCount);
+    if (range.firstVertex < 0) {
+        return -1;
+    }
+    range.firstIndex = allocate(_freeIndices, range.indexCount);
+    if (range.firstIndex < 0) {
+        deallocate(_freeVertices, range.firstVertex, range.vertexCount);
+        return -1;
+    }
+
+    QVector<ArenaVertex> vertices(range.vertexCount);
+    for (int i = 0; i < vertices.size(); i++) {
+        vertices[i].position = positions[i];
+        vertices[i].normal = normals[i];
+    }
+    _state->bindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(ArenaVertex) * range.firstVertex,
+        sizeof(ArenaVertex) * vertices.size(), vertices.constData());
+
+    // the indices are rebased on the first vertex of the mesh, so that every command has a baseVertex of 0
+    QVector<quint32> rebased(indices);
+    for (quint32 & index : rebased) {
+        index += range.firstVertex;
+    }
+    _state->bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quint32) * range.firstIndex,
+        sizeof(quint32) * rebased.size(), rebased.constData());
+
+    // reuse the id of a removed mesh
+    for (int i = 0; i < _meshes.size(); i++) {
+        if (_meshes[i].firstVertex < 0) {
+            _meshes[i] = range;
+            return i;
+        }
+    }
+    _meshes << range;
+    return _meshes.size() - 1;
+}
+
+void GeometryArena::removeMesh(int mesh)
+{
+    MeshRange & range = _meshes[mesh];
+    if (range.firstVertex < 0) {
+        return;
+    }
+    deallocate(_freeVertices, range.firstVertex, range.vertexCount);
+    deallocate(_freeIndices, range.firstIndex, range.indexCount);
+    range = MeshRange();
+}
+
+int GeometryArena::meshCount() const
+{
+    int count = 0;
+    for (const MeshRange & range : _meshes) {
+        count += range.firstVertex >= 0;
+    }
+    return count;
+}
+
+void GeometryArena::clearDraws()
+{
+    _commands.clear();
+    _matrices.clear();
+    _indexTotal = 0;
+}
+
+void GeometryArena::addDraw(int mesh, const QMatrix4x4 & modelMatrix)
+{
+    addDraw(mesh, SimdMatrix4(modelMatrix));
+}
+
+void GeometryArena::addDraw(int mesh, const SimdMatrix4 & modelMatrix)
+{
+    if (_commands.size() == MaxDraws) {
+        return;
+    }
+    const MeshRange & range = _meshes[mesh];
+    DrawCommand command;
+    command.count = range.indexCount;
+    command.instanceCount = 1;
+    command.firstIndex = range.firstIndex;
+    command.baseVertex = 0;
+    command.baseInstance = _commands.size();
+    _commands << command;
+
+    int offset = _matrices.size();
+    _matrices.resize(offset + 16);
+    for (int c = 0; c < 4; c++) {
+        modelMatrix.columns[c].store(_matrices.data() + offset + 4 * c);
+    }
+    _indexTotal += range.indexCount;
+}
+
+void GeometryArena::submit(ShaderProgram * program)
+{
+    GLStateCache & state = *_state;
+    int count = _commands.size();
+    if (count == 0 || _vertexBuffer == 0) {
+        return;
+    }
+
+    // the matrices of the frame, in a region of the stream the GPU no longer reads
+    _matrixStream.beginFrame();
+    int matrixOffset = 0;
+    void * matrices = _matrixStream.allocate(sizeof(GLfloat) * _matrices.size(), sizeof(GLfloat) * 16, &matrixOffset);
+    memcpy(matrices, _matrices.constData(), sizeof(GLfloat) * _matrices.size());
+    _matrixStream.flush();
+    int firstMatrix = matrixOffset / (sizeof(GLfloat) * 16);
+
+    state.activeTexture(GL_TEXTURE0 + matrixTextureUnit);
+    state.bindTexture(GL_TEXTURE_BUFFER, _matrixTexture);
+    state.activeTexture(GL_TEXTURE0);
+    glUniform1i(program->uniformLocation("drawMatrices"), matrixTextureUnit);
+
+    state.bindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+    state.enableVertexAttribArray(positionAttribute);
+    state.enableVertexAttribArray(normalAttribute);
+    glVertexAttribPointer(positionAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex), 0);
+    glVertexAttribPointer(normalAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(ArenaVertex),
+        (void*)offsetof(ArenaVertex, normal));
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+
+    if (_multiDrawElementsIndirect) {
+        // drawIndex advances once per instance, and each command draws the instance baseInstance
+        state.bindBuffer(GL_ARRAY_BUFFER, _drawIndexBuffer);
+        state.enableVertexAttribArray(drawIndexAttribute);
+        glVertexAttribPointer(drawIndexAttribute, 1, GL_FLOAT, GL_FALSE, 0, 0);
+        _vertexAttribDivisor(drawIndexAttribute, 1);
+
+        _commandStream.beginFrame();
+        int commandOffset = 0;
+        DrawCommand * commands = static_cast<DrawCommand *>(
+            _commandStream.allocate(sizeof(DrawCommand) * count, sizeof(GLuint), &commandOffset));
+        for (int i = 0; i < count; i++) {
+            commands[i] = _commands[i];
+            commands[i].baseInstance += firstMatrix;
+        }
+        _commandStream.flush();
+        _multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(qintptr)commandOffset, count, 0);
+        DrawStats::count(GL_TRIANGLES, _indexTotal);
+        _commandStream.endFrame();
+
+        // the other draws of the context expect a per-vertex attribute 2, if any
+        _vertexAttribDivisor(drawIndexAttribute, 0);
+        state.disableVertexAttribArray(drawIndexAttribute);
+    } else {
+        state.disableVertexAttribArray(drawIndexAttribute);
+        for (int i = 0; i < count; i++) {
+            const DrawCommand & command = _commands[i];
+            glVertexAttrib1f(drawIndexAttribute, firstMatrix + i);
+            glDrawElements(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+                (void*)(sizeof(quint32) * command.firstIndex));
+            DrawStats::count(GL_TRIANGLES, command.count);
+        }
+    }
+
+    _matrixStream.endFrame();
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <QtOpenGL>
+
+#include "simdmatrix.h"
+#include "streambuffer.h"
+
+class GLStateCache;
+class ShaderProgram;
+
+// many meshes suballocated from one vertex buffer ({position, normal} floats) and one index buffer,
+// drawn with a single glMultiDrawElementsIndirect whatever the number of meshes and draws
+//
+// each frame a widget calls clearDraws(), addDraw() for every visible object, then submit() with a
+// MeshShader::MultiDraw program: the draw commands are streamed to a GL_DRAW_INDIRECT_BUFFER and the model
+// matrices to a texture buffer (both StreamBuffers), and every command starts at its own baseInstance so that
+// the instanced "drawIndex" attribute (divisor 1) gives the shader the index of its matrix in the whole buffer
+//
+// without glMultiDrawElementsIndirect or base instances (before OpenGL 4.3) the same buffers are drawn by one
+// glDrawElements per draw, with drawIndex set as a constant attribute
+// the calls of the arena are not recorded by GLCapture, its users draw object by object while capturing
+class GeometryArena : protected QGLFunctions
+{
+public:
+    // the draws of a frame beyond this are dropped
+    enum { MaxDraws = 4096 };
+
+    GeometryArena();
+    ~GeometryArena();
+
+    // create the buffers in the current context, holding up to vertexCapacity vertices and indexCapacity indices
+    // the bindings go through the state cache of the context
+    // returns false if the context lacks texture buffers or instanced arrays
+    bool initialize(const QGLContext * context, GLStateCache & state, int vertexCapacity, int indexCapacity);
+    // delete the buffers, the owning context must be current
+    void release();
+
+    bool isInitialized() const { return _vertexBuffer != 0; }
+    // whether submit() issues a single glMultiDrawElementsIndirect
+    bool hasMultiDrawIndirect() const { return _multiDrawElementsIndirect != nullptr; }
+
+    // copy a mesh into the buffers, returns its id or -1 if there is no room left
+    int addMesh(const QVector<QVector3D> & positions, const QVector<QVector3D> & normals,
+        const QVector<quint32> & indices);
+    // give the ranges of a mesh back to the arena
+    void removeMesh(int mesh);
+
+    // forget the draws of the previous frame
+    void clearDraws();
+    // draw a mesh with a model matrix at the next submit()
+    void addDraw(int mesh, const QMatrix4x4 & modelMatrix);
+    void addDraw(int mesh, const SimdMatrix4 & modelMatrix);
+    int drawCount() const { return _commands.size(); }
+
+    // issue the draws, the program must be in use; called at most once per frame
+    void submit(ShaderProgram * program);
+
+    // occupancy of the buffers
+    int meshCount() const;
+    int usedVertices() const { return _vertexCapacity - freeSize(_freeVertices); }
+    int usedIndices() const { return _indexCapacity - freeSize(_freeIndices); }
+    int vertexCapacity() const { return _vertexCapacity; }
+    int indexCapacity() const { return _indexCapacity; }
+
+    // the per-frame uploads
+    const StreamBuffer & matrixStream() const { return _matrixStream; }
+    const StreamBuffer & commandStream() const { return _commandStream; }
+
+private:
+    // the size of the vertex, index and draw index buffers
+    qint64 bufferBytes() const;
+
+private:
+    // free ranges of a buffer, offset -> size, never adjacent
+    typedef QMap<int, int> FreeList;
+    // take the first free range large enough, returns its offset or -1
+    static int allocate(FreeList & freeList, int size);
+    // give a range back, merged with its free neighbours
+    static void deallocate(FreeList & freeList, int offset, int size);
+    static int freeSize(const FreeList & freeList);
+
+    // the layout of glMultiDrawElementsIndirect
+    struct DrawCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    struct MeshRange
+    {
+        int firstVertex = -1, vertexCount = 0;
+        int firstIndex = -1, indexCount = 0;
+    };
+
+    typedef void (QOPENGLF_APIENTRYP MultiDrawElementsIndirect)(GLenum mode, GLenum type,
+        const void * indirect, GLsizei drawcount, GLsizei stride);
+    typedef void (QOPENGLF_APIENTRYP TexBuffer)(GLenum target, GLenum internalformat, GLuint buffer);
+    typedef void (QOPENGLF_APIENTRYP VertexAttribDivisor)(GLuint index, GLuint divisor);
+
+private:
+    GLStateCache * _state;
+    int _vertexCapacity, _indexCapacity;
+    FreeList _freeVertices, _freeIndices;
+    QVector<MeshRange> _meshes; // removed meshes keep an empty range
+
+    // the draws of the frame
+    QVector<DrawCommand> _commands;
+    QVector<GLfloat> _matrices; // 16 per draw, column-major
+    qint64 _indexTotal;
+
+    GLuint _vertexBuffer, _indexBuffer;
+    StreamBuffer _commandStream;
+    StreamBuffer _matrixStream;
+    GLuint _matrixTexture; // a texture buffer on the whole matrix stream
+    GLuint _drawIndexBuffer; // 0, 1, 2... for the instanced drawIndex attribute, one per matrix of the stream
+    QString _memoryOwner; // in MemoryTracker
+
+    MultiDrawElementsIndirect _multiDrawElementsIndirect;
+    TexBuffer _texBuffer;
+    VertexAttribDivisor _vertexAttribDivisor;
+};
@@ -0,0 +1,697 @@
+#include "glcaptureformat.h"
+#include "glstatecache.h"
+
+#include "glcapture.h"
+
+using namespace GLCaptureFormat;
+
+#ifndef GL_TEXTURE_2D_ARRAY
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#endif
+#ifndef GL_TEXTURE_DEPTH
+#define GL_TEXTURE_DEPTH 0x8071
+#endif
+#ifndef GL_SAMPLER_2D_ARRAY
+#define GL_SAMPLER_2D_ARRAY 0x8DC1
+#endif
+
+typedef void (QOPENGLF_APIENTRYP GetBufferSubData)(GLenum target, qopengl_GLintptr offset, 
+    qopengl_GLsizeiptr size, void * data);
+
+namespace {
+
+struct ProgramSource
+{
+    QByteArray vshaderSource, fshaderSource;
+    QVector<QPair<GLuint, QByteArray>> attributeLocations;
+    QVector<QPair<GLuint, QByteArray>> uniformBlockBindings;
+};
+
+// the running capture, only touched by the thread of the captured context
+struct Capture
+{
+    bool active = false;
+    QSize viewport;
+
+    QVector<quint32> words;
+    int commandCount = 0;
+    QVector<QByteArray> blobs;
+
+    QByteArray resources;
+    quint32 resourceCount = 0;
+    QSet<GLuint> buffers, textures, programs; // already snapshot
+
+    QHash<GLuint, ProgramSource> programSources; // kept between captures
+};
+
+Capture capture;
+
+QOpenGLFunctions * gl()
+{
+    return QOpenGLContext::currentContext()->functions();
+}
+
+// appends one command, its argument count is patched in when the command is complete
+class Command
+{
+public:
+    explicit Command(Opcode opcode) : _start(capture.words.size())
+    {
+        capture.words << opcode;
+    }
+    ~Command()
+    {
+        capture.words[_start] |= quint32(capture.words.size() - _start - 1) << 16;
+        capture.commandCount++;
+    }
+
+    Command & operator<<(quint32 v) { capture.words << v; return *this; }
+    Command & operator<<(qint32 v) { capture.words << quint32(v); return *this; }
+    Command & operator<<(float v) 
+    {
+        quint32 w;
+        memcpy(&w, &v, sizeof(w));
+        capture.words << w;
+        return *this;
+    }
+    Command & operator<<(double v)
+    {
+        quint64 w;
+        memcpy(&w, &v, sizeof(w));
+        capture.words << quint32(w) << quint32(w >> 32);
+        return *this;
+    }
+
+private:
+    int _start;
+    Q_DISABLE_COPY(Command)
+};
+
+// a blob of the frame, returns its index or 0xffffffff if there is no data
+quint32 addBlob(const void * data, qint64 size)
+{
+    if (!data) {
+        return 0xffffffff;
+    }
+    capture.blobs << QByteArray(reinterpret_cast<const char *>(data), int(size));
+    return capture.blobs.size() - 1;
+}
+
+// a stream appending to the resources of the capture
+class ResourceStream : public QDataStream
+{
+public:
+    ResourceStream() : QDataStream(&capture.resources, QIODevice::WriteOnly | QIODevice::Append)
+    {
+        setVersion(QDataStream::Qt_5_0);
+        setByteOrder(QDataStream::LittleEndian);
+    }
+};
+
+// the content of a buffer bound to target
+void snapshotBuffer(GLenum target, GLuint buffer)
+{
+    if (buffer == 0 || capture.buffers.contains(buffer)) {
+        return;
+    }
+    capture.buffers.insert(buffer);
+
+    static GetBufferSubData getBufferSubData = reinterpret_cast<GetBufferSubData>(
+        QOpenGLContext::currentContext()->getProcAddress("glGetBufferSubData"));
+    GLint size = 0;
+    gl()->glGetBufferParameteriv(target, GL_BUFFER_SIZE, &size);
+    QByteArray data(size, 0);
+    if (getBufferSubData && size > 0) {
+        getBufferSubData(target, 0, size, data.data());
+    } else if (size > 0) {
+        qWarning("Cannot read back buffer %u, it is replayed with zeros", buffer);
+    }
+
+    ResourceStream() << quint8(Buffer) << quint32(buffer) << data;
+    capture.resourceCount++;
+}
+
+// level 0 of a texture bound to target, as rgba8 (all the layers of an array)
+void snapshotTexture(GLenum target, GLuint texture)
+{
+    if (texture == 0 || capture.textures.contains(texture)) {
+        return;
+    }
+    capture.textures.insert(texture);
+    if (target != GL_TEXTURE_2D && target != GL_TEXTURE_2D_ARRAY) {
+        qWarning("Only 2d textures and 2d texture arrays are captured, texture %u is skipped", texture);
+        return;
+    }
+
+    GLint width = 0, height = 0, layers = 1, minFilter = 0, magFilter = 0, wrapS = 0, wrapT = 0;
+    ::glGetTexLevelParameteriv(target, 0, GL_TEXTURE_WIDTH, &width);
+    ::glGetTexLevelParameteriv(target, 0, GL_TEXTURE_HEIGHT, &height);
+    if (target == GL_TEXTURE_2D_ARRAY) {
+        ::glGetTexLevelParameteriv(target, 0, GL_TEXTURE_DEPTH, &layers);
+    }
+    ::glGetTexParameteriv(target, GL_TEXTURE_MIN_FILTER, &minFilter);
+    ::glGetTexParameteriv(target, GL_TEXTURE_MAG_FILTER, &magFilter);
+    ::glGetTexParameteriv(target, GL_TEXTURE_WRAP_S, &wrapS);
+    ::glGetTexParameteriv(target, GL_TEXTURE_WRAP_T, &wrapT);
+    QByteArray pixels(width * height * layers * 4, 0);
+    ::glGetTexImage(target, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+
+    ResourceStream() << quint8(Texture) << quint32(texture) << quint32(target) 
+        << qint32(width) << qint32(height) << qint32(layers) << qint32(minFilter) << qint32(magFilter) 
+        << qint32(wrapS) << qint32(wrapT) << pixels;
+    capture.resourceCount++;
+}
+
+// number of values of a uniform type, and whether they are integers
+int uniformComponents(GLenum type, bool * isInteger)
+{
+    *isInteger = false;
+    switch (type) {
+    case GL_FLOAT: return 1;
+    case GL_FLOAT_VEC2: return 2;
+    case GL_FLOAT_VEC3: return 3;
+    case GL_FLOAT_VEC4: return 4;
+    case GL_FLOAT_MAT2: return 4;
+    case GL_FLOAT_MAT3: return 9;
+    case GL_FLOAT_MAT4: return 16;
+    case GL_INT:
+    case GL_BOOL:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_CUBE:
+        *isInteger = true;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// the sources of a program in use, and the current values of its uniforms
+void snapshotProgram(GLuint program)
+{
+    if (program == 0 || capture.programs.contains(program)) {
+        return;
+    }
+    capture.programs.insert(program);
+    if (!capture.programSources.contains(program)) {
+        qWarning("Program %u was not built by ShaderProgram, it is replayed as program 0", program);
+        return;
+    }
+    const ProgramSource & source = capture.programSources[program];
+
+    ResourceStream stream;
+    stream << quint8(Program) << quint32(program) << source.vshaderSource << source.fshaderSource;
+    stream << quint32(source.attributeLocations.size());
+    for (auto & attr : source.attributeLocations) {
+        stream << quint32(attr.first) << attr.second;
+    }
+    stream << quint32(source.uniformBlockBindings.size());
+    for (auto & block : source.uniformBlockBindings) {
+        stream << quint32(block.first) << block.second;
+    }
+
+    // uniforms keep their values across frames, so the frame may not set them
+    QVector<QPair<GLint, QPair<QByteArray, QPair<GLenum, QByteArray>>>> uniforms;
+    GLint count = 0;
+    gl()->glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    for (int i = 0; i < count; i++) {
+        char name[256];
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        gl()->glGetActiveUniform(program, i, sizeof(name), &length, &size, &type, name);
+        GLint location = gl()->glGetUniformLocation(program, name);
+        bool isInteger = false;
+        int components = uniformComponents(type, &isInteger);
+        // uniforms in blocks have no location
+        if (location < 0 || components == 0) {
+            continue;
+        }
+        QByteArray value(components * 4, 0);
+        if (isInteger) {
+            gl()->glGetUniformiv(program, location, reinterpret_cast<GLint *>(value.data()));
+        } else {
+            gl()->glGetUniformfv(program, location, reinterpret_cast<GLfloat *>(value.data()));
+        }
+        uniforms << qMakePair(location, qMakePair(QByteArray(name, length), qMakePair(type, value)));
+    }
+    stream << quint32(uniforms.size());
+    for (auto & u : uniforms) {
+        stream << qint32(u.first) << u.second.first << quint32(u.second.second.first) << u.second.second.second;
+    }
+    capture.resourceCount++;
+}
+
+}
+
+void GLCapture::start()
+{
+    capture.active = true;
+    capture.words.clear();
+    capture.commandCount = 0;
+    capture.blobs.clear();
+    capture.resources.clear();
+    capture.resourceCount = 0;
+    capture.buffers.clear();
+    capture.textures.clear();
+    capture.programs.clear();
+
+    // the frame is replayed in a new context, so it must set all of its state
+    GLStateCache::invalidateAll();
+
+    GLint viewport[4];
+    ::glGetIntegerv(GL_VIEWPORT, viewport);
+    capture.viewport = QSize(viewport[2], viewport[3]);
+    Command(Viewport) << viewport[0] << viewport[1] << viewport[2] << viewport[3];
+}
+
+bool GLCapture::isCapturing()
+{
+    return capture.active;
+}
+
+bool GLCapture::finish(const QString & file)
+{
+    capture.active = false;
+
+    QSaveFile f(file);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning("Cannot write the capture %s", qPrintable(file));
+        return false;
+    }
+    QDataStream stream(&f);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << quint32(Magic) << quint32(Version) 
+        << qint32(capture.viewport.width()) << qint32(capture.viewport.height());
+    stream << capture.resourceCount;
+    stream.writeRawData(capture.resources.constData(), capture.resources.size());
+    stream << quint32(capture.blobs.size());
+    for (const QByteArray & blob : capture.blobs) {
+        stream << blob;
+    }
+    stream << quint32(capture.commandCount) << quint32(capture.words.size());
+    for (quint32 w : capture.words) {
+        stream << w;
+    }
+    if (stream.status() != QDataStream::Ok || !f.commit()) {
+        qWarning("Cannot write the capture %s", qPrintable(file));
+        return false;
+    }
+    qDebug("Captured %d calls, %u resources and %d uploads into %s", 
+        capture.commandCount, capture.resourceCount, capture.blobs.size(), qPrintable(file));
+    return true;
+}
+
+int GLCapture::commandCount()
+{
+    return capture.commandCount;
+}
+
+void GLCapture::registerProgram(GLuint program, const QByteArray & vshaderSource, 
+    const QByteArray & fshaderSource, const QVector<QPair<GLuint, QByteArray>> & attributeLocations,
+    const QVector<QPair<GLuint, QByteArray>> & uniformBlockBindings)
+{
+    ProgramSource source = { vshaderSource, fshaderSource, attributeLocations, uniformBlockBindings };
+    capture.programSources.insert(program, source);
+}
+
+//// fixed pipeline
+
+void GLCapture::glBegin(GLenum mode)
+{
+    ::glBegin(mode);
+    if (capture.active) {
+        Command(Begin) << mode;
+    }
+}
+
+void GLCapture::glEnd()
+{
+    ::glEnd();
+    if (capture.active) {
+        Command c(End);
+    }
+}
+
+void GLCapture::glVertex2d(GLdouble x, GLdouble y)
+{
+    ::glVertex2d(x, y);
+    if (capture.active) {
+        Command(Vertex2d) << x << y;
+    }
+}
+
+void GLCapture::glVertex3fv(const GLfloat * v)
+{
+    ::glVertex3fv(v);
+    if (capture.active) {
+        Command(Vertex3f) << v[0] << v[1] << v[2];
+    }
+}
+
+void GLCapture::glVertex4fv(const GLfloat * v)
+{
+    ::glVertex4fv(v);
+    if (capture.active) {
+        Command(Vertex4f) << v[0] << v[1] << v[2] << v[3];
+    }
+}
+
+void GLCapture::glVertex4dv(const GLdouble * v)
+{
+    ::glVertex4dv(v);
+    if (capture.active) {
+        Command(Vertex4d) << v[0] << v[1] << v[2] << v[3];
+    }
+}
+
+void GLCapture::glNormal3fv(const GLfloat * v)
+{
+    ::glNormal3fv(v);
+    if (capture.active) {
+        Command(Normal3f) << v[0] << v[1] << v[2];
+    }
+}
+
+void GLCapture::glTexCoord2fv(const GLfloat * v)
+{
+    ::glTexCoord2fv(v);
+    if (capture.active) {
+        Command(TexCoord2f) << v[0] << v[1];
+    }
+}
+
+void GLCapture::glColor3f(GLfloat r, GLfloat g, GLfloat b)
+{
+    ::glColor3f(r, g, b);
+    if (capture.active) {
+        Command(Color3f) << r << g << b;
+    }
+}
+
+void GLCapture::glColor3fv(const GLfloat * v)
+{
+    ::glColor3fv(v);
+    if (capture.active) {
+        Command(Color3f) << v[0] << v[1] << v[2];
+    }
+}
+
+void GLCapture::glColor4d(GLdouble r, GLdouble g, GLdouble b, GLdouble a)
+{
+    ::glColor4d(r, g, b, a);
+    if (capture.active) {
+        Command(Color4d) << r << g << b << a;
+    }
+}
+
+void GLCapture::glColor4dv(const GLdouble * v)
+{
+    ::glColor4dv(v);
+    if (capture.active) {
+        Command(Color4d) << v[0] << v[1] << v[2] << v[3];
+    }
+}
+
+void GLCapture::glMatrixMode(GLenum mode)
+{
+    ::glMatrixMode(mode);
+    if (capture.active) {
+        Command(MatrixMode) << mode;
+    }
+}
+
+void GLCapture::glLoadIdentity()
+{
+    ::glLoadIdentity();
+    if (capture.active) {
+        Command c(LoadIdentity);
+    }
+}
+
+void GLCapture::glLoadMatrixf(const GLfloat * m)
+{
+    ::glLoadMatrixf(m);
+    if (capture.active) {
+        Command c(LoadMatrixf);
+        for (int i = 0; i < 16; i++) {
+            c << m[i];
+        }
+    }
+}
+
+void GLCapture::glMultMatrixf(const GLfloat * m)
+{
+    ::glMultMatrixf(m);
+    if (capture.active) {
+        Command c(MultMatrixf);
+        for (int i = 0; i < 16; i++) {
+            c << m[i];
+        }
+    }
+}
+
+void GLCapture::glShadeModel(GLenum mode)
+{
+    ::glShadeModel(mode);
+    if (capture.active) {
+        Command(ShadeModel) << mode;
+    }
+}
+
+// number of values taken by glMaterialfv / glLightfv for a parameter
+static int parameterCount(GLenum pname)
+{
+    switch (pname) {
+    case GL_SHININESS:
+    case GL_SPOT_EXPONENT:
+    case GL_SPOT_CUTOFF:
+    case GL_CONSTANT_ATTENUATION:
+    case GL_LINEAR_ATTENUATION:
+    case GL_QUADRATIC_ATTENUATION:
+        return 1;
+    case GL_COLOR_INDEXES:
+    case GL_SPOT_DIRECTION:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+void GLCapture::glMaterialfv(GLenum face, GLenum pname, const GLfloat * params)
+{
+    ::glMaterialfv(face, pname, params);
+    if (capture.active) {
+        Command c(Materialfv);
+        c << face << pname;
+        for (int i = 0; i < parameterCount(pname); i++) {
+            c << params[i];
+        }
+    }
+}
+
+void GLCapture::glLightfv(GLenum light, GLenum pname, const GLfloat * params)
+{
+    ::glLightfv(light, pname, params);
+    if (capture.active) {
+        Command c(Lightfv);
+        c << light << pname;
+        for (int i = 0; i < parameterCount(pname); i++) {
+            c << params[i];
+        }
+    }
+}
+
+//// rasterization and framebuffer
+
+void GLCapture::glLineWidth(GLfloat width)
+{
+    ::glLineWidth(width);
+    if (capture.active) {
+        Command(LineWidth) << width;
+    }
+}
+
+void GLCapture::glPointSize(GLfloat size)
+{
+    ::glPointSize(size);
+    if (capture.active) {
+        Command(PointSize) << size;
+    }
+}
+
+void GLCapture::glClear(GLbitfield mask)
+{
+    ::glClear(mask);
+    if (capture.active) {
+        Command(Clear) << quint32(mask);
+    }
+}
+
+void GLCapture::glClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+    ::glClearColor(r, g, b, a);
+    if (capture.active) {
+        Command(ClearColor) << r << g << b << a;
+    }
+}
+
+void GLCapture::glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    ::glViewport(x, y, width, height);
+    if (capture.active) {
+        Command(Viewport) << x << y << qint32(width) << qint32(height);
+    }
+}
+
+void GLCapture::glEnable(GLenum cap)
+{
+    ::glEnable(cap);
+    if (capture.active) {
+        Command(Enable) << cap;
+    }
+}
+
+void GLCapture::glDisable(GLenum cap)
+{
+    ::glDisable(cap);
+    if (capture.active) {
+        Command(Disable) << cap;
+    }
+}
+
+void GLCapture::glBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+    ::glBlendFunc(sfactor, dfactor);
+    if (capture.active) {
+        Command(BlendFunc) << sfactor << dfactor;
+    }
+}
+
+//// textures
+
+void GLCapture::glActiveTexture(GLenum texture)
+{
+    gl()->glActiveTexture(texture);
+    if (capture.active) {
+        Command(ActiveTexture) << texture;
+    }
+}
+
+void GLCapture::glBindTexture(GLenum target, GLuint texture)
+{
+    ::glBindTexture(target, texture);
+    if (capture.active) {
+        snapshotTexture(target, texture);
+        Command(BindTexture) << target << texture;
+    }
+}
+
+//// buffers
+
+void GLCapture::glBindBuffer(GLenum target, GLuint buffer)
+{
+    gl()->glBindBuffer(target, buffer);
+    if (capture.active) {
+        snapshotBuffer(target, buffer);
+        Command(BindBuffer) << target << buffer;
+    }
+}
+
+void GLCapture::glBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    QOpenGLContext::currentContext()->extraFunctions()->glBindBufferBase(target, index, buffer);
+    if (capture.active) {
+        // also bound to the generic target, from where it is read back
+        snapshotBuffer(target, buffer);
+        Command(BindBufferBase) << target << index << buffer;
+    }
+}
+
+void GLCapture::glBufferData(GLenum target, qopengl_GLsizeiptr size, const void * data, GLenum usage)
+{
+    gl()->glBufferData(target, size, data, usage);
+    if (capture.active) {
+        Command(BufferData) << target << quint32(size) << addBlob(data, size) << usage;
+    }
+}
+
+void GLCapture::glBufferSubData(GLenum target, qopengl_GLintptr offset, qopengl_GLsizeiptr size, const void * data)
+{
+    gl()->glBufferSubData(target, offset, size, data);
+    if (capture.active) {
+        Command(BufferSubData) << target << quint32(offset) << quint32(size) << addBlob(data, size);
+    }
+}
+
+//// programs and vertex arrays
+
+void GLCapture::glUseProgram(GLuint program)
+{
+    gl()->glUseProgram(program);
+    if (capture.active) {
+        snapshotProgram(program);
+        Command(UseProgram) << program;
+    }
+}
+
+void GLCapture::glUniform1i(GLint location, GLint x)
+{
+    gl()->glUniform1i(location, x);
+    if (capture.active) {
+        Command(Uniform1i) << location << x;
+    }
+}
+
+void GLCapture::glUniform1f(GLint location, GLfloat x)
+{
+    gl()->glUniform1f(location, x);
+    if (capture.active) {
+        Command(Uniform1f) << location << x;
+    }
+}
+
+void GLCapture::glUniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z)
+{
+    gl()->glUniform3f(location, x, y, z);
+    if (capture.active) {
+        Command(Uniform3f) << location << x << y << z;
+    }
+}
+
+void GLCapture::glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, 
+    GLsizei stride, const void * pointer)
+{
+    gl()->glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+    if (capture.active) {
+        // the demo only sources attributes from buffers, so the pointer is an offset
+        Command(VertexAttribPointer) << index << size << type << quint32(normalized) 
+            << qint32(stride) << quint32(quintptr(pointer));
+    }
+}
+
+void GLCapture::glEnableVertexAttribArray(GLuint index)
+{
+    gl()->glEnableVertexAttribArray(index);
+    if (capture.active) {
+        Command(EnableVertexAttribArray) << index;
+    }
+}
+
+void GLCapture::glDisableVertexAttribArray(GLuint index)
+{
+    gl()->glDisableVertexAttribArray(index);
+    if (capture.active) {
+        Command(DisableVertexAttribArray) << index;
+    }
+}
+
+void GLCapture::glDrawElements(GLenum mode, GLsizei count, GLenum type, const void * indices)
+{
+    ::glDrawElements(mode, count, type, indices);
+    if (capture.active) {
+        // the demo only draws from element buffers, so the pointer is an offset
+        Command(DrawElements) << mode << qint32(count) << type << quint32(quintptr(indices));
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QtOpenGL>
+
+// records the OpenGL calls of a frame with the content of the objects it uses, for the Replayer
+//
+//     GLCapture::start();
+//     renderer.renderFrame();
+//     GLCapture::finish("terrain.glcap");
+//
+// the files of the paint path include glcapturecalls.h, which routes their GL calls through the
+// wrappers below: each wrapper makes the real call, and records it while a capture is running
+// objects are snapshot when a call first refers to them during the capture, so the frame replays
+// without the widget that built them
+class GLCapture
+{
+public:
+    // start recording the calls made in the current context
+    // the state caches are invalidated, so the frame sets all of its state again
+    static void start();
+    static bool isCapturing();
+    // stop recording and write the frame, returns false if the file cannot be written
+    static bool finish(const QString & file);
+    // number of calls recorded by the running (or last) capture
+    static int commandCount();
+
+    // the sources of a program, needed to rebuild it in the replayer
+    static void registerProgram(GLuint program, const QByteArray & vshaderSource, 
+        const QByteArray & fshaderSource, const QVector<QPair<GLuint, QByteArray>> & attributeLocations,
+        const QVector<QPair<GLuint, QByteArray>> & uniformBlockBindings);
+
+    // the wrapped entry points
+    static void glBegin(GLenum mode);
+    static void glEnd();
+    static void glVertex2d(GLdouble x, GLdouble y);
+    static void glVertex3fv(const GLfloat * v);
+    static void glVertex4fv(const GLfloat * v);
+    static void glVertex4dv(const GLdouble * v);
+    static void glNormal3fv(const GLfloat * v);
+    static void glTexCoord2fv(const GLfloat * v);
+    static void glColor3f(GLfloat r, GLfloat g, GLfloat b);
+    static void glColor3fv(const GLfloat * v);
+    static void glColor4d(GLdouble r, GLdouble g, GLdouble b, GLdouble a);
+    static void glColor4dv(const GLdouble * v);
+    static void glMatrixMode(GLenum mode);
+    static void glLoadIdentity();
+    static void glLoadMatrixf(const GLfloat * m);
+    static void glMultMatrixf(const GLfloat * m);
+    static void glShadeModel(GLenum mode);
+    static void glMaterialfv(GLenum face, GLenum pname, const GLfloat * params);
+    static void glLightfv(GLenum light, GLenum pname, const GLfloat * params);
+
+    static void glLineWidth(GLfloat width);
+    static void glPointSize(GLfloat size);
+    static void glClear(GLbitfield mask);
+    static void glClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+    static void glViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    static void glEnable(GLenum cap);
+    static void glDisable(GLenum cap);
+    static void glBlendFunc(GLenum sfactor, GLenum dfactor);
+
+    static void glActiveTexture(GLenum texture);
+    static void glBindTexture(GLenum target, GLuint texture);
+
+    static void glBindBuffer(GLenum target, GLuint buffer);
+    static void glBindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    static void glBufferData(GLenum target, qopengl_GLsizeiptr size, const void * data, GLenum usage);
+    static void glBufferSubData(GLenum target, qopengl_GLintptr offset, qopengl_GLsizeiptr size, const void * data);
+
+    static void glUseProgram(GLuint program);
+    static void glUniform1i(GLint location, GLint x);
+    static void glUniform1f(GLint location, GLfloat x);
+    static void glUniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z);
+    static void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, 
+        GLsizei stride, const void * pointer);
+    static void glEnableVertexAttribArray(GLuint index);
+    static void glDisableVertexAttribArray(GLuint index);
+    static void glDrawElements(GLenum mode, GLsizei count, GLenum type, const void * indices);
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+// route the GL calls of the including file through GLCapture
+// include it last, and only in files calling these functions unqualified
+// (a call through a function table, e.g. f->glBindBuffer, would not compile)
+#include "glcapture.h"
+
+#define glBegin GLCapture::glBegin
+#define glEnd GLCapture::glEnd
+#define glVertex2d GLCapture::glVertex2d
+#define glVertex3fv GLCapture::glVertex3fv
+#define glVertex4fv GLCapture::glVertex4fv
+#define glVertex4dv GLCapture::glVertex4dv
+#define glNormal3fv GLCapture::glNormal3fv
+#define glTexCoord2fv GLCapture::glTexCoord2fv
+#define glColor3f GLCapture::glColor3f
+#define glColor3fv GLCapture::glColor3fv
+#define glColor4d GLCapture::glColor4d
+#define glColor4dv GLCapture::glColor4dv
+#define glMatrixMode GLCapture::glMatrixMode
+#define glLoadIdentity GLCapture::glLoadIdentity
+#define glLoadMatrixf GLCapture::glLoadMatrixf
+#define glMultMatrixf GLCapture::glMultMatrixf
+#define glShadeModel GLCapture::glShadeModel
+#define glMaterialfv GLCapture::glMaterialfv
+#define glLightfv GLCapture::glLightfv
+
+#define glLineWidth GLCapture::glLineWidth
+#define glPointSize GLCapture::glPointSize
+#define glClear GLCapture::glClear
+#define glClearColor GLCapture::glClearColor
+#define glViewport GLCapture::glViewport
+#define glEnable GLCapture::glEnable
+#define glDisable GLCapture::glDisable
+#define glBlendFunc GLCapture::glBlendFunc
+
+#define glActiveTexture GLCapture::glActiveTexture
+#define glBindTexture GLCapture::glBindTexture
+
+#define glBindBuffer GLCapture::glBindBuffer
+#define glBindBufferBase GLCapture::glBindBufferBase
+#define glBufferData GLCapture::glBufferData
+#define glBufferSubData GLCapture::glBufferSubData
+
+#define glUseProgram GLCapture::glUseProgram
+#define glUniform1i GLCapture::glUniform1i
+#define glUniform1f GLCapture::glUniform1f
+#define glUniform3f GLCapture::glUniform3f
+#define glVertexAttribPointer GLCapture::glVertexAttribPointer
+#define glEnableVertexAttribArray GLCapture::glEnableVertexAttribArray
+#define glDisableVertexAttribArray GLCapture::glDisableVertexAttribArray
+#define glDrawElements GLCapture::glDrawElements
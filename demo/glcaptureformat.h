@@ -0,0 +1,78 @@
+#pragma once
+
+#include <QtGlobal>
+
+// the file format of a captured frame (GLCapture writes it, the Replayer reads it)
+//
+// all values are written with a QDataStream (Qt_5_0, little endian):
+//   quint32 magic, quint32 version, qint32 width, qint32 height (the viewport of the frame)
+//   quint32 resource count, then the resources (see ResourceType)
+//   quint32 blob count, then the blobs as QByteArray (buffer uploads of the frame)
+//   quint32 command count, quint32 word count, then the words of the commands
+//
+// a command is one word (opcode | argument word count << 16) followed by its argument words,
+// floats are stored as their bits, doubles as two words (low, high), 
+// object ids are the ids of the capturing context and are remapped by the replayer
+namespace GLCaptureFormat {
+
+enum : quint32 { Magic = 0x46434c47 /* "GLCF" */, Version = 2 };
+
+// resources are the objects used by the frame, with their content at the time they were first used:
+//   Buffer:  quint32 id, QByteArray data
+//   Texture: quint32 id, quint32 target, qint32 width, height, layers, minFilter, magFilter, wrapS, wrapT,
+//            QByteArray rgba8 pixels of level 0 (of every layer of a GL_TEXTURE_2D_ARRAY, 1 layer otherwise)
+//   Program: quint32 id, QByteArray vertex shader, QByteArray fragment shader,
+//            quint32 n, n x (quint32 location, QByteArray name) attribute bindings,
+//            quint32 n, n x (quint32 binding, QByteArray name) uniform block bindings,
+//            quint32 n, n x (qint32 location, QByteArray name, quint32 type, QByteArray value) uniforms
+enum ResourceType : quint8 { Buffer = 1, Texture, Program };
+
+enum Opcode : quint16 {
+    // fixed pipeline
+    Begin = 1,      // mode
+    End,            //
+    Vertex2d,       // 2 doubles
+    Vertex3f,       // 3 floats
+    Vertex4f,       // 4 floats
+    Vertex4d,       // 4 doubles
+    Normal3f,       // 3 floats
+    TexCoord2f,     // 2 floats
+    Color3f,        // 3 floats
+    Color4d,        // 4 doubles
+    MatrixMode,     // mode
+    LoadIdentity,   //
+    LoadMatrixf,    // 16 floats
+    MultMatrixf,    // 16 floats
+    ShadeModel,     // mode
+    Materialfv,     // face, pname, up to 4 floats
+    Lightfv,        // light, pname, up to 4 floats
+    // rasterization and framebuffer
+    LineWidth,      // float
+    PointSize,      // float
+    Clear,          // mask
+    ClearColor,     // 4 floats
+    Viewport,       // x, y, width, height
+    Enable,         // cap
+    Disable,        // cap
+    BlendFunc,      // sfactor, dfactor
+    // textures
+    ActiveTexture,  // texture unit
+    BindTexture,    // target, texture
+    // buffers
+    BindBuffer,     // target, buffer
+    BindBufferBase, // target, index, buffer
+    BufferData,     // target, size, blob (0xffffffff for no data), usage
+    BufferSubData,  // target, offset, size, blob
+    // programs and vertex arrays
+    UseProgram,     // program
+    Uniform1i,      // location, int
+    Uniform1f,      // location, float
+    Uniform3f,      // location, 3 floats
+    VertexAttribPointer,      // index, size, type, normalized, stride, offset
+    EnableVertexAttribArray,  // index
+    DisableVertexAttribArray, // index
+    DrawElements,   // mode, count, type, offset
+    OpcodeCount
+};
+
+}
@@ -0,0 +1,120 @@
+#include "memorytracker.h"
+
+#include "glresourceregistry.h"
+
+GLResourceRegistry & GLResourceRegistry::instance()
+{
+    static GLResourceRegistry registry;
+    return registry;
+}
+
+GLResourceRegistry::GLResourceRegistry()
+{
+    _totalBytes = 0;
+    _uploadCount = 0;
+    _reuseCount = 0;
+}
+
+GLuint GLResourceRegistry::acquire(Type type, const QString & asset)
+{
+    QMutexLocker lock(&_mutex);
+    auto it = _objects.find(key(type, asset));
+    if (it == _objects.end()) {
+        return 0;
+    }
+    it->refCount++;
+    _reuseCount++;
+    return it->id;
+}
+
+GLuint GLResourceRegistry::acquireOrCreate(Type type, const QString & asset,
+    const std::function<GLuint(qint64 * bytes)> & create)
+{
+    QMutexLocker lock(&_mutex);
+    auto it = _objects.find(key(type, asset));
+    if (it != _objects.end()) {
+        it->refCount++;
+        _reuseCount++;
+        return it->id;
+    }
+    qint64 bytes = 0;
+    GLuint id = create(&bytes);
+    if (id != 0) {
+        insertObject(type, asset, id, bytes);
+    }
+    return id;
+}
+
+QVector<GLuint> GLResourceRegistry::acquireOrInsert(Type type, const QStringList & assets,
+    const QVector<GLuint> & ids, const QVector<qint64> & bytes)
+{
+    Q_ASSERT(assets.size() == ids.size() && ids.size() == bytes.size());
+    QMutexLocker lock(&_mutex);
+    QVector<GLuint> stored = ids;
+    for (int i = 0; i < assets.size(); i++) {
+        auto it = _objects.find(key(type, assets[i]));
+        if (it != _objects.end()) {
+            it->refCount++;
+            _reuseCount++;
+            stored[i] = it->id;
+        } else {
+            insertObject(type, assets[i], ids[i], bytes[i]);
+        }
+    }
+    return stored;
+}
+
+void GLResourceRegistry::insertObject(Type type, const QString & asset, GLuint id, qint64 bytes)
+{
+    Object object = { id, bytes, 1, MemoryTracker::contextOwner() };
+    _objects.insert(key(type, asset), object);
+    MemoryTracker::add(MemoryTracker::Gpu, object.owner, asset, bytes);
+    _totalBytes += bytes;
+    _uploadCount++;
+}
+
+void GLResourceRegistry::release(Type type, const QString & asset)
+{
+    QMutexLocker lock(&_mutex);
+    auto it = _objects.find(key(type, asset));
+    if (it == _objects.end() || --it->refCount > 0) {
+        return;
+    }
+
+    // the last reference is gone, delete the object
+    const QGLContext * context = QGLContext::currentContext();
+    Q_ASSERT(context);
+    QGLFunctions f(context);
+    switch (type) {
+    case Buffer:
+        f.glDeleteBuffers(1, &it->id);
+        break;
+    case Texture:
+        // also removes the texture from the cache of QGLContext::bindTexture
+        const_cast<QGLContext *>(context)->deleteTexture(it->id);
+        break;
+    case Program:
+        f.glDeleteProgram(it->id);
+        break;
+    }
+    _totalBytes -= it->bytes;
+    MemoryTracker::add(MemoryTracker::Gpu, it->owner, asset, -it->bytes);
+    _objects.erase(it);
+}
+
+QSharedPointer<ShaderVariants> GLResourceRegistry::shaderVariants(const QString & key,
+    const std::function<ShaderVariants *()> & create)
+{
+    QMutexLocker lock(&_mutex);
+    QSharedPointer<ShaderVariants> variants = _shaderVariants.value(key).toStrongRef();
+    if (!variants) {
+        variants = QSharedPointer<ShaderVariants>(create());
+        _shaderVariants.insert(key, variants);
+    }
+    return variants;
+}
+
+QString GLResourceRegistry::key(Type type, const QString & asset)
+{
+    return QString::number(type) + ":" + asset;
+}
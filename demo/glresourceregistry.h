@@ -0,0 +1,66 @@
+#pragma once
+
+#include <functional>
+
+#include <QtOpenGL>
+
+#include "shadervariants.h"
+
+// the GPU objects shared by all the widgets of one OpenGL share group, keyed by asset
+// a widget first asks for the object of an asset and only uploads it if no other widget did so,
+// so that an asset shown in several windows is stored in VRAM once
+// the registry may be used from the render threads of the widgets, every call is serialized by a mutex
+class GLResourceRegistry
+{
+public:
+    enum Type { Buffer, Texture, Program };
+
+    static GLResourceRegistry & instance();
+
+    // the id of the object stored for the asset, or 0 if it has not been uploaded yet
+    // on success the caller holds a new reference to the object
+    GLuint acquire(Type type, const QString & asset);
+    // the id of the object stored for the asset, or the one made by 'create' (which also returns its bytes)
+    // when there is none yet; the caller holds a new reference to the object either way
+    // the registry stays locked while 'create' uploads, so two widgets never upload the same asset
+    GLuint acquireOrCreate(Type type, const QString & asset, const std::function<GLuint(qint64 * bytes)> & create);
+    // store the objects uploaded for the assets, unless other objects were stored for them since: the returned
+    // ids are the stored ones, the caller deletes its objects that are not among them
+    // the caller holds a new reference to every returned object
+    QVector<GLuint> acquireOrInsert(Type type, const QStringList & assets, const QVector<GLuint> & ids,
+        const QVector<qint64> & bytes);
+    // drop a reference, the object is deleted with the last one (a context of the share group must be current)
+    void release(Type type, const QString & asset);
+
+    // the shader variants stored for the key, created by 'create' on first use
+    // variants build their programs lazily, so a variant is compiled once for the whole share group
+    QSharedPointer<ShaderVariants> shaderVariants(const QString & key,
+        const std::function<ShaderVariants *()> & create);
+
+    // statistics
+    int objectCount() const { return _objects.size(); }
+    qint64 totalBytes() const { return _totalBytes; }
+    int uploadCount() const { return _uploadCount; }
+    int reuseCount() const { return _reuseCount; }
+
+private:
+    GLResourceRegistry();
+
+    struct Object
+    {
+        GLuint id;
+        qint64 bytes;
+        int refCount;
+        QString owner; // the widget that uploaded it, in MemoryTracker
+    };
+    static QString key(Type type, const QString & asset);
+    // store a new object with one reference, the mutex is held
+    void insertObject(Type type, const QString & asset, GLuint id, qint64 bytes);
+
+    mutable QMutex _mutex;
+    QHash<QString, Object> _objects;
+    QHash<QString, QWeakPointer<ShaderVariants>> _shaderVariants;
+
+    qint64 _totalBytes;
+    int _uploadCount, _reuseCount;
+};
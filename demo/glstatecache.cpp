@@ -0,0 +1,300 @@
+#include "glstatecache.h"
+
+#include "glcapturecalls.h"
+
+static QAtomicInteger<qint64> totalIssued;
+static QAtomicInteger<qint64> totalFiltered;
+static QAtomicInt epoch;
+
+// number of values taken by glMaterialfv / glLightfv for a parameter
+static int parameterCount(GLenum pname)
+{
+    switch (pname) {
+    case GL_SHININESS:
+    case GL_SPOT_EXPONENT:
+    case GL_SPOT_CUTOFF:
+    case GL_CONSTANT_ATTENUATION:
+    case GL_LINEAR_ATTENUATION:
+    case GL_QUADRATIC_ATTENUATION:
+        return 1;
+    case GL_COLOR_INDEXES:
+    case GL_SPOT_DIRECTION:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+static QVector4D toVector(const GLfloat * params, int count)
+{
+    QVector4D v;
+    for (int i = 0; i < count; i++) {
+        v[i] = params[i];
+    }
+    return v;
+}
+
+GLStateCache::GLStateCache()
+    : QGLFunctions()
+{
+    _activeTexture = 0;
+    _epoch = epoch.load();
+    _issuedCalls = 0;
+    _filteredCalls = 0;
+}
+
+GLStateCache::~GLStateCache()
+{}
+
+void GLStateCache::initialize(const QGLContext * context)
+{
+    initializeGLFunctions(context);
+    invalidate();
+}
+
+void GLStateCache::invalidate()
+{
+    _intStates.clear();
+    _floatStates.clear();
+    _activeTexture = 0;
+}
+
+void GLStateCache::invalidateAll()
+{
+    epoch.fetchAndAddRelaxed(1);
+}
+
+void GLStateCache::setEnabled(GLenum cap, bool enabled)
+{
+    if (!update(key(Capability, cap), enabled)) {
+        countFiltered();
+        return;
+    }
+    if (enabled) {
+        glEnable(cap);
+    } else {
+        glDisable(cap);
+    }
+    countIssued();
+}
+
+void GLStateCache::blendFunc(GLenum sfactor, GLenum dfactor)
+{
+    if (!update(key(BlendFunc), QVector4D(sfactor, dfactor, 0, 0))) {
+        countFiltered();
+        return;
+    }
+    glBlendFunc(sfactor, dfactor);
+    countIssued();
+}
+
+void GLStateCache::shadeModel(GLenum mode)
+{
+    if (!update(key(ShadeModel), mode)) {
+        countFiltered();
+        return;
+    }
+    glShadeModel(mode);
+    countIssued();
+}
+
+void GLStateCache::lineWidth(GLfloat width)
+{
+    if (!update(key(LineWidth), QVector4D(width, 0, 0, 0))) {
+        countFiltered();
+        return;
+    }
+    glLineWidth(width);
+    countIssued();
+}
+
+void GLStateCache::pointSize(GLfloat size)
+{
+    if (!update(key(PointSize), QVector4D(size, 0, 0, 0))) {
+        countFiltered();
+        return;
+    }
+    glPointSize(size);
+    countIssued();
+}
+
+void GLStateCache::clearColor(const QColor & color)
+{
+    QVector4D c(color.redF(), color.greenF(), color.blueF(), color.alphaF());
+    if (!update(key(ClearColor), c)) {
+        countFiltered();
+        return;
+    }
+    glClearColor(c.x(), c.y(), c.z(), c.w());
+    countIssued();
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+    if (!update(key(Program), program)) {
+        countFiltered();
+        return;
+    }
+    glUseProgram(program);
+    countIssued();
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+    if (!update(key(Buffer, target), buffer)) {
+        countFiltered();
+        return;
+    }
+    glBindBuffer(target, buffer);
+    countIssued();
+}
+
+void GLStateCache::enableVertexAttribArray(GLuint index)
+{
+    if (!update(key(VertexAttribArray, index), true)) {
+        countFiltered();
+        return;
+    }
+    glEnableVertexAttribArray(index);
+    countIssued();
+}
+
+void GLStateCache::disableVertexAttribArray(GLuint index)
+{
+    if (!update(key(VertexAttribArray, index), false)) {
+        countFiltered();
+        return;
+    }
+    glDisableVertexAttribArray(index);
+    countIssued();
+}
+
+void GLStateCache::activeTexture(GLenum texture)
+{
+    if (!update(key(ActiveTexture), texture)) {
+        countFiltered();
+        return;
+    }
+    glActiveTexture(texture);
+    _activeTexture = texture;
+    countIssued();
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint texture)
+{
+    // bindings can only be shadowed once the active texture unit is known
+    checkEpoch();
+    if (_activeTexture != 0 && !update(key(Texture, _activeTexture, target), texture)) {
+        countFiltered();
+        return;
+    }
+    glBindTexture(target, texture);
+    countIssued();
+}
+
+void GLStateCache::material(GLenum face, GLenum pname, const GLfloat * params)
+{
+    QVector4D v = toVector(params, parameterCount(pname));
+    if (face == GL_FRONT_AND_BACK) {
+        // both faces must already hold the value to skip the upload
+        bool frontChanged = update(key(Material, GL_FRONT, pname), v);
+        bool backChanged = update(key(Material, GL_BACK, pname), v);
+        if (!frontChanged && !backChanged) {
+            countFiltered();
+            return;
+        }
+    } else if (!update(key(Material, face, pname), v)) {
+        countFiltered();
+        return;
+    }
+    glMaterialfv(face, pname, params);
+    countIssued();
+}
+
+void GLStateCache::material(GLenum face, GLenum pname, GLfloat param)
+{
+    material(face, pname, &param);
+}
+
+void GLStateCache::light(GLenum light, GLenum pname, const GLfloat * params)
+{
+    if (!update(key(Light, light, pname), toVector(params, parameterCount(pname)))) {
+        countFiltered();
+        return;
+    }
+    glLightfv(light, pname, params);
+    countIssued();
+}
+
+void GLStateCache::resetCounters()
+{
+    _issuedCalls = 0;
+    _filteredCalls = 0;
+}
+
+qint64 GLStateCache::totalIssuedCalls()
+{
+    return totalIssued.load();
+}
+
+qint64 GLStateCache::totalFilteredCalls()
+{
+    return totalFiltered.load();
+}
+
+quint64 GLStateCache::key(StateKind kind, quint32 a, quint32 b)
+{
+    return (quint64(kind) << 56) | (quint64(a & 0xffffff) << 32) | b;
+}
+
+void GLStateCache::checkEpoch()
+{
+    int e = epoch.load();
+    if (_epoch != e) {
+        invalidate();
+        _epoch = e;
+    }
+}
+
+bool GLStateCache::update(quint64 key, quint32 value)
+{
+    checkEpoch();
+    auto it = _intStates.find(key);
+    if (it != _intStates.end()) {
+        if (it.value() == value) {
+            return false;
+        }
+        it.value() = value;
+    } else {
+        _intStates.insert(key, value);
+    }
+    return true;
+}
+
+bool GLStateCache::update(quint64 key, const QVector4D & value)
+{
+    checkEpoch();
+    auto it = _floatStates.find(key);
+    if (it != _floatStates.end()) {
+        // compare exactly, qFuzzyCompare would drop real changes
+        if (memcmp(&it.value(), &value, sizeof(QVector4D)) == 0) {
+            return false;
+        }
+        it.value() = value;
+    } else {
+        _floatStates.insert(key, value);
+    }
+    return true;
+}
+
+void GLStateCache::countIssued()
+{
+    _issuedCalls++;
+    totalIssued.fetchAndAddRelaxed(1);
+}
+
+void GLStateCache::countFiltered()
+{
+    _filteredCalls++;
+    totalFiltered.fetchAndAddRelaxed(1);
+}
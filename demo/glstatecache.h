@@ -0,0 +1,85 @@
+#pragma once
+
+#include <QtOpenGL>
+
+// a shadow copy of the OpenGL state of one context
+// every state change goes through this class, which only forwards it to OpenGL
+// if it differs from the shadowed value, and counts the calls it issued and filtered
+//
+// the shadow starts out unknown, so the first change of each state is always issued;
+// call invalidate() after code that changes the state behind the cache (e.g. QGLWidget::bindTexture)
+class GLStateCache : protected QGLFunctions
+{
+public:
+    GLStateCache();
+    ~GLStateCache();
+
+    // resolve the OpenGL functions of the context and forget the shadowed state
+    void initialize(const QGLContext * context);
+    // forget the shadowed state
+    void invalidate();
+    // make every cache forget its shadowed state before its next call (e.g. when a frame is captured)
+    static void invalidateAll();
+
+    // glEnable / glDisable
+    void enable(GLenum cap) { setEnabled(cap, true); }
+    void disable(GLenum cap) { setEnabled(cap, false); }
+    void setEnabled(GLenum cap, bool enabled);
+
+    // fixed pipeline and rasterization states
+    void blendFunc(GLenum sfactor, GLenum dfactor);
+    void shadeModel(GLenum mode);
+    void lineWidth(GLfloat width);
+    void pointSize(GLfloat size);
+    void clearColor(const QColor & color);
+
+    // bindings
+    void useProgram(GLuint program);
+    void bindBuffer(GLenum target, GLuint buffer);
+    void enableVertexAttribArray(GLuint index);
+    void disableVertexAttribArray(GLuint index);
+    void activeTexture(GLenum texture);
+    // binds to the current active texture unit
+    void bindTexture(GLenum target, GLuint texture);
+
+    // material and light uploads (glMaterialfv / glMaterialf / glLightfv)
+    // note that GL_POSITION and GL_SPOT_DIRECTION are transformed by the modelview matrix when they are set,
+    // so filtering them is only correct if the caller always sets them under the same modelview matrix
+    void material(GLenum face, GLenum pname, const GLfloat * params);
+    void material(GLenum face, GLenum pname, GLfloat param);
+    void light(GLenum light, GLenum pname, const GLfloat * params);
+
+    // statistics of this cache
+    qint64 issuedCalls() const { return _issuedCalls; }
+    qint64 filteredCalls() const { return _filteredCalls; }
+    void resetCounters();
+
+    // statistics of all the caches
+    static qint64 totalIssuedCalls();
+    static qint64 totalFilteredCalls();
+
+private:
+    // kinds of shadowed states, combined with up to two enums into a key
+    enum StateKind {
+        Capability = 1, BlendFunc, ShadeModel, LineWidth, PointSize, ClearColor,
+        Program, Buffer, VertexAttribArray, ActiveTexture, Texture, Material, Light
+    };
+    static quint64 key(StateKind kind, quint32 a = 0, quint32 b = 0);
+
+    // invalidate the cache if invalidateAll() was called since its last call
+    void checkEpoch();
+    // store a value, returns true if it differs from the shadowed one
+    bool update(quint64 key, quint32 value);
+    bool update(quint64 key, const QVector4D & value);
+
+    void countIssued();
+    void countFiltered();
+
+private:
+    QHash<quint64, quint32> _intStates;
+    QHash<quint64, QVector4D> _floatStates;
+    GLenum _activeTexture; // 0 if unknown
+    int _epoch; // the invalidateAll() count seen by this cache
+
+    qint64 _issuedCalls, _filteredCalls;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QtOpenGL>
+
+// exposes the protected hooks of QGLWidget, 
+// member pointers taken through it still dispatch to the overrides of the demo widgets:
+//     (widget->*&GLWidgetHooks::paintGL)();
+class GLWidgetHooks : public QGLWidget
+{
+public:
+    using QGLWidget::initializeGL;
+    using QGLWidget::resizeGL;
+    using QGLWidget::paintGL;
+};
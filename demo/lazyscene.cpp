@@ -0,0 +1,75 @@
+#include "profiler.h"
+#include "scenes.h"
+#include "startuptimeline.h"
+
+#include "lazyscene.h"
+
+LazyScene::LazyScene(const QString & name, const QGLWidget * shareWidget, QWidget * parent)
+    : QWidget(parent), _name(name), _shareWidget(shareWidget), _scene(nullptr), _hasFirstFrame(false)
+{
+    // the title and size of the scene are only known once it is created
+    setWindowTitle(name);
+    setMinimumSize(200, 200);
+    QVBoxLayout * layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+}
+
+void LazyScene::create()
+{
+    if (_scene) {
+        return;
+    }
+    PROFILE_SCOPE("LazyScene::create");
+    StartupTimeline::record(_name, StartupTimeline::Creating);
+    _scene = createScene(_name, _shareWidget);
+    StartupTimeline::record(_name, StartupTimeline::Created);
+    if (!_scene) {
+        return;
+    }
+
+    // the subwindow follows the title of its widget
+    setWindowTitle(_scene->windowTitle());
+    setFocusProxy(_scene);
+    _scene->installEventFilter(this);
+    layout()->addWidget(_scene);
+}
+
+void LazyScene::showEvent(QShowEvent * e)
+{
+    QWidget::showEvent(e);
+    if (!_scene) {
+        StartupTimeline::record(_name, StartupTimeline::Shown);
+        emit shownEmpty(this);
+    }
+}
+
+void LazyScene::paintEvent(QPaintEvent * e)
+{
+    Q_UNUSED(e);
+    if (_scene) {
+        return;
+    }
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+    painter.setPen(Qt::lightGray);
+    painter.drawText(rect(), Qt::AlignCenter, tr("Loading %1...").arg(_name));
+}
+
+bool LazyScene::eventFilter(QObject * object, QEvent * e)
+{
+    // the scene is painted while the event is delivered (or by its render thread right after)
+    if (object == _scene && e->type() == QEvent::Paint && !_hasFirstFrame) {
+        QMetaObject::invokeMethod(this, "framePainted", Qt::QueuedConnection);
+    }
+    return QWidget::eventFilter(object, e);
+}
+
+void LazyScene::framePainted()
+{
+    if (_hasFirstFrame) {
+        return;
+    }
+    _hasFirstFrame = true;
+    StartupTimeline::record(_name, StartupTimeline::FirstFrame);
+    emit firstFrame(this);
+}
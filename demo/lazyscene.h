@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QtOpenGL>
+
+// a subwindow of OpenGLDemoWindow whose scene widget is constructed on demand, so that the window
+// shows up before the meshes and maps of every scene are loaded
+// the window creates the scene once the subwindow is shown, or prefetches it while the GUI is idle;
+// until then a placeholder is painted
+class LazyScene : public QWidget
+{
+    Q_OBJECT
+
+public:
+    LazyScene(const QString & name, const QGLWidget * shareWidget, QWidget * parent = nullptr);
+
+    const QString & name() const { return _name; }
+    // the scene widget, nullptr until created
+    QGLWidget * scene() const { return _scene; }
+    bool hasFirstFrame() const { return _hasFirstFrame; }
+
+    // construct the scene widget, if it was not yet
+    void create();
+
+signals:
+    // the subwindow was shown before its scene was created
+    void shownEmpty(LazyScene * scene);
+    // the scene painted its first frame
+    void firstFrame(LazyScene * scene);
+
+protected:
+    virtual void showEvent(QShowEvent * e) override;
+    virtual void paintEvent(QPaintEvent * e) override;
+    virtual bool eventFilter(QObject * object, QEvent * e) override;
+
+private slots:
+    void framePainted();
+
+private:
+    QString _name;
+    const QGLWidget * _shareWidget;
+    QGLWidget * _scene;
+    bool _hasFirstFrame;
+};
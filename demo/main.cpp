@@ -2,15 +2,230 @@
 #include <QtWidgets>
 #include <QtOpenGL>
 
+#include "framescheduler.h"
+#include "glcapture.h"
+#include "memorytracker.h"
 #include "opengldemowindow.h"
+#include "offscreenrenderer.h"
+#include "profiler.h"
+#include "scenes.h"
+#include "softwarerasterizer.h"
+#include "softwareraytracer.h"
+#include "startuptimeline.h"
+#include "tilesource.h"
+#include "textureloader.h"
+
+// draw the scenes with the SoftwareRasterizer instead of OpenGL, returns the exit code
+static int renderSoftware(const QCommandLineParser & parser, const QStringList & names, const QSize & size, 
+    int frames, const QDir & outputDir)
+{
+    int threads = parser.value("threads").toInt();
+    SoftwareRasterizer rasterizer(threads > 0 ? threads : QThread::idealThreadCount());
+    rasterizer.setViewportSize(size);
+
+    for (const QString & name : names) {
+        QScopedPointer<QGLWidget> widget(createScene(name));
+        const SoftwareScene * scene = dynamic_cast<const SoftwareScene *>(widget.data());
+        if (!scene) {
+            qWarning("The scene %s cannot be drawn by the software rasterizer, skipped", qPrintable(name));
+            continue;
+        }
+        SoftwareMesh mesh = scene->softwareMesh(size);
+
+        rasterizer.resetStats();
+        for (int i = 0; i < frames; i++) {
+            rasterizer.clear(mesh.clearColor);
+            rasterizer.draw(mesh);
+            QString file = outputDir.filePath(QString("%1-%2.png").arg(name).arg(i, 4, 10, QChar('0')));
+            if (!rasterizer.image().save(file)) {
+                qWarning("Cannot write %s", qPrintable(file));
+                return 1;
+            }
+        }
+
+        SoftwareRasterizer::Stats stats = rasterizer.stats();
+        qDebug("%s: %d frame(s) in %.2f ms/frame on %d thread(s), %.2f M triangles/s, %.1f M pixels/s, %lld steals",
+            qPrintable(name), frames, stats.drawNanoseconds / 1e6 / frames, rasterizer.threadCount(),
+            stats.trianglesPerSecond() / 1e6, stats.pixelsPerSecond() / 1e6, stats.steals);
+    }
+    return 0;
+}
+
+// ray trace the scenes with the SoftwareRayTracer, accumulating one sample per pixel per frame,
+// returns the exit code
+static int renderRayTraced(const QCommandLineParser & parser, const QStringList & names, const QSize & size, 
+    int frames, const QDir & outputDir)
+{
+    int maxThreads = parser.value("threads").toInt() > 0 ? parser.value("threads").toInt() : QThread::idealThreadCount();
+    // the thread counts measured, 1, 2, 4, ... maxThreads with --scaling
+    QList<int> threadCounts;
+    if (parser.isSet("scaling")) {
+        for (int n = 1; n < maxThreads; n *= 2) {
+            threadCounts << n;
+        }
+    }
+    threadCounts << maxThreads;
+
+    for (const QString & name : names) {
+        QScopedPointer<QGLWidget> widget(createScene(name));
+        const SoftwareScene * scene = dynamic_cast<const SoftwareScene *>(widget.data());
+        if (!scene) {
+            qWarning("The scene %s cannot be drawn by the software ray tracer, skipped", qPrintable(name));
+            continue;
+        }
+        SoftwareMesh mesh = scene->softwareMesh(size);
+
+        double singleThreadRate = 0;
+        for (int threads : threadCounts) {
+            SoftwareRayTracer tracer(threads);
+            tracer.setViewportSize(size);
+            for (int i = 0; i < frames; i++) {
+                tracer.render(mesh);
+            }
+            SoftwareRayTracer::Stats stats = tracer.stats();
+            double rate = stats.megaRaysPerSecond();
+            if (threads == 1) {
+                singleThreadRate = rate;
+            }
+            qDebug("%s: %d sample(s) per pixel in %.1f ms/frame on %d thread(s), %.2f M rays/s%s (BVH built in %.1f ms)",
+                qPrintable(name), tracer.sampleCount(), stats.traceNanoseconds / 1e6 / frames, threads, rate,
+                singleThreadRate > 0 ? qPrintable(QString(", %1x the single thread rate").arg(rate / singleThreadRate, 0, 'f', 2)) : "",
+                stats.buildNanoseconds / 1e6);
+
+            if (threads == maxThreads) {
+                QString file = outputDir.filePath(name + "-raytraced.png");
+                if (!tracer.image().save(file)) {
+                    qWarning("Cannot write %s", qPrintable(file));
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// render scenes without a window and write the frames as images, returns the exit code
+static int renderOffscreen(const QCommandLineParser & parser)
+{
+    QStringList names = parser.value("scene") == "all" ? 
+        sceneNames() : parser.value("scene").split(',', QString::SkipEmptyParts);
+    for (const QString & name : names) {
+        if (!sceneNames().contains(name)) {
+            qWarning("Unknown scene \"%s\", expected one of: all, %s", 
+                qPrintable(name), qPrintable(sceneNames().join(", ")));
+            return 1;
+        }
+    }
+
+    QStringList size = parser.value("size").split('x');
+    int width = size.value(0).toInt(), height = size.value(1).toInt();
+    if (size.size() != 2 || width <= 0 || height <= 0) {
+        qWarning("Invalid size \"%s\", expected WIDTHxHEIGHT", qPrintable(parser.value("size")));
+        return 1;
+    }
+    int frames = qMax(1, parser.value("frames").toInt());
+
+    QDir outputDir(parser.value("output"));
+    if (!outputDir.mkpath(".")) {
+        qWarning("Cannot create the output directory %s", qPrintable(outputDir.absolutePath()));
+        return 1;
+    }
+
+    if (parser.isSet("software")) {
+        return renderSoftware(parser, names, QSize(width, height), frames, outputDir);
+    }
+    if (parser.isSet("raytrace")) {
+        return renderRayTraced(parser, names, QSize(width, height), frames, outputDir);
+    }
+
+    OffscreenRenderer renderer(QSize(width, height), parser.value("samples").toInt());
+    if (!renderer.create()) {
+        return 1;
+    }
+    // every written frame shows the textures
+    TextureLoader::setSynchronous(true);
+
+    for (const QString & name : names) {
+        renderer.setScene(createScene(name));
+        for (int i = 0; i < frames; i++) {
+            // the last frame of the scene is captured for the Replayer
+            bool capture = parser.isSet("capture") && i == frames - 1;
+            if (capture) {
+                renderer.makeCurrent();
+                GLCapture::start();
+            }
+            renderer.renderFrame();
+            if (capture && !GLCapture::finish(outputDir.filePath(name + ".glcap"))) {
+                return 1;
+            }
+            QString file = outputDir.filePath(QString("%1-%2.png").arg(name).arg(i, 4, 10, QChar('0')));
+            if (!renderer.grabFrame().save(file)) {
+                qWarning("Cannot write %s", qPrintable(file));
+                return 1;
+            }
+        }
+        qDebug("Wrote %d frame(s) of %s to %s", frames, qPrintable(name), qPrintable(outputDir.absolutePath()));
+        renderer.releaseScene();
+    }
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
+    StartupTimeline::start();
     QApplication a(argc, argv);
 
-    OpenGLDemoWindow w;
-    w.resize(800, 800);
-    w.show();
+    QCommandLineParser parser;
+    parser.setApplicationDescription("OpenGL tutorial demos");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "offscreen", "Render without a window and write the frames to image files." },
+        { "scene", "Scenes to render offscreen: all, or a comma separated list of " + sceneNames().join(", ") + ".", 
+            "names", "all" },
+        { "size", "Resolution of the offscreen frames.", "WIDTHxHEIGHT", "800x800" },
+        { "samples", "Number of samples per pixel of the offscreen frames (0 disables multisampling).", "n", "0" },
+        { "frames", "Number of frames rendered per scene.", "n", "1" },
+        { "output", "Directory of the written frames.", "dir", "frames" },
+        { "capture", "Also capture the GL calls of the last offscreen frame of each scene into <scene>.glcap "
+            "(textures and texture arrays are saved as the RGBA8 texels of their level 0)." },
+        { "software", "Draw the offscreen frames with the multithreaded software rasterizer instead of OpenGL." },
+        { "raytrace", "Ray trace the offscreen frames on the CPU, with one more sample per pixel each frame." },
+        { "threads", "Number of threads of the software renderers (0 uses one per core).", "n", "0" },
+        { "scaling", "Also ray trace with 1, 2, 4, ... threads and report the speedups." },
+        { "trace", "Write the timing zones recorded until exit as a Chrome trace.", "file" },
+        { "max-fps", "Limit the frame rate of the interactive widgets below the display refresh rate.", "fps", "0" },
+        { "render-threads", "Paint each interactive widget on its own thread, off the GUI thread." },
+        { "eager-scenes", "Create the scenes of all the subwindows before showing the window, instead of "
+            "when each subwindow is first shown (the startup timeline is logged either way)." },
+        { "earth-tiles", "Stream the Earth imagery from a directory of <z>/<x>/<y>.jpg tiles, a {z}/{x}/{y} path "
+            "template or a local tile server URL (http://localhost:8000/{z}/{x}/{y}.png).", "location" },
+        { "cpu-budget", "Warn when the CPU memory of the scenes exceeds this many megabytes (0 for no budget).",
+            "MB", "0" },
+        { "gpu-budget", "Warn when the GPU memory of the scenes exceeds this many megabytes (0 for no budget).",
+            "MB", "0" }
+    });
+    parser.process(a);
+    FrameScheduler::setMaxFrameRate(parser.value("max-fps").toDouble());
+    FrameScheduler::setThreadedRendering(parser.isSet("render-threads"));
+    OpenGLDemoWindow::setEagerScenes(parser.isSet("eager-scenes"));
+    if (parser.isSet("earth-tiles")) {
+        TileSource::setDefaultLocation(parser.value("earth-tiles"));
+    }
+    MemoryTracker::setBudget(MemoryTracker::Cpu, qint64(parser.value("cpu-budget").toDouble() * 1048576));
+    MemoryTracker::setBudget(MemoryTracker::Gpu, qint64(parser.value("gpu-budget").toDouble() * 1048576));
+
+    int result = 0;
+    if (parser.isSet("offscreen")) {
+        result = renderOffscreen(parser);
+    } else {
+        OpenGLDemoWindow w;
+        w.resize(800, 800);
+        w.show();
+        result = a.exec();
+    }
 
-    return a.exec();
+    if (parser.isSet("trace") && !Profiler::writeChromeTrace(parser.value("trace"))) {
+        result = 1;
+    }
+    return result;
 }
@@ -0,0 +1,88 @@
+#include "memorytracker.h"
+
+#include "memorypanel.h"
+
+enum Column { NameColumn, CpuColumn, CpuPeakColumn, GpuColumn, GpuPeakColumn, ColumnCount };
+
+static QString megabytes(qint64 bytes)
+{
+    return QString::number(bytes / 1048576.0, 'f', 2);
+}
+
+// fill the columns of a kind
+static void setBytes(QTreeWidgetItem * item, MemoryTracker::Kind kind, qint64 bytes, qint64 peakBytes)
+{
+    int column = kind == MemoryTracker::Cpu ? CpuColumn : GpuColumn;
+    item->setText(column, megabytes(bytes));
+    item->setText(column + 1, megabytes(peakBytes));
+    item->setTextAlignment(column, Qt::AlignRight);
+    item->setTextAlignment(column + 1, Qt::AlignRight);
+}
+
+MemoryPanel::MemoryPanel(QWidget * parent)
+    : QTreeWidget(parent)
+{
+    setColumnCount(ColumnCount);
+    setHeaderLabels(QStringList() << tr("Scene / asset") << tr("CPU MB") << tr("peak") << tr("GPU MB") << tr("peak"));
+    setRootIsDecorated(true);
+    setUniformRowHeights(true);
+    header()->setSectionResizeMode(NameColumn, QHeaderView::Stretch);
+    header()->setStretchLastSection(false);
+    refresh();
+}
+
+void MemoryPanel::refresh()
+{
+    QSet<QString> expanded;
+    for (int i = 0; i < topLevelItemCount(); i++) {
+        if (topLevelItem(i)->isExpanded()) {
+            expanded << topLevelItem(i)->text(NameColumn);
+        }
+    }
+    clear();
+
+    QTreeWidgetItem * total = new QTreeWidgetItem(this, QStringList() << tr("total"));
+    for (MemoryTracker::Kind kind : { MemoryTracker::Cpu, MemoryTracker::Gpu }) {
+        setBytes(total, kind, MemoryTracker::currentBytes(kind), MemoryTracker::peakBytes(kind));
+        if (MemoryTracker::isOverBudget(kind)) {
+            int column = kind == MemoryTracker::Cpu ? CpuColumn : GpuColumn;
+            total->setForeground(column, Qt::red);
+            total->setToolTip(column, tr("over the budget of %1 MB").arg(megabytes(MemoryTracker::budget(kind))));
+        }
+    }
+    QFont bold = total->font(NameColumn);
+    bold.setBold(true);
+    for (int column = 0; column < ColumnCount; column++) {
+        total->setFont(column, bold);
+    }
+
+    // an item per owner, its assets below it with the CPU and GPU ones of the same name on one row
+    QMap<QString, QTreeWidgetItem *> owners;
+    QMap<QString, qint64> ownerBytes[2];
+    for (const MemoryTracker::Usage & usage : MemoryTracker::usages()) {
+        QTreeWidgetItem *& owner = owners[usage.owner];
+        if (!owner) {
+            owner = new QTreeWidgetItem(this, QStringList() << usage.owner);
+        }
+        QTreeWidgetItem * asset = nullptr;
+        for (int i = 0; i < owner->childCount() && !asset; i++) {
+            if (owner->child(i)->text(NameColumn) == usage.asset) {
+                asset = owner->child(i);
+            }
+        }
+        if (!asset) {
+            asset = new QTreeWidgetItem(owner, QStringList() << usage.asset);
+        }
+        setBytes(asset, usage.kind, usage.bytes, usage.peakBytes);
+        ownerBytes[usage.kind][usage.owner] += usage.bytes;
+    }
+    for (QTreeWidgetItem * owner : owners) {
+        QString name = owner->text(NameColumn);
+        // the peaks of the assets are not simultaneous, an owner has no meaningful peak
+        owner->setText(CpuColumn, megabytes(ownerBytes[MemoryTracker::Cpu].value(name)));
+        owner->setText(GpuColumn, megabytes(ownerBytes[MemoryTracker::Gpu].value(name)));
+        owner->setTextAlignment(CpuColumn, Qt::AlignRight);
+        owner->setTextAlignment(GpuColumn, Qt::AlignRight);
+        owner->setExpanded(expanded.contains(name));
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <QtWidgets>
+
+// a table of the memory reported to MemoryTracker: each scene and its assets, with the CPU and GPU bytes
+// and their peaks, under the totals (in red when over their budget)
+class MemoryPanel : public QTreeWidget
+{
+    Q_OBJECT
+
+public:
+    explicit MemoryPanel(QWidget * parent = nullptr);
+
+public slots:
+    // read the tracker again, keeping the expanded scenes expanded
+    void refresh();
+};
@@ -0,0 +1,131 @@
+#include <algorithm>
+
+#include "memorytracker.h"
+
+namespace {
+
+struct Entry
+{
+    qint64 bytes = 0, peakBytes = 0;
+};
+
+struct Totals
+{
+    qint64 bytes = 0, peakBytes = 0, budget = 0;
+    bool warned = false;
+};
+
+QMutex mutex;
+// by kind, owner then asset
+QMap<QString, QMap<QString, Entry>> entries[2];
+Totals totals[2];
+
+const char * kindName(MemoryTracker::Kind kind)
+{
+    return kind == MemoryTracker::Cpu ? "CPU" : "GPU";
+}
+
+// change a total, the mutex is locked
+void changeTotal(MemoryTracker::Kind kind, qint64 delta)
+{
+    Totals & t = totals[kind];
+    t.bytes += delta;
+    t.peakBytes = qMax(t.peakBytes, t.bytes);
+    bool over = t.budget > 0 && t.bytes > t.budget;
+    if (over && !t.warned) {
+        qWarning("%s memory over budget: %.1f MB used, %.1f MB allowed", kindName(kind),
+            t.bytes / 1048576.0, t.budget / 1048576.0);
+    }
+    t.warned = over;
+}
+
+}
+
+void MemoryTracker::set(Kind kind, const QString & owner, const QString & asset, qint64 bytes)
+{
+    QMutexLocker lock(&mutex);
+    Entry & entry = entries[kind][owner][asset];
+    changeTotal(kind, bytes - entry.bytes);
+    entry.bytes = bytes;
+    entry.peakBytes = qMax(entry.peakBytes, bytes);
+}
+
+void MemoryTracker::add(Kind kind, const QString & owner, const QString & asset, qint64 bytes)
+{
+    QMutexLocker lock(&mutex);
+    Entry & entry = entries[kind][owner][asset];
+    changeTotal(kind, bytes);
+    entry.bytes += bytes;
+    entry.peakBytes = qMax(entry.peakBytes, entry.bytes);
+}
+
+void MemoryTracker::clear(Kind kind, const QString & owner)
+{
+    QMutexLocker lock(&mutex);
+    for (const Entry & entry : entries[kind].value(owner)) {
+        changeTotal(kind, -entry.bytes);
+    }
+    entries[kind].remove(owner);
+}
+
+QString MemoryTracker::contextOwner()
+{
+    const QGLContext * context = QGLContext::currentContext();
+    QPaintDevice * device = context ? context->device() : nullptr;
+    if (device && device->devType() == QInternal::Widget) {
+        QString name = static_cast<QWidget *>(device)->objectName();
+        if (!name.isEmpty()) {
+            return name;
+        }
+    }
+    return "shared";
+}
+
+QVector<MemoryTracker::Usage> MemoryTracker::usages()
+{
+    QMutexLocker lock(&mutex);
+    QVector<Usage> result;
+    for (Kind kind : { Cpu, Gpu }) {
+        for (auto owner = entries[kind].constBegin(); owner != entries[kind].constEnd(); ++owner) {
+            for (auto asset = owner->constBegin(); asset != owner->constEnd(); ++asset) {
+                result << Usage{ kind, owner.key(), asset.key(), asset->bytes, asset->peakBytes };
+            }
+        }
+    }
+    std::stable_sort(result.begin(), result.end(), [](const Usage & a, const Usage & b) {
+        return a.owner < b.owner;
+    });
+    return result;
+}
+
+qint64 MemoryTracker::currentBytes(Kind kind)
+{
+    QMutexLocker lock(&mutex);
+    return totals[kind].bytes;
+}
+
+qint64 MemoryTracker::peakBytes(Kind kind)
+{
+    QMutexLocker lock(&mutex);
+    return totals[kind].peakBytes;
+}
+
+void MemoryTracker::setBudget(Kind kind, qint64 bytes)
+{
+    QMutexLocker lock(&mutex);
+    totals[kind].budget = bytes;
+    totals[kind].warned = false;
+    changeTotal(kind, 0);
+}
+
+qint64 MemoryTracker::budget(Kind kind)
+{
+    QMutexLocker lock(&mutex);
+    return totals[kind].budget;
+}
+
+bool MemoryTracker::isOverBudget(Kind kind)
+{
+    QMutexLocker lock(&mutex);
+    return totals[kind].budget > 0 && totals[kind].bytes > totals[kind].budget;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QtOpenGL>
+
+// the memory used by each scene, by asset, on the CPU (meshes, grids, decoded images) and on the GPU
+// (buffers and textures), with the totals, their peaks and optional budgets
+//
+// the owners are the object names of the scene widgets ("dragon", "earth", ...): the widgets report their
+// CPU data, the GPU objects are reported where they are allocated, owned by the widget of the current
+// context (see contextOwner()); the objects of GLResourceRegistry are owned by the widget uploading them,
+// the other widgets reusing them add nothing
+// every call may come from any thread
+class MemoryTracker
+{
+public:
+    enum Kind { Cpu, Gpu };
+
+    // the bytes of an asset of an owner, replacing the previous value; add() changes them by a difference
+    static void set(Kind kind, const QString & owner, const QString & asset, qint64 bytes);
+    static void add(Kind kind, const QString & owner, const QString & asset, qint64 bytes);
+    // forget the assets of an owner (the CPU data of a deleted widget)
+    static void clear(Kind kind, const QString & owner);
+
+    // the object name of the widget of the current context, "shared" for the hidden widget of the share group
+    static QString contextOwner();
+
+    struct Usage
+    {
+        Kind kind;
+        QString owner, asset;
+        qint64 bytes, peakBytes;
+    };
+    // the assets of every owner, by owner then asset
+    static QVector<Usage> usages();
+
+    static qint64 currentBytes(Kind kind);
+    static qint64 peakBytes(Kind kind);
+
+    // the total of a kind above which a warning is logged (once until it is back under it), 0 for none
+    static void setBudget(Kind kind, qint64 bytes);
+    static qint64 budget(Kind kind);
+    static bool isOverBudget(Kind kind);
+};
+
+// the bytes of the elements of a vector (its capacity, which it holds)
+template <class T>
+inline qint64 memoryBytes(const QVector<T> & v)
+{
+    return qint64(v.capacity()) * sizeof(T);
+}
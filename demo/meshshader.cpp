@@ -0,0 +1,156 @@
+#include "frameuniforms.h"
+
+#include "meshshader.h"
+
+// the first lines of the vertex shader, followed by the declaration of FrameBlock
+static const char * vshaderHeader =
+    "#version 120\n"                    // the version of this shader (feature defines are injected after it)
+    "#extension GL_ARB_uniform_buffer_object : require\n" // for FrameBlock
+    "#ifdef MULTI_DRAW\n"
+    "#extension GL_EXT_gpu_shader4 : require\n" // for samplerBuffer and texelFetchBuffer
+    "#endif\n";
+
+// the source code of vertex shader
+static const char * vshaderSource =
+    "#ifdef HEIGHT_MAP\n"
+    "attribute vec2 position;\n"        // the 2d position of each grid vertex
+    "uniform sampler2D normalHeightMap;\n" // the normal (rgb) and height (a) of the terrain
+    "#ifdef SPLIT_HEIGHT_MAP\n"
+    "uniform sampler2D normalZHeightMap;\n" // the normal z and height of the terrain, normalHeightMap has x and y
+    "#endif\n"
+    "uniform float heightRatio;\n"      // the scale applied to the heights
+    "#else\n"
+    "attribute vec3 position;\n"        // the position of each vertex
+    "attribute vec3 normal;\n"          // the normal of each vertex
+    "#endif\n"
+    "#ifdef MULTI_DRAW\n"
+    "attribute float drawIndex;\n"     // the index of the draw in a multi-draw (one value per instance)
+    "uniform samplerBuffer drawMatrices;\n" // the model matrices of the draws, 4 columns each
+    "#endif\n"
+    "#ifdef QUANTIZED_ATTRIBUTES\n"
+    "uniform vec3 positionScale;\n"     // maps the normalized positions in [-1, 1] back to the mesh bounds
+    "uniform vec3 positionOffset;\n"
+    "#endif\n"
+    "varying vec3 pixelNormal;\n"       // the output normal on this vertex (will be interpolated in fragment shader)
+    "varying vec3 pixelPosition;\n"     // the output position in model space (will be interpolated in fragment shader)
+    "varying float pixelHeight;\n"      // the output height on this vertex (1.0 without a height map)
+    "#ifdef LAMBERT_LIGHTING\n"
+    "varying vec3 worldNormal;\n"       // the normal transformed by modelMatrix
+    "#endif\n"
+    "void main(void)\n" // the main function
+    "{\n"
+    "#ifdef HEIGHT_MAP\n"
+    "#ifdef SPLIT_HEIGHT_MAP\n"
+    "    vec4 normalHeight = vec4(texture2D(normalHeightMap, position).rg, texture2D(normalZHeightMap, position).rg);\n"
+    "#else\n"
+    "    vec4 normalHeight = texture2D(normalHeightMap, position);\n"
+    "#endif\n"
+    "    vec4 modelPosition = vec4(position * 2.0 - 1.0, normalHeight.a * heightRatio, 1.0);\n"
+    "    pixelNormal = normalize(normalHeight.rgb);\n"
+    "    pixelHeight = normalHeight.a;\n"
+    "#else\n"
+    "#ifdef QUANTIZED_ATTRIBUTES\n"
+    "    vec4 modelPosition = vec4(positionOffset + positionScale * position, 1.0);\n"
+    "#else\n"
+    "    vec4 modelPosition = vec4(position, 1.0);\n"
+    "#endif\n"
+    "    pixelNormal = normal;\n"
+    "    pixelHeight = 1.0;\n"
+    "#endif\n"
+
+    // gl_Position is the final coordinate of this vertex on screen (the matrices come from FrameBlock)
+    "#ifdef MULTI_DRAW\n"
+    "    int column = int(drawIndex) * 4;\n"
+    "    mat4 model = mat4(texelFetchBuffer(drawMatrices, column), texelFetchBuffer(drawMatrices, column + 1),\n"
+    "        texelFetchBuffer(drawMatrices, column + 2), texelFetchBuffer(drawMatrices, column + 3));\n"
+    "    gl_Position = projectionMatrix * viewMatrix * model * modelPosition;\n"
+    "#else\n"
+    "    mat4 model = modelMatrix;\n"
+    "    gl_Position = modelViewProjectionMatrix * modelPosition;\n"
+    "#endif\n"
+
+    // pass the model space position to retrieve the spatial position of each pixel in fragment shader
+    "    pixelPosition = modelPosition.xyz;\n"
+
+    "#ifdef LAMBERT_LIGHTING\n"
+    "    worldNormal = mat3(model) * pixelNormal;\n"
+    "#endif\n"
+    "}\n";
+
+// the source code of fragment shader
+static const char * fshaderSource =
+    "#version 120\n" // the version of this shader (feature defines are injected after it)
+    "varying vec3 pixelNormal;\n"       // the interpolated normal on this pixel
+    "varying vec3 pixelPosition;\n"     // the interpolated model space position on this pixel
+    "varying float pixelHeight;\n"      // the interpolated height on this pixel
+    "#ifdef LAMBERT_LIGHTING\n"
+    "varying vec3 worldNormal;\n"       // the interpolated world space normal on this pixel
+    "#endif\n"
+    "void main(void)\n" // the main function
+    "{\n"
+
+    // here we directly use the normal vector as color values
+    "    vec4 color = vec4(pixelNormal * pixelHeight, 1.0);\n"
+
+    // light coming from the side of the camera, both faces are lit
+    "#ifdef LAMBERT_LIGHTING\n"
+    "    vec3 lightDirection = normalize(vec3(0.5, -0.5, -1.0));\n"
+    "    float diffuse = abs(dot(normalize(worldNormal), lightDirection));\n"
+    "    color.rgb *= 0.3 + 0.7 * diffuse;\n"
+    "#endif\n"
+
+    // use sin(distance) to the center of cutting spheres to conditionally visualize pixels
+    "#ifdef CUTTING_SPHERES\n"
+    "    vec3 center = vec3(1.0, 0.0, 0.0);\n"
+    "    color *= sin(length(center - pixelPosition));\n"
+    "#endif\n"
+
+    "#ifdef DEBUG_NORMALS\n"
+    "    color = vec4(normalize(pixelNormal) * 0.5 + 0.5, 1.0);\n"
+    "#endif\n"
+
+    "    gl_FragColor = color;\n"
+    "}\n";
+
+// the macros of MeshShader::Feature, in the order of their bits
+static const QVector<QByteArray> featureDefines = {
+    "HEIGHT_MAP",
+    "QUANTIZED_ATTRIBUTES",
+    "CUTTING_SPHERES",
+    "LAMBERT_LIGHTING",
+    "DEBUG_NORMALS",
+    "MULTI_DRAW",
+    "SPLIT_HEIGHT_MAP"
+};
+
+MeshShader::MeshShader()
+    : ShaderVariants(QByteArray(vshaderHeader) + FrameUniforms::blockDeclaration() + vshaderSource,
+        fshaderSource, featureDefines)
+{
+    // bind 0 to the "position" attribute and 1 to the "normal" attribute in every variant
+    bindAttributeLocation(0, "position");
+    bindAttributeLocation(1, "normal");
+    // and 2 to the per-instance "drawIndex" of GeometryArena
+    bindAttributeLocation(2, "drawIndex");
+    // read the camera matrices from the buffer bound by FrameUniforms
+    bindUniformBlock("FrameBlock", FrameUniforms::BindingPoint);
+}
+
+QVector3D MeshShader::shade(quint32 features, const QVector3D & normal, const QVector3D & position, 
+    float height, const QMatrix4x4 & modelMatrix)
+{
+    // keep in sync with fshaderSource
+    QVector3D color = normal * height;
+    if (features & LambertLighting) {
+        QVector3D worldNormal = QVector3D(modelMatrix * QVector4D(normal, 0)).normalized();
+        float diffuse = qAbs(QVector3D::dotProduct(worldNormal, QVector3D(0.5f, -0.5f, -1.0f).normalized()));
+        color *= 0.3f + 0.7f * diffuse;
+    }
+    if (features & CuttingSpheres) {
+        color *= std::sin((QVector3D(1, 0, 0) - position).length());
+    }
+    if (features & DebugNormals) {
+        color = normal.normalized() * 0.5f + QVector3D(0.5f, 0.5f, 0.5f);
+    }
+    return color;
+}
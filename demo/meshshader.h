@@ -0,0 +1,37 @@
+#pragma once
+
+#include "shadervariants.h"
+
+// the shader shared by Dragon2Widget and TerrainWidget
+// every feature is compiled in only when its bit is set in the variant key
+class MeshShader : public ShaderVariants
+{
+public:
+    enum Feature {
+        // positions are grid coordinates displaced by "normalHeightMap" (attribute 0 only)
+        HeightMap = 0x01,
+        // positions are normalized shorts mapped by "positionScale" and "positionOffset",
+        // normals are normalized bytes
+        QuantizedAttributes = 0x02,
+        // modulate colors by concentric spheres around "center"
+        CuttingSpheres = 0x04,
+        // diffuse lighting from a directional light
+        LambertLighting = 0x08,
+        // show the normals instead of the shaded colors
+        DebugNormals = 0x10,
+        // the model matrix of each draw of a GeometryArena multi-draw is read from the texture buffer
+        // "drawMatrices" at the "drawIndex" attribute, instead of modelMatrix (needs GL_EXT_gpu_shader4)
+        MultiDraw = 0x20,
+        // with HeightMap: the map is split in two textures, the normal x and y in "normalHeightMap" (rg)
+        // and the normal z and height in "normalZHeightMap" (rg), as they are block compressed as BC5
+        SplitHeightMap = 0x40
+    };
+
+    MeshShader();
+
+    // the color of the fragment shader evaluated on the CPU, for the renderers without OpenGL
+    // normal and height are the values of the vertex shader (height is 1 without HeightMap),
+    // position is in model space
+    static QVector3D shade(quint32 features, const QVector3D & normal, const QVector3D & position, 
+        float height, const QMatrix4x4 & modelMatrix);
+};
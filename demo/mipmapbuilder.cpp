@@ -0,0 +1,275 @@
+#include "simd.h"
+
+#include "mipmapbuilder.h"
+
+// the texels of clamped edge values on each side of a padded row, as many as the widest filter reaches
+// (even, so that the even texels of the padded row are the even texels of the row)
+static const int padding = 4;
+
+// the number of entries of the table encoding linear values to sRGB, fine enough for exact 8 bit results
+static const int encodeTableSize = 16384;
+
+static int roundUp(int n)
+{
+    return (n + SimdFloat::Width - 1) / SimdFloat::Width * SimdFloat::Width;
+}
+
+// the zeroth order modified Bessel function of the first kind, of the Kaiser window
+static double besselI0(double x)
+{
+    double sum = 1, term = 1;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static const float * srgbToLinearTable()
+{
+    static const QVector<float> table = [] {
+        QVector<float> t(256);
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            t[i] = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+        }
+        return t;
+    }();
+    return table.constData();
+}
+
+static const uchar * linearToSrgbTable()
+{
+    static const QVector<uchar> table = [] {
+        QVector<uchar> t(encodeTableSize);
+        for (int i = 0; i < encodeTableSize; i++) {
+            double l = double(i) / (encodeTableSize - 1);
+            double c = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1 / 2.4) - 0.055;
+            t[i] = uchar(qBound(0, int(c * 255 + 0.5), 255));
+        }
+        return t;
+    }();
+    return table.constData();
+}
+
+static uchar toUnorm8(float v)
+{
+    return uchar(qBound(0, int(v * 255 + 0.5f), 255));
+}
+
+MipmapBuilder::Planes::Planes(int w, int h, int channelCount)
+    : width(w), height(h), channels(channelCount, QVector<float>(w * h + SimdFloat::Width))
+{
+}
+
+MipmapBuilder::MipmapBuilder(WorkStealingPool & pool)
+    : _pool(pool), _scratch(_pool.threadCount())
+{
+}
+
+MipmapBuilder::~MipmapBuilder()
+{
+}
+
+QSize MipmapBuilder::levelSize(const QSize & size, int level)
+{
+    return QSize(qMax(size.width() >> level, 1), qMax(size.height() >> level, 1));
+}
+
+int MipmapBuilder::levelCount(const QSize & size)
+{
+    int count = 1;
+    for (int n = qMax(size.width(), size.height()); n > 1; n /= 2) {
+        count++;
+    }
+    return count;
+}
+
+const QVector<MipmapBuilder::Tap> & MipmapBuilder::taps(Filter filter)
+{
+    static const QVector<Tap> box = { { 0, 0.5f }, { 1, 0.5f } };
+    // sinc(d / 2) for a halving, windowed by a Kaiser window of radius 4 texels (alpha 4),
+    // at the distances d of the taps from the center between the 2 texels
+    static const QVector<Tap> kaiser = [] {
+        const double radius = 4, alpha = 4;
+        QVector<Tap> taps;
+        double sum = 0;
+        for (int offset = -3; offset <= 4; offset++) {
+            double d = offset - 0.5;
+            double x = M_PI * d / 2;
+            double sinc = std::sin(x) / x;
+            double window = besselI0(alpha * std::sqrt(1 - (d / radius) * (d / radius))) / besselI0(alpha);
+            taps << Tap{ offset, float(sinc * window) };
+            sum += sinc * window;
+        }
+        for (Tap & tap : taps) {
+            tap.weight /= sum;
+        }
+        return taps;
+    }();
+    return filter == Kaiser ? kaiser : box;
+}
+
+MipmapBuilder::Planes MipmapBuilder::downsample(const Planes & source, Filter filter)
+{
+    QSize size = levelSize(QSize(source.width, source.height), 1);
+    Planes target(size.width(), size.height(), source.channels.size());
+    const QVector<Tap> & filterTaps = taps(filter);
+    _pool.parallelFor(target.height, [&](int y, int thread) {
+        filterRow(source, target, y, filterTaps, _scratch[thread]);
+    });
+    return target;
+}
+
+void MipmapBuilder::filterRow(const Planes & source, Planes & target, int y, const QVector<Tap> & taps,
+    Scratch & scratch)
+{
+    const int w = source.width, h = source.height, targetWidth = target.width;
+    // even and odd texels computed, enough for the widest tap of the last SIMD group of the row
+    const int halfCount = roundUp(targetWidth + padding + 1) + SimdFloat::Width;
+    const int paddedCount = 2 * halfCount + SimdFloat::Width;
+    scratch.column.resize(roundUp(w));
+    scratch.padded.resize(paddedCount);
+    scratch.even.resize(halfCount);
+    scratch.odd.resize(halfCount);
+    scratch.row.resize(roundUp(targetWidth));
+    float * column = scratch.column.data();
+    float * padded = scratch.padded.data();
+    float * even = scratch.even.data();
+    float * odd = scratch.odd.data();
+    float * row = scratch.row.data();
+
+    // the source rows of the vertical taps, clamped to the image
+    int rows[8];
+    for (int t = 0; t < taps.size(); t++) {
+        rows[t] = qBound(0, 2 * y + taps[t].offset, h - 1);
+    }
+
+    for (int c = 0; c < source.channels.size(); c++) {
+        const float * plane = source.channels[c].constData();
+
+        // vertical pass, over the whole row (the slack of the plane covers the last group)
+        for (int x = 0; x < w; x += SimdFloat::Width) {
+            SimdFloat sum = 0.0f;
+            for (int t = 0; t < taps.size(); t++) {
+                sum = multiplyAdd(SimdFloat::load(plane + rows[t] * w + x), taps[t].weight, sum);
+            }
+            sum.store(column + x);
+        }
+
+        // clamp the edges into the padding, so that the horizontal taps never leave the row
+        for (int i = 0; i < padding; i++) {
+            padded[i] = column[0];
+        }
+        memcpy(padded + padding, column, sizeof(float) * w);
+        for (int i = padding + w; i < paddedCount; i++) {
+            padded[i] = column[w - 1];
+        }
+        for (int i = 0; i < halfCount; i += SimdFloat::Width) {
+            SimdFloat e, o;
+            deinterleave(SimdFloat::load(padded + 2 * i), SimdFloat::load(padded + 2 * i + SimdFloat::Width), &e, &o);
+            e.store(even + i);
+            o.store(odd + i);
+        }
+
+        // horizontal pass: the texel 2x + offset of the row is at x + (offset + padding) / 2
+        // in the even or the odd texels of the padded row
+        for (int x = 0; x < targetWidth; x += SimdFloat::Width) {
+            SimdFloat sum = 0.0f;
+            for (const Tap & tap : taps) {
+                int k = tap.offset + padding;
+                const float * texels = (k % 2 == 0 ? even : odd) + x + k / 2;
+                sum = multiplyAdd(SimdFloat::load(texels), tap.weight, sum);
+            }
+            sum.store(row + x);
+        }
+        memcpy(target.channels[c].data() + y * targetWidth, row, sizeof(float) * targetWidth);
+    }
+}
+
+QVector<QImage> MipmapBuilder::buildRgba8(const QImage & image, Filter filter, bool srgb)
+{
+    QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+    int w = rgba.width(), h = rgba.height();
+    QVector<QImage> levels;
+    if (rgba.isNull()) {
+        return levels;
+    }
+    levels << rgba;
+
+    const float * decode = srgbToLinearTable();
+    Planes planes(w, h, 4);
+    for (int y = 0; y < h; y++) {
+        const uchar * texel = rgba.constScanLine(y);
+        for (int x = 0; x < w; x++, texel += 4) {
+            for (int c = 0; c < 4; c++) {
+                planes.channels[c][y * w + x] = srgb && c < 3 ? decode[texel[c]] : texel[c] / 255.0f;
+            }
+        }
+    }
+
+    const uchar * encode = linearToSrgbTable();
+    for (int level = 1; level < levelCount(rgba.size()); level++) {
+        planes = downsample(planes, filter);
+        QImage out(planes.width, planes.height, QImage::Format_RGBA8888);
+        for (int y = 0; y < planes.height; y++) {
+            uchar * texel = out.scanLine(y);
+            for (int x = 0; x < planes.width; x++, texel += 4) {
+                int i = y * planes.width + x;
+                for (int c = 0; c < 4; c++) {
+                    float v = planes.channels[c][i];
+                    texel[c] = srgb && c < 3 ?
+                        encode[int(qBound(0.0f, v, 1.0f) * (encodeTableSize - 1) + 0.5f)] : toUnorm8(v);
+                }
+            }
+        }
+        levels << out;
+    }
+    return levels;
+}
+
+QVector<QVector<quint16>> MipmapBuilder::buildR16(const quint16 * texels, int width, int height, Filter filter)
+{
+    QVector<QVector<quint16>> levels;
+    levels << QVector<quint16>(texels, texels + width * height);
+
+    Planes planes(width, height, 1);
+    for (int i = 0; i < width * height; i++) {
+        planes.channels[0][i] = texels[i] / 65535.0f;
+    }
+    for (int level = 1; level < levelCount(QSize(width, height)); level++) {
+        planes = downsample(planes, filter);
+        QVector<quint16> out(planes.width * planes.height);
+        for (int i = 0; i < out.size(); i++) {
+            out[i] = quint16(qBound(0, int(planes.channels[0][i] * 65535 + 0.5f), 65535));
+        }
+        levels << out;
+    }
+    return levels;
+}
+
+QVector<QVector<float>> MipmapBuilder::buildFloat(const float * texels, int width, int height, int channels,
+    Filter filter)
+{
+    QVector<QVector<float>> levels;
+    levels << QVector<float>(texels, texels + width * height * channels);
+
+    Planes planes(width, height, channels);
+    for (int i = 0; i < width * height; i++) {
+        for (int c = 0; c < channels; c++) {
+            planes.channels[c][i] = texels[i * channels + c];
+        }
+    }
+    for (int level = 1; level < levelCount(QSize(width, height)); level++) {
+        planes = downsample(planes, filter);
+        int count = planes.width * planes.height;
+        QVector<float> out(count * channels);
+        for (int i = 0; i < count; i++) {
+            for (int c = 0; c < channels; c++) {
+                out[i * channels + c] = planes.channels[c][i];
+            }
+        }
+        levels << out;
+    }
+    return levels;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QtGui>
+
+#include "workstealingpool.h"
+
+// builds the mipmap chains of textures on the CPU, from the full image down to 1x1
+//
+// every level is filtered from the previous one, kept as float planes (one per channel) so that
+// nothing is rounded to the texel format before the last level; each level halves the size (rounded down)
+// with a separable filter: a vertical pass over whole rows, then a horizontal one on the even and odd texels
+// of the row, both SimdFloat::Width texels at a time, with the rows of a level spread over a WorkStealingPool
+// (WorkStealingPool::shared() by default, so that builders made on several threads share its threads)
+//
+// the 8 bit color channels may be sRGB encoded, they are then averaged as linear light
+class MipmapBuilder
+{
+public:
+    enum Filter {
+        // the average of 2x2 texels
+        Box,
+        // a Kaiser windowed sinc of 8x8 texels, sharper than Box without its aliasing
+        Kaiser
+    };
+
+    explicit MipmapBuilder(WorkStealingPool & pool = WorkStealingPool::shared());
+    ~MipmapBuilder();
+
+    // the chain of an RGBA8888 image (other formats are converted first), alpha is always linear
+    QVector<QImage> buildRgba8(const QImage & image, Filter filter, bool srgb);
+    // the chain of a single channel 16 bit image
+    QVector<QVector<quint16>> buildR16(const quint16 * texels, int width, int height, Filter filter);
+    // the chain of a float image of 'channels' interleaved channels
+    QVector<QVector<float>> buildFloat(const float * texels, int width, int height, int channels, Filter filter);
+
+    // the size of a level of the chain of an image, and the number of levels
+    static QSize levelSize(const QSize & size, int level);
+    static int levelCount(const QSize & size);
+
+private:
+    // an image as one float plane per channel, each with SimdFloat::Width floats of slack at its end
+    struct Planes
+    {
+        int width = 0, height = 0;
+        QVector<QVector<float>> channels;
+
+        Planes(int w = 0, int h = 0, int channelCount = 0);
+    };
+    struct Tap
+    {
+        int offset; // from the first of the 2 texels below a texel of the next level
+        float weight;
+    };
+    // the buffers of the rows filtered by one thread
+    struct Scratch
+    {
+        QVector<float> column, padded, even, odd, row;
+    };
+
+    // the next level of 'source'
+    Planes downsample(const Planes & source, Filter filter);
+    void filterRow(const Planes & source, Planes & target, int y, const QVector<Tap> & taps, Scratch & scratch);
+    static const QVector<Tap> & taps(Filter filter);
+
+private:
+    WorkStealingPool & _pool;
+    QVector<Scratch> _scratch;
+};
@@ -0,0 +1,307 @@
+#include <cmath>
+
+#include "profiler.h"
+#include "simd.h"
+
+#include "occlusionculler.h"
+
+static QAtomicInteger<qint64> totalTestedBoxes;
+static QAtomicInteger<qint64> totalCulledBoxes;
+static QAtomicInteger<qint64> totalCullingTime;
+
+OcclusionCuller::OcclusionCuller(int width)
+{
+    // whole SIMD groups per row
+    _width = qMax<int>(SimdFloat::Width, width / SimdFloat::Width * SimdFloat::Width);
+}
+
+OcclusionCuller::~OcclusionCuller()
+{}
+
+void OcclusionCuller::beginFrame(const QMatrix4x4 & viewProjection, const QSize & viewportSize)
+{
+    PROFILE_SCOPE("OcclusionCuller::beginFrame");
+    QElapsedTimer timer;
+    timer.start();
+    _viewProjection = viewProjection;
+
+    int height = qMax(1, qRound(float(_width) * viewportSize.height() / qMax(1, viewportSize.width())));
+    if (_levels.isEmpty() || _levels.first().size != QSize(_width, height)) {
+        _levels.clear();
+        int w = _width, h = height;
+        while (true) {
+            Level level;
+            level.size = QSize(w, h);
+            level.stride = (w + SimdFloat::Width - 1) / SimdFloat::Width * SimdFloat::Width;
+            level.depths.resize(level.stride * h);
+            _levels << level;
+            if (w == 1 && h == 1) {
+                break;
+            }
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+    }
+    _levels.first().depths.fill(1.0f);
+    count(timer.nsecsElapsed(), 0, 0);
+}
+
+void OcclusionCuller::addOccluder(const QVector<QVector3D> & positions, const QVector<quint32> & indices,
+    const QMatrix4x4 & modelMatrix)
+{
+    PROFILE_SCOPE("OcclusionCuller::addOccluder");
+    QElapsedTimer timer;
+    timer.start();
+
+    // column major, m[column * 4 + row]
+    QMatrix4x4 modelViewProjection = _viewProjection * modelMatrix;
+    const float * m = modelViewProjection.constData();
+    _vertices.resize(positions.size());
+    for (int i = 0; i < positions.size(); i++) {
+        const QVector3D & p = positions[i];
+        ClipVertex & v = _vertices[i];
+        v.x = m[0] * p.x() + m[4] * p.y() + m[8] * p.z() + m[12];
+        v.y = m[1] * p.x() + m[5] * p.y() + m[9] * p.z() + m[13];
+        v.z = m[2] * p.x() + m[6] * p.y() + m[10] * p.z() + m[14];
+        v.w = m[3] * p.x() + m[7] * p.y() + m[11] * p.z() + m[15];
+    }
+
+    int triangleCount = indices.size() / 3;
+    for (int t = 0; t < triangleCount; t++) {
+        const ClipVertex * v[3] = { &_vertices[indices[3 * t]], &_vertices[indices[3 * t + 1]], &_vertices[indices[3 * t + 2]] };
+        int behind = 0;
+        for (int i = 0; i < 3; i++) {
+            behind += v[i]->z < -v[i]->w;
+        }
+        if (behind == 0) {
+            rasterizeTriangle(*v[0], *v[1], *v[2]);
+            continue;
+        }
+        if (behind == 3) {
+            continue;
+        }
+        // the part in front of the near plane
+        ClipVertex polygon[4];
+        int n = 0;
+        for (int i = 0; i < 3; i++) {
+            const ClipVertex & a = *v[i];
+            const ClipVertex & b = *v[(i + 1) % 3];
+            float da = a.z + a.w, db = b.z + b.w;
+            if (da >= 0) {
+                polygon[n++] = a;
+            }
+            if ((da >= 0) != (db >= 0)) {
+                float s = da / (da - db);
+                polygon[n++] = { a.x + s * (b.x - a.x), a.y + s * (b.y - a.y), a.z + s * (b.z - a.z), a.w + s * (b.w - a.w) };
+            }
+        }
+        for (int i = 1; i + 1 < n; i++) {
+            rasterizeTriangle(polygon[0], polygon[i], polygon[i + 1]);
+        }
+    }
+    _stats.occluderTriangles += triangleCount;
+    count(timer.nsecsElapsed(), 0, 0);
+}
+
+void OcclusionCuller::rasterizeTriangle(const ClipVertex & v0, const ClipVertex & v1, const ClipVertex & v2)
+{
+    Level & level = _levels.first();
+    int width = level.size.width(), height = level.size.height();
+
+    const ClipVertex * v[3] = { &v0, &v1, &v2 };
+    float sx[3], sy[3], sz[3];
+    for (int i = 0; i < 3; i++) {
+        if (v[i]->w <= 0) {
+            return;
+        }
+        float inverseW = 1.0f / v[i]->w;
+        sx[i] = (v[i]->x * inverseW * 0.5f + 0.5f) * width;
+        sy[i] = (0.5f - v[i]->y * inverseW * 0.5f) * height;
+        sz[i] = v[i]->z * inverseW * 0.5f + 0.5f;
+    }
+    float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+    if (!(area != 0) || std::isnan(area)) {
+        return;
+    }
+    if (area < 0) {
+        std::swap(sx[1], sx[2]);
+        std::swap(sy[1], sy[2]);
+        std::swap(sz[1], sz[2]);
+        area = -area;
+    }
+
+    int x0 = qMax(0, int(std::ceil(qMin(sx[0], qMin(sx[1], sx[2])) - 0.5f)));
+    int x1 = qMin(width - 1, int(std::floor(qMax(sx[0], qMax(sx[1], sx[2])) - 0.5f)));
+    int y0 = qMax(0, int(std::ceil(qMin(sy[0], qMin(sy[1], sy[2])) - 0.5f)));
+    int y1 = qMin(height - 1, int(std::floor(qMax(sy[0], qMax(sy[1], sy[2])) - 0.5f)));
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+
+    // barycentric coordinates and depth at the pixel centers, value = a * x + b * y + c
+    float a[3], b[3], c[3];
+    float inverseArea = 1.0f / area;
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        float ea = sy[j] - sy[k], eb = sx[k] - sx[j];
+        float ec = -(ea * sx[j] + eb * sy[j]);
+        a[i] = ea * inverseArea;
+        b[i] = eb * inverseArea;
+        c[i] = (ec + 0.5f * ea + 0.5f * eb) * inverseArea;
+    }
+    float za = a[0] * sz[0] + a[1] * sz[1] + a[2] * sz[2];
+    float zb = b[0] * sz[0] + b[1] * sz[1] + b[2] * sz[2];
+    float zc = c[0] * sz[0] + c[1] * sz[1] + c[2] * sz[2];
+
+    const SimdFloat ramp = SimdFloat::ramp(), zero(0.0f);
+    x0 = x0 / SimdFloat::Width * SimdFloat::Width;
+    for (int y = y0; y <= y1; y++) {
+        float * row = level.depths.data() + y * level.stride;
+        SimdFloat e0Row = b[0] * y + c[0], e1Row = b[1] * y + c[1], e2Row = b[2] * y + c[2];
+        SimdFloat zRow = zb * y + zc;
+        for (int x = x0; x <= x1; x += SimdFloat::Width) {
+            SimdFloat fx = SimdFloat(float(x)) + ramp;
+            SimdMask inside = (multiplyAdd(a[0], fx, e0Row) >= zero) & (multiplyAdd(a[1], fx, e1Row) >= zero) &
+                (multiplyAdd(a[2], fx, e2Row) >= zero);
+            if (!inside.any()) {
+                continue;
+            }
+            SimdFloat depth = SimdFloat::load(row + x);
+            select(inside, minimum(multiplyAdd(za, fx, zRow), depth), depth).store(row + x);
+        }
+    }
+}
+
+void OcclusionCuller::endOccluders()
+{
+    PROFILE_SCOPE("OcclusionCuller::endOccluders");
+    QElapsedTimer timer;
+    timer.start();
+    for (int l = 1; l < _levels.size(); l++) {
+        const Level & fine = _levels[l - 1];
+        Level & coarse = _levels[l];
+        int fineWidth = fine.size.width(), fineHeight = fine.size.height();
+        for (int y = 0; y < coarse.size.height(); y++) {
+            const float * row0 = fine.depths.constData() + 2 * y * fine.stride;
+            const float * row1 = fine.depths.constData() + qMin(2 * y + 1, fineHeight - 1) * fine.stride;
+            float * out = coarse.depths.data() + y * coarse.stride;
+            for (int x = 0; x < coarse.size.width(); x++) {
+                int x0 = 2 * x, x1 = qMin(2 * x + 1, fineWidth - 1);
+                out[x] = qMax(qMax(row0[x0], row0[x1]), qMax(row1[x0], row1[x1]));
+            }
+        }
+    }
+    count(timer.nsecsElapsed(), 0, 0);
+}
+
+bool OcclusionCuller::isVisible(const QVector3D & boundsMin, const QVector3D & boundsMax, const QMatrix4x4 & modelMatrix)
+{
+    return isVisible(boundsMin, boundsMax, SimdMatrix4(modelMatrix));
+}
+
+bool OcclusionCuller::isVisible(const QVector3D & boundsMin, const QVector3D & boundsMax, const SimdMatrix4 & modelMatrix)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // the screen rectangle and nearest depth of the box: the corners in clip space are the first one
+    // plus the edges along x, y and z
+    SimdMatrix4 modelViewProjection = SimdMatrix4(_viewProjection) * modelMatrix;
+    QVector3D size = boundsMax - boundsMin;
+    SimdVector4 first = modelViewProjection.map(SimdVector4(boundsMin, 1));
+    SimdVector4 edges[3] = { modelViewProjection.columns[0] * size.x(), modelViewProjection.columns[1] * size.y(),
+        modelViewProjection.columns[2] * size.z() };
+    float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1e30f;
+    for (int i = 0; i < 8; i++) {
+        SimdVector4 corner = first;
+        for (int k = 0; k < 3; k++) {
+            if (i & (1 << k)) {
+                corner = corner + edges[k];
+            }
+        }
+        alignas(16) float clip[4];
+        corner.store(clip);
+        if (clip[3] <= 0 || clip[2] < -clip[3]) {
+            count(timer.nsecsElapsed(), 1, 0);
+            return true;
+        }
+        float inverseW = 1.0f / clip[3];
+        minX = qMin(minX, clip[0] * inverseW);
+        maxX = qMax(maxX, clip[0] * inverseW);
+        minY = qMin(minY, clip[1] * inverseW);
+        maxY = qMax(maxY, clip[1] * inverseW);
+        nearest = qMin(nearest, clip[2] * inverseW);
+    }
+
+    const Level & base = _levels.first();
+    int width = base.size.width(), height = base.size.height();
+    int x0 = int(std::floor((minX * 0.5f + 0.5f) * width));
+    int x1 = int(std::floor((maxX * 0.5f + 0.5f) * width));
+    int y0 = int(std::floor((0.5f - maxY * 0.5f) * height));
+    int y1 = int(std::floor((0.5f - minY * 0.5f) * height));
+    if (x1 < 0 || y1 < 0 || x0 >= width || y0 >= height) {
+        // outside of the view, left to the clipping of OpenGL
+        count(timer.nsecsElapsed(), 1, 0);
+        return true;
+    }
+    x0 = qMax(x0, 0);
+    y0 = qMax(y0, 0);
+    x1 = qMin(x1, width - 1);
+    y1 = qMin(y1, height - 1);
+
+    // the first level where the rectangle spans at most 2x2 texels
+    int l = 0;
+    while (l + 1 < _levels.size() && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1)) {
+        l++;
+    }
+    const Level & level = _levels[l];
+    float farthest = 0;
+    for (int y = y0 >> l; y <= (y1 >> l); y++) {
+        for (int x = x0 >> l; x <= (x1 >> l); x++) {
+            farthest = qMax(farthest, level.depths[y * level.stride + x]);
+        }
+    }
+    bool visible = nearest * 0.5f + 0.5f <= farthest;
+    count(timer.nsecsElapsed(), 1, visible ? 0 : 1);
+    return visible;
+}
+
+QImage OcclusionCuller::levelImage(int level) const
+{
+    const Level & l = _levels[level];
+    QImage image(l.size, QImage::Format_Grayscale8);
+    for (int y = 0; y < l.size.height(); y++) {
+        uchar * line = image.scanLine(y);
+        for (int x = 0; x < l.size.width(); x++) {
+            line[x] = uchar(qBound(0.0f, l.depths[y * l.stride + x], 1.0f) * 255 + 0.5f);
+        }
+    }
+    return image;
+}
+
+qint64 OcclusionCuller::totalTested()
+{
+    return totalTestedBoxes.load();
+}
+
+qint64 OcclusionCuller::totalCulled()
+{
+    return totalCulledBoxes.load();
+}
+
+qint64 OcclusionCuller::totalNanoseconds()
+{
+    return totalCullingTime.load();
+}
+
+void OcclusionCuller::count(qint64 nanoseconds, qint64 tested, qint64 culled)
+{
+    _stats.nanoseconds += nanoseconds;
+    _stats.tested += tested;
+    _stats.culled += culled;
+    totalCullingTime.fetchAndAddRelaxed(nanoseconds);
+    if (tested > 0) {
+        totalTestedBoxes.fetchAndAddRelaxed(tested);
+        totalCulledBoxes.fetchAndAddRelaxed(culled);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <QtGui>
+
+#include "simdmatrix.h"
+
+// skips the draws of objects hidden behind a few large occluders, decided on the CPU before they are issued
+//
+// each frame a widget
+//   1. calls beginFrame() with its camera,
+//   2. rasterizes its occluders (big, simple meshes such as walls or terrain) with addOccluder() into a small
+//      depth buffer, SimdFloat::Width pixels at a time,
+//   3. calls endOccluders(), which reduces the buffer into a hierarchical-Z pyramid whose texels keep the
+//      farthest depth of the 2x2 texels below them,
+//   4. asks isVisible() for the bounding box of every other object before its glDrawElements:
+//      the nearest depth of the projected box is compared with the coarsest level where the box covers
+//      at most 2x2 texels, a box behind all of them is hidden
+//
+// the depth buffer samples pixel centers like OpenGL, so an occluder edge may hide up to one culling pixel
+// more than it does on screen; boxes crossing the near plane are always visible
+class OcclusionCuller
+{
+public:
+    // width of the depth buffer, its height follows the aspect ratio of the viewport
+    explicit OcclusionCuller(int width = 256);
+    ~OcclusionCuller();
+
+    // clear the depth buffer for a camera, viewProjection maps world space to clip space
+    void beginFrame(const QMatrix4x4 & viewProjection, const QSize & viewportSize);
+    // rasterize the triangles of an occluder, modelMatrix maps its positions to world space
+    void addOccluder(const QVector<QVector3D> & positions, const QVector<quint32> & indices,
+        const QMatrix4x4 & modelMatrix);
+    // build the pyramid, the occludees can be tested from now on
+    void endOccluders();
+
+    // whether the box (in the space of modelMatrix) may be visible
+    bool isVisible(const QVector3D & boundsMin, const QVector3D & boundsMax, const QMatrix4x4 & modelMatrix);
+    bool isVisible(const QVector3D & boundsMin, const QVector3D & boundsMax, const SimdMatrix4 & modelMatrix);
+
+    // the depth buffer (level 0) and the coarser levels, depths in [0, 1] with 1 for empty
+    int levelCount() const { return _levels.size(); }
+    QSize levelSize(int level) const { return _levels[level].size; }
+    QImage levelImage(int level) const;
+
+    // totals of this culler
+    struct Stats
+    {
+        qint64 occluderTriangles = 0;
+        qint64 tested = 0;
+        qint64 culled = 0;
+        qint64 nanoseconds = 0; // rasterization, pyramid and tests
+
+        double culledPercent() const { return tested > 0 ? 100.0 * culled / tested : 0.0; }
+    };
+    Stats stats() const { return _stats; }
+    void resetStats() { _stats = Stats(); }
+
+    // totals of all the cullers
+    static qint64 totalTested();
+    static qint64 totalCulled();
+    static qint64 totalNanoseconds();
+
+private:
+    struct Level
+    {
+        QSize size;
+        int stride; // a multiple of SimdFloat::Width
+        QVector<float> depths;
+    };
+    // a vertex in clip space
+    struct ClipVertex
+    {
+        float x, y, z, w;
+    };
+
+    void rasterizeTriangle(const ClipVertex & v0, const ClipVertex & v1, const ClipVertex & v2);
+    void count(qint64 nanoseconds, qint64 tested, qint64 culled);
+
+private:
+    int _width;
+    QMatrix4x4 _viewProjection;
+    QVector<Level> _levels;
+    QVector<ClipVertex> _vertices; // of the current occluder
+
+    Stats _stats;
+};
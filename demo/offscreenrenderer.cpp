@@ -0,0 +1,127 @@
+#include "glwidgethooks.h"
+
+#include "offscreenrenderer.h"
+
+OffscreenRenderer::OffscreenRenderer(const QSize & size, int samples)
+{
+    _size = size;
+    _samples = samples;
+    _surface = nullptr;
+    _context = nullptr;
+    _framebuffer = nullptr;
+    _resolveFramebuffer = nullptr;
+    _scene = nullptr;
+}
+
+OffscreenRenderer::~OffscreenRenderer()
+{
+    if (_context) {
+        makeCurrent();
+        releaseScene();
+        delete _framebuffer;
+        delete _resolveFramebuffer;
+        _context->doneCurrent();
+    }
+    delete _context;
+    delete _surface;
+}
+
+bool OffscreenRenderer::create()
+{
+    // the demo widgets use the fixed pipeline, so ask for a compatibility profile
+    QSurfaceFormat format = QGLFormat::toSurfaceFormat(QGLFormat::defaultFormat());
+    format.setProfile(QSurfaceFormat::CompatibilityProfile);
+    format.setDepthBufferSize(24);
+    format.setStencilBufferSize(8);
+    format.setSamples(0); // the framebuffer object carries the samples
+
+    _surface = new QOffscreenSurface;
+    _surface->setFormat(format);
+    _surface->create();
+
+    _context = new QOpenGLContext;
+    _context->setFormat(format);
+    if (!_context->create() || !_context->makeCurrent(_surface)) {
+        qWarning("Cannot create an offscreen OpenGL context");
+        return false;
+    }
+
+    QOpenGLFramebufferObjectFormat fboFormat;
+    fboFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+    fboFormat.setSamples(_samples);
+    _framebuffer = new QOpenGLFramebufferObject(_size, fboFormat);
+    if (_samples > 0) {
+        _resolveFramebuffer = new QOpenGLFramebufferObject(_size);
+    }
+    if (!_framebuffer->isValid()) {
+        qWarning("Cannot create a %dx%d framebuffer object", _size.width(), _size.height());
+        return false;
+    }
+    _framebuffer->bind();
+
+    qDebug("Offscreen rendering at %dx%d on %s", _size.width(), _size.height(), qPrintable(rendererName()));
+    return true;
+}
+
+QString OffscreenRenderer::rendererName() const
+{
+    if (!_context) {
+        return QString();
+    }
+    return reinterpret_cast<const char *>(_context->functions()->glGetString(GL_RENDERER));
+}
+
+void OffscreenRenderer::setScene(QGLWidget * scene)
+{
+    releaseScene();
+    _scene = scene;
+    makeCurrent();
+
+    // redirect the widget to the offscreen context, the widget deletes the wrapper with itself
+    _scene->setAttribute(Qt::WA_DontShowOnScreen);
+    _scene->resize(_size);
+    _scene->setContext(QGLContext::fromOpenGLContext(_context));
+
+    // the widget may make its context current on its (unmapped) window, 
+    // so restore the offscreen surface and framebuffer before each hook
+    (_scene->*&GLWidgetHooks::initializeGL)();
+    makeCurrent();
+    (_scene->*&GLWidgetHooks::resizeGL)(_size.width(), _size.height());
+}
+
+void OffscreenRenderer::releaseScene()
+{
+    if (!_scene) {
+        return;
+    }
+    // the widget releases its GPU objects in its destructor
+    makeCurrent();
+    delete _scene;
+    _scene = nullptr;
+}
+
+void OffscreenRenderer::renderFrame()
+{
+    Q_ASSERT(_scene);
+    makeCurrent();
+    (_scene->*&GLWidgetHooks::paintGL)();
+}
+
+QImage OffscreenRenderer::grabFrame()
+{
+    makeCurrent();
+    if (!_resolveFramebuffer) {
+        return _framebuffer->toImage();
+    }
+    QOpenGLFramebufferObject::blitFramebuffer(_resolveFramebuffer, _framebuffer);
+    return _resolveFramebuffer->toImage();
+}
+
+void OffscreenRenderer::makeCurrent()
+{
+    _context->makeCurrent(_surface);
+    if (_framebuffer) {
+        _framebuffer->bind();
+    }
+    _context->functions()->glViewport(0, 0, _size.width(), _size.height());
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QtOpenGL>
+
+// renders the scene of a demo widget without a window:
+// an OpenGL context is created on a QOffscreenSurface and the scene is painted into a framebuffer object
+//
+// the widget is never shown, its context is replaced by a QGLContext wrapping the offscreen one,
+// so that the unchanged initializeGL / resizeGL / paintGL of the widget draw into the framebuffer
+//
+// on machines without display or GPU run with Mesa's software rasterizer, e.g.
+//     LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe QT_QPA_PLATFORM=offscreen Demo --offscreen
+// (use xvfb-run if the Qt build has no OpenGL support in the offscreen platform plugin)
+class OffscreenRenderer
+{
+public:
+    // samples > 0 renders into a multisampled framebuffer which is resolved when grabbing frames
+    explicit OffscreenRenderer(const QSize & size, int samples = 0);
+    ~OffscreenRenderer();
+
+    // create the context, the surface and the framebuffer, returns false if OpenGL is unavailable
+    bool create();
+    // the GL_RENDERER string of the context, e.g. "llvmpipe (LLVM 15.0.7, 256 bits)"
+    QString rendererName() const;
+
+    // take ownership of a scene widget and initialize it in the offscreen context
+    void setScene(QGLWidget * scene);
+    QGLWidget * scene() const { return _scene; }
+    // delete the current scene, with the offscreen context current
+    void releaseScene();
+
+    // paint one frame of the scene into the framebuffer
+    void renderFrame();
+    // read back the last frame
+    QImage grabFrame();
+
+    // make the offscreen context current and bind the framebuffer
+    void makeCurrent();
+
+    QSize size() const { return _size; }
+    QOpenGLContext * context() const { return _context; }
+
+private:
+    QSize _size;
+    int _samples;
+
+    QOffscreenSurface * _surface;
+    QOpenGLContext * _context;
+    QOpenGLFramebufferObject * _framebuffer;
+    QOpenGLFramebufferObject * _resolveFramebuffer; // single sampled copy of a multisampled _framebuffer
+
+    QGLWidget * _scene;
+};
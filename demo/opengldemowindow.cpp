@@ -1,14 +1,29 @@
 #include <QtOpenGL>
 
-#include "paint2dwidget.h"
-#include "cubewidget.h"
-#include "dragonwidget.h"
-#include "dragon2widget.h"
-#include "earthwidget.h"
-#include "terrainwidget.h"
+#include "scenes.h"
+#include "blockcompressor.h"
+#include "framescheduler.h"
+#include "glstatecache.h"
+#include "glresourceregistry.h"
+#include "lazyscene.h"
+#include "memorypanel.h"
+#include "memorytracker.h"
+#include "occlusionculler.h"
+#include "streambuffer.h"
+#include "textureloader.h"
+#include "tilecache.h"
+#include "renderthread.h"
+#include "startuptimeline.h"
 
 #include "opengldemowindow.h"
 
+static bool eager = false;
+
+// how long the next scene waits for the first frame of the previous one, when it is hidden
+static const int firstFrameTimeout = 100;
+// the pause between the scenes prefetched while idle
+static const int prefetchInterval = 250;
+
 OpenGLDemoWindow::OpenGLDemoWindow(QWidget *parent)
     : QMainWindow(parent)
 {
@@ -25,19 +40,109 @@ OpenGLDemoWindow::OpenGLDemoWindow(QWidget *parent)
     _mdiArea = new QMdiArea(this);
     setCentralWidget(_mdiArea);
 
-    _mdiArea->addSubWindow(new TerrainWidget);
-    _mdiArea->addSubWindow(new Dragon2Widget); 
-    _mdiArea->addSubWindow(new EarthWidget);
-    _mdiArea->addSubWindow(new DragonWidget);
-    _mdiArea->addSubWindow(new CubeWidget);
-    _mdiArea->addSubWindow(new Paint2DWidget);
+    // a hidden widget owning the first context of the share group, 
+    // so that textures and buffers stay alive while subwindows are opened and closed
+    _shareWidget = new QGLWidget;
+
+    // the scenes are created one at a time, each once the previous one painted its first frame
+    _sceneTimer.setSingleShot(true);
+    connect(&_sceneTimer, SIGNAL(timeout()), this, SLOT(createNextScene()));
+    _startupReported = false;
+    for (const QString & name : sceneNames()) {
+        LazyScene * scene = new LazyScene(name, _shareWidget);
+        connect(scene, SIGNAL(shownEmpty(LazyScene *)), this, SLOT(sceneShown(LazyScene *)));
+        connect(scene, SIGNAL(firstFrame(LazyScene *)), this, SLOT(sceneFirstFrame(LazyScene *)));
+        if (eager) {
+            scene->create();
+        }
+        _scenes << scene;
+        _mdiArea->addSubWindow(scene);
+    }
 
     _mdiArea->setBackground(Qt::darkGray);
     _mdiArea->tileSubWindows();
+
+    // the memory of each scene, docked on the right once shown from the View menu
+    _memoryPanel = new MemoryPanel;
+    QDockWidget * memoryDock = new QDockWidget(tr("Memory"), this);
+    memoryDock->setObjectName("memoryDock");
+    memoryDock->setWidget(_memoryPanel);
+    addDockWidget(Qt::RightDockWidgetArea, memoryDock);
+    memoryDock->hide();
+    ui.menuView->addSeparator();
+    ui.menuView->addAction(memoryDock->toggleViewAction());
+
+    // refresh the statistics every second
+    QTimer * statusTimer = new QTimer(this);
+    connect(statusTimer, SIGNAL(timeout()), this, SLOT(updateStatusBar()));
+    statusTimer->start(1000);
 }
 
 OpenGLDemoWindow::~OpenGLDemoWindow()
-{}
+{
+    delete _shareWidget;
+}
+
+void OpenGLDemoWindow::setEagerScenes(bool enabled)
+{
+    eager = enabled;
+}
+
+bool OpenGLDemoWindow::eagerScenes()
+{
+    return eager;
+}
+
+void OpenGLDemoWindow::sceneShown(LazyScene * scene)
+{
+    _shownScenes << scene;
+    // unless waiting for a first frame
+    if (!_sceneTimer.isActive()) {
+        _sceneTimer.start(0);
+    }
+}
+
+void OpenGLDemoWindow::sceneFirstFrame(LazyScene * scene)
+{
+    Q_UNUSED(scene);
+    _sceneTimer.start(_shownScenes.isEmpty() ? prefetchInterval : 0);
+
+    if (_startupReported) {
+        return;
+    }
+    for (const QPointer<LazyScene> & s : _scenes) {
+        if (s && !s->hasFirstFrame()) {
+            return;
+        }
+    }
+    _startupReported = true;
+    qDebug("Startup timeline:\n%s", qPrintable(StartupTimeline::report()));
+}
+
+void OpenGLDemoWindow::createNextScene()
+{
+    // the shown subwindows first, in the order they were shown, then the hidden ones in the window order
+    LazyScene * scene = nullptr;
+    bool shown = false;
+    while (!_shownScenes.isEmpty() && !scene) {
+        LazyScene * s = _shownScenes.takeFirst();
+        if (s && !s->scene()) {
+            scene = s;
+            shown = true;
+        }
+    }
+    for (int i = 0; i < _scenes.size() && !scene; i++) {
+        if (_scenes[i] && !_scenes[i]->scene()) {
+            scene = _scenes[i];
+        }
+    }
+    if (!scene) {
+        return;
+    }
+    scene->create();
+    // the next one is created once this one painted its first frame, or after a while if it is hidden
+    _sceneTimer.start(shown ? firstFrameTimeout : prefetchInterval);
+}
 
 void OpenGLDemoWindow::on_actionTileWin_triggered()
 {
@@ -49,6 +154,80 @@ void OpenGLDemoWindow::on_actionCascadeWin_triggered()
     _mdiArea->cascadeSubWindows();
 }
 
+void OpenGLDemoWindow::updateStatusBar()
+{
+    qint64 issued = GLStateCache::totalIssuedCalls();
+    qint64 filtered = GLStateCache::totalFilteredCalls();
+    qint64 total = issued + filtered;
+    const GLResourceRegistry & resources = GLResourceRegistry::instance();
+    QString message = tr("GL state calls: %1 issued, %2 filtered (%3%)  |  "
+        "GPU objects: %4 (%5 MB), %6 uploaded, %7 reused  |  "
+        "input: %8 events, %9 coalesced, %10 dropped, latency %11 ms avg / %12 ms max")
+        .arg(issued).arg(filtered).arg(total > 0 ? 100.0 * filtered / total : 0.0, 0, 'f', 1)
+        .arg(resources.objectCount()).arg(resources.totalBytes() / 1048576.0, 0, 'f', 1)
+        .arg(resources.uploadCount()).arg(resources.reuseCount())
+        .arg(FrameScheduler::inputEvents()).arg(FrameScheduler::coalescedEvents())
+        .arg(FrameScheduler::droppedEvents())
+        .arg(FrameScheduler::averageLatency(), 0, 'f', 1).arg(FrameScheduler::maxLatency(), 0, 'f', 1);
+    qint64 tested = OcclusionCuller::totalTested();
+    if (tested > 0) {
+        message += tr("  |  occlusion: %1% of %2 boxes culled, %3 ms culling")
+            .arg(100.0 * OcclusionCuller::totalCulled() / tested, 0, 'f', 1).arg(tested)
+            .arg(OcclusionCuller::totalNanoseconds() / 1e6, 0, 'f', 1);
+    }
+    qint64 streamed = StreamBuffer::totalBytes();
+    if (streamed > 0) {
+        message += tr("  |  streamed: %1 MB, %2 ms stalled")
+            .arg(streamed / 1048576.0, 0, 'f', 1).arg(StreamBuffer::totalStallNanoseconds() / 1e6, 0, 'f', 1);
+    }
+    if (TextureLoader::decodedCount() > 0) {
+        message += tr("  |  textures: %1 decoded in %2 ms (worker threads), %3 MB uploaded")
+            .arg(TextureLoader::decodedCount()).arg(TextureLoader::decodeNanoseconds() / 1e6, 0, 'f', 1)
+            .arg(TextureLoader::uploadedBytes() / 1048576.0, 0, 'f', 1);
+    }
+    if (TextureLoader::savedBytes() > 0) {
+        // the encode time is summed over the levels, each spread over the cores
+        qint64 encodeNanoseconds = BlockCompressor::totalNanoseconds();
+        message += tr("  |  block compression: %1 MB saved, %2 cached, encoded at %3 Mtexels/s")
+            .arg(TextureLoader::savedBytes() / 1048576.0, 0, 'f', 1).arg(TextureLoader::cachedCount())
+            .arg(encodeNanoseconds > 0 ? BlockCompressor::totalTexels() * 1e3 / encodeNanoseconds : 0.0, 0, 'f', 1);
+    }
+    if (TileCache::totalLoadedTiles() > 0) {
+        message += tr("  |  tiles: %1 loaded, %2 ms avg latency, CPU %3 MB, GPU %4 MB")
+            .arg(TileCache::totalLoadedTiles())
+            .arg(TileCache::totalLatencyNanoseconds() / 1e6 / TileCache::totalLoadedTiles(), 0, 'f', 1)
+            .arg(TileCache::totalCpuBytes() / 1048576.0, 0, 'f', 1)
+            .arg(TileCache::totalGpuBytes() / 1048576.0, 0, 'f', 1);
+    }
+    if (!_startupReported) {
+        int drawn = 0;
+        double last = 0;
+        for (const QPointer<LazyScene> & scene : _scenes) {
+            if (scene && scene->hasFirstFrame()) {
+                drawn++;
+                last = qMax(last, StartupTimeline::milliseconds(scene->name(), StartupTimeline::FirstFrame));
+            }
+        }
+        message += tr("  |  startup: %1 of %2 scenes drawn, last first frame at %3 ms")
+            .arg(drawn).arg(_scenes.size()).arg(last, 0, 'f', 0);
+    }
+    if (FrameScheduler::threadedRendering()) {
+        message += tr("  |  render threads: %1 frames").arg(RenderThread::presentedFrames());
+    }
+    // "!" after a total over its budget
+    QString cpuOver = MemoryTracker::isOverBudget(MemoryTracker::Cpu) ? "!" : "";
+    QString gpuOver = MemoryTracker::isOverBudget(MemoryTracker::Gpu) ? "!" : "";
+    message += tr("  |  memory: CPU %1 MB%2 (peak %3), GPU %4 MB%5 (peak %6)")
+        .arg(MemoryTracker::currentBytes(MemoryTracker::Cpu) / 1048576.0, 0, 'f', 1).arg(cpuOver)
+        .arg(MemoryTracker::peakBytes(MemoryTracker::Cpu) / 1048576.0, 0, 'f', 1)
+        .arg(MemoryTracker::currentBytes(MemoryTracker::Gpu) / 1048576.0, 0, 'f', 1).arg(gpuOver)
+        .arg(MemoryTracker::peakBytes(MemoryTracker::Gpu) / 1048576.0, 0, 'f', 1);
+    if (_memoryPanel->isVisible()) {
+        _memoryPanel->refresh();
+    }
+    ui.statusBar->showMessage(message);
+}
+
 void OpenGLDemoWindow::on_actionAbout_triggered()
 {
     QMessageBox::about(this, 
@@ -4,6 +4,10 @@
 #include <QtWidgets>
 #include "ui_opengldemowindow.h"
 
+class QGLWidget;
+class LazyScene;
+class MemoryPanel;
+
 // the main window
 class OpenGLDemoWindow : public QMainWindow
 {
@@ -18,8 +22,31 @@ public slots:
     void on_actionCascadeWin_triggered();
     void on_actionAbout_triggered();
 
+    // show the statistics of the OpenGL state caches, the shared GPU objects, the input pacing and the memory
+    void updateStatusBar();
+
+public:
+    // construct the scenes of every subwindow with the window, instead of on demand (for comparison)
+    static void setEagerScenes(bool eager);
+    static bool eagerScenes();
+
+private slots:
+    void sceneShown(LazyScene * scene);
+    void sceneFirstFrame(LazyScene * scene);
+    // create the scene of the subwindow shown first, or else prefetch one of a hidden subwindow
+    void createNextScene();
+
 private:
     QMdiArea * _mdiArea;
+    QGLWidget * _shareWidget;
+
+    // the subwindows (closed ones are deleted), and the shown ones waiting for their scene
+    QList<QPointer<LazyScene>> _scenes;
+    QList<QPointer<LazyScene>> _shownScenes;
+    QTimer _sceneTimer;
+    bool _startupReported;
+
+    MemoryPanel * _memoryPanel;
 
 private:
     Ui::OpenGLDemoWindowClass ui;
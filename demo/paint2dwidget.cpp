@@ -1,11 +1,17 @@
 #include <QtGui>
 
+#include "drawstats.h"
+#include "profiler.h"
+
 #include "paint2dwidget.h"
 
-Paint2DWidget::Paint2DWidget(QWidget *parent)
-    : QGLWidget(parent)
+#include "glcapturecalls.h"
+
+Paint2DWidget::Paint2DWidget(QWidget *parent, const QGLWidget * shareWidget)
+    : QGLWidget(parent, shareWidget), _frameScheduler(this)
 {
     setWindowTitle(tr("1. 2D"));
+    setObjectName("paint2d");
     setMinimumSize(200, 200);
     setMouseTracking(true);
     _scaleOfDrawing = 1;
@@ -17,13 +23,24 @@ Paint2DWidget::~Paint2DWidget()
 
 void Paint2DWidget::initializeGL()
 {
+    PROFILE_SCOPE("Paint2DWidget::initializeGL");
     makeCurrent(); 
+    _glState.initialize(context());
 }
 
 void Paint2DWidget::paintGL()
 {
+    PROFILE_GL_SCOPE("Paint2DWidget::paintGL");
+
+    // apply the input accumulated since the last frame
+    int extent = qMax(qMax(_viewportSize.width(), _viewportSize.height()), 1);
+    QPointF trans = _frameScheduler.takeDrag() / extent * 2.0;
+    _centerOfDrawing.rx() += trans.x();
+    _centerOfDrawing.ry() -= trans.y();
+    _scaleOfDrawing *= std::exp(_frameScheduler.takeWheel() / 10000.0f);
+
     // clear background
-    glClearColor(1.0, 0.0, 0.0, 1.0);
+    _glState.clearColor(Qt::red);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     static const int N = 10;
@@ -48,9 +65,10 @@ void Paint2DWidget::paintGL()
         glVertex2d(x2 + centerX, y2 + centerY);
     }
     glEnd();
+    DrawStats::count(GL_TRIANGLES, (N + 1) * 3);
 
     // decorate with lines
-    glLineWidth(5.0f);
+    _glState.lineWidth(5.0f);
     glBegin(GL_LINES);
     for(int i = 0; i <= N; i++)
     {
@@ -62,23 +80,26 @@ void Paint2DWidget::paintGL()
         double x2 = cos(angle2) * i / N * _scaleOfDrawing;
         double y2 = sin(angle2) * i / N * _scaleOfDrawing;
 
-        qglColor(Qt::black);
+        glColor3f(0, 0, 0);
         glVertex2d(x1 + centerX, y1 + centerY);
         glVertex2d(x2 + centerX, y2 + centerY);
     }
     glEnd();
+    DrawStats::count(GL_LINES, (N + 1) * 2);
 
     // center point
-    glPointSize(20.0);
+    _glState.pointSize(20.0);
     glBegin(GL_POINTS);
-    qglColor(Qt::red);
+    glColor3f(1, 0, 0);
     glVertex2d(centerX, centerY);
     glEnd();
+    DrawStats::count(GL_POINTS, 1);
 }
 
 void Paint2DWidget::resizeGL( int w, int h )
 {
     glViewport(0, 0, qMax(w, h), qMax(w, h));
+    _viewportSize = QSize(w, h);
 }
 
 void Paint2DWidget::mousePressEvent( QMouseEvent * e )
@@ -92,11 +113,9 @@ void Paint2DWidget::mouseMoveEvent( QMouseEvent * e )
     if(e->buttons() != Qt::NoButton)
     {
         setCursor(Qt::ClosedHandCursor);
-        auto trans = (e->pos() - _lastMousePos) / qMax(width(), height()) * 2.0;
-        _centerOfDrawing.rx() += trans.x();
-        _centerOfDrawing.ry() -= trans.y();
+        // the move is applied by the next frame, together with the other moves until then
+        _frameScheduler.addDrag(e->pos() - _lastMousePos);
         _lastMousePos = e->pos();
-        update();
     }
 }
 
@@ -107,6 +126,5 @@ void Paint2DWidget::mouseReleaseEvent( QMouseEvent * e )
 
 void Paint2DWidget::wheelEvent( QWheelEvent * e )
 {
-    _scaleOfDrawing *= std::exp(e->delta() / 10000.0f);
-    update();
+    _frameScheduler.addWheel(e->delta());
 }
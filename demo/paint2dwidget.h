@@ -3,10 +3,13 @@
 
 #include <QGLWidget>
 
+#include "framescheduler.h"
+#include "glstatecache.h"
+
 class Paint2DWidget : public QGLWidget
 {
 public:
-    Paint2DWidget(QWidget *parent = nullptr);
+    Paint2DWidget(QWidget *parent = nullptr, const QGLWidget * shareWidget = nullptr);
     ~Paint2DWidget();
 
 protected:
@@ -25,6 +28,15 @@ private:
     QPointF _centerOfDrawing;
     float _scaleOfDrawing;
 
+    // the size of the last resizeGL
+    QSize _viewportSize;
+
+    // the shadowed OpenGL state of this widget's context
+    GLStateCache _glState;
+
+    // accumulates the mouse input between frames and paces the repaints
+    FrameScheduler _frameScheduler;
+
 private:
     QPointF _lastMousePos;
 };
@@ -0,0 +1,316 @@
+#include <atomic>
+#include <memory>
+
+#include "profiler.h"
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+typedef void (QOPENGLF_APIENTRYP GetQueryObjectui64v)(GLuint id, GLenum pname, GLuint64 * params);
+
+static std::atomic<bool> enabled(true);
+
+namespace {
+
+struct Zone
+{
+    const char * name;
+    qint64 begin, end;
+};
+
+// the zones of one writer (a thread, or the GPU of a context)
+// single producer ring buffer: the writer never blocks, readers skip slots overwritten while reading them
+class ZoneBuffer
+{
+public:
+    enum { Capacity = 1 << 16 };
+
+    ZoneBuffer(int trackId, const QString & trackName)
+        : _slots(new Slot[Capacity]), _written(0), _trackId(trackId), _trackName(trackName)
+    {}
+
+    void append(const Zone & zone)
+    {
+        quint64 i = _written.load(std::memory_order_relaxed);
+        Slot & slot = _slots[i % Capacity];
+        // invalidate the slot while it is written (a seqlock per slot)
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.zone = zone;
+        slot.sequence.store(i + 1, std::memory_order_release);
+        _written.store(i + 1, std::memory_order_release);
+    }
+
+    // the zones that were not overwritten yet, oldest first
+    QVector<Zone> zones() const
+    {
+        QVector<Zone> result;
+        quint64 written = _written.load(std::memory_order_acquire);
+        quint64 first = written > Capacity ? written - Capacity : 0;
+        for (quint64 i = first; i < written; i++) {
+            const Slot & slot = _slots[i % Capacity];
+            if (slot.sequence.load(std::memory_order_acquire) != i + 1) {
+                continue;
+            }
+            Zone zone = slot.zone;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == i + 1) {
+                result << zone;
+            }
+        }
+        return result;
+    }
+
+    int trackId() const { return _trackId; }
+    QString trackName() const { return _trackName; }
+
+private:
+    struct Slot
+    {
+        std::atomic<quint64> sequence; // index + 1 of the zone in the slot, 0 while written
+        Zone zone;
+    };
+    std::unique_ptr<Slot[]> _slots;
+    std::atomic<quint64> _written;
+    int _trackId;
+    QString _trackName;
+};
+
+// all the buffers ever created, buffers are kept after their thread or context is gone
+// the mutex is only taken when a buffer is created and when exporting
+QMutex buffersMutex;
+QList<ZoneBuffer *> buffers;
+
+ZoneBuffer * createBuffer(const QString & trackName)
+{
+    QMutexLocker locker(&buffersMutex);
+    ZoneBuffer * buffer = new ZoneBuffer(buffers.size() + 1, trackName);
+    buffers << buffer;
+    return buffer;
+}
+
+ZoneBuffer * threadBuffer()
+{
+    thread_local ZoneBuffer * buffer = nullptr;
+    if (!buffer) {
+        QString name = QThread::currentThread()->objectName();
+        if (name.isEmpty()) {
+            name = QThread::currentThread() == QCoreApplication::instance()->thread() ? 
+                "Main thread" : QString("Thread %1").arg(quintptr(QThread::currentThreadId()));
+        }
+        buffer = createBuffer(name);
+    }
+    return buffer;
+}
+
+// the GL_TIME_ELAPSED queries of one context, reused in a ring
+class GLQueryRing
+{
+public:
+    enum { Size = 64 };
+
+    GLQueryRing(QOpenGLContext * context)
+    {
+        _functions = context->extraFunctions();
+        _getQueryObjectui64v = reinterpret_cast<GetQueryObjectui64v>(
+            context->getProcAddress("glGetQueryObjectui64v"));
+        // timer queries are core since OpenGL 3.3
+        _supported = _getQueryObjectui64v && !context->isOpenGLES() && 
+            (context->format().version() >= qMakePair(3, 3) || context->hasExtension("GL_ARB_timer_query"));
+        if (_supported) {
+            _functions->glGenQueries(Size, _ids);
+        }
+        _next = 0;
+        _active = false;
+        memset(_pending, 0, sizeof(_pending));
+        _buffer = createBuffer(QString("GPU (context %1)").arg(quintptr(context), 0, 16));
+    }
+
+    int begin(const char * name)
+    {
+        if (!_supported || _active) {
+            return -1;
+        }
+        collect();
+        // all the queries are still in flight, drop the zone rather than waiting
+        if (_pending[_next]) {
+            return -1;
+        }
+        int slot = _next;
+        _next = (_next + 1) % Size;
+        _functions->glBeginQuery(GL_TIME_ELAPSED, _ids[slot]);
+        _names[slot] = name;
+        _begins[slot] = Profiler::now();
+        _pending[slot] = true;
+        _active = true;
+        return slot;
+    }
+
+    void end(int slot)
+    {
+        Q_UNUSED(slot);
+        _functions->glEndQuery(GL_TIME_ELAPSED);
+        _active = false;
+    }
+
+    // record the zones of the finished queries, oldest first
+    void collect()
+    {
+        for (int k = 0; k < Size; k++) {
+            int slot = (_next + k) % Size;
+            if (!_pending[slot]) {
+                continue;
+            }
+            GLuint available = 0;
+            _functions->glGetQueryObjectuiv(_ids[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                // later queries finish after this one
+                break;
+            }
+            GLuint64 elapsed = 0;
+            _getQueryObjectui64v(_ids[slot], GL_QUERY_RESULT, &elapsed);
+            // the GPU zone is placed at the time it was submitted
+            _buffer->append({ _names[slot], _begins[slot], _begins[slot] + qint64(elapsed) });
+            _pending[slot] = false;
+        }
+    }
+
+private:
+    QOpenGLExtraFunctions * _functions;
+    GetQueryObjectui64v _getQueryObjectui64v;
+    bool _supported;
+
+    GLuint _ids[Size];
+    const char * _names[Size];
+    qint64 _begins[Size];
+    bool _pending[Size];
+    int _next;
+    bool _active;
+
+    ZoneBuffer * _buffer;
+};
+
+// the query rings of the contexts used by the calling thread
+GLQueryRing * queryRing(QOpenGLContext * context)
+{
+    // never freed, the connection below may outlive the thread
+    thread_local QHash<QOpenGLContext *, GLQueryRing *> * rings = new QHash<QOpenGLContext *, GLQueryRing *>;
+    GLQueryRing * ring = rings->value(context);
+    if (!ring) {
+        ring = new GLQueryRing(context);
+        rings->insert(context, ring);
+        // the query objects are deleted with the context
+        QHash<QOpenGLContext *, GLQueryRing *> * ringsOfThread = rings;
+        QObject::connect(context, &QOpenGLContext::aboutToBeDestroyed, [ringsOfThread, context] {
+            delete ringsOfThread->take(context);
+        });
+    }
+    return ring;
+}
+
+}
+
+bool Profiler::isEnabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::setEnabled(bool e)
+{
+    enabled.store(e, std::memory_order_relaxed);
+}
+
+qint64 Profiler::now()
+{
+    static QElapsedTimer clock = [] { QElapsedTimer t; t.start(); return t; }();
+    return clock.nsecsElapsed();
+}
+
+void Profiler::recordZone(const char * name, qint64 begin, qint64 end)
+{
+    threadBuffer()->append({ name, begin, end });
+}
+
+int Profiler::beginGLZone(const char * name)
+{
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (!isEnabled() || !context) {
+        return -1;
+    }
+    return queryRing(context)->begin(name);
+}
+
+void Profiler::endGLZone(int slot)
+{
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (slot < 0 || !context) {
+        return;
+    }
+    queryRing(context)->end(slot);
+}
+
+QJsonDocument Profiler::chromeTrace()
+{
+    QJsonArray events;
+    QMutexLocker locker(&buffersMutex);
+    for (const ZoneBuffer * buffer : buffers) {
+        // name the track of the buffer
+        QJsonObject metadata;
+        metadata["name"] = "thread_name";
+        metadata["ph"] = "M";
+        metadata["pid"] = 1;
+        metadata["tid"] = buffer->trackId();
+        metadata["args"] = QJsonObject({ { "name", buffer->trackName() } });
+        events.append(metadata);
+
+        // complete events, times in microseconds
+        for (const Zone & zone : buffer->zones()) {
+            QJsonObject event;
+            event["name"] = zone.name;
+            event["ph"] = "X";
+            event["pid"] = 1;
+            event["tid"] = buffer->trackId();
+            event["ts"] = zone.begin / 1000.0;
+            event["dur"] = (zone.end - zone.begin) / 1000.0;
+            events.append(event);
+        }
+    }
+    return QJsonDocument(QJsonObject({ { "traceEvents", events } }));
+}
+
+bool Profiler::writeChromeTrace(const QString & file)
+{
+    QByteArray json = chromeTrace().toJson(QJsonDocument::Compact);
+    QSaveFile f(file);
+    if (!f.open(QIODevice::WriteOnly) || f.write(json) != json.size() || !f.commit()) {
+        qWarning("Cannot write the trace %s", qPrintable(file));
+        return false;
+    }
+    qDebug("Trace written to %s", qPrintable(file));
+    return true;
+}
+
+ProfileScope::ProfileScope(const char * name)
+{
+    _name = name;
+    _begin = Profiler::isEnabled() ? Profiler::now() : -1;
+}
+
+ProfileScope::~ProfileScope()
+{
+    if (_begin >= 0) {
+        Profiler::recordZone(_name, _begin, Profiler::now());
+    }
+}
+
+GLProfileScope::GLProfileScope(const char * name)
+    : _cpuScope(name)
+{
+    _slot = Profiler::beginGLZone(name);
+}
+
+GLProfileScope::~GLProfileScope()
+{
+    Profiler::endGLZone(_slot);
+}
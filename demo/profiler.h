@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QtOpenGL>
+
+// scoped timing zones, exported as a Chrome trace (load the file in chrome://tracing or Perfetto)
+//
+//     void Widget::paintGL()
+//     {
+//         PROFILE_GL_SCOPE("Widget::paintGL");  // CPU zone + GPU zone measured with GL_TIME_ELAPSED
+//         {
+//             PROFILE_SCOPE("upload");          // CPU zone
+//             ...
+//         }
+//     }
+//
+// zone names must outlive the profiler (string literals)
+// CPU zones are recorded into a lock-free ring buffer of the calling thread, 
+// GPU zones use a ring of query objects per context whose results are collected 
+// once they are available, so the CPU never waits for the GPU
+// GL_TIME_ELAPSED queries cannot overlap, so a GPU zone nested into another one only records its CPU part
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(_profileScope, __LINE__)(name)
+#define PROFILE_GL_SCOPE(name) GLProfileScope PROFILE_CONCAT(_glProfileScope, __LINE__)(name)
+
+class Profiler
+{
+public:
+    // zones are only recorded while enabled (default)
+    static bool isEnabled();
+    static void setEnabled(bool enabled);
+
+    // nanoseconds since the start of the profiler clock
+    static qint64 now();
+
+    // record a finished CPU zone of the calling thread
+    static void recordZone(const char * name, qint64 begin, qint64 end);
+
+    // start a GPU zone in the current context, returns the query slot or -1 if the zone is not measured
+    static int beginGLZone(const char * name);
+    // end the GPU zone started by beginGLZone
+    static void endGLZone(int slot);
+
+    // the recorded zones as a Chrome trace document ({ "traceEvents": [...] })
+    static QJsonDocument chromeTrace();
+    static bool writeChromeTrace(const QString & file);
+};
+
+// a CPU zone covering the lifetime of the object
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char * name);
+    ~ProfileScope();
+
+private:
+    const char * _name;
+    qint64 _begin; // -1 if the profiler was disabled
+    Q_DISABLE_COPY(ProfileScope)
+};
+
+// a CPU zone and a GPU zone of the current context covering the lifetime of the object
+class GLProfileScope
+{
+public:
+    explicit GLProfileScope(const char * name);
+    ~GLProfileScope();
+
+private:
+    ProfileScope _cpuScope;
+    int _slot;
+    Q_DISABLE_COPY(GLProfileScope)
+};
@@ -0,0 +1,97 @@
+#include "framescheduler.h"
+#include "glwidgethooks.h"
+#include "profiler.h"
+
+#include "renderthread.h"
+
+static QAtomicInteger<qint64> totalPresentedFrames;
+
+RenderThread::RenderThread(QGLWidget * widget, FrameScheduler * scheduler)
+    : QThread()
+{
+    _widget = widget;
+    _scheduler = scheduler;
+    _widget->installEventFilter(this);
+}
+
+RenderThread::~RenderThread()
+{
+    stop();
+}
+
+void RenderThread::requestFrame()
+{
+    if (_frameRequested.testAndSetAcquire(0, 1)) {
+        _wakeUps.release();
+    }
+}
+
+void RenderThread::stop()
+{
+    _stopping.storeRelease(1);
+    if (isRunning()) {
+        _wakeUps.release();
+        wait();
+    }
+}
+
+qint64 RenderThread::presentedFrames()
+{
+    return totalPresentedFrames.load();
+}
+
+void RenderThread::run()
+{
+    _widget->makeCurrent();
+    (_widget->*&GLWidgetHooks::initializeGL)();
+
+    QSize size;
+    forever {
+        _wakeUps.acquire();
+        if (_stopping.loadAcquire()) {
+            break;
+        }
+        // requests arriving from now on need another frame
+        _frameRequested.storeRelease(0);
+
+        QSize viewportSize = _scheduler->viewportSize();
+        if (viewportSize != size) {
+            size = viewportSize;
+            (_widget->*&GLWidgetHooks::resizeGL)(size.width(), size.height());
+        }
+        (_widget->*&GLWidgetHooks::paintGL)();
+        {
+            PROFILE_SCOPE("RenderThread::swapBuffers");
+            _widget->swapBuffers();
+        }
+        _scheduler->framePresented();
+        totalPresentedFrames.fetchAndAddRelaxed(1);
+    }
+
+    // the widget releases its objects on the GUI thread
+    _widget->doneCurrent();
+    _widget->context()->moveToThread(QCoreApplication::instance()->thread());
+}
+
+bool RenderThread::eventFilter(QObject * object, QEvent * event)
+{
+    switch (event->type()) {
+    case QEvent::Paint:
+        if (!isRunning() && !_stopping.loadAcquire()) {
+            // QGLWidget made its context current on the GUI thread when it was created
+            _widget->doneCurrent();
+            _widget->context()->moveToThread(this);
+            start();
+        }
+        _scheduler->setViewportSize(_widget->size());
+        requestFrame();
+        // QGLWidget::paintEvent would make the context current on the GUI thread
+        return true;
+    case QEvent::Resize:
+        _scheduler->setViewportSize(static_cast<QResizeEvent *>(event)->size());
+        requestFrame();
+        return true;
+    default:
+        return QThread::eventFilter(object, event);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QtOpenGL>
+
+class FrameScheduler;
+
+// paints a QGLWidget on a thread of its own, so that a heavy scene does not stall the GUI thread
+//
+// the GUI thread only schedules frames: the paint and resize events of the widget are filtered out,
+// the size is published through the FrameScheduler, and requestFrame() wakes the thread,
+// which owns the context of the widget and calls initializeGL / resizeGL / paintGL and swaps the buffers
+//
+// the thread starts with the first paint event of the widget (its window exists by then)
+class RenderThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    RenderThread(QGLWidget * widget, FrameScheduler * scheduler);
+    ~RenderThread();
+
+    // wake the thread to paint a frame, requests made before it started painting are merged
+    void requestFrame();
+    // finish the current frame, stop the thread and give the context back to the GUI thread
+    void stop();
+
+    // frames presented by all the render threads
+    static qint64 presentedFrames();
+
+protected:
+    virtual void run() override;
+    virtual bool eventFilter(QObject * object, QEvent * event) override;
+
+private:
+    QGLWidget * _widget;
+    FrameScheduler * _scheduler;
+
+    QSemaphore _wakeUps;
+    QAtomicInt _frameRequested; // a wake up is pending
+    QAtomicInt _stopping;
+};
@@ -0,0 +1,34 @@
+#include "paint2dwidget.h"
+#include "cubewidget.h"
+#include "crowdwidget.h"
+#include "dragonwidget.h"
+#include "dragon2widget.h"
+#include "earthwidget.h"
+#include "terrainwidget.h"
+
+#include "scenes.h"
+
+QStringList sceneNames()
+{
+    return QStringList() << "crowd" << "terrain" << "dragon2" << "earth" << "dragon" << "cube" << "paint2d";
+}
+
+QGLWidget * createScene(const QString & name, const QGLWidget * shareWidget)
+{
+    if (name == "crowd") {
+        return new CrowdWidget(nullptr, shareWidget);
+    } else if (name == "terrain") {
+        return new TerrainWidget(nullptr, shareWidget);
+    } else if (name == "dragon2") {
+        return new Dragon2Widget(nullptr, shareWidget);
+    } else if (name == "earth") {
+        return new EarthWidget(nullptr, shareWidget);
+    } else if (name == "dragon") {
+        return new DragonWidget(nullptr, shareWidget);
+    } else if (name == "cube") {
+        return new CubeWidget(nullptr, shareWidget);
+    } else if (name == "paint2d") {
+        return new Paint2DWidget(nullptr, shareWidget);
+    }
+    return nullptr;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <QtOpenGL>
+
+// the names of the demo scenes, in the order of the subwindows:
+// "crowd", "terrain", "dragon2", "earth", "dragon", "cube", "paint2d"
+QStringList sceneNames();
+
+// create the widget of a scene, returns nullptr if the name is unknown
+QGLWidget * createScene(const QString & name, const QGLWidget * shareWidget = nullptr);
@@ -0,0 +1,317 @@
+#include "glcapture.h"
+#include "profiler.h"
+
+#include "shaderprogram.h"
+
+static QString & cacheDirectoryStorage()
+{
+    static QString dir =
+        QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/shaders";
+    return dir;
+}
+
+ShaderProgram::ShaderProgram()
+    : QGLFunctions()
+{
+    _program = 0;
+    _uniformOwner = nullptr;
+    _loadedFromCache = false;
+    _initTime = 0.0;
+    _binarySupported = false;
+    _shareGroup = nullptr;
+}
+
+ShaderProgram::~ShaderProgram()
+{
+    // the program belongs to the share group, any of its contexts may delete it
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (_program != 0 && context && context->shareGroup() == _shareGroup) {
+        release();
+    } else if (_program != 0) {
+        qWarning("Shader program %u deleted without a context of its share group, it is leaked", _program);
+    }
+}
+
+void ShaderProgram::bindAttributeLocation(GLuint index, const char * name)
+{
+    _attributeLocations << qMakePair(index, QByteArray(name));
+}
+
+void ShaderProgram::bindUniformBlock(const char * name, GLuint binding)
+{
+    _uniformBlockBindings << qMakePair(binding, QByteArray(name));
+}
+
+bool ShaderProgram::build(const QByteArray & vshaderSource, const QByteArray & fshaderSource)
+{
+    PROFILE_SCOPE("ShaderProgram::build");
+    QElapsedTimer timer;
+    timer.start();
+
+    initializeGLFunctions(QGLContext::currentContext());
+    _loadedFromCache = false;
+    _shareGroup = QOpenGLContext::currentContext()->shareGroup();
+
+    // program binaries are core since OpenGL 4.1, before that they need GL_ARB_get_program_binary
+    QOpenGLContext * ctx = QOpenGLContext::currentContext();
+    _binarySupported = ctx && ctx->hasExtension("GL_ARB_get_program_binary") &&
+        _binaryFunctions.initializeOpenGLFunctions();
+    if (_binarySupported) {
+        GLint numFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        _binarySupported = numFormats > 0;
+    }
+
+    QByteArray key = cacheKey(vshaderSource, fshaderSource);
+    bool ok = false;
+    if (_binarySupported && loadBinary(key)) {
+        _loadedFromCache = true;
+        ok = true;
+    } else {
+        // the binary is missing or rejected by the driver, fall back to the sources
+        ok = compileAndLink(vshaderSource, fshaderSource);
+        if (ok && _binarySupported) {
+            saveBinary(key);
+        }
+    }
+
+    // block bindings are not part of the program binary, so they are set after every build
+    if (ok) {
+        applyUniformBlockBindings();
+        // a captured frame rebuilds the program from its sources
+        GLCapture::registerProgram(_program, vshaderSource, fshaderSource, 
+            _attributeLocations, _uniformBlockBindings);
+    }
+
+    _initTime = timer.nsecsElapsed() / 1e6;
+    if (ok) {
+        qDebug("Shader program %u %s in %.3f ms (%s)", _program,
+            _loadedFromCache ? "loaded from binary cache" : "compiled from source",
+            _initTime, _loadedFromCache ? "warm" : "cold");
+    }
+    return ok;
+}
+
+void ShaderProgram::release()
+{
+    if (_program != 0) {
+        glDeleteProgram(_program);
+        _program = 0;
+    }
+    _uniformLocations.clear();
+    _uniformOwner = nullptr;
+}
+
+bool ShaderProgram::claimUniforms(const void * owner)
+{
+    if (_uniformOwner == owner) {
+        return false;
+    }
+    _uniformOwner = owner;
+    return true;
+}
+
+GLint ShaderProgram::uniformLocation(const char * name)
+{
+    auto it = _uniformLocations.constFind(name);
+    if (it != _uniformLocations.constEnd()) {
+        return it.value();
+    }
+    GLint location = glGetUniformLocation(_program, name);
+    _uniformLocations.insert(name, location);
+    return location;
+}
+
+void ShaderProgram::applyUniformBlockBindings()
+{
+    if (_uniformBlockBindings.isEmpty()) {
+        return;
+    }
+    QOpenGLExtraFunctions * f = QOpenGLContext::currentContext()->extraFunctions();
+    for (auto & block : _uniformBlockBindings) {
+        GLuint index = f->glGetUniformBlockIndex(_program, block.second.constData());
+        if (index != GL_INVALID_INDEX) {
+            f->glUniformBlockBinding(_program, index, block.first);
+        }
+    }
+}
+
+QString ShaderProgram::cacheDirectory()
+{
+    return cacheDirectoryStorage();
+}
+
+void ShaderProgram::setCacheDirectory(const QString & dir)
+{
+    cacheDirectoryStorage() = dir;
+}
+
+QByteArray ShaderProgram::cacheKey(const QByteArray & vshaderSource, const QByteArray & fshaderSource)
+{
+    // a binary is only valid for the exact driver that produced it
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(vshaderSource);
+    hash.addData("\0", 1);
+    hash.addData(fshaderSource);
+    hash.addData("\0", 1);
+    for (auto & attr : _attributeLocations) {
+        hash.addData(QByteArray::number(attr.first));
+        hash.addData(attr.second);
+    }
+    hash.addData(reinterpret_cast<const char *>(glGetString(GL_VENDOR)));
+    hash.addData(reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+    hash.addData(reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+    return hash.result().toHex();
+}
+
+QString ShaderProgram::cacheFilePath(const QByteArray & key) const
+{
+    return cacheDirectory() + "/" + QString::fromLatin1(key) + ".bin";
+}
+
+bool ShaderProgram::loadBinary(const QByteArray & key)
+{
+    QFile file(cacheFilePath(key));
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    QDataStream ds(&file);
+    quint32 format;
+    QByteArray binary;
+    ds >> format >> binary;
+    if (ds.status() != QDataStream::Ok || binary.isEmpty()) {
+        return false;
+    }
+
+    GLuint program = glCreateProgram();
+    _binaryFunctions.glProgramBinary(program, format, binary.constData(), binary.size());
+
+    // the driver may reject binaries after an update, even when its version string is unchanged
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == 0) {
+        qDebug("Program binary %s rejected by the driver", key.constData());
+        glDeleteProgram(program);
+        file.close();
+        file.remove();
+        return false;
+    }
+
+    release();
+    _program = program;
+    return true;
+}
+
+void ShaderProgram::saveBinary(const QByteArray & key)
+{
+    GLint length = 0;
+    glGetProgramiv(_program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    QByteArray binary(length, Qt::Uninitialized);
+    GLenum format = 0;
+    _binaryFunctions.glGetProgramBinary(_program, length, &length, &format, binary.data());
+    binary.resize(length);
+
+    if (!QDir().mkpath(cacheDirectory())) {
+        return;
+    }
+    // write to a temporary file first, so that a concurrent reader never sees a partial binary
+    QSaveFile file(cacheFilePath(key));
+    if (!file.open(QFile::WriteOnly)) {
+        return;
+    }
+    QDataStream ds(&file);
+    ds << quint32(format) << binary;
+    file.commit();
+}
+
+bool ShaderProgram::compileAndLink(const QByteArray & vshaderSource, const QByteArray & fshaderSource)
+{
+    // create a vertex shader and a fragment shader
+    GLuint vshader = compileShader(GL_VERTEX_SHADER, vshaderSource);
+    if (vshader == 0) {
+        return false;
+    }
+    GLuint fshader = compileShader(GL_FRAGMENT_SHADER, fshaderSource);
+    if (fshader == 0) {
+        glDeleteShader(vshader);
+        return false;
+    }
+
+    // create OpenGL shader program
+    GLuint program = glCreateProgram();
+
+    // attach shaders to the program
+    glAttachShader(program, vshader);
+    glAttachShader(program, fshader);
+
+    // attribute locations only take effect when the program is linked
+    for (auto & attr : _attributeLocations) {
+        glBindAttribLocation(program, attr.first, attr.second.constData());
+    }
+
+    // ask the driver to keep the binary retrievable
+    if (_binarySupported) {
+        _binaryFunctions.glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // link the program
+    glLinkProgram(program);
+
+    // the shaders are no longer needed once the program is linked
+    glDetachShader(program, vshader);
+    glDetachShader(program, fshader);
+    glDeleteShader(vshader);
+    glDeleteShader(fshader);
+
+    { // check status
+        GLint logLength, status;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status != 0) {
+            glValidateProgram(program);
+        }
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+        if (logLength > 0) {
+            QByteArray log(logLength, '\0');
+            glGetProgramInfoLog(program, logLength, &logLength, log.data());
+            qDebug("Program link log:\n%s", log.constData());
+        }
+        if (status == 0) {
+            glDeleteProgram(program);
+            return false;
+        }
+    }
+
+    release();
+    _program = program;
+    return true;
+}
+
+GLuint ShaderProgram::compileShader(GLenum type, const QByteArray & source)
+{
+    GLuint shader = glCreateShader(type);
+
+    // load shader source and compile
+    const char * data = source.constData();
+    GLint length = source.size();
+    glShaderSource(shader, 1, &data, &length);
+    glCompileShader(shader);
+    { // check status
+        GLint logLength;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+        if (logLength > 0) {
+            QByteArray log(logLength, '\0');
+            glGetShaderInfoLog(shader, logLength, &logLength, log.data());
+            qDebug("Shader compile log:\n%s", log.constData());
+        }
+        GLint status;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status == 0) {
+            glDeleteShader(shader);
+            return 0;
+        }
+    }
+    return shader;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QtOpenGL>
+#include <QtOpenGLExtensions>
+
+// an OpenGL shader program built from vertex and fragment shader sources
+// linked program binaries are stored in a cache directory (glGetProgramBinary),
+// so that later launches can skip compiling and linking the sources
+class ShaderProgram : protected QGLFunctions
+{
+public:
+    ShaderProgram();
+    // deletes the program if a context of its share group is current
+    ~ShaderProgram();
+
+    // bind an attribute name to a fixed location, must be called before build()
+    void bindAttributeLocation(GLuint index, const char * name);
+    // bind a uniform block to a fixed binding point, applied whenever the program is built
+    void bindUniformBlock(const char * name, GLuint binding);
+
+    // build the program in the current context, returns false on failure
+    bool build(const QByteArray & vshaderSource, const QByteArray & fshaderSource);
+
+    // delete the program, the owning context must be current
+    void release();
+
+    // id of the OpenGL shader program (0 if not built)
+    GLuint programId() const { return _program; }
+    // whether the last build() was served by the on-disk cache (warm start)
+    bool isLoadedFromCache() const { return _loadedFromCache; }
+    // time spent in the last build() in milliseconds
+    double initTime() const { return _initTime; }
+
+    // location of a uniform variable, cached after the first query
+    GLint uniformLocation(const char * name);
+
+    // programs may be shared by several widgets, each with its own uniform values
+    // records the owner of the current values, returns true if it changed (the caller must set its uniforms)
+    bool claimUniforms(const void * owner);
+
+    // directory where program binaries are stored
+    static QString cacheDirectory();
+    static void setCacheDirectory(const QString & dir);
+
+private:
+    // the key of the cache entry: hash of the sources, attribute bindings and driver strings
+    QByteArray cacheKey(const QByteArray & vshaderSource, const QByteArray & fshaderSource);
+    QString cacheFilePath(const QByteArray & key) const;
+
+    bool loadBinary(const QByteArray & key);
+    void saveBinary(const QByteArray & key);
+    bool compileAndLink(const QByteArray & vshaderSource, const QByteArray & fshaderSource);
+    void applyUniformBlockBindings();
+    GLuint compileShader(GLenum type, const QByteArray & source);
+
+private:
+    GLuint _program;
+    QOpenGLContextGroup * _shareGroup; // of the context of the last build()
+    QVector<QPair<GLuint, QByteArray>> _attributeLocations;
+    QVector<QPair<GLuint, QByteArray>> _uniformBlockBindings;
+    QHash<QByteArray, GLint> _uniformLocations;
+    const void * _uniformOwner;
+
+    bool _loadedFromCache;
+    double _initTime;
+
+    // whether GL_ARB_get_program_binary is usable in the current context
+    bool _binarySupported;
+    QOpenGLExtension_ARB_get_program_binary _binaryFunctions;
+};
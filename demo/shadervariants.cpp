@@ -0,0 +1,80 @@
+#include "shadervariants.h"
+
+ShaderVariants::ShaderVariants(const QByteArray & vshaderSource, const QByteArray & fshaderSource,
+    const QVector<QByteArray> & featureDefines)
+    : _vshaderSource(vshaderSource), _fshaderSource(fshaderSource), _featureDefines(featureDefines)
+{}
+
+ShaderVariants::~ShaderVariants()
+{
+    qDeleteAll(_variants);
+}
+
+void ShaderVariants::bindAttributeLocation(GLuint index, const char * name)
+{
+    _attributeLocations << qMakePair(index, QByteArray(name));
+}
+
+void ShaderVariants::bindUniformBlock(const char * name, GLuint binding)
+{
+    _uniformBlockBindings << qMakePair(binding, QByteArray(name));
+}
+
+ShaderProgram * ShaderVariants::variant(quint32 features)
+{
+    QMutexLocker lock(&_mutex);
+    auto it = _variants.constFind(features);
+    if (it != _variants.constEnd()) {
+        return it.value();
+    }
+
+    // first use of this variant, compile it (or load it from the binary cache)
+    ShaderProgram * program = new ShaderProgram;
+    for (auto & attr : _attributeLocations) {
+        program->bindAttributeLocation(attr.first, attr.second.constData());
+    }
+    for (auto & block : _uniformBlockBindings) {
+        program->bindUniformBlock(block.second.constData(), block.first);
+    }
+    if (!program->build(variantSource(_vshaderSource, features), variantSource(_fshaderSource, features))) {
+        qDebug("Failed to build shader variant 0x%x", features);
+        delete program;
+        program = nullptr;
+    }
+    _variants.insert(features, program);
+    return program;
+}
+
+QByteArray ShaderVariants::variantSource(const QByteArray & source, quint32 features) const
+{
+    QByteArray defines;
+    for (int i = 0; i < _featureDefines.size(); i++) {
+        if (features & (1u << i)) {
+            defines += "#define " + _featureDefines[i] + "\n";
+        }
+    }
+
+    // "#version" must stay the first statement of the shader
+    int insertAt = 0;
+    if (source.startsWith("#version")) {
+        insertAt = source.indexOf('\n') + 1;
+        if (insertAt == 0) {
+            return source + "\n" + defines;
+        }
+    }
+    QByteArray result = source;
+    result.insert(insertAt, defines);
+    return result;
+}
+
+void ShaderVariants::release()
+{
+    QMutexLocker lock(&_mutex);
+    for (ShaderProgram * program : _variants) {
+        if (program) {
+            program->release();
+        }
+    }
+    qDeleteAll(_variants);
+    _variants.clear();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QtOpenGL>
+
+#include "shaderprogram.h"
+
+// a family of shader programs generated from one shared source
+// each feature bit of a variant key injects a "#define <name>" right after the "#version" line,
+// variants are compiled lazily on first use and memoized by their key,
+// variant() may be called by several render threads (each building in its own context of the share group)
+class ShaderVariants
+{
+public:
+    // featureDefines[i] is the macro defined when bit i of a variant key is set
+    ShaderVariants(const QByteArray & vshaderSource, const QByteArray & fshaderSource,
+        const QVector<QByteArray> & featureDefines);
+    // deletes the built programs, a context of the share group must be current
+    virtual ~ShaderVariants();
+
+    // bind an attribute name to a fixed location in every variant
+    void bindAttributeLocation(GLuint index, const char * name);
+    // bind a uniform block to a fixed binding point in every variant
+    void bindUniformBlock(const char * name, GLuint binding);
+
+    // the program of the variant with the given features, built in the current context on first use
+    // returns nullptr if the variant failed to build (failures are memoized as well)
+    ShaderProgram * variant(quint32 features);
+
+    // the source of a variant with the feature defines injected
+    QByteArray variantSource(const QByteArray & source, quint32 features) const;
+
+    // number of variants built so far
+    int variantCount() const { return _variants.size(); }
+
+    // delete all the built programs, the owning context must be current
+    void release();
+
+private:
+    QByteArray _vshaderSource, _fshaderSource;
+    QVector<QByteArray> _featureDefines;
+    QVector<QPair<GLuint, QByteArray>> _attributeLocations;
+    QVector<QPair<GLuint, QByteArray>> _uniformBlockBindings;
+    QHash<quint32, ShaderProgram *> _variants;
+    QMutex _mutex; // guards _variants
+
+    Q_DISABLE_COPY(ShaderVariants)
+};
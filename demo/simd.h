@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cmath>
+
+#include <QtGlobal>
+
+// thin wrappers over the widest SIMD registers enabled at compile time:
+// AVX2 (8 lanes, build with -DENABLE_AVX2=ON), SSE2 (4 lanes, any x86-64 build) or plain scalars (1 lane)
+//
+// SimdFloat holds SimdFloat::Width floats, comparisons return SimdMask,
+// and masks combine with &, |, andNot and pick lanes with select()
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#endif
+
+#if defined(SIMD_AVX2)
+
+struct SimdMask
+{
+    __m256 v;
+    SimdMask() {}
+    SimdMask(__m256 m) : v(m) {}
+    static SimdMask all() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    static SimdMask none() { return _mm256_setzero_ps(); }
+    // lanes below n are set
+    static SimdMask firstLanes(int n)
+    {
+        return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(n),
+            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    }
+    // bit i is set if lane i is set
+    int bits() const { return _mm256_movemask_ps(v); }
+    bool any() const { return bits() != 0; }
+};
+inline SimdMask operator&(SimdMask a, SimdMask b) { return _mm256_and_ps(a.v, b.v); }
+inline SimdMask operator|(SimdMask a, SimdMask b) { return _mm256_or_ps(a.v, b.v); }
+// a & ~b
+inline SimdMask andNot(SimdMask a, SimdMask b) { return _mm256_andnot_ps(b.v, a.v); }
+
+struct SimdFloat
+{
+    enum { Width = 8 };
+    __m256 v;
+    SimdFloat() {}
+    SimdFloat(__m256 x) : v(x) {}
+    SimdFloat(float x) : v(_mm256_set1_ps(x)) {}
+    // 0, 1, 2, ... Width - 1
+    static SimdFloat ramp() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+    static SimdFloat load(const float * p) { return _mm256_loadu_ps(p); }
+    void store(float * p) const { _mm256_storeu_ps(p, v); }
+    float operator[](int i) const { alignas(32) float f[Width]; _mm256_store_ps(f, v); return f[i]; }
+};
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm256_add_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return _mm256_div_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+inline SimdMask operator<(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline SimdMask operator<=(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline SimdMask operator>(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline SimdMask operator>=(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline SimdMask operator==(SimdFloat a, SimdFloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+inline SimdFloat minimum(SimdFloat a, SimdFloat b) { return _mm256_min_ps(a.v, b.v); }
+inline SimdFloat maximum(SimdFloat a, SimdFloat b) { return _mm256_max_ps(a.v, b.v); }
+inline SimdFloat squareRoot(SimdFloat a) { return _mm256_sqrt_ps(a.v); }
+// a * b + c
+inline SimdFloat multiplyAdd(SimdFloat a, SimdFloat b, SimdFloat c)
+{
+#if defined(__FMA__)
+    return _mm256_fmadd_ps(a.v, b.v, c.v);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v);
+#endif
+}
+// the lanes of a where mask is set, of b elsewhere
+inline SimdFloat select(SimdMask mask, SimdFloat a, SimdFloat b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+// split the 2 * Width floats a, b into the ones at even and odd positions
+inline void deinterleave(SimdFloat a, SimdFloat b, SimdFloat * even, SimdFloat * odd)
+{
+    // the shuffles work within 128 bit halves, the permutes put the halves back in order
+    __m256 e = _mm256_shuffle_ps(a.v, b.v, _MM_SHUFFLE(2, 0, 2, 0));
+    __m256 o = _mm256_shuffle_ps(a.v, b.v, _MM_SHUFFLE(3, 1, 3, 1));
+    even->v = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(e), _MM_SHUFFLE(3, 1, 2, 0)));
+    odd->v = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(o), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+struct SimdInt
+{
+    __m256i v;
+    SimdInt() {}
+    SimdInt(__m256i x) : v(x) {}
+    SimdInt(int x) : v(_mm256_set1_epi32(x)) {}
+    // truncates towards zero
+    static SimdInt fromFloat(SimdFloat f) { return _mm256_cvttps_epi32(f.v); }
+    static SimdInt load(const quint32 * p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+    void store(quint32 * p) const { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v); }
+};
+inline SimdInt operator|(SimdInt a, SimdInt b) { return _mm256_or_si256(a.v, b.v); }
+inline SimdInt operator<<(SimdInt a, int n) { return _mm256_slli_epi32(a.v, n); }
+inline SimdInt select(SimdMask mask, SimdInt a, SimdInt b)
+{
+    return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), mask.v));
+}
+
+#elif defined(SIMD_SSE2)
+
+struct SimdMask
+{
+    __m128 v;
+    SimdMask() {}
+    SimdMask(__m128 m) : v(m) {}
+    static SimdMask all() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+    static SimdMask none() { return _mm_setzero_ps(); }
+    static SimdMask firstLanes(int n)
+    {
+        return _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(n), _mm_setr_epi32(0, 1, 2, 3)));
+    }
+    int bits() const { return _mm_movemask_ps(v); }
+    bool any() const { return bits() != 0; }
+};
+inline SimdMask operator&(SimdMask a, SimdMask b) { return _mm_and_ps(a.v, b.v); }
+inline SimdMask operator|(SimdMask a, SimdMask b) { return _mm_or_ps(a.v, b.v); }
+inline SimdMask andNot(SimdMask a, SimdMask b) { return _mm_andnot_ps(b.v, a.v); }
+
+struct SimdFloat
+{
+    enum { Width = 4 };
+    __m128 v;
+    SimdFloat() {}
+    SimdFloat(__m128 x) : v(x) {}
+    SimdFloat(float x) : v(_mm_set1_ps(x)) {}
+    static SimdFloat ramp() { return _mm_setr_ps(0, 1, 2, 3); }
+    static SimdFloat load(const float * p) { return _mm_loadu_ps(p); }
+    void store(float * p) const { _mm_storeu_ps(p, v); }
+    float operator[](int i) const { alignas(16) float f[Width]; _mm_store_ps(f, v); return f[i]; }
+};
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return _mm_add_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return _mm_sub_ps(a.v, b.v); }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return _mm_mul_ps(a.v, b.v); }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return _mm_div_ps(a.v, b.v); }
+inline SimdFloat operator-(SimdFloat a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+inline SimdMask operator<(SimdFloat a, SimdFloat b) { return _mm_cmplt_ps(a.v, b.v); }
+inline SimdMask operator<=(SimdFloat a, SimdFloat b) { return _mm_cmple_ps(a.v, b.v); }
+inline SimdMask operator>(SimdFloat a, SimdFloat b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline SimdMask operator>=(SimdFloat a, SimdFloat b) { return _mm_cmpge_ps(a.v, b.v); }
+inline SimdMask operator==(SimdFloat a, SimdFloat b) { return _mm_cmpeq_ps(a.v, b.v); }
+inline SimdFloat minimum(SimdFloat a, SimdFloat b) { return _mm_min_ps(a.v, b.v); }
+inline SimdFloat maximum(SimdFloat a, SimdFloat b) { return _mm_max_ps(a.v, b.v); }
+inline SimdFloat squareRoot(SimdFloat a) { return _mm_sqrt_ps(a.v); }
+inline SimdFloat multiplyAdd(SimdFloat a, SimdFloat b, SimdFloat c) { return _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v); }
+inline SimdFloat select(SimdMask mask, SimdFloat a, SimdFloat b)
+{
+    return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+}
+inline void deinterleave(SimdFloat a, SimdFloat b, SimdFloat * even, SimdFloat * odd)
+{
+    even->v = _mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(2, 0, 2, 0));
+    odd->v = _mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+struct SimdInt
+{
+    __m128i v;
+    SimdInt() {}
+    SimdInt(__m128i x) : v(x) {}
+    SimdInt(int x) : v(_mm_set1_epi32(x)) {}
+    static SimdInt fromFloat(SimdFloat f) { return _mm_cvttps_epi32(f.v); }
+    static SimdInt load(const quint32 * p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+    void store(quint32 * p) const { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v); }
+};
+inline SimdInt operator|(SimdInt a, SimdInt b) { return _mm_or_si128(a.v, b.v); }
+inline SimdInt operator<<(SimdInt a, int n) { return _mm_slli_epi32(a.v, n); }
+inline SimdInt select(SimdMask mask, SimdInt a, SimdInt b)
+{
+    __m128i m = _mm_castps_si128(mask.v);
+    return _mm_or_si128(_mm_and_si128(m, a.v), _mm_andnot_si128(m, b.v));
+}
+
+#else
+
+// one lane, for targets without SSE2
+struct SimdMask
+{
+    bool v;
+    SimdMask() {}
+    SimdMask(bool m) : v(m) {}
+    static SimdMask all() { return true; }
+    static SimdMask none() { return false; }
+    static SimdMask firstLanes(int n) { return n > 0; }
+    int bits() const { return v ? 1 : 0; }
+    bool any() const { return v; }
+};
+inline SimdMask operator&(SimdMask a, SimdMask b) { return a.v && b.v; }
+inline SimdMask operator|(SimdMask a, SimdMask b) { return a.v || b.v; }
+inline SimdMask andNot(SimdMask a, SimdMask b) { return a.v && !b.v; }
+
+struct SimdFloat
+{
+    enum { Width = 1 };
+    float v;
+    SimdFloat() {}
+    SimdFloat(float x) : v(x) {}
+    static SimdFloat ramp() { return 0.0f; }
+    static SimdFloat load(const float * p) { return *p; }
+    void store(float * p) const { *p = v; }
+    float operator[](int) const { return v; }
+};
+inline SimdFloat operator+(SimdFloat a, SimdFloat b) { return a.v + b.v; }
+inline SimdFloat operator-(SimdFloat a, SimdFloat b) { return a.v - b.v; }
+inline SimdFloat operator*(SimdFloat a, SimdFloat b) { return a.v * b.v; }
+inline SimdFloat operator/(SimdFloat a, SimdFloat b) { return a.v / b.v; }
+inline SimdFloat operator-(SimdFloat a) { return -a.v; }
+inline SimdMask operator<(SimdFloat a, SimdFloat b) { return a.v < b.v; }
+inline SimdMask operator<=(SimdFloat a, SimdFloat b) { return a.v <= b.v; }
+inline SimdMask operator>(SimdFloat a, SimdFloat b) { return a.v > b.v; }
+inline SimdMask operator>=(SimdFloat a, SimdFloat b) { return a.v >= b.v; }
+inline SimdMask operator==(SimdFloat a, SimdFloat b) { return a.v == b.v; }
+inline SimdFloat minimum(SimdFloat a, SimdFloat b) { return qMin(a.v, b.v); }
+inline SimdFloat maximum(SimdFloat a, SimdFloat b) { return qMax(a.v, b.v); }
+inline SimdFloat squareRoot(SimdFloat a) { return std::sqrt(a.v); }
+inline SimdFloat multiplyAdd(SimdFloat a, SimdFloat b, SimdFloat c) { return a.v * b.v + c.v; }
+inline SimdFloat select(SimdMask mask, SimdFloat a, SimdFloat b) { return mask.v ? a : b; }
+inline void deinterleave(SimdFloat a, SimdFloat b, SimdFloat * even, SimdFloat * odd) { *even = a; *odd = b; }
+
+struct SimdInt
+{
+    quint32 v;
+    SimdInt() {}
+    SimdInt(quint32 x) : v(x) {}
+    static SimdInt fromFloat(SimdFloat f) { return quint32(qint32(f.v)); }
+    static SimdInt load(const quint32 * p) { return *p; }
+    void store(quint32 * p) const { *p = v; }
+};
+inline SimdInt operator|(SimdInt a, SimdInt b) { return a.v | b.v; }
+inline SimdInt operator<<(SimdInt a, int n) { return a.v << n; }
+inline SimdInt select(SimdMask mask, SimdInt a, SimdInt b) { return mask.v ? a : b; }
+
+#endif
+
+// number of set lanes
+inline int laneCount(SimdMask mask)
+{
+    int bits = mask.bits();
+    int count = 0;
+    for (; bits; bits &= bits - 1) {
+        count++;
+    }
+    return count;
+}
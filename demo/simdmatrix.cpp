@@ -0,0 +1,155 @@
+#include <cmath>
+
+#include "simdmatrix.h"
+
+static_assert(sizeof(QVector4D) == 4 * sizeof(float), "QVector4D is stored as 4 floats");
+
+SimdMatrix4 SimdMatrix4::translation(const QVector3D & t)
+{
+    return SimdMatrix4(SimdVector4(1, 0, 0, 0), SimdVector4(0, 1, 0, 0), SimdVector4(0, 0, 1, 0), SimdVector4(t, 1));
+}
+
+SimdMatrix4 SimdMatrix4::scaling(const QVector3D & s)
+{
+    return SimdMatrix4(SimdVector4(s.x(), 0, 0, 0), SimdVector4(0, s.y(), 0, 0), SimdVector4(0, 0, s.z(), 0),
+        SimdVector4(0, 0, 0, 1));
+}
+
+SimdMatrix4 SimdMatrix4::rotation(float angle, const QVector3D & axis)
+{
+    QVector3D n = axis.normalized();
+    float radians = angle * float(M_PI) / 180;
+    float c = std::cos(radians), s = std::sin(radians), ic = 1 - c;
+    float x = n.x(), y = n.y(), z = n.z();
+    return SimdMatrix4(
+        SimdVector4(x * x * ic + c, y * x * ic + z * s, x * z * ic - y * s, 0),
+        SimdVector4(x * y * ic - z * s, y * y * ic + c, y * z * ic + x * s, 0),
+        SimdVector4(x * z * ic + y * s, y * z * ic - x * s, z * z * ic + c, 0),
+        SimdVector4(0, 0, 0, 1));
+}
+
+SimdMatrix4 SimdMatrix4::transposed() const
+{
+#if defined(SIMD_SSE2) || defined(SIMD_AVX2)
+    __m128 c0 = columns[0].v, c1 = columns[1].v, c2 = columns[2].v, c3 = columns[3].v;
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    return SimdMatrix4(c0, c1, c2, c3);
+#else
+    SimdMatrix4 t;
+    for (int r = 0; r < 4; r++) {
+        for (int c = 0; c < 4; c++) {
+            t.columns[r].v[c] = columns[c].v[r];
+        }
+    }
+    return t;
+#endif
+}
+
+void SimdMatrix4::mapBox(const QVector3D & boundsMin, const QVector3D & boundsMax,
+    QVector3D * outMin, QVector3D * outMax) const
+{
+    // the center is mapped, the half extents grow by the absolute values of the axes (Arvo)
+    SimdVector4 center = map(SimdVector4((boundsMin + boundsMax) / 2, 1));
+    SimdVector4 half(((boundsMax - boundsMin) / 2), 0);
+    SimdVector4 extent = absolute(columns[0]) * half.broadcast<0>();
+    extent = multiplyAdd(absolute(columns[1]), half.broadcast<1>(), extent);
+    extent = multiplyAdd(absolute(columns[2]), half.broadcast<2>(), extent);
+    *outMin = (center - extent).toVector3D();
+    *outMax = (center + extent).toVector3D();
+}
+
+void SimdMatrix4::multiply(const SimdMatrix4 & a, const SimdMatrix4 * b, SimdMatrix4 * out, int count)
+{
+    SimdMatrix4 m = a;
+    for (int i = 0; i < count; i++) {
+        out[i] = m * b[i];
+    }
+}
+
+void SimdMatrix4::mapPoints(const SimdMatrix4 & m, const QVector3D * points, QVector4D * out, int count)
+{
+    SimdVector4 c0 = m.columns[0], c1 = m.columns[1], c2 = m.columns[2], c3 = m.columns[3];
+    for (int i = 0; i < count; i++) {
+        const QVector3D & p = points[i];
+        SimdVector4 r = multiplyAdd(c0, SimdVector4::splat(p.x()), c3);
+        r = multiplyAdd(c1, SimdVector4::splat(p.y()), r);
+        r = multiplyAdd(c2, SimdVector4::splat(p.z()), r);
+        r.store(reinterpret_cast<float *>(out + i));
+    }
+}
+
+void SimdMatrix4::mapPoints(const SimdMatrix4 & m, const float * x, const float * y, const float * z,
+    float * outX, float * outY, float * outZ, float * outW, int count)
+{
+    // the elements of the matrix in every lane, e[column][row]
+    alignas(16) float elements[4][4];
+    for (int c = 0; c < 4; c++) {
+        m.columns[c].store(elements[c]);
+    }
+    SimdFloat e[4][4];
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            e[c][r] = elements[c][r];
+        }
+    }
+    float * outs[4] = { outX, outY, outZ, outW };
+
+    int i = 0;
+    for (; i + SimdFloat::Width <= count; i += SimdFloat::Width) {
+        SimdFloat px = SimdFloat::load(x + i), py = SimdFloat::load(y + i), pz = SimdFloat::load(z + i);
+        for (int r = 0; r < 4; r++) {
+            multiplyAdd(e[0][r], px, multiplyAdd(e[1][r], py, multiplyAdd(e[2][r], pz, e[3][r]))).store(outs[r] + i);
+        }
+    }
+    for (; i < count; i++) {
+        float p[4];
+        m.map(SimdVector4(x[i], y[i], z[i], 1)).store(p);
+        for (int r = 0; r < 4; r++) {
+            outs[r][i] = p[r];
+        }
+    }
+}
+
+SimdFrustum::SimdFrustum(const SimdMatrix4 & viewProjection)
+{
+    // -w <= x, y, z <= w in clip space: the planes are the last row plus or minus the others (Gribb and Hartmann)
+    SimdMatrix4 rows = viewProjection.transposed();
+    SimdVector4 planes[PlaneCount] = {
+        rows.columns[3] + rows.columns[0], rows.columns[3] - rows.columns[0],
+        rows.columns[3] + rows.columns[1], rows.columns[3] - rows.columns[1],
+        rows.columns[3] + rows.columns[2], rows.columns[3] - rows.columns[2]
+    };
+    for (int i = 0; i < PaddedCount; i++) {
+        alignas(16) float p[4] = { 0, 0, 0, 1 };
+        if (i < PlaneCount) {
+            planes[i].store(p);
+            float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            for (int k = 0; k < 4 && length > 0; k++) {
+                p[k] /= length;
+            }
+        }
+        _a[i] = p[0];
+        _b[i] = p[1];
+        _c[i] = p[2];
+        _d[i] = p[3];
+    }
+}
+
+bool SimdFrustum::intersectsBox(const QVector3D & boundsMin, const QVector3D & boundsMax) const
+{
+    SimdFloat minX(boundsMin.x()), minY(boundsMin.y()), minZ(boundsMin.z());
+    SimdFloat maxX(boundsMax.x()), maxY(boundsMax.y()), maxZ(boundsMax.z());
+    SimdFloat zero(0.0f);
+    for (int i = 0; i < PaddedCount; i += SimdFloat::Width) {
+        SimdFloat a = SimdFloat::load(_a + i), b = SimdFloat::load(_b + i), c = SimdFloat::load(_c + i);
+        // the corner farthest along the normal of each plane
+        SimdFloat x = select(a >= zero, maxX, minX);
+        SimdFloat y = select(b >= zero, maxY, minY);
+        SimdFloat z = select(c >= zero, maxZ, minZ);
+        SimdFloat distance = multiplyAdd(a, x, multiplyAdd(b, y, multiplyAdd(c, z, SimdFloat::load(_d + i))));
+        if ((distance < zero).any()) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <QtGui>
+
+#include "simd.h"
+
+// 4x4 matrices and 4 component vectors in SSE registers, for the CPU paths that transform many objects
+// (the placements of the crowd, culling), where QMatrix4x4 spends its time on its flags and scalar loops
+//
+// SimdMatrix4 is column major like QMatrix4x4 and OpenGL: converting from a QMatrix4x4 loads its 4 columns,
+// converting back stores them (the result has no type flags, so Qt takes its general paths with it)
+// the batch functions map arrays of points and matrices; mapPoints() of arrays of coordinates uses the full
+// SimdFloat::Width lanes (8 with AVX2)
+// without SSE2 the registers are arrays of 4 floats
+
+// a vector of 4 floats, a point (w = 1), a direction (w = 0) or a plane
+struct alignas(16) SimdVector4
+{
+#if defined(SIMD_SSE2) || defined(SIMD_AVX2)
+    __m128 v;
+    SimdVector4(__m128 x) : v(x) {}
+    SimdVector4(float x, float y, float z, float w) : v(_mm_setr_ps(x, y, z, w)) {}
+    static SimdVector4 splat(float x) { return _mm_set1_ps(x); }
+    static SimdVector4 load(const float * p) { return _mm_loadu_ps(p); }
+    void store(float * p) const { _mm_storeu_ps(p, v); }
+    // the lane I in every lane
+    template <int I> SimdVector4 broadcast() const { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(I, I, I, I)); }
+    float x() const { return _mm_cvtss_f32(v); }
+#else
+    float v[4];
+    SimdVector4(float x, float y, float z, float w) : v{ x, y, z, w } {}
+    static SimdVector4 splat(float x) { return SimdVector4(x, x, x, x); }
+    static SimdVector4 load(const float * p) { return SimdVector4(p[0], p[1], p[2], p[3]); }
+    void store(float * p) const { p[0] = v[0]; p[1] = v[1]; p[2] = v[2]; p[3] = v[3]; }
+    template <int I> SimdVector4 broadcast() const { return splat(v[I]); }
+    float x() const { return v[0]; }
+#endif
+    SimdVector4() {}
+    explicit SimdVector4(const QVector3D & p, float w = 1) : SimdVector4(p.x(), p.y(), p.z(), w) {}
+    explicit SimdVector4(const QVector4D & p) : SimdVector4(p.x(), p.y(), p.z(), p.w()) {}
+
+    float y() const { return broadcast<1>().x(); }
+    float z() const { return broadcast<2>().x(); }
+    float w() const { return broadcast<3>().x(); }
+    QVector3D toVector3D() const { alignas(16) float f[4]; store(f); return QVector3D(f[0], f[1], f[2]); }
+    QVector4D toVector4D() const { alignas(16) float f[4]; store(f); return QVector4D(f[0], f[1], f[2], f[3]); }
+};
+
+#if defined(SIMD_SSE2) || defined(SIMD_AVX2)
+inline SimdVector4 operator+(SimdVector4 a, SimdVector4 b) { return _mm_add_ps(a.v, b.v); }
+inline SimdVector4 operator-(SimdVector4 a, SimdVector4 b) { return _mm_sub_ps(a.v, b.v); }
+inline SimdVector4 operator*(SimdVector4 a, SimdVector4 b) { return _mm_mul_ps(a.v, b.v); }
+inline SimdVector4 minimum(SimdVector4 a, SimdVector4 b) { return _mm_min_ps(a.v, b.v); }
+inline SimdVector4 maximum(SimdVector4 a, SimdVector4 b) { return _mm_max_ps(a.v, b.v); }
+inline SimdVector4 absolute(SimdVector4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+// a * b + c
+inline SimdVector4 multiplyAdd(SimdVector4 a, SimdVector4 b, SimdVector4 c)
+{
+#if defined(__FMA__)
+    return _mm_fmadd_ps(a.v, b.v, c.v);
+#else
+    return _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v);
+#endif
+}
+// the sum of the lanes, in every lane
+inline SimdVector4 horizontalSum(SimdVector4 a)
+{
+    __m128 s = _mm_add_ps(a.v, _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+#else
+inline SimdVector4 operator+(SimdVector4 a, SimdVector4 b)
+{
+    return SimdVector4(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]);
+}
+inline SimdVector4 operator-(SimdVector4 a, SimdVector4 b)
+{
+    return SimdVector4(a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]);
+}
+inline SimdVector4 operator*(SimdVector4 a, SimdVector4 b)
+{
+    return SimdVector4(a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]);
+}
+inline SimdVector4 minimum(SimdVector4 a, SimdVector4 b)
+{
+    return SimdVector4(qMin(a.v[0], b.v[0]), qMin(a.v[1], b.v[1]), qMin(a.v[2], b.v[2]), qMin(a.v[3], b.v[3]));
+}
+inline SimdVector4 maximum(SimdVector4 a, SimdVector4 b)
+{
+    return SimdVector4(qMax(a.v[0], b.v[0]), qMax(a.v[1], b.v[1]), qMax(a.v[2], b.v[2]), qMax(a.v[3], b.v[3]));
+}
+inline SimdVector4 absolute(SimdVector4 a)
+{
+    return SimdVector4(std::fabs(a.v[0]), std::fabs(a.v[1]), std::fabs(a.v[2]), std::fabs(a.v[3]));
+}
+inline SimdVector4 multiplyAdd(SimdVector4 a, SimdVector4 b, SimdVector4 c) { return a * b + c; }
+inline SimdVector4 horizontalSum(SimdVector4 a) { return SimdVector4::splat(a.v[0] + a.v[1] + a.v[2] + a.v[3]); }
+#endif
+inline SimdVector4 operator*(SimdVector4 a, float s) { return a * SimdVector4::splat(s); }
+inline float dot(SimdVector4 a, SimdVector4 b) { return horizontalSum(a * b).x(); }
+
+// a 4x4 matrix as its 4 columns, mapping column vectors like QMatrix4x4
+struct alignas(16) SimdMatrix4
+{
+    SimdVector4 columns[4];
+
+    // not initialized
+    SimdMatrix4() {}
+    SimdMatrix4(SimdVector4 c0, SimdVector4 c1, SimdVector4 c2, SimdVector4 c3) : columns{ c0, c1, c2, c3 } {}
+    explicit SimdMatrix4(const QMatrix4x4 & m)
+    {
+        const float * data = m.constData();
+        for (int c = 0; c < 4; c++) {
+            columns[c] = SimdVector4::load(data + 4 * c);
+        }
+    }
+    QMatrix4x4 toQMatrix4x4() const
+    {
+        QMatrix4x4 m;
+        float * data = m.data();
+        for (int c = 0; c < 4; c++) {
+            columns[c].store(data + 4 * c);
+        }
+        return m;
+    }
+
+    static SimdMatrix4 identity()
+    {
+        return SimdMatrix4(SimdVector4(1, 0, 0, 0), SimdVector4(0, 1, 0, 0), SimdVector4(0, 0, 1, 0),
+            SimdVector4(0, 0, 0, 1));
+    }
+    static SimdMatrix4 translation(const QVector3D & t);
+    static SimdMatrix4 scaling(const QVector3D & s);
+    // a rotation of 'angle' degrees around 'axis', like QMatrix4x4::rotate()
+    static SimdMatrix4 rotation(float angle, const QVector3D & axis);
+
+    SimdMatrix4 transposed() const;
+
+    // the matrix times a column vector
+    SimdVector4 map(SimdVector4 p) const
+    {
+        SimdVector4 r = columns[0] * p.broadcast<0>();
+        r = multiplyAdd(columns[1], p.broadcast<1>(), r);
+        r = multiplyAdd(columns[2], p.broadcast<2>(), r);
+        return multiplyAdd(columns[3], p.broadcast<3>(), r);
+    }
+    // the box around the 8 corners of a box mapped by an affine matrix
+    void mapBox(const QVector3D & boundsMin, const QVector3D & boundsMax, QVector3D * outMin, QVector3D * outMax) const;
+
+    // batches: out[i] = a * b[i], the maps of count points (out may be 'b' or 'points')
+    static void multiply(const SimdMatrix4 & a, const SimdMatrix4 * b, SimdMatrix4 * out, int count);
+    static void mapPoints(const SimdMatrix4 & m, const QVector3D * points, QVector4D * out, int count);
+    // the same for arrays of coordinates, the w of the points being 1
+    static void mapPoints(const SimdMatrix4 & m, const float * x, const float * y, const float * z,
+        float * outX, float * outY, float * outZ, float * outW, int count);
+};
+
+inline SimdMatrix4 operator*(const SimdMatrix4 & a, const SimdMatrix4 & b)
+{
+    return SimdMatrix4(a.map(b.columns[0]), a.map(b.columns[1]), a.map(b.columns[2]), a.map(b.columns[3]));
+}
+
+inline SimdVector4 operator*(const SimdMatrix4 & m, SimdVector4 p)
+{
+    return m.map(p);
+}
+
+// the 6 planes of the view volume of a view-projection matrix (OpenGL clip space), facing inwards
+// they are stored as arrays of their coefficients, so that a box is tested against SimdFloat::Width
+// planes at a time
+class SimdFrustum
+{
+public:
+    enum { Left, Right, Bottom, Top, Near, Far, PlaneCount };
+
+    explicit SimdFrustum(const SimdMatrix4 & viewProjection);
+
+    // the plane (a, b, c, d) of the points where ax + by + cz + d = 0, with a unit normal
+    SimdVector4 plane(int i) const { return SimdVector4(_a[i], _b[i], _c[i], _d[i]); }
+
+    // whether a part of a box (in world space) may be in the view volume: false if it is entirely
+    // behind one of the planes (some boxes near the corners pass while being outside)
+    bool intersectsBox(const QVector3D & boundsMin, const QVector3D & boundsMax) const;
+
+private:
+    // PlaneCount planes padded to a multiple of the widest SimdFloat with planes containing everything
+    enum { PaddedCount = 8 };
+    alignas(32) float _a[PaddedCount], _b[PaddedCount], _c[PaddedCount], _d[PaddedCount];
+};
@@ -0,0 +1,60 @@
+#include <cfloat>
+
+#include "profiler.h"
+
+#include "smfmesh.h"
+
+SmfMesh SmfMesh::load(const QString & f)
+{
+    PROFILE_SCOPE("SmfMesh::load");
+    SmfMesh mesh;
+    QFile file(f);
+    if(file.open(QFile::ReadOnly))
+    {
+        QTextStream ts(&file);
+        ts.readLine();
+        QString token;
+        while(true)
+        {
+            ts >> token;
+            if(token == "v")
+            {
+                double x, y, z;
+                ts >> x >> y >> z;
+                mesh.positions << QVector3D(x, y, z);
+                mesh.normals << QVector3D(0, 0, 0);
+            }else if (token == "f")
+            {
+                int a, b, c;
+                ts >> a >> b >> c;
+                mesh.indices << (a-1) << (b-1) << (c-1);
+                QVector3D normal = QVector3D::crossProduct(
+                    mesh.positions[a-1] - mesh.positions[b-1], 
+                    mesh.positions[c-1] - mesh.positions[b-1]).normalized();
+                mesh.normals[a-1] += normal;
+                mesh.normals[b-1] += normal;
+                mesh.normals[c-1] += normal;
+            }else
+            {
+                break;
+            }
+        }
+        for(auto & n : mesh.normals)
+        {
+            n = -n.normalized();
+        }
+    }
+    return mesh;
+}
+
+void SmfMesh::bounds(QVector3D * minCorner, QVector3D * maxCorner) const
+{
+    *minCorner = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+    *maxCorner = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (const QVector3D & p : positions) {
+        for (int k = 0; k < 3; k++) {
+            (*minCorner)[k] = qMin((*minCorner)[k], p[k]);
+            (*maxCorner)[k] = qMax((*maxCorner)[k], p[k]);
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QtGui>
+
+// a triangle mesh read from a .smf file ("v x y z" and 1-based "f a b c" lines)
+// with per-vertex normals averaged from the faces around each vertex
+struct SmfMesh
+{
+    QVector<QVector3D> positions;
+    QVector<QVector3D> normals;
+    QVector<quint32> indices; // triangle list
+
+    // an empty mesh if the file cannot be read
+    static SmfMesh load(const QString & file);
+
+    // the corners of the box around the positions
+    void bounds(QVector3D * minCorner, QVector3D * maxCorner) const;
+};
@@ -0,0 +1,220 @@
+#include <cfloat>
+#include <cstring>
+
+#include "simd.h"
+
+#include "soamesh.h"
+
+static int paddedCount(int size)
+{
+    return (size + SoaMesh::Padding - 1) / SoaMesh::Padding * SoaMesh::Padding;
+}
+
+static float horizontalMinimum(SimdFloat v)
+{
+    alignas(32) float f[SimdFloat::Width];
+    v.store(f);
+    float m = f[0];
+    for (int i = 1; i < SimdFloat::Width; i++) {
+        m = qMin(m, f[i]);
+    }
+    return m;
+}
+
+static float horizontalMaximum(SimdFloat v)
+{
+    alignas(32) float f[SimdFloat::Width];
+    v.store(f);
+    float m = f[0];
+    for (int i = 1; i < SimdFloat::Width; i++) {
+        m = qMax(m, f[i]);
+    }
+    return m;
+}
+
+// scale the vectors of 3 arrays to the length 'length', the zero ones stay zero
+static void normalizeArrays(float * x, float * y, float * z, int count, float length)
+{
+    for (int i = 0; i < count; i += SimdFloat::Width) {
+        SimdFloat vx = SimdFloat::load(x + i), vy = SimdFloat::load(y + i), vz = SimdFloat::load(z + i);
+        SimdFloat squared = multiplyAdd(vx, vx, multiplyAdd(vy, vy, vz * vz));
+        SimdFloat scale = select(squared > SimdFloat(0.0f), SimdFloat(length) / squareRoot(squared), SimdFloat(0.0f));
+        (vx * scale).store(x + i);
+        (vy * scale).store(y + i);
+        (vz * scale).store(z + i);
+    }
+}
+
+SoaMesh::SoaMesh()
+    : _size(0), _paddedSize(0), _data(nullptr)
+{
+}
+
+SoaMesh::SoaMesh(const SoaMesh & other)
+    : _size(0), _paddedSize(0), _data(nullptr)
+{
+    *this = other;
+}
+
+SoaMesh & SoaMesh::operator=(const SoaMesh & other)
+{
+    if (this != &other) {
+        resize(other._size);
+        if (_data) {
+            memcpy(_data, other._data, bytes());
+        }
+    }
+    return *this;
+}
+
+SoaMesh::~SoaMesh()
+{
+    qFreeAligned(_data);
+}
+
+void SoaMesh::assign(const QVector<QVector3D> & positions, const QVector<QVector3D> & normals)
+{
+    Q_ASSERT(positions.size() == normals.size());
+    resize(positions.size());
+    for (int i = 0; i < _size; i++) {
+        setVertex(i, positions[i], normals[i]);
+    }
+    pad();
+}
+
+void SoaMesh::resize(int size)
+{
+    int paddedSize = paddedCount(size);
+    if (paddedSize != _paddedSize) {
+        float * data = nullptr;
+        if (paddedSize > 0) {
+            data = static_cast<float *>(qMallocAligned(size_t(paddedSize) * 6 * sizeof(float), Alignment));
+            memset(data, 0, size_t(paddedSize) * 6 * sizeof(float));
+            // the arrays move to their new offsets
+            int kept = qMin(size, _size);
+            for (int a = 0; a < 6 && kept > 0; a++) {
+                memcpy(data + a * paddedSize, _data + a * _paddedSize, kept * sizeof(float));
+            }
+        }
+        qFreeAligned(_data);
+        _data = data;
+        _paddedSize = paddedSize;
+    } else {
+        for (int a = 0; a < 6 && size > _size; a++) {
+            memset(_data + a * _paddedSize + _size, 0, (size - _size) * sizeof(float));
+        }
+    }
+    _size = size;
+    pad();
+}
+
+void SoaMesh::setVertex(int i, const QVector3D & position, const QVector3D & normal)
+{
+    x()[i] = position.x();
+    y()[i] = position.y();
+    z()[i] = position.z();
+    nx()[i] = normal.x();
+    ny()[i] = normal.y();
+    nz()[i] = normal.z();
+}
+
+void SoaMesh::pad()
+{
+    for (int a = 0; a < 6 && _size > 0; a++) {
+        float * array = _data + a * _paddedSize;
+        for (int i = _size; i < _paddedSize; i++) {
+            array[i] = array[0];
+        }
+    }
+}
+
+void SoaMesh::bounds(QVector3D * minCorner, QVector3D * maxCorner) const
+{
+    SimdFloat minX(FLT_MAX), minY(FLT_MAX), minZ(FLT_MAX);
+    SimdFloat maxX(-FLT_MAX), maxY(-FLT_MAX), maxZ(-FLT_MAX);
+    for (int i = 0; i < _paddedSize; i += SimdFloat::Width) {
+        SimdFloat px = SimdFloat::load(x() + i), py = SimdFloat::load(y() + i), pz = SimdFloat::load(z() + i);
+        minX = minimum(minX, px);
+        minY = minimum(minY, py);
+        minZ = minimum(minZ, pz);
+        maxX = maximum(maxX, px);
+        maxY = maximum(maxY, py);
+        maxZ = maximum(maxZ, pz);
+    }
+    *minCorner = QVector3D(horizontalMinimum(minX), horizontalMinimum(minY), horizontalMinimum(minZ));
+    *maxCorner = QVector3D(horizontalMaximum(maxX), horizontalMaximum(maxY), horizontalMaximum(maxZ));
+}
+
+void SoaMesh::transform(const QMatrix4x4 & matrix, SoaMesh * out) const
+{
+    if (out != this) {
+        out->resize(_size);
+    }
+    // the bottom row of an affine matrix is (0, 0, 0, 1)
+    SimdFloat m[3][4];
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 4; c++) {
+            m[r][c] = matrix(r, c);
+        }
+    }
+    QMatrix3x3 normalMatrix = matrix.normalMatrix();
+    SimdFloat n[3][3];
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            n[r][c] = normalMatrix(r, c);
+        }
+    }
+
+    for (int i = 0; i < _paddedSize; i += SimdFloat::Width) {
+        SimdFloat px = SimdFloat::load(x() + i), py = SimdFloat::load(y() + i), pz = SimdFloat::load(z() + i);
+        SimdFloat qx = SimdFloat::load(nx() + i), qy = SimdFloat::load(ny() + i), qz = SimdFloat::load(nz() + i);
+        multiplyAdd(m[0][0], px, multiplyAdd(m[0][1], py, multiplyAdd(m[0][2], pz, m[0][3]))).store(out->x() + i);
+        multiplyAdd(m[1][0], px, multiplyAdd(m[1][1], py, multiplyAdd(m[1][2], pz, m[1][3]))).store(out->y() + i);
+        multiplyAdd(m[2][0], px, multiplyAdd(m[2][1], py, multiplyAdd(m[2][2], pz, m[2][3]))).store(out->z() + i);
+        multiplyAdd(n[0][0], qx, multiplyAdd(n[0][1], qy, n[0][2] * qz)).store(out->nx() + i);
+        multiplyAdd(n[1][0], qx, multiplyAdd(n[1][1], qy, n[1][2] * qz)).store(out->ny() + i);
+        multiplyAdd(n[2][0], qx, multiplyAdd(n[2][1], qy, n[2][2] * qz)).store(out->nz() + i);
+    }
+    out->normalizeNormals();
+}
+
+void SoaMesh::normalizeNormals()
+{
+    normalizeArrays(nx(), ny(), nz(), _paddedSize, 1.0f);
+}
+
+void SoaMesh::computeNormals(const QVector<quint32> & indices)
+{
+    if (isEmpty()) {
+        return;
+    }
+    memset(nx(), 0, size_t(_paddedSize) * 3 * sizeof(float));
+    // the scattered sums stay scalar
+    for (int t = 0; t + 2 < indices.size(); t += 3) {
+        quint32 a = indices[t], b = indices[t + 1], c = indices[t + 2];
+        QVector3D normal = QVector3D::crossProduct(position(a) - position(b), position(c) - position(b)).normalized();
+        for (quint32 v : { a, b, c }) {
+            nx()[v] += normal.x();
+            ny()[v] += normal.y();
+            nz()[v] += normal.z();
+        }
+    }
+    pad();
+    // negated, like SmfMesh::load()
+    normalizeArrays(nx(), ny(), nz(), _paddedSize, -1.0f);
+}
+
+QVector<float> SoaMesh::interleave() const
+{
+    QVector<float> vertices(_size * 6);
+    float * v = vertices.data();
+    for (int i = 0; i < _size; i++, v += 6) {
+        v[0] = x()[i];
+        v[1] = y()[i];
+        v[2] = z()[i];
+        v[3] = nx()[i];
+        v[4] = ny()[i];
+        v[5] = nz()[i];
+    }
+    return vertices;
+}
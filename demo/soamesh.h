@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QtGui>
+
+// the positions and normals of a mesh as a structure of arrays: x, y, z, nx, ny and nz each in their own
+// array, so the CPU passes over the vertices (bounds, transforms, normalization) load SimdFloat::Width
+// vertices per instruction instead of gathering the components of each vertex
+//
+// the arrays are aligned to 32 bytes and padded to a multiple of Padding vertices with copies of the first
+// vertex, so the kernels run over whole registers without a scalar tail and the padding changes no bounds;
+// call pad() after writing the arrays directly
+class SoaMesh
+{
+public:
+    // the widest SimdFloat
+    enum { Padding = 8, Alignment = 32 };
+
+    SoaMesh();
+    SoaMesh(const SoaMesh & other);
+    SoaMesh & operator=(const SoaMesh & other);
+    ~SoaMesh();
+
+    // copy the vertices of arrays of positions and normals (the same size)
+    void assign(const QVector<QVector3D> & positions, const QVector<QVector3D> & normals);
+    // the vertices past the new size are lost, the new ones are zero
+    void resize(int size);
+
+    int size() const { return _size; }
+    bool isEmpty() const { return _size == 0; }
+    int paddedSize() const { return _paddedSize; }
+    // the bytes of the arrays
+    qint64 bytes() const { return qint64(_paddedSize) * 6 * sizeof(float); }
+
+    float * x() { return _data; }
+    float * y() { return _data + _paddedSize; }
+    float * z() { return _data + 2 * _paddedSize; }
+    float * nx() { return _data + 3 * _paddedSize; }
+    float * ny() { return _data + 4 * _paddedSize; }
+    float * nz() { return _data + 5 * _paddedSize; }
+    const float * x() const { return _data; }
+    const float * y() const { return _data + _paddedSize; }
+    const float * z() const { return _data + 2 * _paddedSize; }
+    const float * nx() const { return _data + 3 * _paddedSize; }
+    const float * ny() const { return _data + 4 * _paddedSize; }
+    const float * nz() const { return _data + 5 * _paddedSize; }
+
+    QVector3D position(int i) const { return QVector3D(x()[i], y()[i], z()[i]); }
+    QVector3D normal(int i) const { return QVector3D(nx()[i], ny()[i], nz()[i]); }
+    void setVertex(int i, const QVector3D & position, const QVector3D & normal);
+
+    // copy the first vertex into the padding
+    void pad();
+
+    // the corners of the box around the positions (FLT_MAX and -FLT_MAX when empty)
+    void bounds(QVector3D * minCorner, QVector3D * maxCorner) const;
+    // the positions mapped by an affine matrix and the normals by its normal matrix, renormalized, into 'out'
+    // (which may be this mesh)
+    void transform(const QMatrix4x4 & matrix, SoaMesh * out) const;
+    // scale the normals to unit length, the zero ones stay zero
+    void normalizeNormals();
+    // the normals averaged from the faces around each vertex of a triangle list, oriented like SmfMesh
+    void computeNormals(const QVector<quint32> & indices);
+
+    // the vertices as x y z nx ny nz floats one after the other, for a vertex buffer
+    QVector<float> interleave() const;
+
+private:
+    int _size, _paddedSize;
+    float * _data;
+};
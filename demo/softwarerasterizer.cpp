@@ -0,0 +1,371 @@
+#include <cmath>
+
+#include "profiler.h"
+#include "simd.h"
+
+#include "softwarerasterizer.h"
+
+// vertices transformed per job of pass 1
+static const int verticesPerJob = 4096;
+// triangles set up per job of pass 2 (at least), more chunks balance better but take more bins to merge
+static const int minTrianglesPerChunk = 2048;
+
+SoftwareRasterizer::SoftwareRasterizer(int threadCount)
+    : _pool(threadCount)
+{
+    _stride = 0;
+    _tilesX = 0;
+    _tilesY = 0;
+    _threadPixels.resize(_pool.threadCount());
+    _stealsAtReset = 0;
+}
+
+SoftwareRasterizer::~SoftwareRasterizer()
+{}
+
+void SoftwareRasterizer::setViewportSize(const QSize & size)
+{
+    if (size == _size) {
+        return;
+    }
+    _size = size;
+    _stride = (size.width() + SimdFloat::Width - 1) / SimdFloat::Width * SimdFloat::Width;
+    _tilesX = (size.width() + TileSize - 1) / TileSize;
+    _tilesY = (size.height() + TileSize - 1) / TileSize;
+    _colorBuffer.resize(_stride * size.height());
+    _depthBuffer.resize(_stride * size.height());
+    for (Chunk & chunk : _chunks) {
+        chunk.bins.resize(_tilesX * _tilesY);
+    }
+}
+
+void SoftwareRasterizer::clear(const QColor & color)
+{
+    _colorBuffer.fill(color.rgb());
+    _depthBuffer.fill(1.0f);
+}
+
+void SoftwareRasterizer::draw(const SoftwareMesh & mesh)
+{
+    PROFILE_SCOPE("SoftwareRasterizer::draw");
+    QElapsedTimer timer;
+    timer.start();
+
+    // pass 1: vertex transform
+    _modelViewProjection = mesh.projectionMatrix * mesh.viewMatrix * mesh.modelMatrix;
+    int vertexCount = mesh.positions.size();
+    _vertices.resize(vertexCount);
+    _pool.parallelFor((vertexCount + verticesPerJob - 1) / verticesPerJob, [&](int job, int) {
+        transformVertices(mesh, job * verticesPerJob, qMin(vertexCount, (job + 1) * verticesPerJob));
+    });
+
+    // pass 2: clipping, setup and binning
+    int triangleCount = mesh.indices.size() / 3;
+    int chunkCount = qBound(1, triangleCount / minTrianglesPerChunk, 4 * _pool.threadCount());
+    if (_chunks.size() != chunkCount) {
+        _chunks.resize(chunkCount);
+        for (Chunk & chunk : _chunks) {
+            chunk.bins.resize(_tilesX * _tilesY);
+        }
+    }
+    const quint32 * indices = mesh.indices.constData();
+    _pool.parallelFor(chunkCount, [&](int c, int) {
+        int first = int(qint64(triangleCount) * c / chunkCount);
+        int last = int(qint64(triangleCount) * (c + 1) / chunkCount);
+        setupTriangles(indices, first, last, _chunks[c]);
+    });
+
+    // pass 3: rasterization of the tiles
+    for (ThreadCounter & counter : _threadPixels) {
+        counter.pixels = 0;
+    }
+    _pool.parallelFor(_tilesX * _tilesY, [this](int tile, int thread) {
+        rasterizeTile(tile, thread);
+    });
+
+    for (const Chunk & chunk : _chunks) {
+        _stats.triangles += chunk.triangleCount;
+    }
+    for (const ThreadCounter & counter : _threadPixels) {
+        _stats.pixels += counter.pixels;
+    }
+    _stats.drawNanoseconds += timer.nsecsElapsed();
+    _stats.steals = _pool.stealCount() - _stealsAtReset;
+}
+
+QImage SoftwareRasterizer::image() const
+{
+    return QImage(reinterpret_cast<const uchar *>(_colorBuffer.constData()), _size.width(), _size.height(),
+        _stride * sizeof(quint32), QImage::Format_RGB32).copy();
+}
+
+void SoftwareRasterizer::resetStats()
+{
+    _stats = Stats();
+    _stealsAtReset = _pool.stealCount();
+}
+
+void SoftwareRasterizer::transformVertices(const SoftwareMesh & mesh, int begin, int end)
+{
+    // column major, m[column * 4 + row]
+    const float * m = _modelViewProjection.constData();
+    const QVector3D * positions = mesh.positions.constData();
+    bool hasColors = mesh.colors.size() == mesh.positions.size();
+
+    for (int i = begin; i < end; i += SimdFloat::Width) {
+        int n = qMin<int>(SimdFloat::Width, end - i);
+        // gather SimdFloat::Width positions into lanes
+        alignas(32) float px[SimdFloat::Width] = {}, py[SimdFloat::Width] = {}, pz[SimdFloat::Width] = {};
+        for (int k = 0; k < n; k++) {
+            px[k] = positions[i + k].x();
+            py[k] = positions[i + k].y();
+            pz[k] = positions[i + k].z();
+        }
+        SimdFloat x = SimdFloat::load(px), y = SimdFloat::load(py), z = SimdFloat::load(pz);
+
+        alignas(32) float clip[4][SimdFloat::Width];
+        for (int row = 0; row < 4; row++) {
+            SimdFloat c = multiplyAdd(m[row], x, multiplyAdd(m[4 + row], y, multiplyAdd(m[8 + row], z, m[12 + row])));
+            c.store(clip[row]);
+        }
+
+        for (int k = 0; k < n; k++) {
+            ClipVertex & v = _vertices[i + k];
+            v.x = clip[0][k];
+            v.y = clip[1][k];
+            v.z = clip[2][k];
+            v.w = clip[3][k];
+            QVector3D color = hasColors ? mesh.colors[i + k] : QVector3D(1, 1, 1);
+            v.r = color.x();
+            v.g = color.y();
+            v.b = color.z();
+        }
+    }
+}
+
+void SoftwareRasterizer::setupTriangles(const quint32 * indices, int firstTriangle, int lastTriangle,
+    Chunk & chunk)
+{
+    // resize(0) keeps the capacity of the previous frames
+    chunk.triangles.resize(0);
+    for (QVector<int> & bin : chunk.bins) {
+        bin.resize(0);
+    }
+    chunk.triangleCount = 0;
+
+    for (int t = firstTriangle; t < lastTriangle; t++) {
+        const ClipVertex * v[3] = {
+            &_vertices[indices[3 * t]], &_vertices[indices[3 * t + 1]], &_vertices[indices[3 * t + 2]]
+        };
+
+        // invisible if all the vertices are outside of one clip plane
+        int outside[6] = {};
+        for (int i = 0; i < 3; i++) {
+            outside[0] += v[i]->x > v[i]->w;
+            outside[1] += v[i]->x < -v[i]->w;
+            outside[2] += v[i]->y > v[i]->w;
+            outside[3] += v[i]->y < -v[i]->w;
+            outside[4] += v[i]->z > v[i]->w;
+            outside[5] += v[i]->z < -v[i]->w;
+        }
+        if (outside[0] == 3 || outside[1] == 3 || outside[2] == 3 || outside[3] == 3 ||
+            outside[4] == 3 || outside[5] == 3) {
+            continue;
+        }
+        if (outside[5] == 0) {
+            setupTriangle(*v[0], *v[1], *v[2], chunk);
+            continue;
+        }
+
+        // clip the polygon against the near plane (z >= -w), the other planes are handled by the bounds
+        // of the setup and the depth test
+        ClipVertex polygon[4];
+        int n = 0;
+        for (int i = 0; i < 3; i++) {
+            const ClipVertex & a = *v[i];
+            const ClipVertex & b = *v[(i + 1) % 3];
+            float da = a.z + a.w, db = b.z + b.w;
+            if (da >= 0) {
+                polygon[n++] = a;
+            }
+            if ((da >= 0) != (db >= 0)) {
+                float s = da / (da - db);
+                ClipVertex & c = polygon[n++];
+                c.x = a.x + s * (b.x - a.x);
+                c.y = a.y + s * (b.y - a.y);
+                c.z = a.z + s * (b.z - a.z);
+                c.w = a.w + s * (b.w - a.w);
+                c.r = a.r + s * (b.r - a.r);
+                c.g = a.g + s * (b.g - a.g);
+                c.b = a.b + s * (b.b - a.b);
+            }
+        }
+        for (int i = 1; i + 1 < n; i++) {
+            setupTriangle(polygon[0], polygon[i], polygon[i + 1], chunk);
+        }
+    }
+}
+
+void SoftwareRasterizer::setupTriangle(const ClipVertex & v0, const ClipVertex & v1, const ClipVertex & v2,
+    Chunk & chunk)
+{
+    const ClipVertex * v[3] = { &v0, &v1, &v2 };
+    float sx[3], sy[3], sz[3], iw[3];
+    for (int i = 0; i < 3; i++) {
+        if (v[i]->w <= 0) {
+            return;
+        }
+        // window coordinates with y down, snapped to 1/16 pixel like the subpixel precision of GPUs
+        iw[i] = 1.0f / v[i]->w;
+        sx[i] = std::round((v[i]->x * iw[i] * 0.5f + 0.5f) * _size.width() * 16.0f) / 16.0f;
+        sy[i] = std::round((0.5f - v[i]->y * iw[i] * 0.5f) * _size.height() * 16.0f) / 16.0f;
+        sz[i] = v[i]->z * iw[i];
+    }
+
+    float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+    if (!(area != 0) || std::isnan(area)) {
+        return;
+    }
+    if (area < 0) {
+        // both windings are drawn, make the edge functions positive inside
+        std::swap(v[1], v[2]);
+        std::swap(sx[1], sx[2]);
+        std::swap(sy[1], sy[2]);
+        std::swap(sz[1], sz[2]);
+        std::swap(iw[1], iw[2]);
+        area = -area;
+    }
+
+    // the pixels whose center is within the bounds of the triangle
+    Triangle t;
+    t.x0 = qMax(0, int(std::ceil(qMin(sx[0], qMin(sx[1], sx[2])) - 0.5f)));
+    t.x1 = qMin(_size.width() - 1, int(std::floor(qMax(sx[0], qMax(sx[1], sx[2])) - 0.5f)));
+    t.y0 = qMax(0, int(std::ceil(qMin(sy[0], qMin(sy[1], sy[2])) - 0.5f)));
+    t.y1 = qMin(_size.height() - 1, int(std::floor(qMax(sy[0], qMax(sy[1], sy[2])) - 0.5f)));
+    if (t.x0 > t.x1 || t.y0 > t.y1) {
+        return;
+    }
+
+    // edge i is opposite to vertex i, its function is the barycentric coordinate of vertex i
+    float inverseArea = 1.0f / area;
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        float a = sy[j] - sy[k];
+        float b = sx[k] - sx[j];
+        float c = -(a * sx[j] + b * sy[j]);
+        // a shared edge has opposite coefficients in its two triangles, so exactly one of them owns it
+        t.topLeft[i] = a > 0 || (a == 0 && b > 0);
+        // evaluated at pixel centers
+        t.edges[i].a = a * inverseArea;
+        t.edges[i].b = b * inverseArea;
+        t.edges[i].c = (c + 0.5f * a + 0.5f * b) * inverseArea;
+    }
+
+    // attributes are interpolated with the barycentric coordinates
+    auto plane = [&t](float v0, float v1, float v2) {
+        Plane p;
+        p.a = t.edges[0].a * v0 + t.edges[1].a * v1 + t.edges[2].a * v2;
+        p.b = t.edges[0].b * v0 + t.edges[1].b * v1 + t.edges[2].b * v2;
+        p.c = t.edges[0].c * v0 + t.edges[1].c * v1 + t.edges[2].c * v2;
+        return p;
+    };
+    t.depth = plane(sz[0], sz[1], sz[2]);
+    t.inverseW = plane(iw[0], iw[1], iw[2]);
+    t.colors[0] = plane(v[0]->r * iw[0], v[1]->r * iw[1], v[2]->r * iw[2]);
+    t.colors[1] = plane(v[0]->g * iw[0], v[1]->g * iw[1], v[2]->g * iw[2]);
+    t.colors[2] = plane(v[0]->b * iw[0], v[1]->b * iw[1], v[2]->b * iw[2]);
+
+    int index = chunk.triangles.size();
+    chunk.triangles << t;
+    chunk.triangleCount++;
+    for (int ty = t.y0 / TileSize; ty <= t.y1 / TileSize; ty++) {
+        for (int tx = t.x0 / TileSize; tx <= t.x1 / TileSize; tx++) {
+            chunk.bins[ty * _tilesX + tx] << index;
+        }
+    }
+}
+
+void SoftwareRasterizer::rasterizeTile(int tile, int thread)
+{
+    int tx = tile % _tilesX, ty = tile / _tilesX;
+    QRect rect(tx * TileSize, ty * TileSize, TileSize, TileSize);
+    rect &= QRect(QPoint(0, 0), _size);
+
+    // chunks hold consecutive triangles, so the tile is drawn in the order of the indices
+    for (const Chunk & chunk : _chunks) {
+        for (int i : chunk.bins[tile]) {
+            rasterizeTriangle(chunk.triangles[i], rect, thread);
+        }
+    }
+}
+
+void SoftwareRasterizer::rasterizeTriangle(const Triangle & t, const QRect & tile, int thread)
+{
+    // rows are walked SimdFloat::Width pixels at a time from an aligned column,
+    // tiles are a multiple of SimdFloat::Width wide, so the lanes never leave the tile (or the padded row)
+    int x0 = qMax(t.x0, tile.left()) / SimdFloat::Width * SimdFloat::Width;
+    int x1 = qMin(t.x1, tile.right());
+    int y0 = qMax(t.y0, tile.top());
+    int y1 = qMin(t.y1, tile.bottom());
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+
+    const SimdFloat ramp = SimdFloat::ramp();
+    const SimdFloat zero(0.0f), one(1.0f), scale(255.0f), half(0.5f);
+    const SimdMask topLeft[3] = {
+        t.topLeft[0] ? SimdMask::all() : SimdMask::none(),
+        t.topLeft[1] ? SimdMask::all() : SimdMask::none(),
+        t.topLeft[2] ? SimdMask::all() : SimdMask::none()
+    };
+    const SimdInt opaque(int(0xff000000));
+    qint64 pixels = 0;
+
+    for (int y = y0; y <= y1; y++) {
+        float fy = float(y);
+        // the terms of the row
+        SimdFloat e0Row = t.edges[0].b * fy + t.edges[0].c;
+        SimdFloat e1Row = t.edges[1].b * fy + t.edges[1].c;
+        SimdFloat e2Row = t.edges[2].b * fy + t.edges[2].c;
+        SimdFloat zRow = t.depth.b * fy + t.depth.c;
+        SimdFloat wRow = t.inverseW.b * fy + t.inverseW.c;
+        SimdFloat rRow = t.colors[0].b * fy + t.colors[0].c;
+        SimdFloat gRow = t.colors[1].b * fy + t.colors[1].c;
+        SimdFloat bRow = t.colors[2].b * fy + t.colors[2].c;
+        quint32 * colorRow = _colorBuffer.data() + y * _stride;
+        float * depthRow = _depthBuffer.data() + y * _stride;
+
+        for (int x = x0; x <= x1; x += SimdFloat::Width) {
+            SimdFloat fx = SimdFloat(float(x)) + ramp;
+            SimdFloat e0 = multiplyAdd(t.edges[0].a, fx, e0Row);
+            SimdFloat e1 = multiplyAdd(t.edges[1].a, fx, e1Row);
+            SimdFloat e2 = multiplyAdd(t.edges[2].a, fx, e2Row);
+            SimdMask inside = ((e0 > zero) | ((e0 == zero) & topLeft[0])) &
+                ((e1 > zero) | ((e1 == zero) & topLeft[1])) &
+                ((e2 > zero) | ((e2 == zero) & topLeft[2]));
+            if (!inside.any()) {
+                continue;
+            }
+
+            SimdFloat z = multiplyAdd(t.depth.a, fx, zRow);
+            SimdFloat depth = SimdFloat::load(depthRow + x);
+            SimdMask pass = inside & (z < depth);
+            if (!pass.any()) {
+                continue;
+            }
+            select(pass, z, depth).store(depthRow + x);
+
+            // perspective correct colors
+            SimdFloat w = one / multiplyAdd(t.inverseW.a, fx, wRow);
+            SimdFloat r = minimum(maximum(multiplyAdd(t.colors[0].a, fx, rRow) * w, zero), one);
+            SimdFloat g = minimum(maximum(multiplyAdd(t.colors[1].a, fx, gRow) * w, zero), one);
+            SimdFloat b = minimum(maximum(multiplyAdd(t.colors[2].a, fx, bRow) * w, zero), one);
+            SimdInt rgb = opaque | (SimdInt::fromFloat(multiplyAdd(r, scale, half)) << 16) |
+                (SimdInt::fromFloat(multiplyAdd(g, scale, half)) << 8) |
+                SimdInt::fromFloat(multiplyAdd(b, scale, half));
+            select(pass, rgb, SimdInt::load(colorRow + x)).store(colorRow + x);
+            pixels += laneCount(pass);
+        }
+    }
+    _threadPixels[thread].pixels += pixels;
+}
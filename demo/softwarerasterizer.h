@@ -0,0 +1,112 @@
+#pragma once
+
+#include <QtGui>
+
+#include "softwarescene.h"
+#include "workstealingpool.h"
+
+// draws SoftwareMesh triangles on the CPU, for machines without a GPU
+//
+// a draw runs in three parallel passes over the threads of a WorkStealingPool:
+//   1. vertices are transformed to clip space, SimdFloat::Width at a time
+//   2. triangles are clipped against the near plane, set up (snapped to 1/16 pixel, edge and
+//      attribute planes) and binned into the screen tiles their bounds overlap, one bin list per chunk
+//   3. tiles are rasterized independently: edge functions, depth test and perspective correct colors
+//      are evaluated for SimdFloat::Width pixels of a row at once, in the order the triangles were drawn
+//
+// like OpenGL, pixel centers are at half coordinates, shared edges follow a top-left rule and depth
+// passes with GL_LESS; triangles are not culled and colors are opaque
+class SoftwareRasterizer
+{
+public:
+    explicit SoftwareRasterizer(int threadCount = QThread::idealThreadCount());
+    ~SoftwareRasterizer();
+
+    // resize the color and depth buffers
+    void setViewportSize(const QSize & size);
+    QSize viewportSize() const { return _size; }
+
+    // fill the color buffer and reset the depth buffer to the far plane
+    void clear(const QColor & color);
+    // draw the triangles of a mesh with its camera
+    void draw(const SoftwareMesh & mesh);
+    // the color buffer
+    QImage image() const;
+
+    int threadCount() const { return _pool.threadCount(); }
+
+    // totals since the last resetStats()
+    struct Stats
+    {
+        qint64 triangles = 0; // triangles set up (after clipping, excluding degenerate and offscreen ones)
+        qint64 pixels = 0;    // pixels written (passed the depth test)
+        qint64 drawNanoseconds = 0;
+        qint64 steals = 0;    // work stealing between the threads
+
+        double trianglesPerSecond() const { return drawNanoseconds > 0 ? triangles * 1e9 / drawNanoseconds : 0.0; }
+        double pixelsPerSecond() const { return drawNanoseconds > 0 ? pixels * 1e9 / drawNanoseconds : 0.0; }
+    };
+    Stats stats() const { return _stats; }
+    void resetStats();
+
+    enum { TileSize = 64 };
+
+private:
+    // a vertex in clip space with its color
+    struct ClipVertex
+    {
+        float x, y, z, w;
+        float r, g, b;
+    };
+    // a triangle ready to rasterize: value(x, y) = a * x + b * y + c at the center of pixel (x, y)
+    struct Plane
+    {
+        float a, b, c;
+    };
+    struct Triangle
+    {
+        Plane edges[3];     // barycentric coordinates, >= 0 inside
+        bool topLeft[3];    // whether a pixel center on the edge belongs to the triangle
+        Plane depth;        // z / w
+        Plane inverseW;     // 1 / w
+        Plane colors[3];    // r / w, g / w, b / w
+        int x0, y0, x1, y1; // bounds in pixels, inclusive
+    };
+    // the triangles set up by one job of pass 2, and their indices binned by tile
+    struct Chunk
+    {
+        QVector<Triangle> triangles;
+        QVector<QVector<int>> bins;
+        qint64 triangleCount;
+    };
+
+    void transformVertices(const SoftwareMesh & mesh, int begin, int end);
+    void setupTriangles(const quint32 * indices, int firstTriangle, int lastTriangle, Chunk & chunk);
+    void setupTriangle(const ClipVertex & v0, const ClipVertex & v1, const ClipVertex & v2, Chunk & chunk);
+    void rasterizeTile(int tile, int thread);
+    void rasterizeTriangle(const Triangle & t, const QRect & tile, int thread);
+
+private:
+    WorkStealingPool _pool;
+
+    QSize _size;
+    int _stride; // floats or pixels per row, a multiple of SimdFloat::Width
+    int _tilesX, _tilesY;
+    QVector<quint32> _colorBuffer; // 0xffRRGGBB
+    QVector<float> _depthBuffer;   // z / w of the nearest triangle, 1 is the far plane
+
+    // per draw
+    QVector<ClipVertex> _vertices;
+    QMatrix4x4 _modelViewProjection;
+    QVector<Chunk> _chunks;
+
+    // pixels written per thread, padded to separate cache lines
+    struct alignas(64) ThreadCounter
+    {
+        qint64 pixels;
+    };
+    QVector<ThreadCounter> _threadPixels;
+
+    Stats _stats;
+    qint64 _stealsAtReset;
+};
@@ -0,0 +1,260 @@
+#include <cmath>
+#include <limits>
+
+#include "profiler.h"
+
+#include "softwareraytracer.h"
+
+static const float infinity = std::numeric_limits<float>::infinity();
+
+// the light of MeshShader::LambertLighting, coming from the side of the camera (world space)
+static const QVector3D worldLightDirection = QVector3D(0.5f, -0.5f, -1.0f).normalized();
+// brightness left by a shadow, and by an occluded ambient occlusion ray
+static const float shadowFactor = 0.6f;
+static const float occlusionFactor = 0.3f;
+
+// a uniform number in [0, 1) for each pixel, sample and dimension, the same on every run and thread
+static float random(quint32 x, quint32 y, quint32 sample, quint32 dimension)
+{
+    quint32 h = (x * 0x8da6b343u) ^ (y * 0xd8163841u) ^ (sample * 0xcb1ab31fu) ^ (dimension * 0x165667b1u);
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+// a direction of the hemisphere around the normal n, with a density proportional to the cosine
+static QVector3D cosineDirection(const QVector3D & n, float u1, float u2)
+{
+    float r = std::sqrt(u1);
+    float phi = 2 * float(M_PI) * u2;
+    float x = r * std::cos(phi), y = r * std::sin(phi), z = std::sqrt(qMax(0.0f, 1 - u1));
+
+    // orthonormal basis around n (Duff et al., "Building an Orthonormal Basis, Revisited")
+    float sign = std::copysign(1.0f, n.z());
+    float a = -1 / (sign + n.z());
+    float b = n.x() * n.y() * a;
+    QVector3D tangent(1 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+    QVector3D bitangent(b, sign + n.y() * n.y() * a, -n.y());
+    return tangent * x + bitangent * y + n * z;
+}
+
+SoftwareRayTracer::SoftwareRayTracer(int threadCount)
+    : _pool(threadCount)
+{
+    _occlusionRadius = 0;
+    _offset = 0;
+    _tilesX = 0;
+    _tilesY = 0;
+    _sampleCount = 0;
+    _threadRays.resize(_pool.threadCount());
+}
+
+SoftwareRayTracer::~SoftwareRayTracer()
+{}
+
+void SoftwareRayTracer::setViewportSize(const QSize & size)
+{
+    if (size == _size) {
+        return;
+    }
+    _size = size;
+    _tilesX = (size.width() + TileSize - 1) / TileSize;
+    _tilesY = (size.height() + TileSize - 1) / TileSize;
+    _accumulation.fill(0.0f, 3 * size.width() * size.height());
+    _sampleCount = 0;
+}
+
+void SoftwareRayTracer::render(const SoftwareMesh & mesh)
+{
+    PROFILE_SCOPE("SoftwareRayTracer::render");
+    QElapsedTimer timer;
+    timer.start();
+
+    // the BVH only depends on the triangles, not on the matrices
+    bool geometryChanged = mesh.positions != _positions || mesh.indices != _indices;
+    if (geometryChanged) {
+        _positions = mesh.positions;
+        _indices = mesh.indices;
+        _bvh.build(_positions, _indices);
+        _stats.buildNanoseconds += timer.nsecsElapsed();
+        timer.restart();
+    }
+
+    if (geometryChanged || !accumulates(mesh)) {
+        _normals = mesh.normals;
+        _colors = mesh.colors;
+        _modelMatrix = mesh.modelMatrix;
+        _viewMatrix = mesh.viewMatrix;
+        _projectionMatrix = mesh.projectionMatrix;
+        _clearColor = mesh.clearColor;
+
+        // rays are traced in model space
+        _inverseModelViewProjection = (_projectionMatrix * _viewMatrix * _modelMatrix).inverted();
+        _lightDirection = _modelMatrix.inverted().mapVector(worldLightDirection).normalized();
+        float diagonal = (_bvh.boundsMax() - _bvh.boundsMin()).length();
+        _occlusionRadius = 0.1f * diagonal;
+        _offset = 1e-4f * diagonal;
+
+        _accumulation.fill(0.0f);
+        _sampleCount = 0;
+    }
+
+    for (ThreadCounter & counter : _threadRays) {
+        counter.rays = 0;
+    }
+    _pool.parallelFor(_tilesX * _tilesY, [this](int tile, int thread) {
+        renderTile(tile, thread);
+    });
+    _sampleCount++;
+
+    for (const ThreadCounter & counter : _threadRays) {
+        _stats.rays += counter.rays;
+    }
+    _stats.samples += qint64(_size.width()) * _size.height();
+    _stats.traceNanoseconds += timer.nsecsElapsed();
+}
+
+bool SoftwareRayTracer::accumulates(const SoftwareMesh & mesh) const
+{
+    return mesh.modelMatrix == _modelMatrix && mesh.viewMatrix == _viewMatrix &&
+        mesh.projectionMatrix == _projectionMatrix && mesh.clearColor == _clearColor &&
+        mesh.positions == _positions && mesh.indices == _indices && mesh.normals == _normals && mesh.colors == _colors;
+}
+
+QImage SoftwareRayTracer::image() const
+{
+    QImage image(_size, QImage::Format_RGB32);
+    if (_sampleCount == 0) {
+        image.fill(_clearColor);
+        return image;
+    }
+    float scale = 255.0f / _sampleCount;
+    const float * sum = _accumulation.constData();
+    for (int y = 0; y < _size.height(); y++) {
+        QRgb * line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < _size.width(); x++, sum += 3) {
+            line[x] = qRgb(qBound(0, int(sum[0] * scale + 0.5f), 255), qBound(0, int(sum[1] * scale + 0.5f), 255),
+                qBound(0, int(sum[2] * scale + 0.5f), 255));
+        }
+    }
+    return image;
+}
+
+void SoftwareRayTracer::resetStats()
+{
+    _stats = Stats();
+}
+
+void SoftwareRayTracer::renderTile(int tile, int thread)
+{
+    int x0 = tile % _tilesX * TileSize, y0 = tile / _tilesX * TileSize;
+    int x1 = qMin(x0 + TileSize, _size.width()), y1 = qMin(y0 + TileSize, _size.height());
+    int rays = 0;
+    for (int y = y0; y < y1; y += PacketSize) {
+        for (int x = x0; x < x1; x += PacketSize) {
+            rays += renderPacket(x, y);
+        }
+    }
+    _threadRays[thread].rays += rays;
+}
+
+int SoftwareRayTracer::renderPacket(int x0, int y0)
+{
+    Q_STATIC_ASSERT(PacketSize * PacketSize == RayPacket::Size);
+    int width = _size.width(), height = _size.height();
+    quint32 sample = _sampleCount;
+    int rays = 0;
+
+    // camera rays, through the pixel centers first and then jittered within the pixels for antialiasing
+    RayPacket camera;
+    for (int i = 0; i < RayPacket::Size; i++) {
+        int x = x0 + i % PacketSize, y = y0 + i / PacketSize;
+        if (x >= width || y >= height) {
+            camera.setRay(i, QVector3D(), QVector3D(0, 0, 1), 0);
+            camera.active[i] = false;
+            continue;
+        }
+        float jx = sample == 0 ? 0.5f : random(x, y, sample, 0);
+        float jy = sample == 0 ? 0.5f : random(x, y, sample, 1);
+        float nx = (x + jx) / width * 2 - 1, ny = 1 - (y + jy) / height * 2;
+        QVector3D nearPoint = _inverseModelViewProjection.map(QVector3D(nx, ny, -1));
+        QVector3D farPoint = _inverseModelViewProjection.map(QVector3D(nx, ny, 1));
+        camera.setRay(i, nearPoint, (farPoint - nearPoint).normalized(), infinity);
+        rays++;
+    }
+    _bvh.intersect(camera);
+
+    // shadow and ambient occlusion rays leave the visible points
+    RayPacket shadow, occlusion;
+    QVector3D colors[RayPacket::Size];
+    bool facesLight[RayPacket::Size];
+    for (int i = 0; i < RayPacket::Size; i++) {
+        shadow.setRay(i, QVector3D(), QVector3D(0, 0, 1), 0);
+        occlusion.setRay(i, QVector3D(), QVector3D(0, 0, 1), 0);
+        shadow.active[i] = occlusion.active[i] = false;
+        facesLight[i] = false;
+        if (!camera.active[i] || camera.triangle[i] < 0) {
+            continue;
+        }
+
+        int t = camera.triangle[i];
+        quint32 a = _indices[3 * t], b = _indices[3 * t + 1], c = _indices[3 * t + 2];
+        float u = camera.u[i], v = camera.v[i], w = 1 - u - v;
+        QVector3D direction(camera.dx[i], camera.dy[i], camera.dz[i]);
+        QVector3D position = QVector3D(camera.ox[i], camera.oy[i], camera.oz[i]) + direction * camera.tMax[i];
+
+        // both faces are shaded, so the normals are turned towards the camera
+        QVector3D geometricNormal = QVector3D::crossProduct(_positions[b] - _positions[a],
+            _positions[c] - _positions[a]).normalized();
+        if (QVector3D::dotProduct(geometricNormal, direction) > 0) {
+            geometricNormal = -geometricNormal;
+        }
+        QVector3D normal = geometricNormal;
+        if (_normals.size() == _positions.size()) {
+            normal = (_normals[a] * w + _normals[b] * u + _normals[c] * v).normalized();
+            if (QVector3D::dotProduct(normal, geometricNormal) < 0) {
+                normal = -normal;
+            }
+        }
+        colors[i] = _colors.size() == _positions.size() ?
+            _colors[a] * w + _colors[b] * u + _colors[c] * v : QVector3D(1, 1, 1);
+
+        QVector3D origin = position + geometricNormal * _offset;
+        facesLight[i] = QVector3D::dotProduct(geometricNormal, _lightDirection) > 0;
+        if (facesLight[i]) {
+            shadow.setRay(i, origin, _lightDirection, infinity);
+            rays++;
+        }
+        QVector3D ambient = cosineDirection(normal, random(x0 + i % PacketSize, y0 + i / PacketSize, sample, 2),
+            random(x0 + i % PacketSize, y0 + i / PacketSize, sample, 3));
+        // a direction below the surface (possible with interpolated normals) is mirrored above it
+        float below = QVector3D::dotProduct(ambient, geometricNormal);
+        if (below < 0) {
+            ambient -= 2 * below * geometricNormal;
+        }
+        occlusion.setRay(i, origin, ambient, _occlusionRadius);
+        rays++;
+    }
+    _bvh.occluded(shadow);
+    _bvh.occluded(occlusion);
+
+    QVector3D background(_clearColor.redF(), _clearColor.greenF(), _clearColor.blueF());
+    for (int i = 0; i < RayPacket::Size; i++) {
+        if (!camera.active[i]) {
+            continue;
+        }
+        QVector3D color = background;
+        if (camera.triangle[i] >= 0) {
+            bool lit = facesLight[i] && !shadow.occluded[i];
+            color = colors[i] * ((lit ? 1.0f : shadowFactor) * (occlusion.occluded[i] ? occlusionFactor : 1.0f));
+        }
+        float * sum = _accumulation.data() + 3 * ((y0 + i / PacketSize) * width + x0 + i % PacketSize);
+        sum[0] += color.x();
+        sum[1] += color.y();
+        sum[2] += color.z();
+    }
+    return rays;
+}
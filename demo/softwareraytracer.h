@@ -0,0 +1,89 @@
+#pragma once
+
+#include <QtGui>
+
+#include "softwarescene.h"
+#include "widebvh.h"
+#include "workstealingpool.h"
+
+// ray traces SoftwareMesh triangles on the CPU, with shadows and ambient occlusion
+//
+// every render() call traces one more sample per pixel and adds it to the previous ones, as long as the
+// mesh, its matrices and the viewport stay the same; any change restarts the accumulation, so an idle camera
+// converges progressively (antialiasing, soft ambient occlusion) while a moving one stays responsive
+//
+// the image is split into tiles run by a WorkStealingPool, and each tile into 4x4 pixel packets:
+// camera, shadow and ambient occlusion rays of a packet traverse the WideBvh together.
+// the BVH is built in model space, once per mesh, so turning the model only changes the camera rays
+class SoftwareRayTracer
+{
+public:
+    explicit SoftwareRayTracer(int threadCount = QThread::idealThreadCount());
+    ~SoftwareRayTracer();
+
+    // resize the image, which restarts the accumulation
+    void setViewportSize(const QSize & size);
+    QSize viewportSize() const { return _size; }
+
+    // trace one sample per pixel of the mesh
+    void render(const SoftwareMesh & mesh);
+    // whether render(mesh) would add to the accumulated samples instead of restarting them
+    bool accumulates(const SoftwareMesh & mesh) const;
+    // samples per pixel accumulated in the image
+    int sampleCount() const { return _sampleCount; }
+    // the average of the accumulated samples
+    QImage image() const;
+
+    int threadCount() const { return _pool.threadCount(); }
+
+    // totals since the last resetStats()
+    struct Stats
+    {
+        qint64 rays = 0;         // camera, shadow and ambient occlusion rays
+        qint64 samples = 0;      // pixel samples
+        qint64 traceNanoseconds = 0;
+        qint64 buildNanoseconds = 0; // BVH builds
+
+        double megaRaysPerSecond() const { return traceNanoseconds > 0 ? rays * 1e3 / traceNanoseconds : 0.0; }
+    };
+    Stats stats() const { return _stats; }
+    void resetStats();
+
+    enum { TileSize = 32, PacketSize = 4 };
+
+private:
+    // trace one sample of the pixels of a tile
+    void renderTile(int tile, int thread);
+    // trace one sample of a PacketSize x PacketSize block of pixels, returns the number of rays
+    int renderPacket(int x0, int y0);
+
+private:
+    WorkStealingPool _pool;
+    WideBvh _bvh;
+
+    // the mesh of the BVH and of the accumulated samples
+    QVector<QVector3D> _positions, _normals, _colors;
+    QVector<quint32> _indices;
+    QMatrix4x4 _modelMatrix, _viewMatrix, _projectionMatrix;
+    QColor _clearColor;
+
+    // derived from the mesh by render()
+    QMatrix4x4 _inverseModelViewProjection; // normalized device coordinates to model space
+    QVector3D _lightDirection;              // towards the light, in model space
+    float _occlusionRadius;                 // length of the ambient occlusion rays
+    float _offset;                          // distance between a surface and the rays leaving it
+
+    QSize _size;
+    int _tilesX, _tilesY;
+    QVector<float> _accumulation; // sums of the rgb samples
+    int _sampleCount;
+
+    // rays traced per thread, padded to separate cache lines
+    struct alignas(64) ThreadCounter
+    {
+        qint64 rays;
+    };
+    QVector<ThreadCounter> _threadRays;
+
+    Stats _stats;
+};
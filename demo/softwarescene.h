@@ -0,0 +1,25 @@
+#pragma once
+
+#include <QtGui>
+
+// an indexed triangle mesh with its colors and camera, as drawn by the CPU renderers
+struct SoftwareMesh
+{
+    QVector<QVector3D> positions; // model space
+    QVector<QVector3D> normals;   // model space, normalized
+    QVector<QVector3D> colors;    // the color the GL path shades each vertex with, in [0, 1]
+    QVector<quint32> indices;     // triangle list
+
+    QMatrix4x4 modelMatrix, viewMatrix, projectionMatrix;
+    QColor clearColor;
+};
+
+// a widget whose scene can also be drawn without OpenGL
+class SoftwareScene
+{
+public:
+    virtual ~SoftwareScene() {}
+
+    // the mesh and camera of the current frame, for a viewport of the given size
+    virtual SoftwareMesh softwareMesh(const QSize & viewportSize) const = 0;
+};
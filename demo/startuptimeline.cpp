@@ -0,0 +1,52 @@
+#include "profiler.h"
+
+#include "startuptimeline.h"
+
+static qint64 startTime = 0;
+static QStringList sceneOrder;
+static QHash<QString, QVector<qint64>> stageTimes;
+
+void StartupTimeline::start()
+{
+    startTime = Profiler::now();
+}
+
+void StartupTimeline::record(const QString & scene, Stage stage)
+{
+    if (!stageTimes.contains(scene)) {
+        sceneOrder << scene;
+        stageTimes.insert(scene, QVector<qint64>(StageCount, -1));
+    }
+    qint64 & time = stageTimes[scene][stage];
+    if (time < 0) {
+        time = Profiler::now() - startTime;
+    }
+}
+
+double StartupTimeline::milliseconds(const QString & scene, Stage stage)
+{
+    qint64 time = stageTimes.value(scene, QVector<qint64>(StageCount, -1))[stage];
+    return time < 0 ? -1.0 : time / 1e6;
+}
+
+QStringList StartupTimeline::scenes()
+{
+    return sceneOrder;
+}
+
+QString StartupTimeline::report()
+{
+    auto column = [](double ms) {
+        return ms < 0 ? QString("%1").arg("-", 10) : QString("%1").arg(ms, 10, 'f', 1);
+    };
+    QString text = QString("%1%2%3%4%5\n").arg("scene", -10).arg("shown", 10).arg("creating", 10)
+        .arg("created", 10).arg("1st frame", 10);
+    for (const QString & scene : sceneOrder) {
+        text += QString("%1").arg(scene, -10);
+        for (int stage = 0; stage < StageCount; stage++) {
+            text += column(milliseconds(scene, Stage(stage)));
+        }
+        text += "\n";
+    }
+    return text + "(milliseconds from the start of the application)";
+}
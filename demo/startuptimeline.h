@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QtCore>
+
+// when each scene of the window went through the stages of its startup, from the start of the application
+// the stages are recorded by the GUI thread
+class StartupTimeline
+{
+public:
+    enum Stage {
+        Shown,      // its subwindow was first shown (not recorded for the scenes prefetched while hidden)
+        Creating,   // its widget is being constructed (the meshes and maps are loaded or computed)
+        Created,    // its widget is constructed
+        FirstFrame, // its first frame was painted
+        StageCount
+    };
+
+    // the start of the application, called first by main()
+    static void start();
+
+    // record a stage of a scene, only its first time
+    static void record(const QString & scene, Stage stage);
+    // the milliseconds from the start to a stage of a scene, or -1 if it was not recorded
+    static double milliseconds(const QString & scene, Stage stage);
+
+    // the scenes in the order of their first stage
+    static QStringList scenes();
+    // a table of the stages of each scene, for the log
+    static QString report();
+};
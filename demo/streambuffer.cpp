@@ -0,0 +1,186 @@
+#include "glstatecache.h"
+#include "memorytracker.h"
+
+#include "streambuffer.h"
+
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+#ifndef GL_TIMEOUT_EXPIRED
+#define GL_TIMEOUT_EXPIRED 0x911B
+#endif
+#ifndef GL_WAIT_FAILED
+#define GL_WAIT_FAILED 0x911D
+#endif
+
+static QAtomicInteger<qint64> totalStreamedBytes;
+static QAtomicInteger<qint64> totalStalls;
+
+// the timeout of one glClientWaitSync while stalling, in nanoseconds
+static const GLuint64 waitTimeout = 100000000;
+
+StreamBuffer::StreamBuffer(int regionCount)
+    : _regionCount(qMax(regionCount, 1)), _regionBytes(0), _target(0), _buffer(0), _state(nullptr),
+      _region(0), _used(0), _mapping(nullptr),
+      _bufferStorage(nullptr), _mapBufferRange(nullptr), _fenceSync(nullptr), _clientWaitSync(nullptr),
+      _deleteSync(nullptr)
+{
+}
+
+StreamBuffer::~StreamBuffer()
+{
+}
+
+void StreamBuffer::initialize(const QGLContext * context, GLStateCache & state, GLenum target, int regionBytes,
+    const QString & asset)
+{
+    initializeGLFunctions(context);
+    _state = &state;
+    _target = target;
+    _regionBytes = regionBytes;
+    _region = 0;
+    _used = 0;
+
+    QOpenGLContext * glContext = context->contextHandle();
+    // buffer storage is core since OpenGL 4.4, fences since 3.2
+    bool bufferStorage = glContext->format().version() >= qMakePair(4, 4) ||
+        glContext->hasExtension("GL_ARB_buffer_storage");
+    if (bufferStorage && !glContext->isOpenGLES()) {
+        _bufferStorage = reinterpret_cast<BufferStorage>(glContext->getProcAddress("glBufferStorage"));
+        _mapBufferRange = reinterpret_cast<MapBufferRange>(glContext->getProcAddress("glMapBufferRange"));
+        _fenceSync = reinterpret_cast<FenceSync>(glContext->getProcAddress("glFenceSync"));
+        _clientWaitSync = reinterpret_cast<ClientWaitSync>(glContext->getProcAddress("glClientWaitSync"));
+        _deleteSync = reinterpret_cast<DeleteSync>(glContext->getProcAddress("glDeleteSync"));
+    }
+
+    glGenBuffers(1, &_buffer);
+    state.bindBuffer(target, _buffer);
+    if (_bufferStorage && _mapBufferRange && _fenceSync && _clientWaitSync && _deleteSync) {
+        // coherent: the writes are seen by the GPU without glFlushMappedBufferRange
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr size = GLsizeiptr(_regionCount) * regionBytes;
+        _bufferStorage(target, size, nullptr, flags);
+        _mapping = static_cast<char *>(_mapBufferRange(target, 0, size, flags));
+    }
+    if (_mapping) {
+        _fences.fill(nullptr, _regionCount);
+    } else {
+        glBufferData(target, regionBytes, nullptr, GL_STREAM_DRAW);
+        _staging.resize(regionBytes);
+    }
+    _memoryOwner = MemoryTracker::contextOwner();
+    _memoryAsset = asset;
+    MemoryTracker::add(MemoryTracker::Gpu, _memoryOwner, asset, qint64(regionCount()) * regionBytes);
+    MemoryTracker::add(MemoryTracker::Cpu, _memoryOwner, asset, _staging.size());
+}
+
+void StreamBuffer::release()
+{
+    if (_buffer == 0) {
+        return;
+    }
+    for (GLsync fence : _fences) {
+        if (fence) {
+            _deleteSync(fence);
+        }
+    }
+    _fences.clear();
+    // deleting the buffer also unmaps it
+    glDeleteBuffers(1, &_buffer);
+    MemoryTracker::add(MemoryTracker::Gpu, _memoryOwner, _memoryAsset, -qint64(regionCount()) * _regionBytes);
+    MemoryTracker::add(MemoryTracker::Cpu, _memoryOwner, _memoryAsset, -_staging.size());
+    _buffer = 0;
+    _mapping = nullptr;
+    _staging.clear();
+}
+
+void StreamBuffer::beginFrame()
+{
+    _used = 0;
+    _stats.frames++;
+    _stats.lastFrameBytes = 0;
+    if (!_mapping) {
+        return;
+    }
+
+    _region = (_region + 1) % _regionCount;
+    GLsync fence = _fences[_region];
+    if (!fence) {
+        return;
+    }
+    // the usual case: the GPU is done with the region since regionCount - 1 frames
+    GLenum status = _clientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        QElapsedTimer timer;
+        timer.start();
+        do {
+            status = _clientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, waitTimeout);
+        } while (status == GL_TIMEOUT_EXPIRED);
+        qint64 stall = timer.nsecsElapsed();
+        _stats.stallNanoseconds += stall;
+        totalStalls.fetchAndAddRelaxed(stall);
+    }
+    if (status == GL_WAIT_FAILED) {
+        qWarning("StreamBuffer: glClientWaitSync failed");
+    }
+    _deleteSync(fence);
+    _fences[_region] = nullptr;
+}
+
+void * StreamBuffer::allocate(int bytes, int alignment, int * offset)
+{
+    int start = (_used + alignment - 1) / alignment * alignment;
+    if (start + bytes > _regionBytes) {
+        return nullptr;
+    }
+    _used = start + bytes;
+    _stats.bytes += bytes;
+    _stats.lastFrameBytes += bytes;
+    totalStreamedBytes.fetchAndAddRelaxed(bytes);
+
+    if (_mapping) {
+        *offset = _region * _regionBytes + start;
+        return _mapping + *offset;
+    }
+    *offset = start;
+    return _staging.data() + start;
+}
+
+void StreamBuffer::flush()
+{
+    _state->bindBuffer(_target, _buffer);
+    if (!_mapping && _used > 0) {
+        // orphan the data store the GPU may still read, then fill the new one
+        glBufferData(_target, _regionBytes, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(_target, 0, _used, _staging.constData());
+    }
+}
+
+void StreamBuffer::endFrame()
+{
+    if (_mapping) {
+        _fences[_region] = _fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+qint64 StreamBuffer::totalBytes()
+{
+    return totalStreamedBytes.load();
+}
+
+qint64 StreamBuffer::totalStallNanoseconds()
+{
+    return totalStalls.load();
+}
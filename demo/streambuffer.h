@@ -0,0 +1,96 @@
+#pragma once
+
+#include <QtOpenGL>
+
+class GLStateCache;
+
+// a buffer for the data written anew every frame (instance transforms, draw commands, animated vertices...)
+//
+// the buffer is split into regionCount regions used in turn, one per frame, and a frame writes into its
+// region while the GPU may still read the previous ones:
+//   - with GL_ARB_buffer_storage the buffer is mapped once with GL_MAP_PERSISTENT_BIT, allocate() returns
+//     pointers into the mapping and endFrame() puts a fence after the draws of the region, which beginFrame()
+//     waits for when the region comes back (the stall time)
+//   - otherwise the writes go to a copy in memory and flush() orphans the buffer with glBufferData(nullptr)
+//     before uploading them, so that the driver gives a fresh data store instead of waiting for the GPU;
+//     there is a single region and the stall time is 0 (any wait happens in the driver)
+//
+// per frame: beginFrame(), allocate() and write, flush() before the draws, endFrame() after them
+class StreamBuffer : protected QGLFunctions
+{
+public:
+    explicit StreamBuffer(int regionCount = 3);
+    ~StreamBuffer();
+
+    // create the buffer in the current context for 'target', with regions of regionBytes
+    // the bindings go through the state cache of the context, 'asset' names it in MemoryTracker
+    void initialize(const QGLContext * context, GLStateCache & state, GLenum target, int regionBytes,
+        const QString & asset = "stream buffer");
+    // delete the buffer and the fences, the owning context must be current
+    void release();
+
+    GLuint bufferId() const { return _buffer; }
+    bool isPersistent() const { return _mapping != nullptr; }
+    // number of regions the offsets of allocate() may fall in
+    int regionCount() const { return isPersistent() ? _regionCount : 1; }
+    int regionBytes() const { return _regionBytes; }
+
+    // move to the next region, waiting until the GPU has finished the frame that used it last
+    void beginFrame();
+    // reserve bytes in the region of the frame, at an offset (from the start of the buffer) that is
+    // a multiple of alignment; returns where to write them, or nullptr if the region is full
+    void * allocate(int bytes, int alignment, int * offset);
+    // make the writes of the frame visible to OpenGL, the buffer is left bound to its target
+    void flush();
+    // fence the region, after the last draw that reads it
+    void endFrame();
+
+    // totals of this buffer
+    struct Stats
+    {
+        qint64 frames = 0;
+        qint64 bytes = 0;
+        qint64 stallNanoseconds = 0;
+        int lastFrameBytes = 0;
+
+        double bytesPerFrame() const { return frames > 0 ? double(bytes) / frames : 0.0; }
+    };
+    Stats stats() const { return _stats; }
+    void resetStats() { _stats = Stats(); }
+
+    // totals of all the stream buffers
+    static qint64 totalBytes();
+    static qint64 totalStallNanoseconds();
+
+private:
+    typedef void (QOPENGLF_APIENTRYP BufferStorage)(GLenum target, GLsizeiptr size, const void * data,
+        GLbitfield flags);
+    typedef void * (QOPENGLF_APIENTRYP MapBufferRange)(GLenum target, GLintptr offset, GLsizeiptr length,
+        GLbitfield access);
+    typedef GLsync (QOPENGLF_APIENTRYP FenceSync)(GLenum condition, GLbitfield flags);
+    typedef GLenum (QOPENGLF_APIENTRYP ClientWaitSync)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+    typedef void (QOPENGLF_APIENTRYP DeleteSync)(GLsync sync);
+
+private:
+    int _regionCount;
+    int _regionBytes;
+    GLenum _target;
+    GLuint _buffer;
+    GLStateCache * _state;
+    // the owner and name of the buffer in MemoryTracker
+    QString _memoryOwner, _memoryAsset;
+
+    int _region; // the region of the frame
+    int _used;   // bytes allocated in it
+    char * _mapping; // the persistent mapping of the whole buffer, nullptr when orphaning
+    QByteArray _staging; // the writes of the frame when orphaning
+    QVector<GLsync> _fences; // one per region, nullptr once waited for
+
+    BufferStorage _bufferStorage;
+    MapBufferRange _mapBufferRange;
+    FenceSync _fenceSync;
+    ClientWaitSync _clientWaitSync;
+    DeleteSync _deleteSync;
+
+    Stats _stats;
+};
@@ -1,9 +1,73 @@
+#include "drawstats.h"
+#include "glresourceregistry.h"
+#include "memorytracker.h"
+#include "mipmapbuilder.h"
+#include "profiler.h"
+
 #include "terrainwidget.h"
 
-TerrainWidget::TerrainWidget(QWidget *parent)
-    : QGLWidget(parent), QGLFunctions() 
+#include "glcapturecalls.h"
+
+// names of the GPU objects of this widget in GLResourceRegistry
+static const char * normalHeightMapAsset = ":/images/australia.jpg:filtered-normal-height";
+static const char * gridAsset = "TerrainWidget:grid";
+static const char * triangleIndicesAsset = "TerrainWidget:grid indices";
+
+// the number of grid vertices along each side
+static const int resolution = 256;
+
+// the normal (rgb) and height (a) of a height map filtered down to the grid, whose heights are scaled by heightRatio
+// the vertex shader samples the map once per grid vertex, so a larger map would alias; the heights are filtered
+// as 16 bit values by MipmapBuilder and the normals are computed from them before they are rounded to 8 bits
+static QImage computeNormalHeightMap(const QImage & im, float heightRatio)
+{
+    QVector<quint16> heights(im.width() * im.height());
+    for (int j = 0; j < im.height(); j++) {
+        for (int i = 0; i < im.width(); i++) {
+            heights[j * im.width() + i] = quint16(qGray(im.pixel(i, j)) * 257);
+        }
+    }
+    // the first level with no more texels than the grid has vertices
+    QVector<QVector<quint16>> levels = MipmapBuilder().buildR16(heights.constData(), im.width(), im.height(),
+        MipmapBuilder::Kaiser);
+    int level = 0;
+    while (level + 1 < levels.size() && MipmapBuilder::levelSize(im.size(), level).width() > resolution) {
+        level++;
+    }
+    QSize size = MipmapBuilder::levelSize(im.size(), level);
+    const QVector<quint16> & grid = levels[level];
+    auto heightAt = [&](int i, int j) {
+        return grid[qBound(0, j, size.height() - 1) * size.width() + qBound(0, i, size.width() - 1)] / 65535.0f *
+            heightRatio;
+    };
+
+    QImage normalHeightMap(size, QImage::Format_ARGB32);
+    for (int i = 0; i < size.width(); i++) {
+        for (int j = 0; j < size.height(); j++) {
+            float height = heightAt(i, j);
+            float adjHs[4] = { heightAt(i - 1, j), heightAt(i, j - 1), heightAt(i + 1, j), heightAt(i, j + 1) };
+            float dxdy[][2] = { {-1.0f, 0.0f}, {0.0f, -1.0f}, {1.0f, 0.0f}, {0.0f, 1.0f} };
+            QVector3D normal;
+            for (int k = 0; k < 4; k++) {
+                QVector3D v1(dxdy[k][0], dxdy[k][1], (adjHs[k] - height) * resolution);
+                QVector3D v2(dxdy[(k + 1) % 4][0], dxdy[(k + 1) % 4][1], 
+                    (adjHs[(k + 1) % 4] - height) * resolution);
+                normal += QVector3D::crossProduct(v1, v2).normalized();
+            }
+            normal.normalize();
+            int alpha = (grid[j * size.width() + i] + 128) / 257;
+            QRgb normalHeight = qRgba(normal.x() * 255, normal.y() * 255, normal.z() * 255, alpha);
+            normalHeightMap.setPixel(i, j, normalHeight);
+        }
+    }
+    return normalHeightMap;
+}
+
+TerrainWidget::TerrainWidget(QWidget *parent, const QGLWidget * shareWidget)
+    : QGLWidget(parent, shareWidget), QGLFunctions(), _frameScheduler(this)
 {
     setWindowTitle(tr("6. Terrain"));
+    setObjectName("terrain");
     setMinimumSize(200, 200);
     setMouseTracking(true);
     setFocusPolicy(Qt::ClickFocus);
@@ -16,248 +80,190 @@ TerrainWidget::TerrainWidget(QWidget *parent)
     _modelMatrix.setToIdentity();
     _modelMatrix.scale(4);
     _modelMatrix.rotate(180, 1, 0, 0);
+
+    // initialize view matrix data
+    QMatrix4x4 viewMatrix;
+    viewMatrix.lookAt(QVector3D(0, 0, -10), QVector3D(0, 0, 0), QVector3D(0, -1, 0));
+    _frameUniforms.setViewMatrix(viewMatrix);
   
 
     // initialize buffer ids to 0
     _gridBuffer = 0;
     _triangleIndicesBuffer = 0;
 
+    // the shader variants are shared by the widgets of the share group
+    _meshShader = qSharedPointerCast<MeshShader>(GLResourceRegistry::instance().shaderVariants(
+        "MeshShader", [] { return new MeshShader; }));
+    // the minimal shader variant for this widget: grid displaced by the height map
+    _shaderFeatures = MeshShader::HeightMap;
+
     // initialize program id to -1
     _program = -1;
 
     // initialize uniform variable locations to -1
-    _modelMatrixLocation = -1;
-    _viewMatrixLocation = -1;
-    _projectionMatrixLocation = -1;
     _normalHeightMapLocation = -1;
+    _normalZHeightMapLocation = -1;
     _heightRatioLocation = -1;
 
-    _texture = -1;
+    // the map is computed on a worker thread (at the grid resolution, so it has no mipmaps), then compressed
+    // as 2 BC5 textures (half the size of RGBA8888) saved for the next runs
+    float heightRatio = _heightRatio;
+    _normalHeightMap.load(normalHeightMapAsset, &_frameScheduler, false, TextureLoader::NormalHeightBC5,
+        [heightRatio] { return computeNormalHeightMap(QImage(":/images/australia.jpg"), heightRatio); },
+        ":/images/australia.jpg");
 }
 
 
-TerrainWidget::~TerrainWidget() {}
-
-// the source code of vertex shader
-static const char * vshaderSource =
-    "#version 120\n"                    // the version of this shader
-    "attribute lowp vec2 position;\n"   // the 2d position of each grid vertex
-    "uniform lowp mat4 viewMatrix;\n"       // the viewMatrix of this shader program
-    "uniform lowp mat4 modelMatrix;\n"      // the modelMatrix of this shader program
-    "uniform lowp mat4 projectionMatrix;\n" // the projectionMatrix of this shader program
-    "uniform sampler2D normalHeightMap;\n" // the normalHeightMap of this shader program
-    "uniform lowp float heightRatio;\n" // the heightRatio of this shader program
-    "varying lowp vec3 pixelNormal;\n"    // the output normal on this vertex (will be interpolated in fragment shader)
-    "varying lowp vec3 pixelPosition;\n"  // the output position on this vertex (will be interpolated in fragment shader)
-    "varying lowp float pixelHeight;\n"
-    "void main(void)\n" // the main function
-    "{\n"
-    "    lowp vec4 normalHeight = texture2D(normalHeightMap, position);\n"
-    "    lowp float height = normalHeight.a * heightRatio;\n"
-    // get pixelNormal
-    "    pixelNormal = normalize(normalHeight.rgb);\n"
-
-    // gl_Position is the final coordinate of this vertex on screen
-    "    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(position * 2.0 - 1.0, height, 1.0);\n"  
-
-    // get pixelPosition
-    "    lowp vec4 position4 = viewMatrix * modelMatrix * vec4(position * 2.0 - 1.0, height, 1.0);\n"
-    "    pixelPosition = position4.xyz / position4.w;\n"
-
-    "    pixelHeight = normalHeight.a;\n"
-
-    "}\n";
-
-// the source code of fragment shader
-static const char * fshaderSource =
-    "#version 120\n" // the version of this shader
-    "varying lowp vec3 pixelNormal;\n"    // the input normal on this pixel
-    "varying lowp vec3 pixelPosition;\n"  // the input position of this pixel
-    "varying lowp float pixelHeight;\n"
-    "void main(void)\n" // the main function
-    "{\n"
-
-    "    gl_FragColor = vec4(pixelNormal * pixelHeight, 1.0);\n"
-
-    "}\n";
-
+TerrainWidget::~TerrainWidget() 
+{
+    // take the context back from the render thread, if any
+    _frameScheduler.stopRendering();
+
+    // drop the references to the shared buffers and texture
+    if (_gridBuffer != 0) {
+        makeCurrent();
+        GLResourceRegistry & resources = GLResourceRegistry::instance();
+        _normalHeightMap.release();
+        resources.release(GLResourceRegistry::Buffer, gridAsset);
+        resources.release(GLResourceRegistry::Buffer, triangleIndicesAsset);
+        _meshShader.clear();
+    }
+    MemoryTracker::clear(MemoryTracker::Cpu, objectName());
+}
 
 void TerrainWidget::initializeGL() 
 {
+    PROFILE_SCOPE("TerrainWidget::initializeGL");
     makeCurrent();
     initializeGLFunctions(context());
-
-    // create OpenGL shader program
-    _program = glCreateProgram();
-
-    // create a vertex shader
-    int vshader = glCreateShader(GL_VERTEX_SHADER);
-
-    // load shader source and compile
-    glShaderSource(vshader, 1, &vshaderSource, 0);
-    glCompileShader(vshader);
-    { // check status
-        GLint logLength;
-        glGetShaderiv(vshader, GL_INFO_LOG_LENGTH, &logLength);
-        if (logLength > 0) {
-            GLchar *log = (GLchar *)malloc(logLength);
-            glGetShaderInfoLog(vshader, logLength, &logLength, log);
-            qDebug("Shader compile log:\n%s", log);
-            free(log);
-        }
-        GLint status;
-        glGetShaderiv(vshader, GL_COMPILE_STATUS, &status);
-        if (status == 0) {
-            glDeleteShader(vshader);
-            return;
-        }
-    }
-
-    // create a fragment shader
-    int fshader = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // load shader source and compile
-    glShaderSource(fshader, 1, &fshaderSource, 0);
-    glCompileShader(fshader);
-    { // check status
-        GLint logLength;
-        glGetShaderiv(fshader, GL_INFO_LOG_LENGTH, &logLength);
-        if (logLength > 0) {
-            GLchar *log = (GLchar *)malloc(logLength);
-            glGetShaderInfoLog(fshader, logLength, &logLength, log);
-            qDebug("Shader compile log:\n%s", log);
-            free(log);
-        }
-        GLint status;
-        glGetShaderiv(fshader, GL_COMPILE_STATUS, &status);
-        if (status == 0) {
-            glDeleteShader(fshader);
-            return;
-        }
-    }
-
-    // attach shaders to the program
-    glAttachShader(_program, vshader);
-    glAttachShader(_program, fshader);
-
-    // link the program
-    glLinkProgram(_program);
-    { // check status
-        GLint logLength, status;
-        glValidateProgram(_program);
-        glGetProgramiv(_program, GL_INFO_LOG_LENGTH, &logLength);
-        if (logLength > 0) {
-            GLchar *log = (GLchar *)malloc(logLength);
-            glGetProgramInfoLog(_program, logLength, &logLength, log);
-            qDebug("Program validate log:\n%s", log);
-            free(log);
-        }
-
-        glGetProgramiv(_program, GL_VALIDATE_STATUS, &status);
-        if (status == 0) {
-            return;
-        }
-    }
+    _glState.initialize(context());
 
     // now we deal with the GL_TEXTURE0 group only 
     // (one texture group contains multiple kinds of textures, eg. GL_TEXTURE_1D, GL_TEXTURE_2D...)
     // see https://www.opengl.org/discussion_boards/showthread.php/174926-when-to-use-glActiveTexture for explanation
-    glActiveTexture(GL_TEXTURE0);
-    // this functon wraps two tasks:
-    // 1. we create a new texture object whose data comes from the _normalHeightMap, 
-    //    and the name of the texture object is returned as '_texture';
-    // 2. we bind the object '_texture' onto the GL_TEXTURE_2D part within the GL_TEXTURE0 group
-    // related gl calls include:
-    //  glCreateTextures, glBindTexture, glTexImage2D
-    _texture = bindTexture(_normalHeightMap, GL_TEXTURE_2D, GL_RGBA);
-
-
-
-    // get locations of uniform variable from the linked program
-    _modelMatrixLocation = glGetUniformLocation(_program, "modelMatrix");
-    _viewMatrixLocation = glGetUniformLocation(_program, "viewMatrix");
-    _projectionMatrixLocation = glGetUniformLocation(_program, "projectionMatrix");
-    _normalHeightMapLocation = glGetUniformLocation(_program, "normalHeightMap");
-    _heightRatioLocation = glGetUniformLocation(_program, "heightRatio");
-
-
-    Q_ASSERT(_modelMatrixLocation != -1 && _viewMatrixLocation != -1 && 
-        _projectionMatrixLocation != -1 && _normalHeightMapLocation != -1 &&
-        _heightRatioLocation != -1);
-
-
-    // bind 0 to the "position" attribute of each vertex in shader program
-    glBindAttribLocation(_program, 0, "position");
-
-
-    // generate buffers
-    glGenBuffers(1, &_gridBuffer);
-    glGenBuffers(1, &_triangleIndicesBuffer);
-
-    // use _vertBuffer as the ArrayBuffer and fill it with vertices array 
-    glBindBuffer(GL_ARRAY_BUFFER, _gridBuffer);
-   
-    glBufferData(GL_ARRAY_BUFFER, sizeof(_grids.first()) * _grids.size(),
-        _grids.data(), GL_STATIC_DRAW);
-
-    // use _triangleIndicesBuffer as the ElementArrayBuffer and fill it with triangle indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _triangleIndicesBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(_triangleIndices.first()) * _triangleIndices.size(),
-        _triangleIndices.data(), GL_STATIC_DRAW);
-
-    // unbind buffers
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
+    _glState.activeTexture(GL_TEXTURE0);
+
+    // reuse the buffers if another widget of the share group already uploaded them
+    GLResourceRegistry & resources = GLResourceRegistry::instance();
+    _gridBuffer = resources.acquireOrCreate(GLResourceRegistry::Buffer, gridAsset, [&](qint64 * bytes) {
+        // generate buffer
+        GLuint buffer = 0;
+        glGenBuffers(1, &buffer);
+
+        // use the buffer as the ArrayBuffer and fill it with grids array 
+        _glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+        *bytes = sizeof(_grids.first()) * _grids.size();
+        glBufferData(GL_ARRAY_BUFFER, *bytes, _grids.data(), GL_STATIC_DRAW);
+        return buffer;
+    });
+
+    _triangleIndicesBuffer = resources.acquireOrCreate(GLResourceRegistry::Buffer, triangleIndicesAsset,
+        [&](qint64 * bytes) {
+            // generate buffer
+            GLuint buffer = 0;
+            glGenBuffers(1, &buffer);
+
+            // use the buffer as the ElementArrayBuffer and fill it with triangle indices
+            _glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+            *bytes = sizeof(_triangleIndices.first()) * _triangleIndices.size();
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, *bytes, _triangleIndices.data(), GL_STATIC_DRAW);
+            return buffer;
+        });
 }
 
 void TerrainWidget::paintGL() 
 {
-    qglClearColor(Qt::white);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    PROFILE_GL_SCOPE("TerrainWidget::paintGL");
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_ALPHA_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // apply the input accumulated since the last frame
+    QPointF t = _frameScheduler.takeDrag();
+    if (!t.isNull()) {
+        QMatrix4x4 rotMat;
+        rotMat.rotate(-t.x() / 10.0 * M_PI, 0, 1, 0);
+        rotMat.rotate(t.y() / 10.0 * M_PI, 1, 0, 0);
+        _modelMatrix = rotMat * _modelMatrix;
+    }
+    int wheel = _frameScheduler.takeWheel();
+    if (wheel != 0) {
+        _modelMatrix.scale(exp(wheel / 1000.0));
+    }
+    // an odd number of presses toggles a feature
+    if (_frameScheduler.takeKeyPresses(Qt::Key_L) % 2) {
+        _shaderFeatures ^= MeshShader::LambertLighting;
+    }
+    if (_frameScheduler.takeKeyPresses(Qt::Key_N) % 2) {
+        _shaderFeatures ^= MeshShader::DebugNormals;
+    }
 
-    // use the OpenGL shader program for painting
-    glUseProgram(_program);
+    _glState.clearColor(Qt::white);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // set states (only the changed ones reach OpenGL)
+    _glState.enable(GL_DEPTH_TEST);
+    _glState.enable(GL_ALPHA_TEST);
+    _glState.enable(GL_BLEND);
+    _glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // bind the texture as GL_TEXTURE_2D in the texture group 0, there is nothing to draw until it is uploaded
+    _glState.activeTexture(GL_TEXTURE0);
+    GLuint texture = _normalHeightMap.update(context(), _glState);
+    if (texture == 0) {
+        return;
+    }
+    _glState.bindTexture(GL_TEXTURE_2D, texture);
+    // the compressed map is split in two textures, the second one goes to the texture group 1
+    bool split = _normalHeightMap.textureCount() > 1;
+    if (split) {
+        _glState.activeTexture(GL_TEXTURE1);
+        _glState.bindTexture(GL_TEXTURE_2D, _normalHeightMap.texture(1));
+        _glState.activeTexture(GL_TEXTURE0);
+    }
 
+    // the shader variant of the current features, compiled on its first use
+    ShaderProgram * program = _meshShader->variant(_shaderFeatures | (split ? MeshShader::SplitHeightMap : 0));
+    if (!program) {
+        return;
+    }
+    if (program->programId() != _program) {
+        // get locations of uniform variable from the linked program
+        _program = program->programId();
+        _normalHeightMapLocation = program->uniformLocation("normalHeightMap");
+        _normalZHeightMapLocation = split ? program->uniformLocation("normalZHeightMap") : -1;
+        _heightRatioLocation = program->uniformLocation("heightRatio");
+
+        Q_ASSERT(_normalHeightMapLocation != -1 && _heightRatioLocation != -1);
+    }
 
-    //// set uniform values
-    // set model matrix
-    glUniformMatrix4fv(_modelMatrixLocation, 1, GL_FALSE, _modelMatrix.data());
+    // use the OpenGL shader program for painting
+    _glState.useProgram(_program);
+
+    // uniform values are kept by the program (which may be shared with other widgets),
+    // so they are only set when another widget set its own values in between
+    if (program->claimUniforms(this)) {
+        // set normalHeightMap to 0 so that we can access the content of the texture via 'sampler2D' in the shader
+        glUniform1i(_normalHeightMapLocation, 0);
+        if (split) {
+            glUniform1i(_normalZHeightMapLocation, 1);
+        }
+        // set height ratio
+        glUniform1f(_heightRatioLocation, _heightRatio);
+    }
 
-    // set view matrix
-    QMatrix4x4 viewMatrix;
-    viewMatrix.setToIdentity();
-    viewMatrix.lookAt(QVector3D(0, 0, -10), QVector3D(0, 0, 0), QVector3D(0, -1, 0));
-    glUniformMatrix4fv(_viewMatrixLocation, 1, GL_FALSE, viewMatrix.data());
 
-    // set projection matrix
-    QMatrix4x4 projectionMatrix;
-    projectionMatrix.setToIdentity();
-    projectionMatrix.perspective(30, (float)width() / height(), 0.01f, 1e5f);
-    glUniformMatrix4fv(_projectionMatrixLocation, 1, GL_FALSE, projectionMatrix.data());
 
-    // bind _texture as GL_TEXTURE_2D in the texture group 0  
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _texture);
-    // set normalHeightMap to 0 so that we can access the content of _texture via 'sampler2D' in the shader
-    glUniform1i(_normalHeightMapLocation, 0);
+    //// set uniform values
+    // set model matrix, the camera block is only uploaded if a matrix changed since the last frame
+    _frameUniforms.setModelMatrix(_modelMatrix);
+    _frameUniforms.bind();
 
-    // set height ratio
-    glUniform1f(_heightRatioLocation, _heightRatio);
 
 
 
     //// set attributes data
     // bind ArrayBuffer to _gridBuffer
-    glBindBuffer(GL_ARRAY_BUFFER, _gridBuffer);
+    _glState.bindBuffer(GL_ARRAY_BUFFER, _gridBuffer);
     // enable vertex attribute "position" (bound to 0 already)
-    glEnableVertexAttribArray(0);
+    _glState.enableVertexAttribArray(0);
     // set the data of vertex attribute "position" using current ArrayBuffer
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(_grids.first()), 0);   
 
@@ -266,29 +272,25 @@ void TerrainWidget::paintGL()
 
     //// draw call
     // bind ElementArrayBuffer to _triangleIndicesBuffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _triangleIndicesBuffer);
+    _glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _triangleIndicesBuffer);
     // draw mesh using the indices stored in ElementArrayBuffer
     glDrawElements(GL_TRIANGLES, _triangleIndices.size(), GL_UNSIGNED_INT, 0);
+    DrawStats::count(GL_TRIANGLES, _triangleIndices.size());
 
 
 
     //// finalize
-    // disable vertex attributes
-    glDisableVertexAttribArray(0);
-
-    // unbind buffers
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-    // restore states
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_ALPHA_TEST);
-    glDisable(GL_BLEND);
+    // states and bindings are left as they are, _glState skips setting them again in the next frame
 }
 
 void TerrainWidget::resizeGL(int w, int h) 
 {
     glViewport(0, 0, w, h);
+
+    // set projection matrix (it only relies on the size of the window)
+    QMatrix4x4 projectionMatrix;
+    projectionMatrix.perspective(30, (float)w / h, 0.01f, 1e5f);
+    _frameUniforms.setProjectionMatrix(projectionMatrix);
 }
 
 void TerrainWidget::mousePressEvent(QMouseEvent * e) {
@@ -300,13 +302,9 @@ void TerrainWidget::mouseMoveEvent(QMouseEvent * e)
 {
     if (e->buttons() != Qt::NoButton) {
         setCursor(Qt::ClosedHandCursor);
-        auto t = (e->pos() - _lastMousePos);
-        QMatrix4x4 rotMat;
-        rotMat.rotate(-t.x() / 10.0 * M_PI, 0, 1, 0);
-        rotMat.rotate(t.y() / 10.0 * M_PI, 1, 0, 0);
-        _modelMatrix = rotMat * _modelMatrix;
+        // the rotation is applied by the next frame, together with the other moves until then
+        _frameScheduler.addDrag(e->pos() - _lastMousePos);
         _lastMousePos = e->pos();
-        update();
     }
 }
 
@@ -317,14 +315,51 @@ void TerrainWidget::mouseReleaseEvent(QMouseEvent * e)
 
 void TerrainWidget::wheelEvent(QWheelEvent * e) 
 {
-    _modelMatrix.scale(exp(e->delta() / 1000.0));
-    update();
+    _frameScheduler.addWheel(e->delta());
+}
+
+void TerrainWidget::keyPressEvent(QKeyEvent * e)
+{
+    // the shader features are toggled by the next frame, which compiles the new variant on its first use
+    if (e->key() == Qt::Key_L || e->key() == Qt::Key_N) {
+        _frameScheduler.addKey(e->key());
+    } else {
+        QGLWidget::keyPressEvent(e);
+    }
+}
+
+SoftwareMesh TerrainWidget::softwareMesh(const QSize & viewportSize) const
+{
+    // what the vertex shader does with the grid (the uploaded height map is flipped vertically)
+    SoftwareMesh mesh;
+    QImage normalHeightMap = _normalHeightMap.image();
+    int w = normalHeightMap.width(), h = normalHeightMap.height();
+    mesh.positions.reserve(_grids.size());
+    mesh.normals.reserve(_grids.size());
+    mesh.colors.reserve(_grids.size());
+    for (const QVector2D & p : _grids) {
+        QRgb texel = normalHeightMap.pixel(qMin(int(p.x() * w), w - 1), qMin(int((1 - p.y()) * h), h - 1));
+        float height = qAlpha(texel) / 255.0f;
+        QVector3D normal = QVector3D(qRed(texel), qGreen(texel), qBlue(texel)).normalized();
+        QVector3D position(p.x() * 2 - 1, p.y() * 2 - 1, height * _heightRatio);
+        mesh.positions << position;
+        mesh.normals << normal;
+        mesh.colors << MeshShader::shade(_shaderFeatures, normal, position, height, _modelMatrix);
+    }
+    mesh.indices = _triangleIndices;
+
+    mesh.modelMatrix = _modelMatrix;
+    mesh.viewMatrix = _frameUniforms.viewMatrix();
+    // as set by resizeGL
+    mesh.projectionMatrix.perspective(30, (float)viewportSize.width() / viewportSize.height(), 0.01f, 1e5f);
+    mesh.clearColor = Qt::white;
+    return mesh;
 }
 
 void TerrainWidget::prepare() 
 {
+    PROFILE_SCOPE("TerrainWidget::prepare");
     // create grid data
-    static const int resolution = 256;
     _grids.resize(resolution * resolution);
     for (int i = 0; i < resolution; i++) {
         for (int j = 0; j < resolution; j++) {
@@ -343,31 +378,6 @@ void TerrainWidget::prepare()
             _triangleIndices << p2 << p3 << p4;
         }
     }
-
-    // load the image
-    QImage im(tr(":/images/australia.jpg"));
-    // compute the normal and height map
-    _normalHeightMap = QImage(im.width(), im.height(), QImage::Format_ARGB32);
-    for (int i = 0; i < im.width(); i++) {
-        for (int j = 0; j < im.height(); j++) {
-            float height = qGray(im.pixel(i, j)) / 255.0f * _heightRatio;
-            float adjHs[4] = { 
-                i > 0 ? (qAlpha(_normalHeightMap.pixel(i - 1, j)) / 255.0f * _heightRatio) : height,
-                j > 0 ? (qAlpha(_normalHeightMap.pixel(i, j - 1)) / 255.0f * _heightRatio) : height,
-                i < im.width() - 1 ? (qAlpha(_normalHeightMap.pixel(i + 1, j)) / 255.0f * _heightRatio) : height,
-                j < im.height() - 1 ? (qAlpha(_normalHeightMap.pixel(i, j + 1)) / 255.0f * _heightRatio) : height
-            };
-            float dxdy[][2] = { {-1.0f, 0.0f}, {0.0f, -1.0f}, {1.0f, 0.0f}, {0.0f, 1.0f} };
-            QVector3D normal;
-            for (int k = 0; k < 4; k++) {
-                QVector3D v1(dxdy[k][0], dxdy[k][1], (adjHs[k] - height) * resolution);
-                QVector3D v2(dxdy[(k + 1) % 4][0], dxdy[(k + 1) % 4][1], 
-                    (adjHs[(k + 1) % 4] - height) * resolution);
-                normal += QVector3D::crossProduct(v1, v2).normalized();
-            }
-            normal.normalize();
-            QRgb normalHeight = qRgba(normal.x() * 255, normal.y() * 255, normal.z() * 255, qGray(im.pixel(i, j)));
-            _normalHeightMap.setPixel(i, j, normalHeight);
-        }
-    }
+    MemoryTracker::set(MemoryTracker::Cpu, objectName(), "grid", memoryBytes(_grids));
+    MemoryTracker::set(MemoryTracker::Cpu, objectName(), "indices", memoryBytes(_triangleIndices));
 }
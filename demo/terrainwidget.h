@@ -2,13 +2,23 @@
 
 #include <QtOpenGL>
 
-class TerrainWidget : public QGLWidget, public QGLFunctions 
+#include "frameuniforms.h"
+#include "framescheduler.h"
+#include "glstatecache.h"
+#include "meshshader.h"
+#include "softwarescene.h"
+#include "textureloader.h"
+
+class TerrainWidget : public QGLWidget, public QGLFunctions, public SoftwareScene
 {
 
 public:
-    TerrainWidget(QWidget *parent = nullptr);
+    TerrainWidget(QWidget *parent = nullptr, const QGLWidget * shareWidget = nullptr);
     ~TerrainWidget();
 
+    // the displaced grid, shaded like the current shader variant
+    virtual SoftwareMesh softwareMesh(const QSize & viewportSize) const override;
+
 protected:
     // opengl methods
     virtual void initializeGL() override;
@@ -22,6 +32,9 @@ protected:
     virtual void mouseReleaseEvent(QMouseEvent * e) override;
     virtual void wheelEvent(QWheelEvent * e) override;
 
+    // key event handler (toggles shader features)
+    virtual void keyPressEvent(QKeyEvent * e) override;
+
     // prepare data
     void prepare();
 
@@ -39,16 +52,24 @@ private:
     // buffer for storing the _triangleIndices data on GPU
     GLuint _triangleIndicesBuffer;
 
-    // id of the OpenGL shader program
+    // the variants of the shader, the features in use and the id of the current program
+    QSharedPointer<MeshShader> _meshShader;
+    quint32 _shaderFeatures;
     GLuint _program;
+    // the matrices shared with the shader program through FrameBlock
+    FrameUniforms _frameUniforms;
     // location of uniform variables in the OpenGL shader program 
-    GLuint _modelMatrixLocation, _viewMatrixLocation, _projectionMatrixLocation, 
-        _normalHeightMapLocation, _heightRatioLocation;
+    GLuint _normalHeightMapLocation, _normalZHeightMapLocation, _heightRatioLocation;
+
+    // the normal (rgb) and height (a) map, computed from the image in the background
+    // (or read back compressed from TextureCache), the terrain is drawn once it is uploaded
+    AsyncTexture _normalHeightMap;
+
+    // the shadowed OpenGL state of this widget's context
+    GLStateCache _glState;
 
-    // texture of the height map
-    GLuint _texture;
-    // the normal height map
-    QImage _normalHeightMap;
+    // accumulates the mouse input between frames and paces the repaints
+    FrameScheduler _frameScheduler;
 
 private:
     QPointF _lastMousePos;
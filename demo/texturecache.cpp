@@ -0,0 +1,93 @@
+#include "texturecache.h"
+
+// the first bytes of an entry, "BCTX"
+static const quint32 magic = 0x42435458;
+// changed whenever the layout of an entry or the output of BlockCompressor changes
+static const quint32 version = 1;
+
+static QString & cacheDirectoryStorage()
+{
+    static QString dir =
+        QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/textures";
+    return dir;
+}
+
+QString TextureCache::cacheDirectory()
+{
+    return cacheDirectoryStorage();
+}
+
+void TextureCache::setCacheDirectory(const QString & dir)
+{
+    cacheDirectoryStorage() = dir;
+}
+
+QByteArray TextureCache::key(const QString & source, const QByteArray & recipe)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    QFile file(source);
+    if (file.open(QFile::ReadOnly)) {
+        hash.addData(&file);
+    }
+    hash.addData("\0", 1);
+    hash.addData(recipe);
+    hash.addData(QByteArray::number(version));
+    return hash.result().toHex();
+}
+
+QString TextureCache::filePath(const QString & source, const QByteArray & key)
+{
+    // resources are read only, so are some data directories
+    QFileInfo info(source);
+    if (!source.startsWith(':') && QFileInfo(info.absolutePath()).isWritable()) {
+        return info.absoluteFilePath() + "." + QString::fromLatin1(key.left(8)) + ".bctex";
+    }
+    return cacheDirectory() + "/" + QString::fromLatin1(key) + ".bctex";
+}
+
+bool TextureCache::load(const QString & source, const QByteArray & key, QVector<CompressedTexture> * textures)
+{
+    QFile file(filePath(source, key));
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    QDataStream ds(&file);
+    quint32 fileMagic, fileVersion, count;
+    ds >> fileMagic >> fileVersion >> count;
+    if (ds.status() != QDataStream::Ok || fileMagic != magic || fileVersion != version) {
+        return false;
+    }
+    QVector<CompressedTexture> result(count);
+    for (CompressedTexture & texture : result) {
+        quint32 format;
+        ds >> format >> texture.sizes >> texture.levels;
+        texture.format = format;
+        if (texture.sizes.isEmpty() || texture.sizes.size() != texture.levels.size()) {
+            return false;
+        }
+    }
+    if (ds.status() != QDataStream::Ok) {
+        return false;
+    }
+    *textures = result;
+    return true;
+}
+
+void TextureCache::save(const QString & source, const QByteArray & key, const QVector<CompressedTexture> & textures)
+{
+    QString path = filePath(source, key);
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        return;
+    }
+    // a concurrent reader sees the previous entry or the complete new one
+    QSaveFile file(path);
+    if (!file.open(QFile::WriteOnly)) {
+        return;
+    }
+    QDataStream ds(&file);
+    ds << magic << version << quint32(textures.size());
+    for (const CompressedTexture & texture : textures) {
+        ds << quint32(texture.format) << texture.sizes << texture.levels;
+    }
+    file.commit();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QtOpenGL>
+
+// a block compressed texture: its OpenGL internal format and the data of each level of its mipmap chain
+struct CompressedTexture
+{
+    GLenum format = 0;
+    QVector<QSize> sizes;
+    QVector<QByteArray> levels;
+};
+
+// the block compressed textures of the assets, saved so that later runs upload them without decoding
+// or encoding anything
+//
+// an entry is keyed by the hash of the bytes of its source file and of how the textures are made from it;
+// it is saved next to the source file, or in cacheDirectory() when the source is a Qt resource
+// or its directory is not writable
+class TextureCache
+{
+public:
+    // the key of the entry of the textures made from 'source' in the way described by 'recipe'
+    static QByteArray key(const QString & source, const QByteArray & recipe);
+
+    // the textures of an entry, false if there is none (or it is unreadable)
+    static bool load(const QString & source, const QByteArray & key, QVector<CompressedTexture> * textures);
+    static void save(const QString & source, const QByteArray & key, const QVector<CompressedTexture> & textures);
+
+    // directory where the entries of resources are stored
+    static QString cacheDirectory();
+    static void setCacheDirectory(const QString & dir);
+
+private:
+    static QString filePath(const QString & source, const QByteArray & key);
+};
@@ -0,0 +1,516 @@
+#include <atomic>
+
+#include "blockcompressor.h"
+#include "framescheduler.h"
+#include "glresourceregistry.h"
+#include "glstatecache.h"
+#include "memorytracker.h"
+#include "mipmapbuilder.h"
+#include "profiler.h"
+
+#include "textureloader.h"
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_TIMEOUT_EXPIRED
+#define GL_TIMEOUT_EXPIRED 0x911B
+#endif
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+static std::atomic<bool> synchronous(false);
+static QAtomicInteger<qint64> totalDecoded;
+static QAtomicInteger<qint64> totalDecodeNanoseconds;
+static QAtomicInteger<qint64> totalCached;
+static QAtomicInteger<qint64> totalUploadedBytes;
+static QAtomicInteger<qint64> totalSavedBytes;
+
+// decodes one asset on a worker thread
+class DecodeJob : public QRunnable
+{
+public:
+    DecodeJob(const QSharedPointer<DecodedTexture> & texture, const QString & asset,
+        TextureLoader::Compression compression, const QString & source)
+        : _texture(texture), _asset(asset), _compression(compression), _source(source)
+    {
+    }
+
+    virtual void run() override;
+
+    QSharedPointer<DecodedTexture> _texture;
+    QString _asset;
+    TextureLoader::Compression _compression;
+    QString _source;
+};
+
+// the compressed textures of the levels of an image
+static QVector<CompressedTexture> compressLevels(const QVector<QImage> & levels,
+    TextureLoader::Compression compression)
+{
+    if (levels.isEmpty()) {
+        return QVector<CompressedTexture>();
+    }
+    PROFILE_SCOPE("TextureLoader::compress");
+    // the format and first channel of each texture
+    QVector<QPair<BlockCompressor::Format, int>> textures;
+    if (compression == TextureLoader::ColorBC1) {
+        textures << qMakePair(BlockCompressor::BC1, 0);
+    } else if (compression == TextureLoader::NormalHeightBC5) {
+        textures << qMakePair(BlockCompressor::BC5, 0) << qMakePair(BlockCompressor::BC5, 2);
+    }
+
+    BlockCompressor compressor;
+    QVector<CompressedTexture> result;
+    for (const auto & texture : textures) {
+        CompressedTexture compressed;
+        compressed.format = BlockCompressor::glFormat(texture.first);
+        for (const QImage & level : levels) {
+            compressed.sizes << level.size();
+            compressed.levels << compressor.compress(level, texture.first, texture.second);
+        }
+        result << compressed;
+    }
+    return result;
+}
+
+bool DecodedTexture::isFinished() const
+{
+    QMutexLocker lock(&_mutex);
+    return _finished;
+}
+
+void DecodedTexture::wait() const
+{
+    QMutexLocker lock(&_mutex);
+    while (!_finished) {
+        _done.wait(&_mutex);
+    }
+}
+
+QImage DecodedTexture::image() const
+{
+    decodeImage();
+    QMutexLocker lock(&_mutex);
+    return _image;
+}
+
+QVector<QImage> DecodedTexture::levels() const
+{
+    decodeImage();
+    QMutexLocker lock(&_mutex);
+    return _levels;
+}
+
+QVector<CompressedTexture> DecodedTexture::compressed() const
+{
+    QMutexLocker lock(&_mutex);
+    return _compressed;
+}
+
+void DecodedTexture::decodeImage() const
+{
+    QMutexLocker decodeLock(&_decodeMutex);
+    if (_decoded) {
+        return;
+    }
+    PROFILE_SCOPE("TextureLoader::decode");
+    QElapsedTimer timer;
+    timer.start();
+
+    QImage image = _decoder();
+    if (image.isNull()) {
+        qWarning("TextureLoader: cannot read %s", qPrintable(_asset));
+    }
+    // the layout of GL_RGBA / GL_UNSIGNED_BYTE, so that the driver copies the texels without converting them
+    QVector<QImage> levels;
+    if (!image.isNull()) {
+        QImage rgba = image.convertToFormat(QImage::Format_RGBA8888).mirrored();
+        if (_mipmaps) {
+            // the images with mipmaps are color maps, stored as sRGB
+            levels = MipmapBuilder().buildRgba8(rgba, MipmapBuilder::Kaiser, true);
+        } else {
+            levels << rgba;
+        }
+    }
+
+    totalDecoded.fetchAndAddRelaxed(1);
+    totalDecodeNanoseconds.fetchAndAddRelaxed(timer.nsecsElapsed());
+    QMutexLocker lock(&_mutex);
+    _image = image;
+    _levels = levels;
+    _decoded = true;
+}
+
+TextureLoader & TextureLoader::instance()
+{
+    static TextureLoader loader;
+    return loader;
+}
+
+TextureLoader::TextureLoader()
+{
+    // leave a core to the GUI thread
+    _pool.setMaxThreadCount(qMax(QThread::idealThreadCount() - 1, 1));
+    // the decodes filter and compress on the shared pool, which must outlive their threads at exit
+    WorkStealingPool::shared();
+}
+
+QSharedPointer<DecodedTexture> TextureLoader::decode(const QString & asset, bool mipmaps, Compression compression,
+    const Decoder & decoder, const QString & source)
+{
+    QMutexLocker lock(&_mutex);
+    QSharedPointer<DecodedTexture> texture = _decodes.value(asset).toStrongRef();
+    if (texture) {
+        return texture;
+    }
+    texture.reset(new DecodedTexture);
+    texture->_asset = asset;
+    texture->_decoder = decoder ? decoder : [asset] { return QImage(asset); };
+    texture->_mipmaps = mipmaps;
+    _decodes[asset] = texture;
+    _pool.start(new DecodeJob(texture, asset, compression, source.isEmpty() ? asset : source));
+    return texture;
+}
+
+void DecodeJob::run()
+{
+    QVector<CompressedTexture> compressed;
+    if (_compression != TextureLoader::Uncompressed) {
+        // the entry depends on everything that changes the texels
+        QByteArray recipe = _asset.toUtf8() + '\0' + QByteArray::number(_compression) + '\0' +
+            QByteArray::number(_texture->_mipmaps);
+        QByteArray key = TextureCache::key(_source, recipe);
+        if (TextureCache::load(_source, key, &compressed)) {
+            totalCached.fetchAndAddRelaxed(1);
+        } else {
+            compressed = compressLevels(_texture->levels(), _compression);
+            if (!compressed.isEmpty()) {
+                TextureCache::save(_source, key, compressed);
+            }
+        }
+    } else {
+        _texture->decodeImage();
+    }
+    {
+        QMutexLocker lock(&_texture->_mutex);
+        _texture->_compressed = compressed;
+        _texture->_finished = true;
+        _texture->_done.wakeAll();
+    }
+    emit _texture->finished();
+}
+
+void TextureLoader::setSynchronous(bool enabled)
+{
+    synchronous = enabled;
+}
+
+bool TextureLoader::isSynchronous()
+{
+    return synchronous;
+}
+
+qint64 TextureLoader::decodedCount()
+{
+    return totalDecoded.load();
+}
+
+qint64 TextureLoader::decodeNanoseconds()
+{
+    return totalDecodeNanoseconds.load();
+}
+
+qint64 TextureLoader::cachedCount()
+{
+    return totalCached.load();
+}
+
+qint64 TextureLoader::uploadedBytes()
+{
+    return totalUploadedBytes.load();
+}
+
+qint64 TextureLoader::savedBytes()
+{
+    return totalSavedBytes.load();
+}
+
+void TextureLoader::countUpload(qint64 bytes, qint64 uncompressedBytes)
+{
+    totalUploadedBytes.fetchAndAddRelaxed(bytes);
+    totalSavedBytes.fetchAndAddRelaxed(uncompressedBytes - bytes);
+}
+
+AsyncTexture::AsyncTexture()
+    : _scheduler(nullptr), _initialized(false), _ready(false), _pixelBuffer(0), _uploadBytes(0), _fence(nullptr),
+      _s3tc(false),
+      _rgtc(false), _mapBufferRange(nullptr), _unmapBuffer(nullptr), _fenceSync(nullptr), _clientWaitSync(nullptr),
+      _deleteSync(nullptr)
+{
+}
+
+AsyncTexture::~AsyncTexture()
+{
+}
+
+void AsyncTexture::load(const QString & asset, FrameScheduler * scheduler, bool mipmaps,
+    TextureLoader::Compression compression, const TextureLoader::Decoder & decoder, const QString & source)
+{
+    _asset = asset;
+    _scheduler = scheduler;
+    _decoded = TextureLoader::instance().decode(asset, mipmaps, compression, decoder, source);
+    // the connection is dropped with the scheduler, even if the decode outlives the widget
+    QObject::connect(_decoded.data(), &DecodedTexture::finished, scheduler, &FrameScheduler::requestFrame,
+        Qt::QueuedConnection);
+}
+
+QImage AsyncTexture::image() const
+{
+    if (!_decoded) {
+        return QImage();
+    }
+    _decoded->wait();
+    return _decoded->image();
+}
+
+QString AsyncTexture::textureAsset(int i) const
+{
+    return i == 0 ? _asset : _asset + ":" + QString::number(i);
+}
+
+bool AsyncTexture::supportsFormat(GLenum format) const
+{
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? _s3tc : _rgtc;
+}
+
+GLuint AsyncTexture::update(const QGLContext * context, GLStateCache & state)
+{
+    if (_ready || !_decoded) {
+        return texture(0);
+    }
+    if (!_initialized) {
+        initializeGLFunctions(context);
+        QOpenGLContext * glContext = context->contextHandle();
+        _mapBufferRange = reinterpret_cast<MapBufferRange>(glContext->getProcAddress("glMapBufferRange"));
+        _unmapBuffer = reinterpret_cast<UnmapBuffer>(glContext->getProcAddress("glUnmapBuffer"));
+        // fences are core since OpenGL 3.2
+        if (glContext->format().version() >= qMakePair(3, 2) || glContext->hasExtension("GL_ARB_sync")) {
+            _fenceSync = reinterpret_cast<FenceSync>(glContext->getProcAddress("glFenceSync"));
+            _clientWaitSync = reinterpret_cast<ClientWaitSync>(glContext->getProcAddress("glClientWaitSync"));
+            _deleteSync = reinterpret_cast<DeleteSync>(glContext->getProcAddress("glDeleteSync"));
+        }
+        // BC1 is an extension everywhere, BC4 and BC5 (RGTC) are core since OpenGL 3.0
+        _s3tc = glContext->hasExtension("GL_EXT_texture_compression_s3tc");
+        _rgtc = glContext->format().version() >= qMakePair(3, 0) ||
+            glContext->hasExtension("GL_ARB_texture_compression_rgtc") ||
+            glContext->hasExtension("GL_EXT_texture_compression_rgtc");
+        _initialized = true;
+    }
+
+    if (_textures.isEmpty()) {
+        // another widget of the share group may have uploaded it already
+        GLResourceRegistry & resources = GLResourceRegistry::instance();
+        while (GLuint shared = resources.acquire(GLResourceRegistry::Texture, textureAsset(_textures.size()))) {
+            _textures << shared;
+        }
+        if (!_textures.isEmpty()) {
+            _ready = true;
+            return texture(0);
+        }
+        if (TextureLoader::isSynchronous()) {
+            _decoded->wait();
+        } else if (!_decoded->isFinished()) {
+            return 0;
+        }
+        startUpload(state);
+        if (_textures.isEmpty()) {
+            // not readable, there will never be a texture
+            _ready = true;
+            return 0;
+        }
+    }
+
+    // the upload is done when the fence has signaled, without a fence the first draw waits for it
+    if (_fence && !TextureLoader::isSynchronous() &&
+        _clientWaitSync(_fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        requestFrame();
+        return 0;
+    }
+    finishUpload();
+    return texture(0);
+}
+
+void AsyncTexture::startUpload(GLStateCache & state)
+{
+    PROFILE_SCOPE("AsyncTexture::startUpload");
+    QVector<CompressedTexture> compressed = _decoded->compressed();
+    for (const CompressedTexture & texture : compressed) {
+        if (!supportsFormat(texture.format)) {
+            compressed.clear();
+            break;
+        }
+    }
+    // without support for the compressed formats, upload the levels (decoded now if they came from the cache)
+    QVector<QImage> levels;
+    if (compressed.isEmpty()) {
+        levels = _decoded->levels();
+        if (levels.isEmpty()) {
+            return;
+        }
+    }
+
+    // the data of each level of each texture, in the order of the pixel buffer
+    QVector<QPair<const void *, qint64>> data;
+    for (const CompressedTexture & texture : compressed) {
+        for (const QByteArray & level : texture.levels) {
+            data << qMakePair(static_cast<const void *>(level.constData()), qint64(level.size()));
+        }
+    }
+    for (const QImage & level : levels) {
+        data << qMakePair(static_cast<const void *>(level.constBits()), qint64(level.byteCount()));
+    }
+    QVector<qint64> offsets;
+    qint64 bytes = 0;
+    for (const auto & level : data) {
+        offsets << bytes;
+        bytes += level.second;
+    }
+
+    // copy the levels into a pixel buffer object, the texture is then filled from it by the GPU,
+    // so glTexImage2D returns without converting or copying the texels on this thread
+    glGenBuffers(1, &_pixelBuffer);
+    state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, _pixelBuffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+    uchar * mapping = _mapBufferRange && _unmapBuffer ? static_cast<uchar *>(_mapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT)) : nullptr;
+    for (int i = 0; i < data.size(); i++) {
+        if (mapping) {
+            memcpy(mapping + offsets[i], data[i].first, data[i].second);
+        } else {
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, offsets[i], data[i].second, data[i].first);
+        }
+    }
+    if (mapping) {
+        _unmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    int levelCount = compressed.isEmpty() ? levels.size() : compressed.first().levels.size();
+    int textureCount = compressed.isEmpty() ? 1 : compressed.size();
+    qint64 uncompressedBytes = 0;
+    for (int t = 0, i = 0; t < textureCount; t++) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        state.bindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        qint64 textureBytes = 0;
+        for (int level = 0; level < levelCount; level++, i++) {
+            if (compressed.isEmpty()) {
+                glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, levels[level].width(), levels[level].height(), 0,
+                    GL_RGBA, GL_UNSIGNED_BYTE, (void*)(qintptr)offsets[i]);
+                uncompressedBytes += data[i].second;
+            } else {
+                // the blocks are copied as they are
+                const CompressedTexture & source = compressed[t];
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, source.format, source.sizes[level].width(),
+                    source.sizes[level].height(), 0, data[i].second, (void*)(qintptr)offsets[i]);
+                uncompressedBytes += qint64(source.sizes[level].width()) * source.sizes[level].height() * 4;
+            }
+            textureBytes += data[i].second;
+        }
+        _textures << texture;
+        _textureBytes << textureBytes;
+    }
+    if (!compressed.isEmpty()) {
+        // all the compressed textures hold the texels of one RGBA8888 texture
+        uncompressedBytes /= textureCount;
+    }
+    // QGLWidget::bindTexture and the other pixel transfers expect client memory
+    state.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (_fenceSync) {
+        _fence = _fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    TextureLoader::countUpload(bytes, uncompressedBytes);
+
+    // the textures are accounted for by GLResourceRegistry once complete
+    _memoryOwner = MemoryTracker::contextOwner();
+    _uploadBytes = 2 * bytes;
+    MemoryTracker::add(MemoryTracker::Gpu, _memoryOwner, _asset + " (uploading)", _uploadBytes);
+}
+
+void AsyncTexture::finishUpload()
+{
+    if (_fence) {
+        _deleteSync(_fence);
+        _fence = nullptr;
+    }
+    glDeleteBuffers(1, &_pixelBuffer);
+    _pixelBuffer = 0;
+    MemoryTracker::add(MemoryTracker::Gpu, _memoryOwner, _asset + " (uploading)", -_uploadBytes);
+    _uploadBytes = 0;
+
+    // keep the textures of the widget that finished first, in one step so that no other widget registers
+    // its textures in between
+    QStringList assets;
+    for (int i = 0; i < _textures.size(); i++) {
+        assets << textureAsset(i);
+    }
+    QVector<GLuint> stored = GLResourceRegistry::instance().acquireOrInsert(GLResourceRegistry::Texture, assets,
+        _textures, _textureBytes);
+    for (int i = 0; i < _textures.size(); i++) {
+        if (stored[i] != _textures[i]) {
+            glDeleteTextures(1, &_textures[i]);
+        }
+    }
+    _textures = stored;
+    _ready = true;
+}
+
+void AsyncTexture::requestFrame()
+{
+    // update() may run on a render thread, the scheduler belongs to the GUI thread
+    QMetaObject::invokeMethod(_scheduler, "requestFrame", Qt::QueuedConnection);
+}
+
+void AsyncTexture::release()
+{
+    if (_textures.isEmpty()) {
+        return;
+    }
+    if (_ready) {
+        for (int i = 0; i < _textures.size(); i++) {
+            GLResourceRegistry::instance().release(GLResourceRegistry::Texture, textureAsset(i));
+        }
+    } else {
+        // the upload is still in flight
+        if (_fence) {
+            _deleteSync(_fence);
+            _fence = nullptr;
+        }
+        glDeleteBuffers(1, &_pixelBuffer);
+        glDeleteTextures(_textures.size(), _textures.constData());
+        _pixelBuffer = 0;
+        MemoryTracker::add(MemoryTracker::Gpu, _memoryOwner, _asset + " (uploading)", -_uploadBytes);
+        _uploadBytes = 0;
+    }
+    _textures.clear();
+    _textureBytes.clear();
+    _ready = false;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <functional>
+
+#include <QtOpenGL>
+
+#include "texturecache.h"
+
+class FrameScheduler;
+class GLStateCache;
+
+// the decoded image of a texture asset, its mipmap levels and its block compressed textures,
+// produced by a worker thread of TextureLoader
+class DecodedTexture : public QObject
+{
+    Q_OBJECT
+
+public:
+    // whether the worker thread is done (the image may still be null if the asset could not be read)
+    bool isFinished() const;
+    // block until the worker thread is done
+    void wait() const;
+
+    // the decoded image, as returned by the decode function
+    // (decoded by the calling thread if the compressed textures were read from TextureCache)
+    QImage image() const;
+    // the levels to upload: RGBA8888, flipped vertically like QGLWidget::bindTexture does,
+    // the first one is the full image and the others (if any) its mipmaps down to 1x1
+    // (decoded by the calling thread like image())
+    QVector<QImage> levels() const;
+    // the block compressed textures made of the levels, empty if the asset is not compressed
+    QVector<CompressedTexture> compressed() const;
+
+signals:
+    // emitted by the worker thread when it is done
+    void finished();
+
+private:
+    friend class DecodeJob;
+    friend class TextureLoader;
+
+    // decode the image and build its levels, unless done already
+    void decodeImage() const;
+
+    QString _asset;
+    std::function<QImage()> _decoder;
+    bool _mipmaps = false;
+
+    mutable QMutex _mutex;
+    mutable QWaitCondition _done;
+    bool _finished = false;
+    mutable QImage _image;
+    mutable QVector<QImage> _levels;
+    QVector<CompressedTexture> _compressed;
+
+    // held while decoding, so that the image is decoded once
+    mutable QMutex _decodeMutex;
+    mutable bool _decoded = false;
+};
+
+// decodes the images of textures (JPEG, PNG... or computed ones) on a pool of worker threads,
+// so that the widgets never wait for them on the GUI thread
+// an asset requested while its decode is still referenced is only decoded once
+class TextureLoader
+{
+public:
+    // returns the image of the asset, which is QImage(asset) unless set otherwise
+    typedef std::function<QImage()> Decoder;
+
+    // the block compressed textures made of the levels by BlockCompressor
+    enum Compression {
+        Uncompressed,
+        // one BC1 texture of the rgb channels, for color maps
+        ColorBC1,
+        // two BC5 textures, of the red and green channels then of the blue and alpha channels:
+        // the normal (rgb) and height (a) of a height map
+        NormalHeightBC5
+    };
+
+    static TextureLoader & instance();
+
+    // start decoding the asset, or return the decode in flight for it
+    // mipmaps are built by MipmapBuilder, as sRGB colors with its Kaiser filter
+    // compressed textures are read from TextureCache when they were saved by a previous run, the entry
+    // is keyed by the bytes of 'source' (the asset by default), which must be the only input of the decoder
+    QSharedPointer<DecodedTexture> decode(const QString & asset, bool mipmaps, Compression compression = Uncompressed,
+        const Decoder & decoder = Decoder(), const QString & source = QString());
+
+    // make AsyncTexture wait for the decode and the upload instead of returning 0 (offscreen rendering, benchmarks)
+    static void setSynchronous(bool synchronous);
+    static bool isSynchronous();
+
+    // statistics
+    static qint64 decodedCount();
+    static qint64 decodeNanoseconds(); // summed over the worker threads
+    static qint64 cachedCount(); // compressed textures read from TextureCache instead
+    static qint64 uploadedBytes();
+    static qint64 savedBytes(); // by block compression, compared to the RGBA8888 levels
+
+private:
+    TextureLoader();
+    friend class AsyncTexture;
+    friend class DecodeJob;
+    static void countUpload(qint64 bytes, qint64 uncompressedBytes);
+
+    QMutex _mutex;
+    QHash<QString, QWeakPointer<DecodedTexture>> _decodes;
+    QThreadPool _pool;
+};
+
+// the texture of an asset, as seen by one widget
+// its image is decoded by TextureLoader, then the widget uploads it from paintGL through a pixel buffer object
+// and uses it once the fence put after the upload has signaled; the texture object is shared with the other
+// widgets of the share group through GLResourceRegistry
+// compressed assets are uploaded as their block compressed textures when the context supports their formats
+// (one texture object per compressed texture), and as the RGBA8888 levels otherwise
+class AsyncTexture : protected QGLFunctions
+{
+public:
+    AsyncTexture();
+    ~AsyncTexture();
+
+    // start decoding the asset (with mipmaps if the texture is minified), the scheduler of the widget
+    // is asked for a frame whenever the texture makes progress
+    void load(const QString & asset, FrameScheduler * scheduler, bool mipmaps,
+        TextureLoader::Compression compression = TextureLoader::Uncompressed,
+        const TextureLoader::Decoder & decoder = TextureLoader::Decoder(), const QString & source = QString());
+
+    // with the context of the widget current, advance the upload and return the (first) texture,
+    // or 0 while it is not available yet; the texture may be left bound to GL_TEXTURE_2D
+    GLuint update(const QGLContext * context, GLStateCache & state);
+
+    // once update() returned a texture: the number of texture objects (the compressed textures,
+    // or 1 for the RGBA8888 levels), and each of them
+    int textureCount() const { return _textures.size(); }
+    GLuint texture(int i) const { return _textures.value(i); }
+
+    // the decoded image, waiting for the worker thread if needed
+    QImage image() const;
+
+    // whether the widget holds OpenGL objects, which release() deletes with its context current
+    bool hasObjects() const { return !_textures.isEmpty(); }
+    void release();
+
+private:
+    // the name of a texture object in GLResourceRegistry
+    QString textureAsset(int i) const;
+    bool supportsFormat(GLenum format) const;
+
+    void startUpload(GLStateCache & state);
+    void finishUpload();
+    void requestFrame();
+
+    typedef void * (QOPENGLF_APIENTRYP MapBufferRange)(GLenum target, GLintptr offset, GLsizeiptr length,
+        GLbitfield access);
+    typedef GLboolean (QOPENGLF_APIENTRYP UnmapBuffer)(GLenum target);
+    typedef GLsync (QOPENGLF_APIENTRYP FenceSync)(GLenum condition, GLbitfield flags);
+    typedef GLenum (QOPENGLF_APIENTRYP ClientWaitSync)(GLsync sync, GLbitfield flags, GLuint64 timeout);
+    typedef void (QOPENGLF_APIENTRYP DeleteSync)(GLsync sync);
+
+private:
+    QString _asset;
+    FrameScheduler * _scheduler;
+    QSharedPointer<DecodedTexture> _decoded;
+
+    bool _initialized;
+    bool _ready; // _textures are complete and registered
+    QVector<GLuint> _textures;
+    QVector<qint64> _textureBytes;
+    GLuint _pixelBuffer; // the staging buffer of the upload in flight
+    // the owner of the upload in flight in MemoryTracker, and its bytes (the staging buffer and the textures)
+    QString _memoryOwner;
+    qint64 _uploadBytes;
+    GLsync _fence;
+    bool _s3tc, _rgtc; // the compressed formats of the context
+
+    MapBufferRange _mapBufferRange;
+    UnmapBuffer _unmapBuffer;
+    FenceSync _fenceSync;
+    ClientWaitSync _clientWaitSync;
+    DeleteSync _deleteSync;
+};
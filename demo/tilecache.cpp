@@ -0,0 +1,303 @@
+#include <algorithm>
+
+#include "framescheduler.h"
+#include "glstatecache.h"
+#include "memorytracker.h"
+#include "profiler.h"
+#include "textureloader.h"
+
+#include "tilecache.h"
+
+#ifndef GL_TEXTURE_2D_ARRAY
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#endif
+
+// the tiles uploaded by a frame at most, so that a burst of decoded tiles does not stall it
+static const int uploadsPerFrame = 8;
+
+static QAtomicInteger<qint64> loadedTiles;
+static QAtomicInteger<qint64> latencyNanoseconds;
+static QAtomicInteger<qint64> cpuBytesTotal;
+static QAtomicInteger<qint64> gpuBytesTotal;
+
+// decodes one tile on a worker thread
+class TileJob : public QRunnable
+{
+public:
+    TileJob(TileCache * cache, const TileId & tile) : _cache(cache), _tile(tile) {}
+
+    virtual void run() override
+    {
+        PROFILE_SCOPE("TileCache::decode");
+        QImage image = _cache->_source->tile(_tile);
+        // the layout of the layers, flipped like the other textures
+        if (!image.isNull()) {
+            image = image.convertToFormat(QImage::Format_RGBA8888).mirrored();
+        }
+        _cache->finishJob(_tile, image);
+    }
+
+private:
+    TileCache * _cache;
+    TileId _tile;
+};
+
+TileCache::TileCache()
+    : _scheduler(nullptr), _layerCount(0), _state(nullptr), _texture(0), _texImage3D(nullptr),
+      _texSubImage3D(nullptr), _frame(0), _uploads(0), _needsFrame(false), _reportedCpuBytes(0)
+{
+    _clock.start();
+}
+
+TileCache::~TileCache()
+{
+    // the jobs in flight call back this cache
+    _pool.clear();
+    _pool.waitForDone();
+    cpuBytesTotal.fetchAndAddRelaxed(-_reportedCpuBytes);
+    if (!_memoryOwner.isEmpty()) {
+        MemoryTracker::set(MemoryTracker::Cpu, _memoryOwner, "decoded tiles", 0);
+    }
+}
+
+void TileCache::setSource(const QSharedPointer<TileSource> & source, FrameScheduler * scheduler, int layerCount,
+    qint64 cpuBytes)
+{
+    _source = source;
+    _scheduler = scheduler;
+    _layerCount = layerCount;
+    _decoded.setMaxCost(int(qMin(cpuBytes, qint64(INT_MAX))));
+    // the sources block on files or sockets more than on the CPU
+    _pool.setMaxThreadCount(qMax(QThread::idealThreadCount() / 2, 2));
+}
+
+bool TileCache::initialize(const QGLContext * context, GLStateCache & state)
+{
+    _state = &state;
+    initializeGLFunctions(context);
+
+    QOpenGLContext * glContext = context->contextHandle();
+    // texture arrays are core since OpenGL 3.0
+    if (!_source || glContext->isOpenGLES() ||
+        (glContext->format().version() < qMakePair(3, 0) && !glContext->hasExtension("GL_EXT_texture_array"))) {
+        return false;
+    }
+    _texImage3D = reinterpret_cast<TexImage3D>(glContext->getProcAddress("glTexImage3D"));
+    _texSubImage3D = reinterpret_cast<TexSubImage3D>(glContext->getProcAddress("glTexSubImage3D"));
+    if (!_texImage3D || !_texSubImage3D) {
+        return false;
+    }
+
+    glGenTextures(1, &_texture);
+    state.bindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+    // the tiles are drawn at about one texel per pixel, they have no mipmaps
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    _texImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, TileSource::TileSize, TileSource::TileSize, _layerCount, 0,
+        GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    _layers.clear();
+    _layerTiles.clear();
+    _layerFrames.clear();
+    gpuBytesTotal.fetchAndAddRelaxed(gpuBytes());
+    _memoryOwner = MemoryTracker::contextOwner();
+    MemoryTracker::add(MemoryTracker::Gpu, _memoryOwner, "tiles", gpuBytes());
+    return true;
+}
+
+void TileCache::release()
+{
+    if (_texture == 0) {
+        return;
+    }
+    glDeleteTextures(1, &_texture);
+    _texture = 0;
+    _layers.clear();
+    _layerTiles.clear();
+    _layerFrames.clear();
+    gpuBytesTotal.fetchAndAddRelaxed(-gpuBytes());
+    MemoryTracker::add(MemoryTracker::Gpu, _memoryOwner, "tiles", -gpuBytes());
+}
+
+void TileCache::beginFrame()
+{
+    _frame++;
+    _uploads = 0;
+    _needsFrame = false;
+    _requests.clear();
+    _requested.clear();
+
+    QVector<QPair<TileId, QImage>> finished;
+    {
+        QMutexLocker lock(&_finishedMutex);
+        finished.swap(_finished);
+    }
+    for (const auto & tile : finished) {
+        _inFlight.remove(tile.first);
+        if (tile.second.isNull()) {
+            _missing.insert(tile.first);
+            _requestTimes.remove(tile.first);
+        } else {
+            _decoded.insert(tile.first, new QImage(tile.second), tile.second.byteCount());
+        }
+    }
+}
+
+int TileCache::lookup(const TileId & tile, QRectF * area)
+{
+    // the tile, or its nearest ancestor that can be drawn
+    int layer = -1;
+    TileId found = tile;
+    for (;;) {
+        auto it = _layers.constFind(found);
+        if (it != _layers.constEnd()) {
+            layer = it.value();
+            _layerFrames[layer] = _frame;
+            break;
+        }
+        if (!_missing.contains(found)) {
+            if (TextureLoader::isSynchronous() && !_decoded.contains(found)) {
+                // offscreen frames are rendered with all their tiles
+                QImage image = _source->tile(found);
+                if (image.isNull()) {
+                    _missing.insert(found);
+                } else {
+                    image = image.convertToFormat(QImage::Format_RGBA8888).mirrored();
+                    _decoded.insert(found, new QImage(image), image.byteCount());
+                }
+            }
+            QImage * image = _decoded.object(found);
+            if (image) {
+                layer = upload(found, *image);
+                if (layer >= 0) {
+                    break;
+                }
+            } else if (!_missing.contains(found)) {
+                request(found);
+            }
+        }
+        if (found.zoom == 0) {
+            return -1;
+        }
+        found = found.parent();
+    }
+
+    // the area of the tile in the layer of its ancestor, in texture coordinates of the flipped layer
+    QRectF rect = tile.rect(), ancestor = found.rect();
+    double scale = 1.0 / ancestor.width();
+    *area = QRectF((rect.left() - ancestor.left()) * scale, (rect.top() - ancestor.top()) * scale,
+        rect.width() * scale, rect.height() * scale);
+    return layer;
+}
+
+int TileCache::upload(const TileId & tile, const QImage & image)
+{
+    if (_uploads >= uploadsPerFrame && !TextureLoader::isSynchronous()) {
+        _needsFrame = true;
+        return -1;
+    }
+    // a free layer, or the one drawn the longest ago (but not by this frame)
+    int layer = _layerTiles.size();
+    if (layer >= _layerCount) {
+        layer = -1;
+        for (int i = 0; i < _layerCount; i++) {
+            if (_layerFrames[i] < _frame && (layer < 0 || _layerFrames[i] < _layerFrames[layer])) {
+                layer = i;
+            }
+        }
+        if (layer < 0) {
+            return -1;
+        }
+        _layers.remove(_layerTiles[layer]);
+        _layerTiles[layer] = tile;
+        _layerFrames[layer] = _frame;
+    } else {
+        _layerTiles << tile;
+        _layerFrames << _frame;
+    }
+    _layers.insert(tile, layer);
+
+    PROFILE_SCOPE("TileCache::upload");
+    _state->bindTexture(GL_TEXTURE_2D_ARRAY, _texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    _texSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, TileSource::TileSize, TileSource::TileSize, 1,
+        GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+    _uploads++;
+
+    loadedTiles.fetchAndAddRelaxed(1);
+    if (_requestTimes.contains(tile)) {
+        latencyNanoseconds.fetchAndAddRelaxed(_clock.nsecsElapsed() - _requestTimes.take(tile));
+    }
+    return layer;
+}
+
+void TileCache::request(const TileId & tile)
+{
+    if (_inFlight.contains(tile) || _requested.contains(tile)) {
+        return;
+    }
+    _requested.insert(tile);
+    _requests << tile;
+    if (!_requestTimes.contains(tile)) {
+        _requestTimes.insert(tile, _clock.nsecsElapsed());
+    }
+}
+
+void TileCache::endFrame()
+{
+    // the coarsest tiles first, they stand in for the most tiles; the requests that do not fit
+    // are dropped, the next frames request them again if they are still wanted
+    std::stable_sort(_requests.begin(), _requests.end(), [](const TileId & a, const TileId & b) {
+        return a.zoom < b.zoom;
+    });
+    int maxInFlight = 2 * _pool.maxThreadCount();
+    for (const TileId & tile : _requests) {
+        if (_inFlight.size() >= maxInFlight) {
+            _needsFrame = true;
+            break;
+        }
+        _inFlight.insert(tile);
+        _pool.start(new TileJob(this, tile));
+    }
+
+    qint64 bytes = _decoded.totalCost();
+    cpuBytesTotal.fetchAndAddRelaxed(bytes - _reportedCpuBytes);
+    _reportedCpuBytes = bytes;
+    MemoryTracker::set(MemoryTracker::Cpu, _memoryOwner, "decoded tiles", bytes);
+
+    if (_needsFrame) {
+        QMetaObject::invokeMethod(_scheduler, "requestFrame", Qt::QueuedConnection);
+    }
+}
+
+void TileCache::finishJob(const TileId & tile, const QImage & image)
+{
+    {
+        QMutexLocker lock(&_finishedMutex);
+        _finished << qMakePair(tile, image);
+    }
+    // the scheduler belongs to the GUI thread
+    QMetaObject::invokeMethod(_scheduler, "requestFrame", Qt::QueuedConnection);
+}
+
+qint64 TileCache::totalLoadedTiles()
+{
+    return loadedTiles.load();
+}
+
+qint64 TileCache::totalLatencyNanoseconds()
+{
+    return latencyNanoseconds.load();
+}
+
+qint64 TileCache::totalCpuBytes()
+{
+    return cpuBytesTotal.load();
+}
+
+qint64 TileCache::totalGpuBytes()
+{
+    return gpuBytesTotal.load();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <QtOpenGL>
+
+#include "tilesource.h"
+
+class FrameScheduler;
+class GLStateCache;
+
+// streams the tiles of a TileSource into the layers of a GL_TEXTURE_2D_ARRAY
+//
+// each frame a widget calls beginFrame(), then lookup() for every tile it wants to draw, then endFrame():
+// a tile that is not in the array yet is drawn with the layer of its nearest ancestor in the array, and is
+// decoded by a worker thread (the coarsest requests first), kept in a CPU cache of decoded tiles bounded
+// in bytes and least recently used first out, then uploaded to the layer least recently drawn
+// the tiles the source does not have are remembered, and their ancestors drawn instead for good
+class TileCache : protected QGLFunctions
+{
+public:
+    TileCache();
+    ~TileCache();
+
+    // set the source and the budgets, before initialize(); the scheduler is asked for a frame
+    // whenever a tile is decoded
+    void setSource(const QSharedPointer<TileSource> & source, FrameScheduler * scheduler, int layerCount = 128,
+        qint64 cpuBytes = 64 << 20);
+    const QSharedPointer<TileSource> & source() const { return _source; }
+
+    // create the texture array in the current context, returns false without texture arrays (OpenGL 3.0)
+    bool initialize(const QGLContext * context, GLStateCache & state);
+    // delete the texture array, the owning context must be current
+    void release();
+
+    bool isInitialized() const { return _texture != 0; }
+    GLuint textureId() const { return _texture; }
+
+    void beginFrame();
+    // the layer to draw a tile with and the area of the tile in it (the whole layer or a part of an ancestor),
+    // or -1 if no ancestor is in the array yet; the texture array may be left bound to GL_TEXTURE_2D_ARRAY
+    int lookup(const TileId & tile, QRectF * area);
+    // start decoding the tiles requested by this frame
+    void endFrame();
+
+    // statistics of this cache
+    int residentTiles() const { return _layers.size(); }
+    qint64 cpuBytes() const { return _decoded.totalCost(); }
+    qint64 gpuBytes() const { return qint64(_layerCount) * TileSource::TileSize * TileSource::TileSize * 4; }
+
+    // totals of all the caches
+    static qint64 totalLoadedTiles();
+    static qint64 totalLatencyNanoseconds(); // from the first request of a tile to its upload
+    static qint64 totalCpuBytes();
+    static qint64 totalGpuBytes();
+
+private:
+    friend class TileJob;
+
+    // upload a decoded tile to the least recently drawn layer, returns the layer or -1 if all are in use
+    // or this frame uploaded enough already
+    int upload(const TileId & tile, const QImage & image);
+    void request(const TileId & tile);
+    // called by the worker threads
+    void finishJob(const TileId & tile, const QImage & image);
+
+    typedef void (QOPENGLF_APIENTRYP TexImage3D)(GLenum target, GLint level, GLint internalformat,
+        GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void * pixels);
+    typedef void (QOPENGLF_APIENTRYP TexSubImage3D)(GLenum target, GLint level, GLint xoffset, GLint yoffset,
+        GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void * pixels);
+
+private:
+    QSharedPointer<TileSource> _source;
+    FrameScheduler * _scheduler;
+    int _layerCount;
+
+    GLStateCache * _state;
+    GLuint _texture;
+    TexImage3D _texImage3D;
+    TexSubImage3D _texSubImage3D;
+
+    // the tiles in the array: their layer, and the frame each layer was last drawn
+    QHash<TileId, int> _layers;
+    QVector<TileId> _layerTiles;
+    QVector<qint64> _layerFrames;
+    qint64 _frame;
+    int _uploads; // during this frame
+
+    // the decoded tiles, the cost is their size in bytes
+    QCache<TileId, QImage> _decoded;
+    QSet<TileId> _missing;
+    // the tiles wanted by this frame and not decoded yet, the first request time of the ones not finished
+    QVector<TileId> _requests;
+    QHash<TileId, qint64> _requestTimes;
+    QSet<TileId> _requested, _inFlight;
+    QElapsedTimer _clock;
+    bool _needsFrame;
+    qint64 _reportedCpuBytes;
+    QString _memoryOwner; // in MemoryTracker
+
+    // the tiles decoded by the worker threads since the last frame
+    QMutex _finishedMutex;
+    QVector<QPair<TileId, QImage>> _finished;
+    QThreadPool _pool;
+};
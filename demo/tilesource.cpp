@@ -0,0 +1,162 @@
+#include <QtNetwork>
+
+#include "tilesource.h"
+
+// how long a tile server may take to connect and to answer
+static const int httpTimeout = 5000;
+
+static QString & defaultLocationStorage()
+{
+    static QString location = ":/images/earthmap.jpg";
+    return location;
+}
+
+// the path or URL of a tile
+static QString expand(const QString & pathTemplate, const TileId & tile)
+{
+    QString path = pathTemplate;
+    path.replace("{z}", QString::number(tile.zoom));
+    path.replace("{x}", QString::number(tile.x));
+    path.replace("{y}", QString::number(tile.y));
+    return path;
+}
+
+static QImage toTileSize(const QImage & image)
+{
+    if (image.isNull() || image.size() == QSize(TileSource::TileSize, TileSource::TileSize)) {
+        return image;
+    }
+    return image.scaled(TileSource::TileSize, TileSource::TileSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+QRectF TileId::rect() const
+{
+    double w = 1.0 / columns(zoom), h = 1.0 / rows(zoom);
+    return QRectF(x * w, y * h, w, h);
+}
+
+TileSource::~TileSource()
+{
+}
+
+QString TileSource::defaultLocation()
+{
+    return defaultLocationStorage();
+}
+
+void TileSource::setDefaultLocation(const QString & location)
+{
+    defaultLocationStorage() = location;
+}
+
+QSharedPointer<TileSource> TileSource::create(const QString & location)
+{
+    if (location.startsWith("http://")) {
+        // the depth of a server is unknown, the tiles past it are missing and their parents are drawn instead
+        QString urlTemplate = location.contains("{z}") ? location : location + "/{z}/{x}/{y}.png";
+        return QSharedPointer<TileSource>(new HttpTileSource(urlTemplate, 18));
+    }
+    if (location.contains("{z}")) {
+        QString directory = location.left(location.indexOf("{z}"));
+        return QSharedPointer<TileSource>(new FileTileSource(location, FileTileSource::deepestZoom(directory)));
+    }
+    if (QFileInfo(location).isDir()) {
+        // the format of the first tile
+        QFileInfoList tiles = QDir(location + "/0/0").entryInfoList(QDir::Files);
+        QString suffix = tiles.isEmpty() ? QString("jpg") : tiles.first().suffix();
+        return QSharedPointer<TileSource>(new FileTileSource(location + "/{z}/{x}/{y}." + suffix,
+            FileTileSource::deepestZoom(location)));
+    }
+    return QSharedPointer<TileSource>(new ImageTileSource(location));
+}
+
+FileTileSource::FileTileSource(const QString & pathTemplate, int maxZoom)
+    : _template(pathTemplate), _maxZoom(maxZoom)
+{
+}
+
+int FileTileSource::deepestZoom(const QString & directory)
+{
+    int zoom = 0;
+    for (const QString & name : QDir(directory).entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        bool number = false;
+        int z = name.toInt(&number);
+        if (number) {
+            zoom = qMax(zoom, z);
+        }
+    }
+    return zoom;
+}
+
+QImage FileTileSource::tile(const TileId & tile)
+{
+    return toTileSize(QImage(expand(_template, tile)));
+}
+
+HttpTileSource::HttpTileSource(const QString & urlTemplate, int maxZoom)
+    : _template(urlTemplate), _maxZoom(maxZoom)
+{
+}
+
+QImage HttpTileSource::tile(const TileId & tile)
+{
+    QUrl url(expand(_template, tile));
+    QTcpSocket socket;
+    socket.connectToHost(url.host(), url.port(80));
+    if (!socket.waitForConnected(httpTimeout)) {
+        qWarning("HttpTileSource: cannot connect to %s", qPrintable(url.authority()));
+        return QImage();
+    }
+    socket.write("GET " + url.path(QUrl::FullyEncoded).toLatin1() + " HTTP/1.0\r\n"
+        "Host: " + url.authority().toLatin1() + "\r\n\r\n");
+
+    // HTTP/1.0 closes the connection after the response
+    QByteArray response;
+    while (socket.waitForReadyRead(httpTimeout)) {
+        response += socket.readAll();
+    }
+    response += socket.readAll();
+
+    // "HTTP/1.x 200 ...", the headers, an empty line and the image
+    int body = response.indexOf("\r\n\r\n");
+    if (!response.startsWith("HTTP/1.") || response.mid(9, 3) != "200" || body < 0) {
+        return QImage();
+    }
+    return toTileSize(QImage::fromData(response.mid(body + 4)));
+}
+
+ImageTileSource::ImageTileSource(const QString & imagePath)
+    : _path(imagePath), _size(QImageReader(imagePath).size()), _decoded(false)
+{
+}
+
+int ImageTileSource::maxZoom() const
+{
+    int zoom = 0;
+    while (_size.width() / TileId::columns(zoom + 1) >= TileSize) {
+        zoom++;
+    }
+    return zoom;
+}
+
+const QImage & ImageTileSource::image()
+{
+    QMutexLocker lock(&_mutex);
+    if (!_decoded) {
+        _image = QImage(_path);
+        _decoded = true;
+    }
+    return _image;
+}
+
+QImage ImageTileSource::tile(const TileId & tile)
+{
+    const QImage & source = image();
+    if (source.isNull()) {
+        return QImage();
+    }
+    QRectF r = tile.rect();
+    QRect pixels(QPoint(qRound(r.left() * source.width()), qRound(r.top() * source.height())),
+        QPoint(qRound(r.right() * source.width()) - 1, qRound(r.bottom() * source.height()) - 1));
+    return toTileSize(source.copy(pixels));
+}
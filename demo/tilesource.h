@@ -0,0 +1,114 @@
+#pragma once
+
+#include <QtGui>
+
+// a tile of an equirectangular pyramid of the Earth (plate carree, like earthmap.jpg):
+// zoom 0 is 2 tiles of 180 x 180 degrees, each zoom splits a tile in 2 x 2,
+// x grows eastwards from the date line and y southwards from the north pole ("z/x/y" like slippy maps)
+struct TileId
+{
+    int zoom = 0, x = 0, y = 0;
+
+    TileId() {}
+    TileId(int z, int tx, int ty) : zoom(z), x(tx), y(ty) {}
+
+    static int columns(int zoom) { return 2 << zoom; }
+    static int rows(int zoom) { return 1 << zoom; }
+
+    TileId parent() const { return TileId(zoom - 1, x / 2, y / 2); }
+    // the children 0 to 3, row by row
+    TileId child(int i) const { return TileId(zoom + 1, 2 * x + (i & 1), 2 * y + (i >> 1)); }
+
+    // the area of the tile in the whole image, in [0, 1] from its top left corner
+    QRectF rect() const;
+
+    bool operator==(const TileId & other) const { return zoom == other.zoom && x == other.x && y == other.y; }
+    bool operator!=(const TileId & other) const { return !(*this == other); }
+};
+
+inline uint qHash(const TileId & tile, uint seed = 0)
+{
+    return ::qHash((quint64(tile.zoom) << 48) | (quint64(tile.x) << 24) | quint64(tile.y), seed);
+}
+
+// where the tiles come from; tile() is called by worker threads and may block
+class TileSource
+{
+public:
+    // the width and height of the tiles, the images of other sizes are scaled to it
+    enum { TileSize = 256 };
+
+    virtual ~TileSource();
+
+    // the deepest zoom of the pyramid
+    virtual int maxZoom() const = 0;
+    // the image of a tile, or a null image if the source has none
+    virtual QImage tile(const TileId & tile) = 0;
+    // a readable description, for the logs
+    virtual QString name() const = 0;
+
+    // the source of a location:
+    //   a directory of <z>/<x>/<y>.jpg (or .png) tiles,
+    //   a template with {z}, {x} and {y} placeholders, a path or an http:// URL (a local tile server),
+    //   or an image (like the resource :/images/earthmap.jpg) which is cut into tiles
+    static QSharedPointer<TileSource> create(const QString & location);
+
+    // the location used by the widgets that stream the Earth imagery (the earth map by default)
+    static QString defaultLocation();
+    static void setDefaultLocation(const QString & location);
+};
+
+// the tiles of files named after a template, such as "tiles/{z}/{x}/{y}.jpg"
+class FileTileSource : public TileSource
+{
+public:
+    FileTileSource(const QString & pathTemplate, int maxZoom);
+
+    virtual int maxZoom() const override { return _maxZoom; }
+    virtual QImage tile(const TileId & tile) override;
+    virtual QString name() const override { return _template; }
+
+    // the deepest <z> directory of a tile directory
+    static int deepestZoom(const QString & directory);
+
+private:
+    QString _template;
+    int _maxZoom;
+};
+
+// the tiles served over HTTP/1.0 by a local tile server, such as "http://localhost:8000/{z}/{x}/{y}.png"
+// each request uses its own connection, which is enough for a server on the same machine
+class HttpTileSource : public TileSource
+{
+public:
+    HttpTileSource(const QString & urlTemplate, int maxZoom);
+
+    virtual int maxZoom() const override { return _maxZoom; }
+    virtual QImage tile(const TileId & tile) override;
+    virtual QString name() const override { return _template; }
+
+private:
+    QString _template;
+    int _maxZoom;
+};
+
+// the tiles cut from one image, which is decoded by the first tile()
+// the pyramid stops where a tile would be magnified
+class ImageTileSource : public TileSource
+{
+public:
+    explicit ImageTileSource(const QString & imagePath);
+
+    virtual int maxZoom() const override;
+    virtual QImage tile(const TileId & tile) override;
+    virtual QString name() const override { return _path; }
+
+private:
+    const QImage & image();
+
+    QString _path;
+    QSize _size;
+    QMutex _mutex;
+    QImage _image;
+    bool _decoded;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QtCore>
+
+// a single-producer single-consumer triple buffer:
+// the writer fills back() and publish()es it, the reader calls update() and reads front(),
+// neither side ever waits for the other, and the reader always gets the latest complete value
+//
+// the three slots are exchanged through one atomic index, whose dirty bit marks a slot
+// published since the reader last took one
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : _shared(1), _back(0), _front(2) {}
+
+    // writer side
+    T & back() { return _slots[_back]; }
+    void publish()
+    {
+        _back = _shared.fetchAndStoreAcquireRelease(_back | Dirty) & IndexMask;
+    }
+
+    // reader side, returns true if a value was published since the last update
+    bool update()
+    {
+        if (!(_shared.loadAcquire() & Dirty)) {
+            return false;
+        }
+        _front = _shared.fetchAndStoreAcquireRelease(_front) & IndexMask;
+        return true;
+    }
+    const T & front() const { return _slots[_front]; }
+
+private:
+    enum { IndexMask = 3, Dirty = 4 };
+
+    T _slots[3];
+    QAtomicInt _shared; // the slot in between, with the dirty bit
+    int _back;  // only touched by the writer
+    int _front; // only touched by the reader
+
+    Q_DISABLE_COPY(TripleBuffer)
+};
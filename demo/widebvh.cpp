@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <limits>
+
+#include "profiler.h"
+
+#include "widebvh.h"
+
+static const float infinity = std::numeric_limits<float>::infinity();
+
+// number of centroid bins evaluated per split
+static const int binCount = 16;
+// traversal stacks up to this size stay on the call stack
+static const int inlineStackSize = 256;
+
+static float surfaceArea(const QVector3D & boundsMin, const QVector3D & boundsMax)
+{
+    QVector3D d = boundsMax - boundsMin;
+    if (d.x() < 0 || d.y() < 0 || d.z() < 0) {
+        return 0; // empty
+    }
+    return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+static float horizontalMinimum(SimdFloat v)
+{
+    alignas(32) float f[SimdFloat::Width];
+    v.store(f);
+    float m = f[0];
+    for (int i = 1; i < SimdFloat::Width; i++) {
+        m = qMin(m, f[i]);
+    }
+    return m;
+}
+
+WideBvh::WideBvh()
+{
+    _depth = 0;
+}
+
+void WideBvh::build(const QVector<QVector3D> & positions, const QVector<quint32> & indices)
+{
+    PROFILE_SCOPE("WideBvh::build");
+    _nodes.clear();
+    _triangles.clear();
+    _depth = 0;
+
+    int triangleCount = indices.size() / 3;
+    _items.resize(triangleCount);
+    _boundsMin = QVector3D(infinity, infinity, infinity);
+    _boundsMax = -_boundsMin;
+    for (int i = 0; i < triangleCount; i++) {
+        const QVector3D & a = positions[indices[3 * i]];
+        const QVector3D & b = positions[indices[3 * i + 1]];
+        const QVector3D & c = positions[indices[3 * i + 2]];
+        BuildItem & item = _items[i];
+        item.boundsMin = QVector3D(qMin(a.x(), qMin(b.x(), c.x())), qMin(a.y(), qMin(b.y(), c.y())),
+            qMin(a.z(), qMin(b.z(), c.z())));
+        item.boundsMax = QVector3D(qMax(a.x(), qMax(b.x(), c.x())), qMax(a.y(), qMax(b.y(), c.y())),
+            qMax(a.z(), qMax(b.z(), c.z())));
+        item.centroid = (item.boundsMin + item.boundsMax) * 0.5f;
+        item.index = i;
+        _boundsMin = QVector3D(qMin(_boundsMin.x(), item.boundsMin.x()), qMin(_boundsMin.y(), item.boundsMin.y()),
+            qMin(_boundsMin.z(), item.boundsMin.z()));
+        _boundsMax = QVector3D(qMax(_boundsMax.x(), item.boundsMax.x()), qMax(_boundsMax.y(), item.boundsMax.y()),
+            qMax(_boundsMax.z(), item.boundsMax.z()));
+    }
+    if (triangleCount == 0) {
+        _boundsMin = _boundsMax = QVector3D();
+        return;
+    }
+
+    _nodes.append(Node());
+    buildNode(0, 0, triangleCount, 1);
+
+    // the leaves refer to ranges of the items, which are now in their final order
+    _triangles.resize(triangleCount);
+    for (int i = 0; i < triangleCount; i++) {
+        int index = _items[i].index;
+        const QVector3D & a = positions[indices[3 * index]];
+        QVector3D edge1 = positions[indices[3 * index + 1]] - a;
+        QVector3D edge2 = positions[indices[3 * index + 2]] - a;
+        Triangle & t = _triangles[i];
+        for (int k = 0; k < 3; k++) {
+            t.v0[k] = a[k];
+            t.edge1[k] = edge1[k];
+            t.edge2[k] = edge2[k];
+        }
+        t.index = index;
+    }
+    _items.clear();
+    _items.squeeze();
+}
+
+void WideBvh::buildNode(int node, int begin, int end, int depth)
+{
+    _depth = qMax(_depth, depth);
+
+    // split the largest range until there is one per child, or every range fits in a leaf
+    int ranges[Width][2] = { { begin, end } };
+    int rangeCount = 1;
+    while (rangeCount < Width) {
+        int largest = -1;
+        for (int i = 0; i < rangeCount; i++) {
+            int count = ranges[i][1] - ranges[i][0];
+            if (count > LeafSize && (largest < 0 || count > ranges[largest][1] - ranges[largest][0])) {
+                largest = i;
+            }
+        }
+        if (largest < 0) {
+            break;
+        }
+        int middle = split(ranges[largest][0], ranges[largest][1]);
+        ranges[rangeCount][0] = middle;
+        ranges[rangeCount][1] = ranges[largest][1];
+        ranges[largest][1] = middle;
+        rangeCount++;
+    }
+
+    Node result;
+    for (int i = 0; i < Width; i++) {
+        result.minX[i] = result.minY[i] = result.minZ[i] = infinity;
+        result.maxX[i] = result.maxY[i] = result.maxZ[i] = -infinity;
+        result.child[i] = -1;
+        result.count[i] = 0;
+    }
+    for (int i = 0; i < rangeCount; i++) {
+        for (int k = ranges[i][0]; k < ranges[i][1]; k++) {
+            const BuildItem & item = _items[k];
+            result.minX[i] = qMin(result.minX[i], item.boundsMin.x());
+            result.minY[i] = qMin(result.minY[i], item.boundsMin.y());
+            result.minZ[i] = qMin(result.minZ[i], item.boundsMin.z());
+            result.maxX[i] = qMax(result.maxX[i], item.boundsMax.x());
+            result.maxY[i] = qMax(result.maxY[i], item.boundsMax.y());
+            result.maxZ[i] = qMax(result.maxZ[i], item.boundsMax.z());
+        }
+        int count = ranges[i][1] - ranges[i][0];
+        if (count <= LeafSize) {
+            result.child[i] = ranges[i][0];
+            result.count[i] = count;
+        } else {
+            // the vector may grow during the recursion, so the node is only written once its children are known
+            result.child[i] = _nodes.size();
+            _nodes.append(Node());
+            buildNode(result.child[i], ranges[i][0], ranges[i][1], depth + 1);
+        }
+    }
+    _nodes[node] = result;
+}
+
+int WideBvh::split(int begin, int end)
+{
+    int middle = (begin + end) / 2;
+
+    QVector3D centroidMin = _items[begin].centroid, centroidMax = centroidMin;
+    for (int i = begin + 1; i < end; i++) {
+        const QVector3D & c = _items[i].centroid;
+        centroidMin = QVector3D(qMin(centroidMin.x(), c.x()), qMin(centroidMin.y(), c.y()), qMin(centroidMin.z(), c.z()));
+        centroidMax = QVector3D(qMax(centroidMax.x(), c.x()), qMax(centroidMax.y(), c.y()), qMax(centroidMax.z(), c.z()));
+    }
+    QVector3D extent = centroidMax - centroidMin;
+    int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+    if (extent[axis] <= 0) {
+        // all the centroids are at the same place, any split is as good
+        return middle;
+    }
+
+    struct Bin
+    {
+        QVector3D boundsMin = QVector3D(infinity, infinity, infinity);
+        QVector3D boundsMax = QVector3D(-infinity, -infinity, -infinity);
+        int count = 0;
+    };
+    Bin bins[binCount];
+    float scale = binCount / extent[axis];
+    auto binOf = [&](const BuildItem & item) {
+        return qMin(binCount - 1, int((item.centroid[axis] - centroidMin[axis]) * scale));
+    };
+    for (int i = begin; i < end; i++) {
+        const BuildItem & item = _items[i];
+        Bin & bin = bins[binOf(item)];
+        bin.boundsMin = QVector3D(qMin(bin.boundsMin.x(), item.boundsMin.x()), qMin(bin.boundsMin.y(), item.boundsMin.y()),
+            qMin(bin.boundsMin.z(), item.boundsMin.z()));
+        bin.boundsMax = QVector3D(qMax(bin.boundsMax.x(), item.boundsMax.x()), qMax(bin.boundsMax.y(), item.boundsMax.y()),
+            qMax(bin.boundsMax.z(), item.boundsMax.z()));
+        bin.count++;
+    }
+
+    // cost of splitting after bin i: the triangles of each side weighted by the surface area of its bounds
+    float leftCost[binCount - 1];
+    Bin left;
+    for (int i = 0; i < binCount - 1; i++) {
+        left.boundsMin = QVector3D(qMin(left.boundsMin.x(), bins[i].boundsMin.x()),
+            qMin(left.boundsMin.y(), bins[i].boundsMin.y()), qMin(left.boundsMin.z(), bins[i].boundsMin.z()));
+        left.boundsMax = QVector3D(qMax(left.boundsMax.x(), bins[i].boundsMax.x()),
+            qMax(left.boundsMax.y(), bins[i].boundsMax.y()), qMax(left.boundsMax.z(), bins[i].boundsMax.z()));
+        left.count += bins[i].count;
+        leftCost[i] = left.count * surfaceArea(left.boundsMin, left.boundsMax);
+    }
+    int bestSplit = -1;
+    float bestCost = infinity;
+    Bin right;
+    for (int i = binCount - 1; i > 0; i--) {
+        right.boundsMin = QVector3D(qMin(right.boundsMin.x(), bins[i].boundsMin.x()),
+            qMin(right.boundsMin.y(), bins[i].boundsMin.y()), qMin(right.boundsMin.z(), bins[i].boundsMin.z()));
+        right.boundsMax = QVector3D(qMax(right.boundsMax.x(), bins[i].boundsMax.x()),
+            qMax(right.boundsMax.y(), bins[i].boundsMax.y()), qMax(right.boundsMax.z(), bins[i].boundsMax.z()));
+        right.count += bins[i].count;
+        float cost = leftCost[i - 1] + right.count * surfaceArea(right.boundsMin, right.boundsMax);
+        if (cost < bestCost) {
+            bestCost = cost;
+            bestSplit = i - 1;
+        }
+    }
+
+    BuildItem * first = _items.data() + begin;
+    BuildItem * last = _items.data() + end;
+    BuildItem * pivot = std::partition(first, last, [&](const BuildItem & item) { return binOf(item) <= bestSplit; });
+    if (pivot == first || pivot == last) {
+        // every centroid fell into one bin, split at the median instead
+        std::nth_element(first, _items.data() + middle, last, [axis](const BuildItem & a, const BuildItem & b) {
+            return a.centroid[axis] < b.centroid[axis];
+        });
+        return middle;
+    }
+    return int(pivot - _items.data());
+}
+
+void WideBvh::intersect(RayPacket & packet) const
+{
+    traverse<false>(packet);
+}
+
+void WideBvh::occluded(RayPacket & packet) const
+{
+    traverse<true>(packet);
+}
+
+template <bool anyHit>
+void WideBvh::traverse(RayPacket & packet) const
+{
+    enum { Groups = RayPacket::Groups, W = SimdFloat::Width };
+    const SimdFloat zero(0.0f), one(1.0f), beyond(infinity);
+
+    // the packet in registers
+    SimdFloat ox[Groups], oy[Groups], oz[Groups], dx[Groups], dy[Groups], dz[Groups];
+    SimdFloat inverseDx[Groups], inverseDy[Groups], inverseDz[Groups];
+    SimdFloat tMax[Groups], u[Groups], v[Groups];
+    SimdMask active[Groups], found[Groups];
+    for (int g = 0; g < Groups; g++) {
+        ox[g] = SimdFloat::load(packet.ox + g * W);
+        oy[g] = SimdFloat::load(packet.oy + g * W);
+        oz[g] = SimdFloat::load(packet.oz + g * W);
+        dx[g] = SimdFloat::load(packet.dx + g * W);
+        dy[g] = SimdFloat::load(packet.dy + g * W);
+        dz[g] = SimdFloat::load(packet.dz + g * W);
+        inverseDx[g] = one / dx[g];
+        inverseDy[g] = one / dy[g];
+        inverseDz[g] = one / dz[g];
+        tMax[g] = SimdFloat::load(packet.tMax + g * W);
+        u[g] = v[g] = zero;
+        alignas(32) float flags[W];
+        for (int i = 0; i < W; i++) {
+            flags[i] = packet.active[g * W + i] ? 1.0f : 0.0f;
+        }
+        active[g] = SimdFloat::load(flags) > zero;
+        found[g] = SimdMask::none();
+    }
+    if (!anyHit) {
+        for (int i = 0; i < RayPacket::Size; i++) {
+            packet.triangle[i] = -1;
+        }
+    }
+
+    // a node or a leaf to visit, and the distance at which the nearest ray of the packet enters it
+    struct Entry
+    {
+        qint32 child, count;
+        float distance;
+    };
+    // up to Width - 1 siblings wait on each level above the deepest node, an unbalanced tree gets a larger
+    // stack on the heap
+    QVarLengthArray<Entry, inlineStackSize> stack((Width - 1) * _depth + Width);
+    int stackSize = 0;
+    if (!_nodes.isEmpty()) {
+        stack[stackSize++] = { 0, 0, 0.0f };
+    }
+
+    while (stackSize > 0) {
+        Entry entry = stack[--stackSize];
+
+        // skip the entry if every ray already ended before it
+        SimdFloat distance(entry.distance);
+        bool reached = false;
+        for (int g = 0; g < Groups && !reached; g++) {
+            reached = (active[g] & (distance <= tMax[g])).any();
+        }
+        if (!reached) {
+            continue;
+        }
+
+        if (entry.count > 0) {
+            // leaf, Möller-Trumbore tests of its triangles against the packet
+            for (int i = entry.child; i < entry.child + entry.count; i++) {
+                const Triangle & t = _triangles[i];
+                const SimdFloat e1x(t.edge1[0]), e1y(t.edge1[1]), e1z(t.edge1[2]);
+                const SimdFloat e2x(t.edge2[0]), e2y(t.edge2[1]), e2z(t.edge2[2]);
+                for (int g = 0; g < Groups; g++) {
+                    if (!active[g].any()) {
+                        continue;
+                    }
+                    SimdFloat px = dy[g] * e2z - dz[g] * e2y;
+                    SimdFloat py = dz[g] * e2x - dx[g] * e2z;
+                    SimdFloat pz = dx[g] * e2y - dy[g] * e2x;
+                    // a ray parallel to the triangle gets an infinite or NaN inverse, failing the tests below
+                    SimdFloat inverseDet = one / (e1x * px + e1y * py + e1z * pz);
+                    SimdFloat tx = ox[g] - SimdFloat(t.v0[0]);
+                    SimdFloat ty = oy[g] - SimdFloat(t.v0[1]);
+                    SimdFloat tz = oz[g] - SimdFloat(t.v0[2]);
+                    SimdFloat hitU = (tx * px + ty * py + tz * pz) * inverseDet;
+                    SimdFloat qx = ty * e1z - tz * e1y;
+                    SimdFloat qy = tz * e1x - tx * e1z;
+                    SimdFloat qz = tx * e1y - ty * e1x;
+                    SimdFloat hitV = (dx[g] * qx + dy[g] * qy + dz[g] * qz) * inverseDet;
+                    SimdFloat hitT = (e2x * qx + e2y * qy + e2z * qz) * inverseDet;
+                    SimdMask hit = active[g] & (hitU >= zero) & (hitV >= zero) & (hitU + hitV <= one) &
+                        (hitT > zero) & (hitT < tMax[g]);
+                    if (!hit.any()) {
+                        continue;
+                    }
+                    if (anyHit) {
+                        found[g] = found[g] | hit;
+                        active[g] = andNot(active[g], hit);
+                    } else {
+                        tMax[g] = select(hit, hitT, tMax[g]);
+                        u[g] = select(hit, hitU, u[g]);
+                        v[g] = select(hit, hitV, v[g]);
+                        for (int bits = hit.bits(); bits; bits &= bits - 1) {
+                            packet.triangle[g * W + qCountTrailingZeroBits(quint32(bits))] = t.index;
+                        }
+                    }
+                }
+            }
+            if (anyHit) {
+                bool anyActive = false;
+                for (int g = 0; g < Groups && !anyActive; g++) {
+                    anyActive = active[g].any();
+                }
+                if (!anyActive) {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        // inner node, slab tests of the boxes of its children against the packet
+        const Node & node = _nodes[entry.child];
+        Entry children[Width];
+        int childCount = 0;
+        for (int c = 0; c < Width; c++) {
+            if (node.child[c] < 0) {
+                continue;
+            }
+            const SimdFloat minX(node.minX[c]), minY(node.minY[c]), minZ(node.minZ[c]);
+            const SimdFloat maxX(node.maxX[c]), maxY(node.maxY[c]), maxZ(node.maxZ[c]);
+            float nearest = infinity;
+            for (int g = 0; g < Groups; g++) {
+                SimdFloat x0 = (minX - ox[g]) * inverseDx[g], x1 = (maxX - ox[g]) * inverseDx[g];
+                SimdFloat y0 = (minY - oy[g]) * inverseDy[g], y1 = (maxY - oy[g]) * inverseDy[g];
+                SimdFloat z0 = (minZ - oz[g]) * inverseDz[g], z1 = (maxZ - oz[g]) * inverseDz[g];
+                SimdFloat tNear = maximum(maximum(minimum(x0, x1), minimum(y0, y1)), maximum(minimum(z0, z1), zero));
+                SimdFloat tFar = minimum(minimum(maximum(x0, x1), maximum(y0, y1)), minimum(maximum(z0, z1), tMax[g]));
+                SimdMask hit = active[g] & (tNear <= tFar);
+                if (hit.any()) {
+                    nearest = qMin(nearest, horizontalMinimum(select(hit, tNear, beyond)));
+                }
+            }
+            if (nearest == infinity) {
+                continue;
+            }
+            // sorted by decreasing distance, so the nearest child is popped first
+            int k = childCount++;
+            for (; k > 0 && children[k - 1].distance < nearest; k--) {
+                children[k] = children[k - 1];
+            }
+            children[k] = { node.child[c], node.count[c], nearest };
+        }
+        Q_ASSERT(stackSize + childCount <= stack.size());
+        for (int i = 0; i < childCount; i++) {
+            stack[stackSize++] = children[i];
+        }
+    }
+
+    for (int g = 0; g < Groups; g++) {
+        if (anyHit) {
+            int bits = found[g].bits();
+            for (int i = 0; i < W; i++) {
+                packet.occluded[g * W + i] = (bits >> i) & 1;
+            }
+        } else {
+            tMax[g].store(packet.tMax + g * W);
+            u[g].store(packet.u + g * W);
+            v[g].store(packet.v + g * W);
+        }
+    }
+}
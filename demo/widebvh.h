@@ -0,0 +1,106 @@
+#pragma once
+
+#include <QtGui>
+
+#include "simd.h"
+
+// rays traced together through a WideBvh, e.g. the rays of a 4x4 pixel block
+// the rays are stored as arrays so the traversal loads them SimdFloat::Width lanes at a time
+struct RayPacket
+{
+    enum { Size = 16, Groups = Size / SimdFloat::Width };
+
+    // origin, normalized direction and the end of each ray
+    alignas(32) float ox[Size], oy[Size], oz[Size];
+    alignas(32) float dx[Size], dy[Size], dz[Size];
+    alignas(32) float tMax[Size];
+    // rays set to false are ignored
+    bool active[Size];
+
+    // results of WideBvh::intersect(): the nearest triangle (-1 for a miss), its distance in tMax,
+    // and the barycentric coordinates of the hit point (weights of the second and third vertices)
+    qint32 triangle[Size];
+    alignas(32) float u[Size], v[Size];
+    // result of WideBvh::occluded()
+    bool occluded[Size];
+
+    void setRay(int i, const QVector3D & origin, const QVector3D & direction, float end)
+    {
+        ox[i] = origin.x(); oy[i] = origin.y(); oz[i] = origin.z();
+        dx[i] = direction.x(); dy[i] = direction.y(); dz[i] = direction.z();
+        tMax[i] = end;
+        active[i] = true;
+    }
+};
+
+// a bounding volume hierarchy with 4 children per node over the triangles of a mesh, built with the
+// surface area heuristic
+//
+// a node stores the boxes of its 4 children side by side, and a packet of rays is tested against a box
+// SimdFloat::Width rays at a time; the children are visited nearest first and skipped once they are farther
+// than every ray of the packet, so coherent packets (camera rays, shadow rays towards one light) share
+// most of their traversal
+class WideBvh
+{
+public:
+    enum { Width = 4, LeafSize = 4 };
+
+    WideBvh();
+
+    // build the hierarchy of an indexed triangle list
+    void build(const QVector<QVector3D> & positions, const QVector<quint32> & indices);
+    bool isEmpty() const { return _nodes.isEmpty(); }
+
+    // find the nearest triangle hit by each active ray before its tMax
+    void intersect(RayPacket & packet) const;
+    // find whether each active ray hits any triangle before its tMax
+    void occluded(RayPacket & packet) const;
+
+    // the bounds of the mesh
+    QVector3D boundsMin() const { return _boundsMin; }
+    QVector3D boundsMax() const { return _boundsMax; }
+
+    int nodeCount() const { return _nodes.size(); }
+    int depth() const { return _depth; }
+
+private:
+    struct Node
+    {
+        // bounds of the children, by axis
+        float minX[Width], minY[Width], minZ[Width];
+        float maxX[Width], maxY[Width], maxZ[Width];
+        // inner child: index of its node, and count 0
+        // leaf child: first triangle in _triangles, and its triangle count
+        // unused child: -1 and count 0
+        qint32 child[Width];
+        qint32 count[Width];
+    };
+    // a triangle prepared for the intersection test
+    struct Triangle
+    {
+        float v0[3], edge1[3], edge2[3];
+        qint32 index; // in the indices given to build()
+    };
+    // a triangle during the build
+    struct BuildItem
+    {
+        QVector3D boundsMin, boundsMax, centroid;
+        qint32 index;
+    };
+
+    // fill the node with up to Width children made of the items [begin, end)
+    void buildNode(int node, int begin, int end, int depth);
+    // split the items [begin, end) in two along the best plane found by binning their centroids,
+    // returns the first item of the second half
+    int split(int begin, int end);
+
+    template <bool anyHit>
+    void traverse(RayPacket & packet) const;
+
+private:
+    QVector<Node> _nodes;
+    QVector<Triangle> _triangles;
+    QVector<BuildItem> _items; // during the build
+    QVector3D _boundsMin, _boundsMax;
+    int _depth;
+};
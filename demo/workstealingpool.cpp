@@ -0,0 +1,165 @@
+#include "workstealingpool.h"
+
+class WorkStealingPool::Worker : public QThread
+{
+public:
+    Worker(WorkStealingPool * pool, int thread) : _pool(pool), _thread(thread) {}
+
+protected:
+    virtual void run() override { _pool->workerLoop(_thread); }
+
+private:
+    WorkStealingPool * _pool;
+    int _thread;
+};
+
+WorkStealingPool::WorkStealingPool(int threadCount)
+{
+    _task = nullptr;
+    _generation = 0;
+    _busyWorkers = 0;
+    _quit = false;
+
+    threadCount = qMax(1, threadCount);
+    for (int i = 0; i < threadCount; i++) {
+        _queues << new Queue;
+    }
+    for (int i = 1; i < threadCount; i++) {
+        _workers << new Worker(this, i);
+        _workers.last()->start();
+    }
+}
+
+WorkStealingPool & WorkStealingPool::shared()
+{
+    static WorkStealingPool pool;
+    return pool;
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        QMutexLocker lock(&_mutex);
+        _quit = true;
+        _wake.wakeAll();
+    }
+    for (Worker * worker : _workers) {
+        worker->wait();
+    }
+    qDeleteAll(_workers);
+    qDeleteAll(_queues);
+}
+
+void WorkStealingPool::parallelFor(int count, const std::function<void(int, int)> & task)
+{
+    if (count <= 0) {
+        return;
+    }
+    QMutexLocker loopLock(&_loopMutex);
+    int threads = threadCount();
+    if (threads == 1 || count == 1) {
+        for (int i = 0; i < count; i++) {
+            task(i, 0);
+        }
+        return;
+    }
+
+    // contiguous ranges keep neighboring iterations (and their data) on one thread
+    for (int i = 0; i < threads; i++) {
+        QMutexLocker lock(&_queues[i]->mutex);
+        _queues[i]->begin = int(qint64(count) * i / threads);
+        _queues[i]->end = int(qint64(count) * (i + 1) / threads);
+    }
+
+    {
+        QMutexLocker lock(&_mutex);
+        _task = &task;
+        _generation++;
+        _busyWorkers = _workers.size();
+        _wake.wakeAll();
+    }
+
+    work(0);
+
+    QMutexLocker lock(&_mutex);
+    while (_busyWorkers > 0) {
+        _done.wait(&_mutex);
+    }
+    _task = nullptr;
+}
+
+void WorkStealingPool::workerLoop(int thread)
+{
+    quint64 generation = 0;
+    forever {
+        {
+            QMutexLocker lock(&_mutex);
+            while (!_quit && _generation == generation) {
+                _wake.wait(&_mutex);
+            }
+            if (_quit) {
+                return;
+            }
+            generation = _generation;
+        }
+
+        work(thread);
+
+        QMutexLocker lock(&_mutex);
+        if (--_busyWorkers == 0) {
+            _done.wakeAll();
+        }
+    }
+}
+
+void WorkStealingPool::work(int thread)
+{
+    // the task is only read here, while parallelFor waits for this thread
+    const std::function<void(int, int)> & task = *_task;
+    int index;
+    forever {
+        while (pop(thread, &index)) {
+            task(index, thread);
+        }
+        if (!steal(thread)) {
+            return;
+        }
+    }
+}
+
+bool WorkStealingPool::pop(int thread, int * index)
+{
+    Queue * queue = _queues[thread];
+    QMutexLocker lock(&queue->mutex);
+    if (queue->begin >= queue->end) {
+        return false;
+    }
+    *index = queue->begin++;
+    return true;
+}
+
+bool WorkStealingPool::steal(int thread)
+{
+    int threads = threadCount();
+    for (int i = 1; i < threads; i++) {
+        Queue * victim = _queues[(thread + i) % threads];
+        int begin, end;
+        {
+            QMutexLocker lock(&victim->mutex);
+            if (victim->begin >= victim->end) {
+                continue;
+            }
+            // the victim keeps the lower half, which it works on next
+            begin = victim->begin + (victim->end - victim->begin) / 2;
+            end = victim->end;
+            victim->end = begin;
+        }
+        Queue * queue = _queues[thread];
+        QMutexLocker lock(&queue->mutex);
+        queue->begin = begin;
+        queue->end = end;
+        _steals.fetchAndAddRelaxed(1);
+        return true;
+    }
+    return false;
+}
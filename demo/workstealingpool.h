@@ -0,0 +1,65 @@
+#pragma once
+
+#include <functional>
+
+#include <QtCore>
+
+// a fixed set of threads running the iterations of parallel loops
+//
+// parallelFor() splits the index range evenly into one queue per thread, each thread takes the indices
+// of its own queue in order and, once it is empty, steals the upper half of the queue of another thread,
+// so uneven iterations (e.g. screen tiles covered by many triangles) are rebalanced without a central queue
+class WorkStealingPool
+{
+public:
+    // threadCount includes the calling thread, threadCount - 1 threads are started
+    explicit WorkStealingPool(int threadCount = QThread::idealThreadCount());
+    ~WorkStealingPool();
+
+    // the pool shared by the CPU kernels that run on worker threads of their own (mipmaps, block compression),
+    // so that they never start more than one thread per core between them
+    static WorkStealingPool & shared();
+
+    int threadCount() const { return _queues.size(); }
+
+    // run task(index, thread) for every index in [0, count) and return when all are done
+    // 'thread' in [0, threadCount()) identifies the running thread, e.g. to pick per-thread scratch data;
+    // the calling thread is thread 0
+    // the loops of several calling threads run one after the other (a task must not call parallelFor)
+    void parallelFor(int count, const std::function<void(int index, int thread)> & task);
+
+    // number of queue halves taken from other threads since the pool was created
+    qint64 stealCount() const { return _steals.load(); }
+
+private:
+    class Worker;
+
+    // the indices left to a thread, [begin, end)
+    struct alignas(64) Queue
+    {
+        QMutex mutex;
+        int begin = 0, end = 0;
+    };
+
+    void workerLoop(int thread);
+    // run indices until no queue has any left
+    void work(int thread);
+    bool pop(int thread, int * index);
+    bool steal(int thread);
+
+private:
+    QVector<Queue *> _queues;
+    QVector<Worker *> _workers;
+
+    QMutex _loopMutex; // held by the thread running a loop
+    QMutex _mutex;
+    QWaitCondition _wake, _done;
+    const std::function<void(int, int)> * _task;
+    quint64 _generation; // number of parallelFor calls, workers wake up when it changes
+    int _busyWorkers;
+    bool _quit;
+
+    QAtomicInteger<qint64> _steals;
+
+    Q_DISABLE_COPY(WorkStealingPool)
+};
@@ -0,0 +1,346 @@
+#include "glcaptureformat.h"
+
+#include "glreplayer.h"
+
+using namespace GLCaptureFormat;
+
+#ifndef GL_TEXTURE_2D_ARRAY
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#endif
+
+static inline float toFloat(quint32 w)
+{
+    float f;
+    memcpy(&f, &w, sizeof(f));
+    return f;
+}
+
+static inline double toDouble(const quint32 * w)
+{
+    quint64 bits = w[0] | (quint64(w[1]) << 32);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+static inline const GLfloat * toFloats(const quint32 * w)
+{
+    return reinterpret_cast<const GLfloat *>(w);
+}
+
+GLReplayer::GLReplayer()
+{
+    _commandCount = 0;
+}
+
+GLReplayer::~GLReplayer()
+{}
+
+bool GLReplayer::load(const QString & file)
+{
+    QFile f(file);
+    if (!f.open(QIODevice::ReadOnly)) {
+        qWarning("Cannot open the capture %s", qPrintable(file));
+        return false;
+    }
+    QDataStream stream(&f);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic = 0, version = 0;
+    qint32 width = 0, height = 0;
+    stream >> magic >> version >> width >> height;
+    if (magic != Magic || version != Version) {
+        qWarning("%s is not a capture of this version", qPrintable(file));
+        return false;
+    }
+    _size = QSize(width, height);
+
+    quint32 resourceCount = 0;
+    stream >> resourceCount;
+    for (quint32 i = 0; i < resourceCount && stream.status() == QDataStream::Ok; i++) {
+        quint8 type = 0;
+        stream >> type;
+        if (type == GLCaptureFormat::Buffer) {
+            quint32 id;
+            QByteArray data;
+            stream >> id >> data;
+            _buffers.insert(id, data);
+        } else if (type == GLCaptureFormat::Texture) {
+            GLReplayer::Texture t;
+            stream >> t.id >> t.target >> t.width >> t.height >> t.layers >> t.minFilter >> t.magFilter
+                >> t.wrapS >> t.wrapT >> t.pixels;
+            _textures << t;
+        } else if (type == GLCaptureFormat::Program) {
+            GLReplayer::Program p;
+            quint32 n = 0;
+            stream >> p.id >> p.vshaderSource >> p.fshaderSource >> n;
+            for (quint32 j = 0; j < n; j++) {
+                QPair<GLuint, QByteArray> attr;
+                stream >> attr.first >> attr.second;
+                p.attributeLocations << attr;
+            }
+            stream >> n;
+            for (quint32 j = 0; j < n; j++) {
+                QPair<GLuint, QByteArray> block;
+                stream >> block.first >> block.second;
+                p.uniformBlockBindings << block;
+            }
+            stream >> n;
+            for (quint32 j = 0; j < n; j++) {
+                Uniform u;
+                stream >> u.location >> u.name >> u.type >> u.value;
+                p.uniforms << u;
+            }
+            _programs << p;
+        } else {
+            qWarning("Unknown resource type %d in %s", type, qPrintable(file));
+            return false;
+        }
+    }
+
+    quint32 blobCount = 0;
+    stream >> blobCount;
+    _blobs.resize(blobCount);
+    for (QByteArray & blob : _blobs) {
+        stream >> blob;
+    }
+
+    quint32 commandCount = 0, wordCount = 0;
+    stream >> commandCount >> wordCount;
+    _commandCount = commandCount;
+    _words.resize(wordCount);
+    for (quint32 & w : _words) {
+        stream >> w;
+    }
+    if (stream.status() != QDataStream::Ok) {
+        qWarning("%s is truncated", qPrintable(file));
+        return false;
+    }
+    return true;
+}
+
+bool GLReplayer::createResources()
+{
+    initializeOpenGLFunctions();
+
+    for (auto it = _buffers.constBegin(); it != _buffers.constEnd(); ++it) {
+        GLuint id = 0;
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        glBufferData(GL_ARRAY_BUFFER, it.value().size(), it.value().constData(), GL_STATIC_DRAW);
+        _bufferIds.insert(it.key(), id);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    for (const Texture & t : _textures) {
+        GLuint id = 0;
+        glGenTextures(1, &id);
+        glBindTexture(t.target, id);
+        if (t.target == GL_TEXTURE_2D_ARRAY) {
+            glTexImage3D(t.target, 0, GL_RGBA8, t.width, t.height, t.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                t.pixels.constData());
+        } else {
+            glTexImage2D(t.target, 0, GL_RGBA8, t.width, t.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, t.pixels.constData());
+        }
+        glTexParameteri(t.target, GL_TEXTURE_MIN_FILTER, t.minFilter);
+        glTexParameteri(t.target, GL_TEXTURE_MAG_FILTER, t.magFilter);
+        glTexParameteri(t.target, GL_TEXTURE_WRAP_S, t.wrapS);
+        glTexParameteri(t.target, GL_TEXTURE_WRAP_T, t.wrapT);
+        // only level 0 is captured, the other levels are rebuilt
+        if (t.minFilter != GL_NEAREST && t.minFilter != GL_LINEAR) {
+            glGenerateMipmap(t.target);
+        }
+        glBindTexture(t.target, 0);
+        _textureIds.insert(t.id, id);
+    }
+
+    // uniform locations by captured program id, captured location -> new location
+    QHash<GLuint, QHash<GLint, GLint>> uniformLocations;
+    for (const Program & p : _programs) {
+        GLuint id = buildProgram(p, &uniformLocations[p.id]);
+        if (id == 0) {
+            return false;
+        }
+        _programIds.insert(p.id, id);
+    }
+    glUseProgram(0);
+
+    // rewrite the ids and uniform locations of the calls once, so that replay() only reads words
+    const QHash<GLint, GLint> * locations = nullptr;
+    for (int i = 0; i < _words.size(); i += 1 + (_words[i] >> 16)) {
+        quint32 * args = _words.data() + i + 1;
+        switch (_words[i] & 0xffff) {
+        case BindTexture:
+            args[1] = _textureIds.value(args[1]);
+            break;
+        case BindBuffer:
+            args[1] = _bufferIds.value(args[1]);
+            break;
+        case BindBufferBase:
+            args[2] = _bufferIds.value(args[2]);
+            break;
+        case UseProgram:
+            locations = uniformLocations.contains(args[0]) ? &uniformLocations[args[0]] : nullptr;
+            args[0] = _programIds.value(args[0]);
+            break;
+        case Uniform1i:
+        case Uniform1f:
+        case Uniform3f:
+            args[0] = quint32(locations ? locations->value(qint32(args[0]), -1) : -1);
+            break;
+        }
+    }
+    return true;
+}
+
+GLuint GLReplayer::buildProgram(const Program & program, QHash<GLint, GLint> * locations)
+{
+    auto compile = [this](GLenum type, const QByteArray & source) {
+        GLuint shader = glCreateShader(type);
+        const char * s = source.constData();
+        glShaderSource(shader, 1, &s, nullptr);
+        glCompileShader(shader);
+        GLint ok = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+        if (!ok) {
+            char log[1024];
+            glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            qWarning("Cannot compile a captured shader: %s", log);
+        }
+        return shader;
+    };
+
+    GLuint id = glCreateProgram();
+    GLuint vshader = compile(GL_VERTEX_SHADER, program.vshaderSource);
+    GLuint fshader = compile(GL_FRAGMENT_SHADER, program.fshaderSource);
+    glAttachShader(id, vshader);
+    glAttachShader(id, fshader);
+    for (auto & attr : program.attributeLocations) {
+        glBindAttribLocation(id, attr.first, attr.second.constData());
+    }
+    glLinkProgram(id);
+    glDeleteShader(vshader);
+    glDeleteShader(fshader);
+    GLint ok = 0;
+    glGetProgramiv(id, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetProgramInfoLog(id, sizeof(log), nullptr, log);
+        qWarning("Cannot link captured program %u: %s", program.id, log);
+        glDeleteProgram(id);
+        return 0;
+    }
+    for (auto & block : program.uniformBlockBindings) {
+        GLuint index = glGetUniformBlockIndex(id, block.second.constData());
+        if (index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(id, index, block.first);
+        }
+    }
+
+    // restore the values the uniforms had when the frame started
+    glUseProgram(id);
+    for (const Uniform & u : program.uniforms) {
+        GLint location = glGetUniformLocation(id, u.name.constData());
+        locations->insert(u.location, location);
+        if (location >= 0) {
+            setUniform(location, u);
+        }
+    }
+    return id;
+}
+
+void GLReplayer::setUniform(GLint location, const Uniform & uniform)
+{
+    const GLint * i = reinterpret_cast<const GLint *>(uniform.value.constData());
+    const GLfloat * f = reinterpret_cast<const GLfloat *>(uniform.value.constData());
+    switch (uniform.type) {
+    case GL_FLOAT: glUniform1fv(location, 1, f); break;
+    case GL_FLOAT_VEC2: glUniform2fv(location, 1, f); break;
+    case GL_FLOAT_VEC3: glUniform3fv(location, 1, f); break;
+    case GL_FLOAT_VEC4: glUniform4fv(location, 1, f); break;
+    case GL_FLOAT_MAT2: glUniformMatrix2fv(location, 1, GL_FALSE, f); break;
+    case GL_FLOAT_MAT3: glUniformMatrix3fv(location, 1, GL_FALSE, f); break;
+    case GL_FLOAT_MAT4: glUniformMatrix4fv(location, 1, GL_FALSE, f); break;
+    default: glUniform1iv(location, 1, i); break;
+    }
+}
+
+void GLReplayer::replay()
+{
+    const quint32 * w = _words.constData();
+    const quint32 * end = w + _words.size();
+    while (w < end) {
+        const quint32 * a = w + 1;
+        switch (*w & 0xffff) {
+        // fixed pipeline
+        case Begin: ::glBegin(a[0]); break;
+        case End: ::glEnd(); break;
+        case Vertex2d: ::glVertex2d(toDouble(a), toDouble(a + 2)); break;
+        case Vertex3f: ::glVertex3fv(toFloats(a)); break;
+        case Vertex4f: ::glVertex4fv(toFloats(a)); break;
+        case Vertex4d: ::glVertex4d(toDouble(a), toDouble(a + 2), toDouble(a + 4), toDouble(a + 6)); break;
+        case Normal3f: ::glNormal3fv(toFloats(a)); break;
+        case TexCoord2f: ::glTexCoord2fv(toFloats(a)); break;
+        case Color3f: ::glColor3fv(toFloats(a)); break;
+        case Color4d: ::glColor4d(toDouble(a), toDouble(a + 2), toDouble(a + 4), toDouble(a + 6)); break;
+        case MatrixMode: ::glMatrixMode(a[0]); break;
+        case LoadIdentity: ::glLoadIdentity(); break;
+        case LoadMatrixf: ::glLoadMatrixf(toFloats(a)); break;
+        case MultMatrixf: ::glMultMatrixf(toFloats(a)); break;
+        case ShadeModel: ::glShadeModel(a[0]); break;
+        case Materialfv: ::glMaterialfv(a[0], a[1], toFloats(a + 2)); break;
+        case Lightfv: ::glLightfv(a[0], a[1], toFloats(a + 2)); break;
+        // rasterization and framebuffer
+        case LineWidth: glLineWidth(toFloat(a[0])); break;
+        case PointSize: ::glPointSize(toFloat(a[0])); break;
+        case Clear: glClear(a[0]); break;
+        case ClearColor: glClearColor(toFloat(a[0]), toFloat(a[1]), toFloat(a[2]), toFloat(a[3])); break;
+        case Viewport: glViewport(qint32(a[0]), qint32(a[1]), qint32(a[2]), qint32(a[3])); break;
+        case Enable: glEnable(a[0]); break;
+        case Disable: glDisable(a[0]); break;
+        case BlendFunc: glBlendFunc(a[0], a[1]); break;
+        // textures
+        case ActiveTexture: glActiveTexture(a[0]); break;
+        case BindTexture: glBindTexture(a[0], a[1]); break;
+        // buffers
+        case BindBuffer: glBindBuffer(a[0], a[1]); break;
+        case BindBufferBase: glBindBufferBase(a[0], a[1], a[2]); break;
+        case BufferData:
+            glBufferData(a[0], a[1], a[2] == 0xffffffff ? nullptr : _blobs[a[2]].constData(), a[3]);
+            break;
+        case BufferSubData: glBufferSubData(a[0], a[1], a[2], _blobs[a[3]].constData()); break;
+        // programs and vertex arrays
+        case UseProgram: glUseProgram(a[0]); break;
+        case Uniform1i: glUniform1i(qint32(a[0]), qint32(a[1])); break;
+        case Uniform1f: glUniform1f(qint32(a[0]), toFloat(a[1])); break;
+        case Uniform3f: glUniform3f(qint32(a[0]), toFloat(a[1]), toFloat(a[2]), toFloat(a[3])); break;
+        case VertexAttribPointer:
+            glVertexAttribPointer(a[0], qint32(a[1]), a[2], GLboolean(a[3]), qint32(a[4]),
+                reinterpret_cast<const void *>(quintptr(a[5])));
+            break;
+        case EnableVertexAttribArray: glEnableVertexAttribArray(a[0]); break;
+        case DisableVertexAttribArray: glDisableVertexAttribArray(a[0]); break;
+        case DrawElements:
+            glDrawElements(a[0], qint32(a[1]), a[2], reinterpret_cast<const void *>(quintptr(a[3])));
+            break;
+        }
+        w = a + (*w >> 16);
+    }
+}
+
+void GLReplayer::releaseResources()
+{
+    for (GLuint id : _bufferIds) {
+        glDeleteBuffers(1, &id);
+    }
+    for (GLuint id : _textureIds) {
+        glDeleteTextures(1, &id);
+    }
+    for (GLuint id : _programIds) {
+        glDeleteProgram(id);
+    }
+    _bufferIds.clear();
+    _textureIds.clear();
+    _programIds.clear();
+}
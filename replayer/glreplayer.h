@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QtGui>
+
+// replays a frame captured by GLCapture
+// the file is decoded once, then replay() runs its calls straight from a word array,
+// without any of the logic of the widget that produced them
+class GLReplayer : protected QOpenGLExtraFunctions
+{
+public:
+    GLReplayer();
+    ~GLReplayer();
+
+    // read a capture file, returns false if it is not a valid capture
+    bool load(const QString & file);
+
+    // the viewport of the captured frame
+    QSize size() const { return _size; }
+    int commandCount() const { return _commandCount; }
+
+    // create the captured objects in the current context and remap the ids of the calls to them
+    bool createResources();
+    // make the calls of the frame once
+    void replay();
+    // delete the objects, the context must be current
+    void releaseResources();
+
+private:
+    struct Texture
+    {
+        GLuint id;
+        GLenum target;
+        GLint width, height, layers, minFilter, magFilter, wrapS, wrapT;
+        QByteArray pixels;
+    };
+    struct Uniform
+    {
+        GLint location;
+        QByteArray name;
+        GLenum type;
+        QByteArray value;
+    };
+    struct Program
+    {
+        GLuint id;
+        QByteArray vshaderSource, fshaderSource;
+        QVector<QPair<GLuint, QByteArray>> attributeLocations;
+        QVector<QPair<GLuint, QByteArray>> uniformBlockBindings;
+        QVector<Uniform> uniforms;
+    };
+
+    GLuint buildProgram(const Program & program, QHash<GLint, GLint> * locations);
+    void setUniform(GLint location, const Uniform & uniform);
+
+private:
+    QSize _size;
+    int _commandCount;
+
+    QHash<GLuint, QByteArray> _buffers;
+    QVector<Texture> _textures;
+    QVector<Program> _programs;
+    QVector<QByteArray> _blobs;
+    QVector<quint32> _words;
+
+    // the objects created by createResources, by captured id
+    QHash<GLuint, GLuint> _bufferIds, _textureIds, _programIds;
+};
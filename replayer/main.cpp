@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <numeric>
+
+#include <QtCore>
+#include <QtGui>
+
+#include "glreplayer.h"
+
+// replays a frame captured with "Demo --offscreen --capture" and reports the cost of its calls
+//
+//     Replayer terrain.glcap --warmup 10 --frames 500
+//
+// the calls are replayed without any of the logic of the demo widgets, so comparing the replay time with
+// the frame time of the Benchmark separates the cost of the driver from the cost of the application
+int main(int argc, char *argv[])
+{
+    QGuiApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays the OpenGL calls of a captured demo frame");
+    parser.addHelpOption();
+    parser.addPositionalArgument("capture", "The .glcap file written by Demo --capture.");
+    parser.addOptions({
+        { "warmup", "Number of replays before measuring.", "n", "10" },
+        { "frames", "Number of measured replays.", "n", "500" }
+    });
+    parser.process(a);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+    int warmupFrames = qMax(0, parser.value("warmup").toInt());
+    int measuredFrames = qMax(1, parser.value("frames").toInt());
+
+    GLReplayer replayer;
+    if (!replayer.load(parser.positionalArguments().first())) {
+        return 1;
+    }
+
+    // the demo draws with the fixed pipeline, so the replay needs a compatibility context
+    QSurfaceFormat format;
+    format.setProfile(QSurfaceFormat::CompatibilityProfile);
+    format.setDepthBufferSize(24);
+    QOffscreenSurface surface;
+    surface.setFormat(format);
+    surface.create();
+    QOpenGLContext context;
+    context.setFormat(format);
+    if (!context.create() || !context.makeCurrent(&surface)) {
+        qWarning("Cannot create an OpenGL context");
+        return 1;
+    }
+    QOpenGLFramebufferObject fbo(replayer.size(), QOpenGLFramebufferObject::CombinedDepthStencil);
+    fbo.bind();
+    if (!replayer.createResources()) {
+        return 1;
+    }
+
+    for (int i = 0; i < warmupFrames; i++) {
+        replayer.replay();
+    }
+    context.functions()->glFinish();
+
+    // glFinish makes every measure include the gpu work of its frame
+    QVector<double> frameMs;
+    frameMs.reserve(measuredFrames);
+    QElapsedTimer total;
+    total.start();
+    for (int i = 0; i < measuredFrames; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        replayer.replay();
+        context.functions()->glFinish();
+        frameMs << timer.nsecsElapsed() / 1e6;
+    }
+    double totalSeconds = total.nsecsElapsed() / 1e9;
+
+    std::sort(frameMs.begin(), frameMs.end());
+    double mean = std::accumulate(frameMs.begin(), frameMs.end(), 0.0) / frameMs.size();
+    auto percentile = [&frameMs](double p) { return frameMs[qMin(int(p * frameMs.size()), frameMs.size() - 1)]; };
+    printf("%d calls per frame, %dx%d\n", replayer.commandCount(), replayer.size().width(), replayer.size().height());
+    printf("frame  mean %.3f ms  min %.3f ms  p50 %.3f ms  p95 %.3f ms\n", 
+        mean, frameMs.first(), percentile(0.5), percentile(0.95));
+    printf("%.2f M calls/s\n", double(replayer.commandCount()) * measuredFrames / totalSeconds / 1e6);
+
+    replayer.releaseResources();
+    fbo.release();
+    context.doneCurrent();
+    return 0;
+}